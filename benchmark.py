@@ -0,0 +1,279 @@
+#!/usr/bin/python
+
+#
+# Micro-benchmarks of the binding layer, run against the test driver
+#
+# Every benchmark times single calls and reports the call rate, the
+# median and 99th percentile latency, and the number of python memory
+# blocks left allocated per call.  The results are printed as JSON so
+# that runs against different versions can be compared by a script.
+#
+
+import sys
+import gc
+import json
+import time
+import optparse
+
+parser = optparse.OptionParser(usage="%prog [options] [BUILD-PATH]")
+parser.add_option("-u", "--uri", default="test:///default",
+                  help="connection URI (default: %default)")
+parser.add_option("-n", "--iterations", type="int", default=1000,
+                  help="calls per benchmark (default: %default)")
+parser.add_option("-d", "--domains", type="int", default=100,
+                  help="synthetic domains to create (default: %default)")
+parser.add_option("-o", "--output", default=None,
+                  help="write the results to this file instead of stdout")
+parser.add_option("-b", "--bench", action="append", default=None,
+                  help="only run this benchmark, can be repeated")
+(opts, args) = parser.parse_args()
+
+if len(args) >= 1:
+    # Munge import path to insert build location for libvirt mod
+    sys.path.insert(0, args[0])
+import libvirt
+
+if hasattr(time, "perf_counter"):
+    clock = time.perf_counter
+else:
+    clock = time.time
+
+DOMAIN_XML = """<domain type='test'>
+  <name>bench-%d</name>
+  <memory>8192</memory>
+  <os>
+    <type>hvm</type>
+  </os>
+</domain>"""
+
+VOLUME_XML = """<volume>
+  <name>bench.img</name>
+  <capacity>%d</capacity>
+</volume>"""
+
+STREAM_SIZE = 1024 * 1024
+
+
+class Skip(Exception):
+    pass
+
+
+def percentile(values, pct):
+    idx = int(round(pct / 100.0 * (len(values) - 1)))
+    return values[idx]
+
+
+def measure(func, iterations, units=1):
+    """
+    Time @iterations calls of @func, each of them processing @units
+    items, and return the statistics describing them
+    """
+    func()
+
+    times = []
+    for i in range(iterations):
+        start = clock()
+        func()
+        times.append(clock() - start)
+    times.sort()
+    total = sum(times)
+
+    ret = {
+        "calls": iterations,
+        "ops_per_sec": total and iterations * units / total or None,
+        "p50_us": percentile(times, 50) * 1e6,
+        "p99_us": percentile(times, 99) * 1e6,
+        "blocks_per_call": None,
+    }
+
+    if hasattr(sys, "getallocatedblocks"):
+        count = min(iterations, 100)
+        gc.collect()
+        before = sys.getallocatedblocks()
+        for i in range(count):
+            func()
+        gc.collect()
+        ret["blocks_per_call"] = (sys.getallocatedblocks() - before) / float(count)
+
+    return ret
+
+
+def bench_typed_params_get(conn, dom):
+    return measure(dom.schedulerParameters, opts.iterations)
+
+
+def bench_typed_params_set(conn, dom):
+    params = dom.schedulerParameters()
+    return measure(lambda: dom.setSchedulerParameters(params), opts.iterations)
+
+
+def bench_all_domain_stats(conn, dom):
+    try:
+        conn.getAllDomainStats()
+    except libvirtError as e:
+        raise Skip(str(e))
+    return measure(conn.getAllDomainStats, max(opts.iterations // 10, 1),
+                   len(conn.listAllDomains()))
+
+
+def bench_list_all_domains(conn, dom):
+    return measure(conn.listAllDomains, opts.iterations)
+
+
+def bench_list_all_domains_lazy(conn, dom):
+    return measure(lambda: conn.listAllDomains(0, True), opts.iterations)
+
+
+def bench_list_all_domains_names(conn, dom):
+    return measure(lambda: conn.listAllDomains(0, True).names(), opts.iterations)
+
+
+def stream_volume(conn):
+    try:
+        pool = conn.listAllStoragePools()[0]
+    except (IndexError, libvirtError):
+        raise Skip("no storage pool")
+    try:
+        vol = pool.storageVolLookupByName("bench.img")
+    except libvirtError:
+        vol = pool.createXML(VOLUME_XML % STREAM_SIZE, 0)
+    return vol
+
+
+def bench_stream_recv(conn, dom):
+    vol = stream_volume(conn)
+
+    def download():
+        st = conn.newStream(0)
+        vol.download(st, 0, STREAM_SIZE, 0)
+        while st.recv(256 * 1024):
+            pass
+        st.finish()
+
+    try:
+        download()
+    except libvirtError as e:
+        raise Skip(str(e))
+    ret = measure(download, max(opts.iterations // 100, 1), STREAM_SIZE)
+    ret["bytes_per_sec"] = ret.pop("ops_per_sec")
+    return ret
+
+
+def bench_stream_send(conn, dom):
+    vol = stream_volume(conn)
+    data = b"\0" * (256 * 1024)
+
+    def upload():
+        st = conn.newStream(0)
+        vol.upload(st, 0, STREAM_SIZE, 0)
+        for i in range(STREAM_SIZE // len(data)):
+            st.send(data)
+        st.finish()
+
+    try:
+        upload()
+    except libvirtError as e:
+        raise Skip(str(e))
+    ret = measure(upload, max(opts.iterations // 100, 1), STREAM_SIZE)
+    ret["bytes_per_sec"] = ret.pop("ops_per_sec")
+    return ret
+
+
+def bench_event_timeout(conn, dom):
+    # Cost of a round trip through the event loop and the python
+    # timeout callback dispatcher
+    fired = []
+
+    def timeout_cb(timer, opaque):
+        fired.append(timer)
+
+    timer = libvirt.virEventAddTimeout(0, timeout_cb, None)
+    try:
+        return measure(libvirt.virEventRunDefaultImpl, opts.iterations)
+    finally:
+        libvirt.virEventRemoveTimeout(timer)
+
+
+def bench_event_lifecycle(conn, dom):
+    # Rate at which domain lifecycle events reach the python callback
+    events = []
+
+    def lifecycle_cb(conn, dom, event, detail, opaque):
+        events.append(event)
+
+    cbid = conn.domainEventRegisterAny(None,
+                                       libvirt.VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+                                       lifecycle_cb, None)
+
+    def round_trip(deadline=None):
+        del events[:]
+        dom.suspend()
+        dom.resume()
+        while len(events) < 2:
+            if deadline and clock() > deadline:
+                raise Skip("no lifecycle events received")
+            libvirt.virEventRunDefaultImpl()
+
+    # Keep the loop waking up so a driver without events can't hang us
+    timer = libvirt.virEventAddTimeout(100, lambda timer, opaque: None, None)
+    try:
+        round_trip(clock() + 5)
+        ret = measure(round_trip, max(opts.iterations // 10, 1), 2)
+    finally:
+        libvirt.virEventRemoveTimeout(timer)
+        conn.domainEventDeregisterAny(cbid)
+    ret["events_per_sec"] = ret.pop("ops_per_sec")
+    return ret
+
+
+BENCHMARKS = [
+    ("typed_params_get", bench_typed_params_get),
+    ("typed_params_set", bench_typed_params_set),
+    ("all_domain_stats", bench_all_domain_stats),
+    ("list_all_domains", bench_list_all_domains),
+    ("list_all_domains_lazy", bench_list_all_domains_lazy),
+    ("list_all_domains_names", bench_list_all_domains_names),
+    ("stream_recv", bench_stream_recv),
+    ("stream_send", bench_stream_send),
+    ("event_timeout", bench_event_timeout),
+    ("event_lifecycle", bench_event_lifecycle),
+]
+
+libvirtError = libvirt.libvirtError
+
+# The event loop needs to be registered before the connection is opened
+libvirt.virEventRegisterDefaultImpl()
+
+conn = libvirt.open(opts.uri)
+dom = conn.lookupByName("test")
+
+for i in range(opts.domains):
+    conn.createXML(DOMAIN_XML % i, 0)
+
+results = {
+    "uri": opts.uri,
+    "libvirt_version": conn.getLibVersion(),
+    "python_version": sys.version.split()[0],
+    "domains": len(conn.listAllDomains()),
+    "benchmarks": {},
+}
+
+for (name, func) in BENCHMARKS:
+    if opts.bench and name not in opts.bench:
+        continue
+    try:
+        results["benchmarks"][name] = func(conn, dom)
+    except Skip as e:
+        results["benchmarks"][name] = {"skipped": str(e)}
+
+for d in conn.listAllDomains():
+    if d.name().startswith("bench-"):
+        d.destroy()
+conn.close()
+
+output = json.dumps(results, indent=2, sort_keys=True)
+if opts.output:
+    with open(opts.output, "w") as f:
+        f.write(output + "\n")
+else:
+    print(output)
@@ -367,6 +367,19 @@ py_types = {
 py_return_types = {
 }
 
+#
+# How the METH_FASTCALL wrappers unpack the arguments parsed with
+# these formats, other ones fall back to PyArg_ParseTuple
+#
+py_fast_unwrap = {
+    'i': "libvirt_intUnwrap(args[%d], &%s) < 0",
+    'I': "libvirt_fastcallUintUnwrap(args[%d], &%s) < 0",
+    'l': "libvirt_longUnwrap(args[%d], (long *) &%s) < 0",
+    'L': "libvirt_longlongUnwrap(args[%d], (long long *) &%s) < 0",
+    'd': "libvirt_doubleUnwrap(args[%d], &%s) < 0",
+    'z': "libvirt_fastcallStringUnwrap(args[%d], (char **) &%s) < 0",
+}
+
 unknown_types = {}
 
 foreign_encoding_args = (
@@ -517,6 +530,7 @@ skip_function = (
     'virConnectDomainEventDeregister', # overridden in virConnect.py
     'virConnectDomainEventRegisterAny',   # overridden in virConnect.py
     'virConnectDomainEventDeregisterAny', # overridden in virConnect.py
+    'virConnectDomainEventRegisterBatch', # overridden in virConnect.py
     'virConnectNetworkEventRegisterAny',   # overridden in virConnect.py
     'virConnectNetworkEventDeregisterAny', # overridden in virConnect.py
     'virSaveLastError', # We have our own python error wrapper
@@ -532,12 +546,16 @@ skip_function = (
     'virConnectListAllNWFilters', # overridden in virConnect.py
     'virConnectListAllSecrets', # overridden in virConnect.py
     'virConnectGetAllDomainStats', # overridden in virConnect.py
+    'virConnectGetAllDomainStatsColumns', # overridden in virConnect.py
     'virDomainListGetStats', # overriden in virConnect.py
 
     'virStreamRecvAll', # Pure python libvirt-override-virStream.py
     'virStreamSendAll', # Pure python libvirt-override-virStream.py
     'virStreamRecv', # overridden in libvirt-override-virStream.py
     'virStreamSend', # overridden in libvirt-override-virStream.py
+    'virStreamRecvInto', # overridden in libvirt-override-virStream.py
+    'virStreamRecvToFD', # overridden in libvirt-override-virStream.py
+    'virStreamSendFromFD', # overridden in libvirt-override-virStream.py
 
     'virConnectUnregisterCloseCallback', # overridden in virConnect.py
     'virConnectRegisterCloseCallback', # overridden in virConnect.py
@@ -550,6 +568,26 @@ skip_function = (
     'virDomainGetTime', # overridden in virDomain.py
     'virDomainSetTime', # overridden in virDomain.py
 
+    'virDomainSetSchedulerParameters', # overridden in virDomain.py
+    'virDomainSetSchedulerParametersFlags', # overridden in virDomain.py
+    'virDomainSetBlkioParameters', # overridden in virDomain.py
+    'virDomainSetMemoryParameters', # overridden in virDomain.py
+    'virDomainSetNumaParameters', # overridden in virDomain.py
+    'virDomainSetInterfaceParameters', # overridden in virDomain.py
+    'virDomainSetBlockIoTune', # overridden in virDomain.py
+    'virNodeSetMemoryParameters', # overridden in virConnect.py
+
+    'virDomainGetVcpus', # overridden in virDomain.py
+    'virDomainGetVcpuPinInfo', # overridden in virDomain.py
+    'virDomainGetEmulatorPinInfo', # overridden in virDomain.py
+    'virDomainGetIOThreadInfo', # overridden in virDomain.py
+    'virNodeGetCPUMap', # overridden in virConnect.py
+
+    'virDomainBlockPeekInto', # overridden in virDomain.py
+    'virDomainMemoryPeekInto', # overridden in virDomain.py
+    'virDomainBlockPeekRangesInto', # overridden in virDomain.py
+    'virDomainMemoryPeekRangesInto', # overridden in virDomain.py
+
     # 'Ref' functions have no use for bindings users.
     "virConnectRef",
     "virDomainRef",
@@ -617,6 +655,10 @@ qemu_skip_function = (
 function_skip_python_impl = (
     "virStreamFree", # Needed in custom virStream __del__, but free shouldn't
                      # be exposed in bindings
+    "virDomainGetXMLDesc", # Go through the XML cache in the override files
+    "virConnectGetCapabilities",
+    "virConnectGetSysinfo",
+    "virConnectGetDomainCapabilities",
 )
 
 lxc_function_skip_python_impl = ()
@@ -674,6 +716,10 @@ def print_function_wrapper(module, name, output, export, include):
     c_args=""
     c_return=""
     c_convert=""
+    fast_nargs=0
+    fast_unwrap=[]
+    fast_assign=""
+    fast_ok=True
     num_bufs=0
     for arg in args:
         # This should be correct
@@ -686,6 +732,13 @@ def print_function_wrapper(module, name, output, export, include):
                 f = 't#'
             if f is not None:
                 format = format + f
+            if t is not None:
+                fast_assign = fast_assign + "    pyobj_%s = args[%d];\n" % (arg[0], fast_nargs)
+            elif f in py_fast_unwrap:
+                fast_unwrap.append(py_fast_unwrap[f] % (fast_nargs, arg[0]))
+            else:
+                fast_ok = False
+            fast_nargs = fast_nargs + 1
             if t is not None:
                 format_args = format_args + ", &pyobj_%s" % (arg[0])
                 c_args = c_args + "    PyObject *pyobj_%s;\n" % (arg[0])
@@ -760,19 +813,27 @@ def print_function_wrapper(module, name, output, export, include):
         export.write("#if %s\n" % cond)
         output.write("#if %s\n" % cond)
 
-    include.write("PyObject * ")
     if module == "libvirt":
-        include.write("libvirt_%s(PyObject *self, PyObject *args);\n" % (name))
-        export.write("    { (char *)\"%s\", libvirt_%s, METH_VARARGS, NULL },\n" %
-                     (name, name))
+        prefix = "libvirt_"
     elif module == "libvirt-lxc":
-        include.write("libvirt_lxc_%s(PyObject *self, PyObject *args);\n" % (name))
-        export.write("    { (char *)\"%s\", libvirt_lxc_%s, METH_VARARGS, NULL },\n" %
-                     (name, name))
+        prefix = "libvirt_lxc_"
     elif module == "libvirt-qemu":
-        include.write("libvirt_qemu_%s(PyObject *self, PyObject *args);\n" % (name))
-        export.write("    { (char *)\"%s\", libvirt_qemu_%s, METH_VARARGS, NULL },\n" %
-                     (name, name))
+        prefix = "libvirt_qemu_"
+
+    # Those manually generated keep the METH_VARARGS convention
+    if file == "python" or \
+       (file == "python_accessor" and ret[0] != "void" and ret[2] is None):
+        fast_ok = False
+
+    include.write("PyObject * ")
+    if fast_ok:
+        include.write("%s%s(PyObject *self, LIBVIRT_FASTCALL_ARGS);\n" % (prefix, name))
+        export.write("    { (char *)\"%s\", (PyCFunction) %s%s, LIBVIRT_FASTCALL_FLAGS, NULL },\n" %
+                     (name, prefix, name))
+    else:
+        include.write("%s%s(PyObject *self, PyObject *args);\n" % (prefix, name))
+        export.write("    { (char *)\"%s\", %s%s, METH_VARARGS, NULL },\n" %
+                     (name, prefix, name))
 
     if file == "python":
         # Those have been manually generated
@@ -790,15 +851,15 @@ def print_function_wrapper(module, name, output, export, include):
         return 1
 
     output.write("PyObject *\n")
-    if module == "libvirt":
-        output.write("libvirt_%s(PyObject *self ATTRIBUTE_UNUSED," % (name))
-    elif module == "libvirt-lxc":
-        output.write("libvirt_lxc_%s(PyObject *self ATTRIBUTE_UNUSED," % (name))
-    elif module == "libvirt-qemu":
-        output.write("libvirt_qemu_%s(PyObject *self ATTRIBUTE_UNUSED," % (name))
-    output.write(" PyObject *args")
-    if format == "":
-        output.write(" ATTRIBUTE_UNUSED")
+    output.write("%s%s(PyObject *self ATTRIBUTE_UNUSED," % (prefix, name))
+    if fast_ok and format == "":
+        output.write(" LIBVIRT_FASTCALL_NOARGS")
+    elif fast_ok:
+        output.write(" LIBVIRT_FASTCALL_ARGS")
+    else:
+        output.write(" PyObject *args")
+        if format == "":
+            output.write(" ATTRIBUTE_UNUSED")
     output.write(") {\n")
     if ret[0] != 'void':
         output.write("    PyObject *py_retval;\n")
@@ -806,10 +867,24 @@ def print_function_wrapper(module, name, output, export, include):
         output.write(c_return)
     if c_args != "":
         output.write(c_args)
+    if fast_ok:
+        output.write("\n#if LIBVIRT_HAVE_FASTCALL\n")
+        checks = ["libvirt_fastcallArgsCheck(\"%s\", nargs, %d) < 0" %
+                  (name, fast_nargs)] + fast_unwrap
+        output.write("    if (%s)\n" % " ||\n        ".join(checks))
+        output.write("        return NULL;\n")
+        output.write(fast_assign)
+        # Without arguments, there is nothing left to parse otherwise
+        if format != "":
+            output.write("#else\n")
     if format != "":
-        output.write("\n    if (!PyArg_ParseTuple(args, (char *)\"%s\"%s))\n" %
+        if not fast_ok:
+            output.write("\n")
+        output.write("    if (!PyArg_ParseTuple(args, (char *)\"%s\"%s))\n" %
                      (format, format_args))
         output.write("        return NULL;\n")
+    if fast_ok:
+        output.write("#endif\n")
     if c_convert != "":
         output.write(c_convert + "\n")
 
@@ -1072,6 +1147,22 @@ function_classes["None"] = []
 
 function_post = {}
 
+# virDomain methods changing the XML description of the domain, even
+# though libvirt may report no event for it, after which the documents
+# kept by the XML document cache of the connection are dropped.  The
+# typed parameter setters overridden in virDomain.py do the same.
+for name in ("virDomainAttachDevice", "virDomainAttachDeviceFlags",
+             "virDomainDetachDevice", "virDomainDetachDeviceFlags",
+             "virDomainUpdateDeviceFlags", "virDomainSetMetadata",
+             "virDomainSetMemory", "virDomainSetMaxMemory",
+             "virDomainSetMemoryFlags", "virDomainSetVcpus",
+             "virDomainSetVcpusFlags", "virDomainSetVcpu",
+             "virDomainPinVcpu", "virDomainPinVcpuFlags",
+             "virDomainPinEmulator", "virDomainPinIOThread",
+             "virDomainAddIOThread", "virDomainDelIOThread",
+             "virDomainSetPerfEvents", "virDomainRename"):
+    function_post[name] = "self._conn.invalidateXMLCache(self)"
+
 # Functions returning an integral type which need special rules to
 # check for errors and raise exceptions.
 functions_int_exception_test = {
@@ -1587,6 +1678,8 @@ def buildWrappers(module):
                             classes.write("        else: %s__o = %s%s\n" %
                                           (arg[0], arg[0], classes_type[arg[1]][0]))
                     n = n + 1
+                if name == "virConnectClose":
+                    classes.write("        self._disableCaches()\n")
                 if ret[0] != "void":
                     classes.write("        ret = ")
                 else:
@@ -1657,7 +1750,12 @@ def buildWrappers(module):
                         # generate the returned class wrapper for the object
                         #
                         classes.write("        __tmp = ")
-                        classes.write(classes_type[ret[0]][1] % ("ret"))
+                        if classname == "virConnect" and \
+                           classes_type[ret[0]][2] == "virDomain":
+                            # Goes through the domain object cache
+                            classes.write("self._wrapDomain(ret)")
+                        else:
+                            classes.write(classes_type[ret[0]][1] % ("ret"))
                         classes.write("\n")
 
                         #
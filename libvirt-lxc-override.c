@@ -119,6 +119,27 @@ static PyMethodDef libvirtLxcMethods[] = {
 };
 
 #if PY_MAJOR_VERSION > 2
+# if LIBVIRT_HAVE_MULTIPHASE_INIT
+static PyInterpreterState *libvirtmod_lxc_interpreter;
+
+static int
+libvirtLxcModuleExec(PyObject *module ATTRIBUTE_UNUSED)
+{
+    if (virInitialize() < 0) {
+        PyErr_SetString(PyExc_RuntimeError, "cannot initialize libvirt");
+        return -1;
+    }
+
+    return libvirt_moduleClaimInterpreter(&libvirtmod_lxc_interpreter, "libvirtmod_lxc");
+}
+
+static PyModuleDef_Slot libvirtLxcModuleSlots[] = {
+    {Py_mod_exec, libvirtLxcModuleExec},
+    LIBVIRT_MODULE_SLOTS
+    {0, NULL}
+};
+# endif /* LIBVIRT_HAVE_MULTIPHASE_INIT */
+
 static struct PyModuleDef moduledef = {
         PyModuleDef_HEAD_INIT,
 # ifndef __CYGWIN__
@@ -127,9 +148,17 @@ static struct PyModuleDef moduledef = {
         "cygvirtmod_lxc",
 # endif
         NULL,
+# if LIBVIRT_HAVE_MULTIPHASE_INIT
+        0,
+# else
         -1,
+# endif
         libvirtLxcMethods,
+# if LIBVIRT_HAVE_MULTIPHASE_INIT
+        libvirtLxcModuleSlots,
+# else
         NULL,
+# endif
         NULL,
         NULL,
         NULL
@@ -143,6 +172,9 @@ PyInit_cygvirtmod_lxc
 # endif
   (void)
 {
+# if LIBVIRT_HAVE_MULTIPHASE_INIT
+    return PyModuleDef_Init(&moduledef);
+# else
     PyObject *module;
 
     if (virInitialize() < 0)
@@ -151,6 +183,7 @@ PyInit_cygvirtmod_lxc
     module = PyModule_Create(&moduledef);
 
     return module;
+# endif
 }
 #else /* ! PY_MAJOR_VERSION > 2 */
 void
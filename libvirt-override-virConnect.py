@@ -38,184 +38,11 @@
         """
         try:
             for cb,opaque in self.domainEventCallbacks.items():
-                cb(self, virDomain(self, _obj=dom), event, detail, opaque)
+                cb(self, self._wrapDomain(dom), event, detail, opaque)
             return 0
         except AttributeError:
             pass
 
-    def _dispatchDomainEventLifecycleCallback(self, dom, event, detail, cbData):
-        """Dispatches events to python user domain lifecycle event callbacks
-        """
-        cb = cbData["cb"]
-        opaque = cbData["opaque"]
-
-        cb(self, virDomain(self, _obj=dom), event, detail, opaque)
-        return 0
-
-    def _dispatchDomainEventGenericCallback(self, dom, cbData):
-        """Dispatches events to python user domain generic event callbacks
-        """
-        cb = cbData["cb"]
-        opaque = cbData["opaque"]
-
-        cb(self, virDomain(self, _obj=dom), opaque)
-        return 0
-
-    def _dispatchDomainEventRTCChangeCallback(self, dom, offset, cbData):
-        """Dispatches events to python user domain RTC change event callbacks
-        """
-        cb = cbData["cb"]
-        opaque = cbData["opaque"]
-
-        cb(self, virDomain(self, _obj=dom), offset ,opaque)
-        return 0
-
-    def _dispatchDomainEventWatchdogCallback(self, dom, action, cbData):
-        """Dispatches events to python user domain watchdog event callbacks
-        """
-        cb = cbData["cb"]
-        opaque = cbData["opaque"]
-
-        cb(self, virDomain(self, _obj=dom), action, opaque)
-        return 0
-
-    def _dispatchDomainEventIOErrorCallback(self, dom, srcPath, devAlias,
-                                            action, cbData):
-        """Dispatches events to python user domain IO error event callbacks
-        """
-        cb = cbData["cb"]
-        opaque = cbData["opaque"]
-
-        cb(self, virDomain(self, _obj=dom), srcPath, devAlias, action, opaque)
-        return 0
-
-    def _dispatchDomainEventIOErrorReasonCallback(self, dom, srcPath,
-                                                  devAlias, action, reason,
-                                                  cbData):
-        """Dispatches events to python user domain IO error event callbacks
-        """
-        cb = cbData["cb"]
-        opaque = cbData["opaque"]
-
-        cb(self, virDomain(self, _obj=dom), srcPath, devAlias, action,
-           reason, opaque)
-        return 0
-
-    def _dispatchDomainEventGraphicsCallback(self, dom, phase, localAddr,
-                                            remoteAddr, authScheme, subject,
-                                            cbData):
-        """Dispatches events to python user domain graphics event callbacks
-        """
-        cb = cbData["cb"]
-        opaque = cbData["opaque"]
-
-        cb(self, virDomain(self, _obj=dom), phase, localAddr, remoteAddr,
-           authScheme, subject, opaque)
-        return 0
-
-    def _dispatchDomainEventBlockJobCallback(self, dom, disk, type, status, cbData):
-        """Dispatches events to python user domain blockJob/blockJob2 event callbacks
-        """
-        try:
-            cb = cbData["cb"]
-            opaque = cbData["opaque"]
-
-            cb(self, virDomain(self, _obj=dom), disk, type, status, opaque)
-            return 0
-        except AttributeError:
-            pass
-
-    def _dispatchDomainEventDiskChangeCallback(self, dom, oldSrcPath, newSrcPath, devAlias, reason, cbData):
-        """Dispatches event to python user domain diskChange event callbacks
-        """
-        cb = cbData["cb"]
-        opaque = cbData["opaque"]
-
-        cb(self, virDomain(self, _obj=dom), oldSrcPath, newSrcPath, devAlias, reason, opaque)
-        return 0
-
-    def _dispatchDomainEventTrayChangeCallback(self, dom, devAlias, reason, cbData):
-        """Dispatches event to python user domain trayChange event callbacks
-        """
-        cb = cbData["cb"]
-        opaque = cbData["opaque"]
-
-        cb(self, virDomain(self, _obj=dom), devAlias, reason, opaque)
-        return 0
-
-    def _dispatchDomainEventPMWakeupCallback(self, dom, reason, cbData):
-        """Dispatches event to python user domain pmwakeup event callbacks
-        """
-        cb = cbData["cb"]
-        opaque = cbData["opaque"]
-
-        cb(self, virDomain(self, _obj=dom), reason, opaque)
-        return 0
-
-    def _dispatchDomainEventPMSuspendCallback(self, dom, reason, cbData):
-        """Dispatches event to python user domain pmsuspend event callbacks
-        """
-        cb = cbData["cb"]
-        opaque = cbData["opaque"]
-
-        cb(self, virDomain(self, _obj=dom), reason, opaque)
-        return 0
-
-    def _dispatchDomainEventBalloonChangeCallback(self, dom, actual, cbData):
-        """Dispatches events to python user domain balloon change event callbacks
-        """
-        cb = cbData["cb"]
-        opaque = cbData["opaque"]
-
-        cb(self, virDomain(self, _obj=dom), actual, opaque)
-        return 0
-
-    def _dispatchDomainEventPMSuspendDiskCallback(self, dom, reason, cbData):
-        """Dispatches event to python user domain pmsuspend-disk event callbacks
-        """
-        cb = cbData["cb"]
-        opaque = cbData["opaque"]
-
-        cb(self, virDomain(self, _obj=dom), reason, opaque)
-        return 0
-
-    def _dispatchDomainEventDeviceRemovedCallback(self, dom, devAlias, cbData):
-        """Dispatches event to python user domain device removed event callbacks
-        """
-        cb = cbData["cb"]
-        opaque = cbData["opaque"]
-
-        cb(self, virDomain(self, _obj=dom), devAlias, opaque)
-        return 0
-
-    def _dispatchDomainEventTunableCallback(self, dom, params, cbData):
-        """Dispatches event to python user domain tunable event callbacks
-        """
-        cb = cbData["cb"]
-        opaque = cbData["opaque"]
-
-        cb(self, virDomain(self, _obj=dom), params, opaque)
-        return 0
-
-    def _dispatchDomainEventAgentLifecycleCallback(self, dom, state, reason, cbData):
-        """Dispatches event to python user domain agent lifecycle event callback
-        """
-
-        cb = cbData["cb"]
-        opaque = cbData["opaque"]
-
-        cb(self, virDomain(self, _obj=dom), state, reason, opaque)
-        return 0
-
-    def _dispatchDomainEventDeviceAddedCallback(self, dom, devAlias, cbData):
-        """Dispatches event to python user domain device added event callbacks
-        """
-        cb = cbData["cb"]
-        opaque = cbData["opaque"]
-
-        cb(self, virDomain(self, _obj=dom), devAlias, opaque)
-        return 0
-
     def domainEventDeregisterAny(self, callbackID):
         """Removes a Domain Event Callback. De-registering for a
            domain callback will disable delivery of this event type """
@@ -262,7 +89,10 @@
 
     def domainEventRegisterAny(self, dom, eventID, cb, opaque):
         """Adds a Domain Event Callback. Registering for a domain
-           callback will enable delivery of the events """
+           callback will enable delivery of the events
+
+           The callback is invoked straight from the C module as
+           cb(conn, dom, <event specific arguments>, opaque) """
         if not hasattr(self, 'domainEventCallbackID'):
             self.domainEventCallbackID = {}
         cbData = { "cb": cb, "conn": self, "opaque": opaque }
@@ -275,84 +105,482 @@
         self.domainEventCallbackID[ret] = opaque
         return ret
 
-    def listAllDomains(self, flags=0):
-        """List all domains and returns a list of domain objects"""
-        ret = libvirtmod.virConnectListAllDomains(self._o, flags)
+    def enableDomainCache(self, enable=True):
+        """Enables or disables the reuse of virDomain objects.
+
+           While enabled, the domains returned by lookups, listings,
+           stats queries and event callbacks of this connection are
+           the virDomain objects still alive for them, if any, rather
+           than new ones, so they can be compared by identity.  The
+           objects are only weakly referenced by the cache.
+
+           The cache is kept up to date with a domain lifecycle event
+           callback, so an event loop implementation must have been
+           registered.  Entries are dropped when a domain is undefined,
+           and also when it is started or stopped, since that changes
+           its ID.  As the callback refers to the connection, the cache
+           keeps it alive until it is disabled, which close() does. """
+        if enable:
+            if getattr(self, '_domainCache', None) is not None:
+                return
+            callbackID = self.domainEventRegisterAny(None,
+                                                     VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+                                                     virConnect._domainCacheLifecycle,
+                                                     None)
+            self._domainCacheCallbackID = callbackID
+            self._domainCache = weakref.WeakValueDictionary()
+        else:
+            if getattr(self, '_domainCache', None) is None:
+                return
+            self._domainCache = None
+            self.domainEventDeregisterAny(self._domainCacheCallbackID)
+            self._domainCacheCallbackID = None
+
+    def _disableCaches(self):
+        """Disables the domain and XML caches before the connection is
+           closed, since their event callbacks refer to it """
+        for disable in (self.enableDomainCache, self.enableXMLCache):
+            try:
+                disable(False)
+            except libvirtError:
+                pass
+
+    def _domainCacheLifecycle(self, dom, event, detail, opaque):
+        """Drops the domains whose cached object went stale"""
+        cache = getattr(self, '_domainCache', None)
+        if cache is not None and event in (VIR_DOMAIN_EVENT_UNDEFINED,
+                                           VIR_DOMAIN_EVENT_STARTED,
+                                           VIR_DOMAIN_EVENT_STOPPED):
+            cache.pop(dom.UUID(), None)
+
+    def _wrapDomain(self, domptr):
+        """Returns the virDomain object for the domain pointer @domptr,
+           going through the domain object cache if enabled """
+        cache = getattr(self, '_domainCache', None)
+        if cache is None:
+            return virDomain(self, _obj=domptr)
+
+        uuid = libvirtmod.virDomainGetUUID(domptr)
+        dom = cache.get(uuid)
+        if dom is None:
+            dom = virDomain(self, _obj=domptr)
+            cache[uuid] = dom
+        else:
+            # The cached object keeps its own reference
+            libvirtmod.virDomainFree(domptr)
+        return dom
+
+    # Domain events after which the XML description of a domain may
+    # differ, the ones unknown to the libvirt built against are skipped
+    _xmlCacheEventIDs = ("VIR_DOMAIN_EVENT_ID_LIFECYCLE",
+                         "VIR_DOMAIN_EVENT_ID_DEVICE_ADDED",
+                         "VIR_DOMAIN_EVENT_ID_DEVICE_REMOVED",
+                         "VIR_DOMAIN_EVENT_ID_TUNABLE",
+                         "VIR_DOMAIN_EVENT_ID_BALLOON_CHANGE",
+                         "VIR_DOMAIN_EVENT_ID_TRAY_CHANGE",
+                         "VIR_DOMAIN_EVENT_ID_DISK_CHANGE",
+                         "VIR_DOMAIN_EVENT_ID_BLOCK_JOB",
+                         "VIR_DOMAIN_EVENT_ID_BLOCK_JOB_2")
+
+    def enableXMLCache(self, enable=True):
+        """Enables or disables the caching of XML documents.
+
+           While enabled, the results of virDomain.XMLDesc, keyed by
+           domain UUID and flags, and of getCapabilities, getSysinfo
+           and getDomainCapabilities, keyed by their arguments, are
+           kept by the connection and returned again on later calls.
+
+           The domain documents are kept up to date with domain event
+           callbacks, so an event loop implementation must have been
+           registered.  They are dropped on every lifecycle event,
+           including DEFINED and UNDEFINED, on the DEVICE_ADDED,
+           DEVICE_REMOVED, TUNABLE, BALLOON_CHANGE, TRAY_CHANGE and
+           DISK_CHANGE events, and on the block job events, since a
+           pivot, commit or copy changes the disk sources.  libvirt
+           reports no event for some changes, such as those made to
+           the persistent configuration only or to the metadata, so
+           the documents of a domain are also dropped when one of its
+           methods changing its devices, memory, vCPUs, tunables or
+           metadata succeeds.  The same changes made through another
+           connection can leave stale documents behind, to be dropped
+           by invalidateXMLCache.  libvirt reports no event for the
+           host documents either, they are only dropped by
+           invalidateXMLCache.  Raises libvirtError, leaving the cache
+           disabled, if one of the event callbacks can't be
+           registered.  Like the domain cache, it is disabled by
+           close(). """
+        if enable:
+            if getattr(self, '_xmlCache', None) is not None:
+                return
+            callbackIDs = []
+            try:
+                for name in virConnect._xmlCacheEventIDs:
+                    if name not in globals():
+                        continue
+                    callbackIDs.append(self.domainEventRegisterAny(None,
+                                                                   globals()[name],
+                                                                   virConnect._xmlCacheEvent,
+                                                                   None))
+            except libvirtError:
+                for callbackID in callbackIDs:
+                    self.domainEventDeregisterAny(callbackID)
+                raise
+            self._xmlCacheCallbackIDs = callbackIDs
+            self._xmlCache = _virXMLCache()
+        else:
+            if getattr(self, '_xmlCache', None) is None:
+                return
+            self._xmlCache = None
+            for callbackID in self._xmlCacheCallbackIDs:
+                self.domainEventDeregisterAny(callbackID)
+            self._xmlCacheCallbackIDs = None
+
+    def _xmlCacheEvent(self, dom, *args):
+        """Drops the cached documents of @dom, whatever the event"""
+        cache = getattr(self, '_xmlCache', None)
+        if cache is not None:
+            cache.invalidate(dom.UUID())
+
+    def _xmlCacheFetch(self, dom, key, fetch):
+        """Returns the document cached under @key for the virDomain
+           @dom, or the host if None, calling @fetch to get it on a miss
+           or while the cache is disabled """
+        cache = getattr(self, '_xmlCache', None)
+        if cache is None:
+            return fetch()
+
+        if dom is None:
+            uuid = None
+        else:
+            uuid = dom.UUID()
+        (doc, generation) = cache.lookup(uuid, key)
+        if doc is None:
+            doc = fetch()
+            cache.store(uuid, key, doc, generation)
+        return doc
+
+    def invalidateXMLCache(self, dom=None):
+        """Drops the cached XML documents of the virDomain @dom, or all
+           of them, host documents included, if @dom is None, so they
+           are fetched again.  For the changes libvirt doesn't report
+           an event for. """
+        cache = getattr(self, '_xmlCache', None)
+        if cache is None:
+            return
+        if dom is None:
+            cache.invalidateAll()
+        else:
+            cache.invalidate(dom.UUID())
+
+    def xmlCacheStats(self):
+        """Returns the counters of the XML document cache as a dict
+           with the 'hits', 'misses', 'invalidations' and 'entries'
+           keys, or None if the cache isn't enabled.  'invalidations'
+           counts the domains, or the host, whose cached documents
+           were dropped. """
+        cache = getattr(self, '_xmlCache', None)
+        if cache is None:
+            return None
+        return cache.stats()
+
+    def getCapabilities(self):
+        """Provides capabilities of the hypervisor / driver, cached
+           while the XML document cache is enabled. """
+        def fetch():
+            ret = libvirtmod.virConnectGetCapabilities(self._o)
+            if ret is None: raise libvirtError ('virConnectGetCapabilities() failed', conn=self)
+            return ret
+        return self._xmlCacheFetch(None, ("capabilities",), fetch)
+
+    def getSysinfo(self, flags=0):
+        """This returns the XML description of the sysinfo details for
+           the host on which the hypervisor is running, cached while
+           the XML document cache is enabled. """
+        def fetch():
+            ret = libvirtmod.virConnectGetSysinfo(self._o, flags)
+            if ret is None: raise libvirtError ('virConnectGetSysinfo() failed', conn=self)
+            return ret
+        return self._xmlCacheFetch(None, ("sysinfo", flags), fetch)
+
+    def getDomainCapabilities(self, emulatorbin=None, arch=None, machine=None, virttype=None, flags=0):
+        """Prior creating a domain (for instance via virDomainCreateXML
+           or virDomainDefineXML) it may be suitable to know what the
+           underlying emulator and/or libvirt is capable of.  The result
+           is cached while the XML document cache is enabled. """
+        def fetch():
+            ret = libvirtmod.virConnectGetDomainCapabilities(self._o, emulatorbin, arch, machine, virttype, flags)
+            if ret is None: raise libvirtError ('virConnectGetDomainCapabilities() failed', conn=self)
+            return ret
+        return self._xmlCacheFetch(None, ("domcaps", emulatorbin, arch, machine, virttype, flags), fetch)
+
+    def getCPUMap(self, flags=0, cpumap_format=VIR_PYTHON_CPUMAP_TUPLE):
+        """Get node CPU information, returned as a (cpunum, cpumap,
+           online) tuple.  The cpumap is in the VIR_PYTHON_CPUMAP_*
+           representation given by @cpumap_format """
+        ret = libvirtmod.virNodeGetCPUMap(self._o, flags, cpumap_format)
+        if ret is None: raise libvirtError ('virNodeGetCPUMap() failed', conn=self)
+        return ret
+
+    def _typedParamSchema(self, family):
+        """Returns the dict caching the types of the typed parameter
+           fields of the @family tunables on this connection """
+        schemas = getattr(self, '_typedParamSchemas', None)
+        if schemas is None:
+            schemas = self._typedParamSchemas = {}
+        return schemas.setdefault(family, {})
+
+    def setMemoryParameters(self, params, flags=0):
+        """Change the node memory tunables.  Each value can be given as
+           a (VIR_TYPED_PARAM_*, value) tuple to set its type explicitly,
+           the type of the other fields is looked up once per connection """
+        schema = self._typedParamSchema("nodememory")
+        ret = libvirtmod.virNodeSetMemoryParameters(self._o, params, flags, schema)
+        if ret == -1: raise libvirtError ('virNodeSetMemoryParameters() failed', conn=self)
+        return ret
+
+    def domainEventRegisterBatch(self, dom, eventIDs, cb, opaque,
+                                 max_batch=64, max_delay_ms=100):
+        """Adds a Domain Event Callback receiving the events of all of
+           @eventIDs in batches, which is much cheaper than a call per
+           event when many of them are emitted.
+
+           Events are queued by the C module and delivered as
+           cb(conn, events, opaque), where each entry of the events
+           list is an (eventID, dom, <event specific arguments>) tuple.
+           A batch is delivered once @max_batch events are pending, or
+           @max_delay_ms after the first of them was queued.  Requires
+           a registered event loop implementation.
+
+           Returns the list of callback IDs, one per event ID, each of
+           which can be removed with domainEventDeregisterAny(). """
+        if not hasattr(self, 'domainEventCallbackID'):
+            self.domainEventCallbackID = {}
+        cbData = { "cb": cb, "conn": self, "opaque": opaque }
+        if dom is None:
+            ret = libvirtmod.virConnectDomainEventRegisterBatch(self._o, None, list(eventIDs), cbData, max_batch, max_delay_ms)
+        else:
+            ret = libvirtmod.virConnectDomainEventRegisterBatch(self._o, dom._o, list(eventIDs), cbData, max_batch, max_delay_ms)
+        if ret == -1:
+            raise libvirtError ('virConnectDomainEventRegisterBatch() failed', conn=self)
+        for callbackID in ret:
+            self.domainEventCallbackID[callbackID] = opaque
+        return ret
+
+    def batch(self):
+        """Return a context collecting calls on the objects of this
+           connection, to issue them together once it is left:
+
+               with conn.batch() as b:
+                   for dom in doms:
+                       b(dom).info()
+               for (ok, value) in b.results:
+                   ...
+
+           The calls run concurrently on the aioCall() worker pool with
+           the interpreter lock released, and as the remote driver
+           keeps the calls of several threads in flight on a single
+           connection they cost about one round trip altogether.
+           b.results lists an (ok, value) tuple per call, in the order
+           the calls were made: ok is True and value the result of the
+           calls which succeeded, ok is False and value the exception
+           raised by the calls which failed.  Calls can also be queued
+           with b.call(func, *args), and issued early with b.run(). """
+        return _virBatch(self)
+
+    def lookupByNameOrNone(self, name):
+        """Like lookupByName(), but returns None instead of raising
+           libvirtError if there is no such domain """
+        ret = libvirtmod.virDomainLookupByName(self._o, name)
+        if ret is None:
+            return _virLookupMiss('virDomainLookupByName', VIR_ERR_NO_DOMAIN, self)
+        return self._wrapDomain(ret)
+
+    def lookupByIDOrNone(self, id):
+        """Like lookupByID(), but returns None instead of raising
+           libvirtError if there is no such domain """
+        ret = libvirtmod.virDomainLookupByID(self._o, id)
+        if ret is None:
+            return _virLookupMiss('virDomainLookupByID', VIR_ERR_NO_DOMAIN, self)
+        return self._wrapDomain(ret)
+
+    def lookupByUUIDOrNone(self, uuid):
+        """Like lookupByUUID(), but returns None instead of raising
+           libvirtError if there is no such domain """
+        ret = libvirtmod.virDomainLookupByUUID(self._o, uuid)
+        if ret is None:
+            return _virLookupMiss('virDomainLookupByUUID', VIR_ERR_NO_DOMAIN, self)
+        return self._wrapDomain(ret)
+
+    def lookupByUUIDStringOrNone(self, uuidstr):
+        """Like lookupByUUIDString(), but returns None instead of
+           raising libvirtError if there is no such domain """
+        ret = libvirtmod.virDomainLookupByUUIDString(self._o, uuidstr)
+        if ret is None:
+            return _virLookupMiss('virDomainLookupByUUIDString', VIR_ERR_NO_DOMAIN, self)
+        return self._wrapDomain(ret)
+
+    def networkLookupByNameOrNone(self, name):
+        """Like networkLookupByName(), but returns None instead of
+           raising libvirtError if there is no such network """
+        ret = libvirtmod.virNetworkLookupByName(self._o, name)
+        if ret is None:
+            return _virLookupMiss('virNetworkLookupByName', VIR_ERR_NO_NETWORK, self)
+        return virNetwork(self, _obj=ret)
+
+    def networkLookupByUUIDStringOrNone(self, uuidstr):
+        """Like networkLookupByUUIDString(), but returns None instead of
+           raising libvirtError if there is no such network """
+        ret = libvirtmod.virNetworkLookupByUUIDString(self._o, uuidstr)
+        if ret is None:
+            return _virLookupMiss('virNetworkLookupByUUIDString', VIR_ERR_NO_NETWORK, self)
+        return virNetwork(self, _obj=ret)
+
+    def storagePoolLookupByNameOrNone(self, name):
+        """Like storagePoolLookupByName(), but returns None instead of
+           raising libvirtError if there is no such storage pool """
+        ret = libvirtmod.virStoragePoolLookupByName(self._o, name)
+        if ret is None:
+            return _virLookupMiss('virStoragePoolLookupByName', VIR_ERR_NO_STORAGE_POOL, self)
+        return virStoragePool(self, _obj=ret)
+
+    def storagePoolLookupByUUIDStringOrNone(self, uuidstr):
+        """Like storagePoolLookupByUUIDString(), but returns None
+           instead of raising libvirtError if there is no such storage
+           pool """
+        ret = libvirtmod.virStoragePoolLookupByUUIDString(self._o, uuidstr)
+        if ret is None:
+            return _virLookupMiss('virStoragePoolLookupByUUIDString', VIR_ERR_NO_STORAGE_POOL, self)
+        return virStoragePool(self, _obj=ret)
+
+    def storageVolLookupByKeyOrNone(self, key):
+        """Like storageVolLookupByKey(), but returns None instead of
+           raising libvirtError if there is no such storage volume """
+        ret = libvirtmod.virStorageVolLookupByKey(self._o, key)
+        if ret is None:
+            return _virLookupMiss('virStorageVolLookupByKey', VIR_ERR_NO_STORAGE_VOL, self)
+        return virStorageVol(self, _obj=ret)
+
+    def storageVolLookupByPathOrNone(self, path):
+        """Like storageVolLookupByPath(), but returns None instead of
+           raising libvirtError if there is no such storage volume """
+        ret = libvirtmod.virStorageVolLookupByPath(self._o, path)
+        if ret is None:
+            return _virLookupMiss('virStorageVolLookupByPath', VIR_ERR_NO_STORAGE_VOL, self)
+        return virStorageVol(self, _obj=ret)
+
+    def listAllDomains(self, flags=0, lazy=False):
+        """List all domains and returns a list of domain objects
+
+        If lazy is True, a lazy _virObjectList is returned instead."""
+        ret = libvirtmod.virConnectListAllDomains(self._o, flags, lazy)
         if ret is None:
             raise libvirtError("virConnectListAllDomains() failed", conn=self)
 
+        if lazy:
+            return _virObjectList(ret, self._wrapDomain)
+
         retlist = list()
         for domptr in ret:
-            retlist.append(virDomain(self, _obj=domptr))
+            retlist.append(self._wrapDomain(domptr))
 
         return retlist
 
-    def listAllStoragePools(self, flags=0):
-        """Returns a list of storage pool objects"""
-        ret = libvirtmod.virConnectListAllStoragePools(self._o, flags)
+    def listAllStoragePools(self, flags=0, lazy=False):
+        """Returns a list of storage pool objects
+
+        If lazy is True, a lazy _virObjectList is returned instead."""
+        ret = libvirtmod.virConnectListAllStoragePools(self._o, flags, lazy)
         if ret is None:
             raise libvirtError("virConnectListAllStoragePools() failed", conn=self)
 
+        if lazy:
+            return _virObjectList(ret, lambda poolptr: virStoragePool(self, _obj=poolptr))
+
         retlist = list()
         for poolptr in ret:
             retlist.append(virStoragePool(self, _obj=poolptr))
 
         return retlist
 
-    def listAllNetworks(self, flags=0):
-        """Returns a list of network objects"""
-        ret = libvirtmod.virConnectListAllNetworks(self._o, flags)
+    def listAllNetworks(self, flags=0, lazy=False):
+        """Returns a list of network objects
+
+        If lazy is True, a lazy _virObjectList is returned instead."""
+        ret = libvirtmod.virConnectListAllNetworks(self._o, flags, lazy)
         if ret is None:
             raise libvirtError("virConnectListAllNetworks() failed", conn=self)
 
+        if lazy:
+            return _virObjectList(ret, lambda netptr: virNetwork(self, _obj=netptr))
+
         retlist = list()
         for netptr in ret:
             retlist.append(virNetwork(self, _obj=netptr))
 
         return retlist
 
-    def listAllInterfaces(self, flags=0):
-        """Returns a list of interface objects"""
-        ret = libvirtmod.virConnectListAllInterfaces(self._o, flags)
+    def listAllInterfaces(self, flags=0, lazy=False):
+        """Returns a list of interface objects
+
+        If lazy is True, a lazy _virObjectList is returned instead."""
+        ret = libvirtmod.virConnectListAllInterfaces(self._o, flags, lazy)
         if ret is None:
             raise libvirtError("virConnectListAllInterfaces() failed", conn=self)
 
+        if lazy:
+            return _virObjectList(ret, lambda ifaceptr: virInterface(self, _obj=ifaceptr))
+
         retlist = list()
         for ifaceptr in ret:
             retlist.append(virInterface(self, _obj=ifaceptr))
 
         return retlist
 
-    def listAllDevices(self, flags=0):
-        """Returns a list of host node device objects"""
-        ret = libvirtmod.virConnectListAllNodeDevices(self._o, flags)
+    def listAllDevices(self, flags=0, lazy=False):
+        """Returns a list of host node device objects
+
+        If lazy is True, a lazy _virObjectList is returned instead."""
+        ret = libvirtmod.virConnectListAllNodeDevices(self._o, flags, lazy)
         if ret is None:
             raise libvirtError("virConnectListAllNodeDevices() failed", conn=self)
 
+        if lazy:
+            return _virObjectList(ret, lambda devptr: virNodeDevice(self, _obj=devptr))
+
         retlist = list()
         for devptr in ret:
             retlist.append(virNodeDevice(self, _obj=devptr))
 
         return retlist
 
-    def listAllNWFilters(self, flags=0):
-        """Returns a list of network filter objects"""
-        ret = libvirtmod.virConnectListAllNWFilters(self._o, flags)
+    def listAllNWFilters(self, flags=0, lazy=False):
+        """Returns a list of network filter objects
+
+        If lazy is True, a lazy _virObjectList is returned instead."""
+        ret = libvirtmod.virConnectListAllNWFilters(self._o, flags, lazy)
         if ret is None:
             raise libvirtError("virConnectListAllNWFilters() failed", conn=self)
 
+        if lazy:
+            return _virObjectList(ret, lambda filter_ptr: virNWFilter(self, _obj=filter_ptr))
+
         retlist = list()
         for filter_ptr in ret:
             retlist.append(virNWFilter(self, _obj=filter_ptr))
 
         return retlist
 
-    def listAllSecrets(self, flags=0):
-        """Returns a list of secret objects"""
-        ret = libvirtmod.virConnectListAllSecrets(self._o, flags)
+    def listAllSecrets(self, flags=0, lazy=False):
+        """Returns a list of secret objects
+
+        If lazy is True, a lazy _virObjectList is returned instead."""
+        ret = libvirtmod.virConnectListAllSecrets(self._o, flags, lazy)
         if ret is None:
             raise libvirtError("virConnectListAllSecrets() failed", conn=self)
 
+        if lazy:
+            return _virObjectList(ret, lambda secret_ptr: virSecret(self, _obj=secret_ptr))
+
         retlist = list()
         for secret_ptr in ret:
             retlist.append(virSecret(self, _obj=secret_ptr))
@@ -409,7 +637,7 @@
         block attempts at migration, save-to-file, or snapshots. """
         ret = libvirtmod.virDomainCreateXMLWithFiles(self._o, xmlDesc, files, flags)
         if ret is None:raise libvirtError('virDomainCreateXMLWithFiles() failed', conn=self)
-        __tmp = virDomain(self,_obj=ret)
+        __tmp = self._wrapDomain(ret)
         return __tmp
 
     def getAllDomainStats(self, stats = 0, flags=0):
@@ -460,11 +688,36 @@
 
         retlist = list()
         for elem in ret:
-            record = (virDomain(self, _obj=elem[0]) , elem[1])
+            record = (self._wrapDomain(elem[0]) , elem[1])
             retlist.append(record)
 
         return retlist
 
+    def getAllDomainStatsColumns(self, stats = 0, flags=0):
+        """Query statistics for all domains on a given connection, in
+        columnar form.
+
+        Takes the same @stats and @flags as getAllDomainStats, but instead
+        of one (domain, dict) record per domain it returns a tuple
+        (uuids, columns). @uuids is the list of domain UUID strings, and
+        @columns maps every statistic field name to a sequence indexed
+        like @uuids. Numeric fields are returned as array.array objects
+        of the field's native type, string fields as lists. Domains which
+        do not report a field hold 0 (or None for strings) in its column."""
+        ret = libvirtmod.virConnectGetAllDomainStatsColumns(self._o, stats, flags)
+        if ret is None:
+            raise libvirtError("virConnectGetAllDomainStatsColumns() failed", conn=self)
+
+        (uuids, raw) = ret
+        columns = dict()
+        for (field, (typ, values)) in raw.items():
+            if typ == VIR_TYPED_PARAM_STRING:
+                columns[field] = values
+            else:
+                columns[field] = _typedParamArray(typ, values)
+
+        return (uuids, columns)
+
     def domainListGetStats(self, doms, stats=0, flags=0):
         """ Query statistics for given domains.
 
@@ -507,7 +760,7 @@
 
         retlist = list()
         for elem in ret:
-            record = (virDomain(self, _obj=elem[0]) , elem[1])
+            record = (self._wrapDomain(elem[0]) , elem[1])
             retlist.append(record)
 
         return retlist
@@ -1,9 +1,14 @@
-    def listAllSnapshots(self, flags=0):
-        """List all snapshots and returns a list of snapshot objects"""
-        ret = libvirtmod.virDomainListAllSnapshots(self._o, flags)
+    def listAllSnapshots(self, flags=0, lazy=False):
+        """List all snapshots and returns a list of snapshot objects
+
+        If lazy is True, a lazy _virObjectList is returned instead."""
+        ret = libvirtmod.virDomainListAllSnapshots(self._o, flags, lazy)
         if ret is None:
             raise libvirtError("virDomainListAllSnapshots() failed", conn=self)
 
+        if lazy:
+            return _virObjectList(ret, lambda snapptr: virDomainSnapshot(self, _obj=snapptr))
+
         retlist = list()
         for snapptr in ret:
             retlist.append(virDomainSnapshot(self, _obj=snapptr))
@@ -11,6 +16,58 @@
         return retlist
 
 
+    def snapshotLookupByNameOrNone(self, name, flags=0):
+        """Like snapshotLookupByName(), but returns None instead of
+           raising libvirtError if there is no such snapshot """
+        ret = libvirtmod.virDomainSnapshotLookupByName(self._o, name, flags)
+        if ret is None:
+            return _virLookupMiss('virDomainSnapshotLookupByName', VIR_ERR_NO_DOMAIN_SNAPSHOT, self)
+        return virDomainSnapshot(self, _obj=ret)
+
+    def XMLDesc(self, flags=0):
+        """Provide an XML description of the domain.  The description
+        may be reused by virDomainCreateXML() to relaunch the domain.
+        It is cached, per set of @flags, while the XML document cache
+        of the connection is enabled. """
+        def fetch():
+            ret = libvirtmod.virDomainGetXMLDesc(self._o, flags)
+            if ret is None: raise libvirtError ('virDomainGetXMLDesc() failed', dom=self)
+            return ret
+        return self._conn._xmlCacheFetch(self, ("xml", flags), fetch)
+
+    def jobMonitor(self, cb, opaque=None, interval_ms=500, stall_ms=0,
+                   dirty_rate=0, downtimes=None, postcopy=False):
+        """Watch the progress of the job of the domain, typically a
+           migration started by migrate3() or migrateToURI3(), from a
+           native thread polling its stats every interval_ms:
+
+               with dom.jobMonitor(cb, stall_ms=10000,
+                                   downtimes=[500, 1000], postcopy=True):
+                   dom.migrateToURI3(uri, params,
+                                     flags | VIR_MIGRATE_POSTCOPY)
+
+           Python is only called back, as cb(dom, event, progress,
+           opaque), for the VIR_PYTHON_JOB_MONITOR_* events: when
+           data_remaining reaches no new low for stall_ms, when
+           memory_dirty_rate goes over dirty_rate (in pages per
+           second), when the job ends, and for the escalations of
+           those stalls and dirty rates.  Each of them sets the next
+           maximum downtime from the downtimes list in milliseconds,
+           and once it is exhausted switches the migration to post-copy
+           if postcopy is True.  progress is the dict of the last
+           sampled fields, as returned by the progress() method of the
+           monitor; stall_ms and dirty_rate set to 0 disable their
+           events.
+
+           The monitor stops once the job ends, when its stop() method
+           is called, or when it is garbage collected.  Leaving the with
+           block stops it too, but first reports the end of the job
+           with its completed stats if the monitor didn't yet.  Failures
+           to get the stats are retried on the next poll, except if the
+           domain is gone. """
+        return _virJobMonitor(self, cb, opaque, interval_ms, stall_ms,
+                              dirty_rate, downtimes, postcopy)
+
     def createWithFiles(self, files, flags=0):
         """Launch a defined domain. If the call succeeds the domain moves from the
         defined to the running domains pools.
@@ -72,3 +129,141 @@
         ret = libvirtmod.virDomainSetTime(self._o, time, flags)
         if ret == -1: raise libvirtError ('virDomainSetTime() failed', dom=self)
         return ret
+
+    def setSchedulerParameters(self, params):
+        """Change the scheduler parameters.  Each value can be given as a
+        (VIR_TYPED_PARAM_*, value) tuple to set its type explicitly,
+        the type of the other fields is looked up once per connection """
+        schema = self._conn._typedParamSchema("scheduler")
+        ret = libvirtmod.virDomainSetSchedulerParameters(self._o, params, schema)
+        if ret == -1: raise libvirtError ('virDomainSetSchedulerParameters() failed', dom=self)
+        self._conn.invalidateXMLCache(self)
+        return ret
+
+    def setSchedulerParametersFlags(self, params, flags=0):
+        """Change the scheduler parameters.  Each value can be given as a
+        (VIR_TYPED_PARAM_*, value) tuple to set its type explicitly,
+        the type of the other fields is looked up once per connection """
+        schema = self._conn._typedParamSchema("scheduler")
+        ret = libvirtmod.virDomainSetSchedulerParametersFlags(self._o, params, flags, schema)
+        if ret == -1: raise libvirtError ('virDomainSetSchedulerParametersFlags() failed', dom=self)
+        self._conn.invalidateXMLCache(self)
+        return ret
+
+    def setBlkioParameters(self, params, flags=0):
+        """Change the blkio tunables.  Each value can be given as a
+        (VIR_TYPED_PARAM_*, value) tuple to set its type explicitly,
+        the type of the other fields is looked up once per connection """
+        schema = self._conn._typedParamSchema("blkio")
+        ret = libvirtmod.virDomainSetBlkioParameters(self._o, params, flags, schema)
+        if ret == -1: raise libvirtError ('virDomainSetBlkioParameters() failed', dom=self)
+        self._conn.invalidateXMLCache(self)
+        return ret
+
+    def setMemoryParameters(self, params, flags=0):
+        """Change the memory tunables.  Each value can be given as a
+        (VIR_TYPED_PARAM_*, value) tuple to set its type explicitly,
+        the type of the other fields is looked up once per connection """
+        schema = self._conn._typedParamSchema("memory")
+        ret = libvirtmod.virDomainSetMemoryParameters(self._o, params, flags, schema)
+        if ret == -1: raise libvirtError ('virDomainSetMemoryParameters() failed', dom=self)
+        self._conn.invalidateXMLCache(self)
+        return ret
+
+    def setNumaParameters(self, params, flags=0):
+        """Change the NUMA tunables.  Each value can be given as a
+        (VIR_TYPED_PARAM_*, value) tuple to set its type explicitly,
+        the type of the other fields is looked up once per connection """
+        schema = self._conn._typedParamSchema("numa")
+        ret = libvirtmod.virDomainSetNumaParameters(self._o, params, flags, schema)
+        if ret == -1: raise libvirtError ('virDomainSetNumaParameters() failed', dom=self)
+        self._conn.invalidateXMLCache(self)
+        return ret
+
+    def setInterfaceParameters(self, device, params, flags=0):
+        """Change the bandwidth tunables for a interface device.  Each value can be given as a
+        (VIR_TYPED_PARAM_*, value) tuple to set its type explicitly,
+        the type of the other fields is looked up once per connection """
+        schema = self._conn._typedParamSchema("interface")
+        ret = libvirtmod.virDomainSetInterfaceParameters(self._o, device, params, flags, schema)
+        if ret == -1: raise libvirtError ('virDomainSetInterfaceParameters() failed', dom=self)
+        self._conn.invalidateXMLCache(self)
+        return ret
+
+    def setBlockIoTune(self, disk, params, flags=0):
+        """Change the I/O tunables for a block device.  Each value can be given as a
+        (VIR_TYPED_PARAM_*, value) tuple to set its type explicitly,
+        the type of the other fields is looked up once per connection """
+        schema = self._conn._typedParamSchema("blockiotune")
+        ret = libvirtmod.virDomainSetBlockIoTune(self._o, disk, params, flags, schema)
+        if ret == -1: raise libvirtError ('virDomainSetBlockIoTune() failed', dom=self)
+        self._conn.invalidateXMLCache(self)
+        return ret
+
+    def vcpus(self, cpumap_format=VIR_PYTHON_CPUMAP_TUPLE):
+        """Extract information about virtual CPUs of domain, returned
+        as a (info, cpumaps) tuple.  The cpumaps are in the
+        VIR_PYTHON_CPUMAP_* representation given by @cpumap_format """
+        ret = libvirtmod.virDomainGetVcpus(self._o, cpumap_format)
+        if ret == -1: raise libvirtError ('virDomainGetVcpus() failed', dom=self)
+        return ret
+
+    def vcpuPinInfo(self, flags=0, cpumap_format=VIR_PYTHON_CPUMAP_TUPLE):
+        """Query the CPU affinity setting of all virtual CPUs of domain.
+        The cpumaps are in the VIR_PYTHON_CPUMAP_* representation given
+        by @cpumap_format """
+        ret = libvirtmod.virDomainGetVcpuPinInfo(self._o, flags, cpumap_format)
+        if ret is None: raise libvirtError ('virDomainGetVcpuPinInfo() failed', dom=self)
+        return ret
+
+    def emulatorPinInfo(self, flags=0, cpumap_format=VIR_PYTHON_CPUMAP_TUPLE):
+        """Query the CPU affinity setting of the emulator process of
+        domain.  The cpumap is in the VIR_PYTHON_CPUMAP_* representation
+        given by @cpumap_format """
+        ret = libvirtmod.virDomainGetEmulatorPinInfo(self._o, flags, cpumap_format)
+        if ret is None: raise libvirtError ('virDomainGetEmulatorPinInfo() failed', dom=self)
+        return ret
+
+    def ioThreadInfo(self, flags=0, cpumap_format=VIR_PYTHON_CPUMAP_TUPLE):
+        """Query the CPU affinity setting of the IOThreads of the domain,
+        returned as a list of (iothread_id, cpumap) tuples.  The cpumaps
+        are in the VIR_PYTHON_CPUMAP_* representation given by
+        @cpumap_format """
+        ret = libvirtmod.virDomainGetIOThreadInfo(self._o, flags, cpumap_format)
+        if ret is None: raise libvirtError ('virDomainGetIOThreadInfo() failed', dom=self)
+        return ret
+
+    def blockPeekInto(self, disk, offset, buffer, flags=0):
+        """Read the contents of domain's disk device @disk from
+        @offset straight into @buffer, a writable object supporting
+        the buffer protocol such as a bytearray, a memoryview or an
+        mmap, which is filled entirely """
+        ret = libvirtmod.virDomainBlockPeekInto(self._o, disk, offset, buffer, flags)
+        if ret == -1: raise libvirtError ('virDomainBlockPeekInto() failed', dom=self)
+        return ret
+
+    def memoryPeekInto(self, start, buffer, flags=0):
+        """Read the contents of domain's memory from @start straight
+        into @buffer, a writable object supporting the buffer protocol,
+        which is filled entirely """
+        ret = libvirtmod.virDomainMemoryPeekInto(self._o, start, buffer, flags)
+        if ret == -1: raise libvirtError ('virDomainMemoryPeekInto() failed', dom=self)
+        return ret
+
+    def blockPeekRangesInto(self, disk, ranges, buffer, flags=0):
+        """Read each of the (offset, size) @ranges of domain's disk
+        device @disk into @buffer, one after the other, in a single call
+        not holding the interpreter lock.  Returns the number of bytes
+        read, the sum of the range sizes """
+        ret = libvirtmod.virDomainBlockPeekRangesInto(self._o, disk, ranges, buffer, flags)
+        if ret == -1: raise libvirtError ('virDomainBlockPeekRangesInto() failed', dom=self)
+        return ret
+
+    def memoryPeekRangesInto(self, ranges, buffer, flags=0):
+        """Read each of the (start, size) @ranges of domain's memory
+        into @buffer, one after the other, in a single call not holding
+        the interpreter lock.  Returns the number of bytes read, the sum
+        of the range sizes """
+        ret = libvirtmod.virDomainMemoryPeekRangesInto(self._o, ranges, buffer, flags)
+        if ret == -1: raise libvirtError ('virDomainMemoryPeekRangesInto() failed', dom=self)
+        return ret
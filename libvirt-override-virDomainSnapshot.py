@@ -6,12 +6,17 @@
         """Get the domain that a snapshot was created for"""
         return self.domain()
 
-    def listAllChildren(self, flags=0):
-        """List all child snapshots and returns a list of snapshot objects"""
-        ret = libvirtmod.virDomainSnapshotListAllChildren(self._o, flags)
+    def listAllChildren(self, flags=0, lazy=False):
+        """List all child snapshots and returns a list of snapshot objects
+
+        If lazy is True, a lazy _virObjectList is returned instead."""
+        ret = libvirtmod.virDomainSnapshotListAllChildren(self._o, flags, lazy)
         if ret is None:
             raise libvirtError("virDomainSnapshotListAllChildren() failed", conn=self)
 
+        if lazy:
+            return _virObjectList(ret, lambda snapptr: virDomainSnapshot(self, _obj=snapptr))
+
         retlist = list()
         for snapptr in ret:
             retlist.append(virDomainSnapshot(self, _obj=snapptr))
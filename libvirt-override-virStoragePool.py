@@ -1,11 +1,24 @@
-    def listAllVolumes(self, flags=0):
-        """List all storage volumes and returns a list of storage volume objects"""
-        ret = libvirtmod.virStoragePoolListAllVolumes(self._o, flags)
+    def listAllVolumes(self, flags=0, lazy=False):
+        """List all storage volumes and returns a list of storage volume objects
+
+        If lazy is True, a lazy _virObjectList is returned instead."""
+        ret = libvirtmod.virStoragePoolListAllVolumes(self._o, flags, lazy)
         if ret is None:
             raise libvirtError("virStoragePoolListAllVolumes() failed", conn=self)
 
+        if lazy:
+            return _virObjectList(ret, lambda volptr: virStorageVol(self, _obj=volptr))
+
         retlist = list()
         for volptr in ret:
             retlist.append(virStorageVol(self, _obj=volptr))
 
         return retlist
+
+    def storageVolLookupByNameOrNone(self, name):
+        """Like storageVolLookupByName(), but returns None instead of
+           raising libvirtError if there is no such storage volume """
+        ret = libvirtmod.virStorageVolLookupByName(self._o, name)
+        if ret is None:
+            return _virLookupMiss('virStorageVolLookupByName', VIR_ERR_NO_STORAGE_VOL, self)
+        return virStorageVol(self, _obj=ret)
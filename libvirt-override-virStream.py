@@ -25,7 +25,7 @@
         ret = libvirtmod.virStreamEventAddCallback(self._o, events, cbData)
         if ret == -1: raise libvirtError ('virStreamEventAddCallback() failed')
 
-    def recvAll(self, handler, opaque):
+    def recvAll(self, handler, opaque, buf=None):
         """Receive the entire data stream, sending the data to the
         requested data sink. This is simply a convenient alternative
         to virStreamRecv, for apps that do blocking-I/O.
@@ -37,9 +37,26 @@
                         opaque): # extra data passed to recvAll as opaque
                 fd = opaque
                 return os.write(fd, buf)
+
+        If @buf is a writable buffer (e.g. a bytearray), every chunk is
+        received into it and the handler is passed a memoryview of the
+        received bytes instead of a new string. The view is only valid
+        until the handler returns. This needs a memoryview able to look
+        at @buf as bytes, so Python 2.6 and typed buffers on Python 2.7
+        raise TypeError.
         """
+        if buf is not None:
+            # recvInto counts bytes, whatever the item size of buf
+            view = _virByteView(buf)
+            if view is None:
+                raise TypeError("recvAll buf can't be viewed as bytes")
+
         while True:
-            got = self.recv(1024*64)
+            if buf is None:
+                got = self.recv(1024*64)
+            else:
+                ret = self.recvInto(buf)
+                got = ret if ret == -2 else view[:ret]
             if got == -2:
                 raise libvirtError("cannot use recvAll with "
                                    "nonblocking stream")
@@ -71,10 +88,13 @@
                         opaque): # extra data passed to recvAll as opaque
                 fd = opaque
                 return os.read(fd, nbytes)
+
+        The handler may return any object supporting the buffer
+        protocol, which is sent without being copied.
         """
         while True:
             try:
-                got = handler(self, 1024*64, opaque)
+                got = handler(self, 256*1024, opaque)
             except:
                 e = sys.exc_info()[1]
                 try:
@@ -83,13 +103,109 @@
                     pass
                 raise e
 
-            if got == "":
+            # send() counts bytes, so typed or multi-dimensional buffers
+            # are sliced through a view of them as flat bytes, strings
+            # and the objects without one as they are
+            data = None
+            if not isinstance(got, _virStringTypes):
+                data = _virByteView(got)
+            if data is None:
+                data = got
+
+            if len(data) == 0:
                 break
 
-            ret = self.send(got)
-            if ret == -2:
-                raise libvirtError("cannot use sendAll with "
-                                   "nonblocking stream")
+            while len(data) > 0:
+                ret = self.send(data)
+                if ret == -2:
+                    raise libvirtError("cannot use sendAll with "
+                                       "nonblocking stream")
+                data = data[ret:]
+
+    def _dispatchStreamProgressCallback(self, total, cbData):
+        """
+        Dispatches progress reports to python user's stream progress callbacks
+        """
+        cb = cbData["cb"]
+        opaque = cbData["opaque"]
+
+        cb(self, total, opaque)
+        return 0
+
+    def recvToFD(self, fd, chunk_size=256*1024, progress=None, opaque=None,
+                 interval=1.0, sparse=VIR_PYTHON_STREAM_SPARSE_NONE):
+        """Receive the entire data stream and write it to the file
+        descriptor @fd. Unlike recvAll, the whole transfer runs in
+        native code without holding the interpreter lock, using
+        buffers of @chunk_size bytes.
+
+        If @progress is given, it is called at most every @interval
+        seconds, and once more when the stream ends:
+
+            def progress(stream, # virStream instance
+                         total,  # number of bytes transferred so far
+                         opaque): # extra data passed to recvToFD as opaque
+
+        The stream is aborted if writing to @fd fails or if the
+        progress callback raises an exception. On success, the total
+        number of bytes received is returned. If the stream is
+        nonblocking and would block, libvirtError is raised, with what
+        would have been returned for the data written to @fd until then
+        in its transferred attribute.
+
+        With a @sparse mode other than VIR_PYTHON_STREAM_SPARSE_NONE,
+        the blocks of zeros received, and the holes of the stream in
+        VIR_PYTHON_STREAM_SPARSE_STREAM mode, become holes of @fd if it
+        is a regular file: skipped past its end, punched within it.  A
+        tuple (logical, physical) is returned then, physical being the
+        part of the logical bytes received that was written as data,
+        and progress is told about the logical bytes.
+        """
+        cbData = None
+        if progress is not None:
+            cbData = {"stream": self, "cb" : progress, "opaque" : opaque}
+
+        ret = libvirtmod.virStreamRecvToFD(self._o, fd, chunk_size, cbData, int(interval * 1000), sparse)
+        if ret is None:
+            raise libvirtError("virStreamRecvToFD() failed")
+        if isinstance(ret, tuple) and ret[0] == -2:
+            err = libvirtError("cannot use recvToFD with nonblocking stream")
+            err.transferred = ret[1]
+            raise err
+        return ret
+
+    def sendFromFD(self, fd, chunk_size=256*1024, progress=None, opaque=None,
+                   interval=1.0, sparse=VIR_PYTHON_STREAM_SPARSE_NONE):
+        """Send the data read from the file descriptor @fd until its end
+        to the stream. Unlike sendAll, the whole transfer runs in
+        native code without holding the interpreter lock, using
+        buffers of @chunk_size bytes.
+
+        @progress and @interval work as in recvToFD. The stream is
+        aborted if reading from @fd fails or if the progress callback
+        raises an exception. On success, the total number of bytes
+        sent is returned. As in recvToFD, libvirtError is raised with
+        the transferred attribute set if the stream would block; data
+        already read from @fd but not sent is not counted there.
+
+        With a @sparse mode other than VIR_PYTHON_STREAM_SPARSE_NONE,
+        the holes of @fd, if it is a regular file, are skipped instead
+        of read, and in VIR_PYTHON_STREAM_SPARSE_STREAM mode they and
+        the blocks of zeros read are sent as holes of the stream.  As
+        in recvToFD, a tuple (logical, physical) is returned then.
+        """
+        cbData = None
+        if progress is not None:
+            cbData = {"stream": self, "cb" : progress, "opaque" : opaque}
+
+        ret = libvirtmod.virStreamSendFromFD(self._o, fd, chunk_size, cbData, int(interval * 1000), sparse)
+        if ret is None:
+            raise libvirtError("virStreamSendFromFD() failed")
+        if isinstance(ret, tuple) and ret[0] == -2:
+            err = libvirtError("cannot use sendFromFD with nonblocking stream")
+            err.transferred = ret[1]
+            raise err
+        return ret
 
     def recv(self, nbytes):
         """Reads a series of bytes from the stream. This method may
@@ -108,6 +224,23 @@
         if ret is None: raise libvirtError ('virStreamRecv() failed')
         return ret
 
+    def recvInto(self, buf, nbytes=-1):
+        """Reads a series of bytes from the stream straight into @buf,
+        which must be a writable object supporting the buffer protocol
+        such as a bytearray, a memoryview or an mmap. At most @nbytes
+        bytes are read, or len(buf) if @nbytes is omitted. This method
+        may block the calling application for an arbitrary amount
+        of time.
+
+        On success, the number of bytes received is returned, 0
+        meaning the end of the stream. On failure, an exception is
+        raised. If the stream is a NONBLOCK stream and the request
+        would block, integer -2 is returned.
+        """
+        ret = libvirtmod.virStreamRecvInto(self._o, buf, nbytes)
+        if ret is None: raise libvirtError ('virStreamRecvInto() failed')
+        return ret
+
     def send(self, data):
         """Write a series of bytes to the stream. This method may
         block the calling application for an arbitrary amount
@@ -121,6 +254,12 @@
         Errors are not guaranteed to be reported synchronously
         with the call, but may instead be delayed until a
         subsequent call.
+
+        @data may be any object supporting the buffer protocol, such
+        as bytes, a bytearray, a memoryview or an mmap. On success,
+        the number of bytes sent is returned, which may be less than
+        len(data). If the stream is a NONBLOCK stream and the request
+        would block, integer -2 is returned.
         """
         ret = libvirtmod.virStreamSend(self._o, data)
         if ret == -1: raise libvirtError ('virStreamSend() failed')
@@ -21,6 +21,12 @@
 #include <libvirt/libvirt.h>
 #include <libvirt/virterror.h>
 #include <stddef.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <strings.h>
+#include <ctype.h>
 #include "typewrappers.h"
 #include "build/libvirt.h"
 #include "libvirt-utils.h"
@@ -71,6 +77,127 @@ static char *py_str(PyObject *obj)
     return ret;
 }
 
+/* Process-wide intern table of typed parameter field names.  Stats and
+ * tunables report the same small set of field names over and over, so
+ * rather than creating a new string object for every parameter we hand
+ * out one interned object per name.  The table is also indexed by the
+ * address of that object, which lets the dict -> typed parameter
+ * conversions map keys handed back by the user straight to their C
+ * name.  Entries are never released.
+ *
+ * The table is not locked: its consistency relies entirely on the GIL,
+ * which every caller holds, and the key objects it hands out belong to
+ * the one interpreter the module can be executed in.  It has to move
+ * into module state, behind a lock, before the module can declare that
+ * it runs without the GIL or in several interpreters.  */
+#define VIR_PY_FIELD_CACHE_SIZE 512
+#define VIR_PY_FIELD_CACHE_MAX (VIR_PY_FIELD_CACHE_SIZE / 4 * 3)
+
+typedef struct {
+    char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+    PyObject *key;
+} virPyTypedParamField;
+typedef virPyTypedParamField *virPyTypedParamFieldPtr;
+
+static virPyTypedParamField fieldCache[VIR_PY_FIELD_CACHE_SIZE];
+static virPyTypedParamFieldPtr fieldCacheByKey[VIR_PY_FIELD_CACHE_SIZE];
+static size_t fieldCacheUsed;
+
+static size_t
+virPyTypedParamFieldHash(const char *field)
+{
+    size_t h = 2166136261U;
+
+    while (*field)
+        h = (h ^ (unsigned char) *field++) * 16777619U;
+
+    return h & (VIR_PY_FIELD_CACHE_SIZE - 1);
+}
+
+static size_t
+virPyTypedParamFieldKeyHash(PyObject *key)
+{
+    return ((size_t) key >> 4) & (VIR_PY_FIELD_CACHE_SIZE - 1);
+}
+
+/* Return a new reference to the interned string object for @field */
+static PyObject *
+libvirt_typedParamFieldWrap(const char *field)
+{
+    virPyTypedParamFieldPtr entry;
+    PyObject *key;
+    size_t h = virPyTypedParamFieldHash(field);
+
+    while (fieldCache[h].key) {
+        if (STREQ(fieldCache[h].field, field)) {
+            Py_INCREF(fieldCache[h].key);
+            return fieldCache[h].key;
+        }
+        h = (h + 1) & (VIR_PY_FIELD_CACHE_SIZE - 1);
+    }
+
+    if (!(key = libvirt_constcharPtrWrap(field)))
+        return NULL;
+
+    if (fieldCacheUsed >= VIR_PY_FIELD_CACHE_MAX ||
+        strlen(field) >= VIR_TYPED_PARAM_FIELD_LENGTH)
+        return key;
+
+#if PY_MAJOR_VERSION > 2
+    PyUnicode_InternInPlace(&key);
+#else
+    PyString_InternInPlace(&key);
+#endif
+
+    entry = &fieldCache[h];
+    strcpy(entry->field, field);
+    Py_INCREF(key);
+    entry->key = key;
+    fieldCacheUsed++;
+
+    h = virPyTypedParamFieldKeyHash(key);
+    while (fieldCacheByKey[h])
+        h = (h + 1) & (VIR_PY_FIELD_CACHE_SIZE - 1);
+    fieldCacheByKey[h] = entry;
+
+    return key;
+}
+
+/* Return the field name interned for the @key object, or NULL if @key
+ * did not come from the intern table */
+static const char *
+libvirt_typedParamFieldLookup(PyObject *key)
+{
+    size_t h = virPyTypedParamFieldKeyHash(key);
+
+    while (fieldCacheByKey[h]) {
+        if (fieldCacheByKey[h]->key == key)
+            return fieldCacheByKey[h]->field;
+        h = (h + 1) & (VIR_PY_FIELD_CACHE_SIZE - 1);
+    }
+
+    return NULL;
+}
+
+/* Convert a dict key into a typed parameter field name.  Interned keys
+ * are resolved without copying, otherwise the key is unwrapped into
+ * @keycopy which the caller must free.  Return NULL on failure, after
+ * raising a python exception.  */
+static const char *
+libvirt_typedParamFieldUnwrap(PyObject *key, char **keycopy)
+{
+    const char *field;
+
+    *keycopy = NULL;
+    if ((field = libvirt_typedParamFieldLookup(key)))
+        return field;
+
+    if (libvirt_charPtrUnwrap(key, keycopy) < 0)
+        return NULL;
+
+    return *keycopy;
+}
+
 /* Helper function to convert a virTypedParameter output array into a
  * Python dictionary for return to the user.  Return NULL on failure,
  * after raising a python exception.  */
@@ -123,7 +250,7 @@ getPyVirTypedParameter(const virTypedParameter *params, int nparams)
             break;
         }
 
-        key = libvirt_constcharPtrWrap(params[i].field);
+        key = libvirt_typedParamFieldWrap(params[i].field);
         if (!key || !val)
             goto cleanup;
 
@@ -143,11 +270,19 @@ cleanup:
     return NULL;
 }
 
+/* Whether a typed parameter value is given as a (type, value) tuple */
+static int
+libvirt_typedParamIsExplicit(PyObject *value)
+{
+    return PyTuple_Check(value) && PyTuple_GET_SIZE(value) == 2;
+}
+
 /* Allocate a new typed parameter array with the same contents and
  * length as info, and using the array params of length nparams as
- * hints on what types to use when creating the new array. The caller
- * must clear the array before freeing it. Return NULL on failure,
- * after raising a python exception.  */
+ * hints on what types to use when creating the new array.  Values
+ * given as a (type, value) tuple use their explicit type instead.
+ * The caller must clear the array before freeing it. Return NULL on
+ * failure, after raising a python exception.  */
 static virTypedParameterPtr ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2)
 setPyVirTypedParameter(PyObject *info,
                        const virTypedParameter *params, int nparams)
@@ -179,29 +314,39 @@ setPyVirTypedParameter(PyObject *info,
 
     temp = &ret[0];
     while (PyDict_Next(info, &pos, &key, &value)) {
-        char *keystr = NULL;
+        char *keycopy = NULL;
+        const char *keystr;
+        int type;
 
-        if (libvirt_charPtrUnwrap(key, &keystr) < 0 ||
-            keystr == NULL)
+        if (!(keystr = libvirt_typedParamFieldUnwrap(key, &keycopy)))
             goto cleanup;
 
-        for (i = 0; i < nparams; i++) {
-            if (STREQ(params[i].field, keystr))
-                break;
-        }
-        if (i == nparams) {
-            PyErr_Format(PyExc_LookupError,
-                         "Attribute name \"%s\" could not be recognized",
-                         keystr);
-            VIR_FREE(keystr);
-            goto cleanup;
+        if (libvirt_typedParamIsExplicit(value)) {
+            if (libvirt_intUnwrap(PyTuple_GET_ITEM(value, 0), &type) < 0) {
+                VIR_FREE(keycopy);
+                goto cleanup;
+            }
+            value = PyTuple_GET_ITEM(value, 1);
+        } else {
+            for (i = 0; i < nparams; i++) {
+                if (STREQ(params[i].field, keystr))
+                    break;
+            }
+            if (i == nparams) {
+                PyErr_Format(PyExc_LookupError,
+                             "Attribute name \"%s\" could not be recognized",
+                             keystr);
+                VIR_FREE(keycopy);
+                goto cleanup;
+            }
+            type = params[i].type;
         }
 
         strncpy(temp->field, keystr, VIR_TYPED_PARAM_FIELD_LENGTH - 1);
-        temp->type = params[i].type;
-        VIR_FREE(keystr);
+        temp->type = type;
+        VIR_FREE(keycopy);
 
-        switch (params[i].type) {
+        switch (type) {
         case VIR_TYPED_PARAM_INT:
             if (libvirt_intUnwrap(value, &temp->value.i) < 0)
                 goto cleanup;
@@ -250,7 +395,7 @@ setPyVirTypedParameter(PyObject *info,
              * don't recognize.  */
             PyErr_Format(PyExc_LookupError,
                          "Type value \"%d\" not recognized",
-                         params[i].type);
+                         type);
             goto cleanup;
         }
 
@@ -263,6 +408,101 @@ cleanup:
     return NULL;
 }
 
+/*
+ * Typed parameter schemas
+ *
+ * The Set*Parameters wrappers used to fetch the current parameters
+ * only to learn the type of each field they are given.  They now take
+ * an optional schema dict, kept per connection and parameter family by
+ * the python layer, mapping field names to their type: it is filled in
+ * from the parameters fetched the first time, and the fetch is skipped
+ * once all the fields being set are known.
+ */
+/* Convert info into a typed parameter array like setPyVirTypedParameter,
+ * using @schema for the field types.  Return 1 and set @new_params on
+ * success, 0 if some field isn't in @schema, or -1 on failure, after
+ * raising a python exception.  */
+static int
+setPyVirTypedParameterFromSchema(PyObject *info,
+                                 PyObject *schema,
+                                 virTypedParameterPtr *new_params)
+{
+    PyObject *key, *value, *type;
+#if PY_MAJOR_VERSION == 2 && PY_MINOR_VERSION <= 4
+    int pos = 0;
+#else
+    Py_ssize_t pos = 0;
+#endif
+    virTypedParameterPtr hints = NULL;
+    int nhints = 0;
+    int ret = -1;
+
+    *new_params = NULL;
+
+    if (!PyDict_Check(info) || (schema != Py_None && !PyDict_Check(schema)))
+        return 0;
+
+    if (VIR_ALLOC_N(hints, PyDict_Size(info) + 1) < 0) {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    while (PyDict_Next(info, &pos, &key, &value)) {
+        char *keycopy = NULL;
+        const char *keystr;
+
+        if (libvirt_typedParamIsExplicit(value))
+            continue;
+
+        if (schema == Py_None || !(type = PyDict_GetItem(schema, key))) {
+            ret = 0;
+            goto cleanup;
+        }
+
+        if (!(keystr = libvirt_typedParamFieldUnwrap(key, &keycopy)) ||
+            libvirt_intUnwrap(type, &hints[nhints].type) < 0) {
+            VIR_FREE(keycopy);
+            goto cleanup;
+        }
+        strncpy(hints[nhints].field, keystr, VIR_TYPED_PARAM_FIELD_LENGTH - 1);
+        nhints++;
+        VIR_FREE(keycopy);
+    }
+
+    if (!(*new_params = setPyVirTypedParameter(info, hints, nhints)))
+        goto cleanup;
+
+    ret = 1;
+
+ cleanup:
+    VIR_FREE(hints);
+    return ret;
+}
+
+/* Record the types of @params in @schema, if not None */
+static void
+libvirt_typedParamSchemaUpdate(PyObject *schema,
+                               const virTypedParameter *params,
+                               int nparams)
+{
+    PyObject *key, *type;
+    size_t i;
+
+    if (!PyDict_Check(schema))
+        return;
+
+    for (i = 0; i < nparams; i++) {
+        key = libvirt_typedParamFieldWrap(params[i].field);
+        type = libvirt_intWrap(params[i].type);
+
+        if (!key || !type || PyDict_SetItem(schema, key, type) < 0)
+            PyErr_Clear();
+
+        Py_XDECREF(key);
+        Py_XDECREF(type);
+    }
+}
+
 /* While these appeared in libvirt in 1.0.2, we only
  * need them in the python from 1.1.0 onwards */
 #if LIBVIR_CHECK_VERSION(1, 1, 0)
@@ -423,7 +663,8 @@ virPyDictToTypedParams(PyObject *dict,
     int n = 0;
     int max = 0;
     int ret = -1;
-    char *keystr = NULL;
+    char *keycopy = NULL;
+    const char *keystr;
 
     *ret_params = NULL;
     *ret_nparams = 0;
@@ -432,8 +673,7 @@ virPyDictToTypedParams(PyObject *dict,
         return -1;
 
     while (PyDict_Next(dict, &pos, &key, &value)) {
-        if (libvirt_charPtrUnwrap(key, &keystr) < 0 ||
-            !keystr)
+        if (!(keystr = libvirt_typedParamFieldUnwrap(key, &keycopy)))
             goto cleanup;
 
         if (PyList_Check(value) || PyTuple_Check(value)) {
@@ -449,7 +689,7 @@ virPyDictToTypedParams(PyObject *dict,
                                             hints, nhints, keystr, value) < 0)
             goto cleanup;
 
-        VIR_FREE(keystr);
+        VIR_FREE(keycopy);
     }
 
     *ret_params = params;
@@ -458,7 +698,7 @@ virPyDictToTypedParams(PyObject *dict,
     ret = 0;
 
 cleanup:
-    VIR_FREE(keystr);
+    VIR_FREE(keycopy);
     virTypedParamsFree(params, n);
     return ret;
 }
@@ -500,6 +740,201 @@ cleanup:
     return i_retval;
 }
 
+/*
+ * CPU maps are passed to python as a tuple or list with a bool per
+ * CPU by default.  Callers handling many of them can ask for libvirt's
+ * own layout instead, either as bytes or as an int whose bit N is set
+ * if CPU N is in the map, which saves creating an object per CPU.
+ * These values match the VIR_PYTHON_CPUMAP_* constants of the python
+ * module.
+ */
+enum {
+    VIR_PY_CPUMAP_TUPLE = 0,
+    VIR_PY_CPUMAP_BYTES = 1,
+    VIR_PY_CPUMAP_INT = 2,
+};
+
+static int
+libvirt_cpumapFormatCheck(int format)
+{
+    if (format < VIR_PY_CPUMAP_TUPLE || format > VIR_PY_CPUMAP_INT) {
+        PyErr_Format(PyExc_ValueError, "unknown cpumap format %d", format);
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject *
+libvirt_cpumapIntWrap(const unsigned char *cpumap,
+                      size_t cpumaplen)
+{
+    PyObject *ret = NULL, *word = NULL, *shift = NULL, *tmp;
+    size_t i = cpumaplen;
+    size_t n = cpumaplen % 8 ? cpumaplen % 8 : 8;
+    size_t j;
+
+    if (cpumaplen == 0)
+        return PyLong_FromLong(0);
+
+    if (!(shift = PyLong_FromLong(64)))
+        return NULL;
+
+    /* Build the number 64 bits at a time, most significant first */
+    while (i > 0) {
+        unsigned long long val = 0;
+
+        for (j = 0; j < n; j++)
+            val = (val << 8) | cpumap[i - 1 - j];
+        i -= n;
+        n = 8;
+
+        if (!(word = PyLong_FromUnsignedLongLong(val)))
+            goto error;
+
+        if (!ret) {
+            ret = word;
+            word = NULL;
+            continue;
+        }
+
+        if (!(tmp = PyNumber_Lshift(ret, shift)))
+            goto error;
+        Py_DECREF(ret);
+        ret = tmp;
+
+        if (!(tmp = PyNumber_Or(ret, word)))
+            goto error;
+        Py_DECREF(ret);
+        ret = tmp;
+        Py_CLEAR(word);
+    }
+
+    Py_DECREF(shift);
+    return ret;
+
+ error:
+    Py_XDECREF(ret);
+    Py_XDECREF(word);
+    Py_DECREF(shift);
+    return NULL;
+}
+
+/* Convert the map of @cpunum CPUs at @cpumap into the python @format,
+ * using a list rather than a tuple for VIR_PY_CPUMAP_TUPLE if @list */
+static PyObject *
+libvirt_cpumapWrap(const unsigned char *cpumap,
+                   size_t cpumaplen,
+                   int cpunum,
+                   int format,
+                   bool list)
+{
+    PyObject *ret, *item;
+    size_t i;
+
+    if (format == VIR_PY_CPUMAP_BYTES)
+        return libvirt_charPtrSizeWrap((char *) cpumap, cpumaplen);
+    if (format == VIR_PY_CPUMAP_INT)
+        return libvirt_cpumapIntWrap(cpumap, cpumaplen);
+
+    if (!(ret = list ? PyList_New(cpunum) : PyTuple_New(cpunum)))
+        return NULL;
+
+    for (i = 0; i < cpunum; i++) {
+        if (!(item = PyBool_FromLong(VIR_CPU_USED(cpumap, i)))) {
+            Py_DECREF(ret);
+            return NULL;
+        }
+        if (list)
+            PyList_SET_ITEM(ret, i, item);
+        else
+            PyTuple_SET_ITEM(ret, i, item);
+    }
+
+    return ret;
+}
+
+/* Fill the zeroed map @cpumap of @cpumaplen bytes from @pycpumap, a
+ * tuple of bools, bytes or an int.  Return 0 on success, or -1 after
+ * raising a python exception.  */
+static int
+libvirt_cpumapUnwrap(PyObject *pycpumap,
+                     unsigned char *cpumap,
+                     size_t cpumaplen)
+{
+    size_t i, j;
+
+    if (PyTuple_Check(pycpumap)) {
+        Py_ssize_t tuple_size = PyTuple_GET_SIZE(pycpumap);
+
+        for (i = 0; i < tuple_size && i < cpumaplen * 8; i++) {
+            bool b;
+
+            if (libvirt_boolUnwrap(PyTuple_GET_ITEM(pycpumap, i), &b) < 0)
+                return -1;
+
+            if (b)
+                VIR_USE_CPU(cpumap, i);
+        }
+        return 0;
+    }
+
+#if PY_MAJOR_VERSION > 2
+    if (PyBytes_Check(pycpumap)) {
+#else
+    if (PyString_Check(pycpumap)) {
+#endif
+        char *data;
+        Py_ssize_t size;
+
+        if (libvirt_charPtrSizeUnwrap(pycpumap, &data, &size) < 0)
+            return -1;
+        memcpy(cpumap, data, MIN(size, cpumaplen));
+        return 0;
+    }
+
+#if PY_MAJOR_VERSION == 2
+    if (PyInt_Check(pycpumap) || PyLong_Check(pycpumap)) {
+#else
+    if (PyLong_Check(pycpumap)) {
+#endif
+        PyObject *num, *shift, *tmp;
+        int ret = -1;
+
+        if (!(num = PyNumber_Long(pycpumap)))
+            return -1;
+        if (!(shift = PyLong_FromLong(64))) {
+            Py_DECREF(num);
+            return -1;
+        }
+
+        /* Bits past the end of the map are ignored, like extra bools */
+        for (i = 0; i < cpumaplen; i += 8) {
+            unsigned long long val = PyLong_AsUnsignedLongLongMask(num);
+
+            if (val == (unsigned long long) -1 && PyErr_Occurred())
+                goto cleanup;
+
+            for (j = 0; j < 8 && i + j < cpumaplen; j++)
+                cpumap[i + j] = (val >> (8 * j)) & 0xff;
+
+            if (!(tmp = PyNumber_Rshift(num, shift)))
+                goto cleanup;
+            Py_DECREF(num);
+            num = tmp;
+        }
+        ret = 0;
+
+     cleanup:
+        Py_DECREF(num);
+        Py_DECREF(shift);
+        return ret;
+    }
+
+    PyErr_SetString(PyExc_TypeError,
+                    "Unexpected type, tuple, bytes or int is required");
+    return -1;
+}
+
 /************************************************************************
  *									*
  *		Statistics						*
@@ -959,6 +1394,7 @@ libvirt_virDomainSetSchedulerParameters(PyObject *self ATTRIBUTE_UNUSED,
 {
     virDomainPtr domain;
     PyObject *pyobj_domain, *info;
+    PyObject *pyobj_schema = Py_None;
     PyObject *ret = NULL;
     char *c_retval;
     int i_retval;
@@ -966,8 +1402,9 @@ libvirt_virDomainSetSchedulerParameters(PyObject *self ATTRIBUTE_UNUSED,
     Py_ssize_t size = 0;
     virTypedParameterPtr params = NULL, new_params = NULL;
 
-    if (!PyArg_ParseTuple(args, (char *)"OO:virDomainSetScedulerParameters",
-                          &pyobj_domain, &info))
+    if (!PyArg_ParseTuple(args, (char *)"OO|O:virDomainSetScedulerParameters",
+                          &pyobj_domain, &info,
+                          &pyobj_schema))
         return NULL;
     domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
 
@@ -980,6 +1417,13 @@ libvirt_virDomainSetSchedulerParameters(PyObject *self ATTRIBUTE_UNUSED,
         return NULL;
     }
 
+    switch (setPyVirTypedParameterFromSchema(info, pyobj_schema, &new_params)) {
+    case -1:
+        return NULL;
+    case 1:
+        goto set;
+    }
+
     LIBVIRT_BEGIN_ALLOW_THREADS;
     c_retval = virDomainGetSchedulerType(domain, &nparams);
     LIBVIRT_END_ALLOW_THREADS;
@@ -1010,6 +1454,9 @@ libvirt_virDomainSetSchedulerParameters(PyObject *self ATTRIBUTE_UNUSED,
     if (!new_params)
         goto cleanup;
 
+    libvirt_typedParamSchemaUpdate(pyobj_schema, params, nparams);
+
+ set:
     LIBVIRT_BEGIN_ALLOW_THREADS;
     i_retval = virDomainSetSchedulerParameters(domain, new_params, size);
     LIBVIRT_END_ALLOW_THREADS;
@@ -1033,17 +1480,19 @@ libvirt_virDomainSetSchedulerParametersFlags(PyObject *self ATTRIBUTE_UNUSED,
 {
     virDomainPtr domain;
     PyObject *pyobj_domain, *info;
+    PyObject *pyobj_schema = Py_None;
     PyObject *ret = NULL;
     char *c_retval;
     int i_retval;
     int nparams = 0;
     Py_ssize_t size = 0;
     unsigned int flags;
-    virTypedParameterPtr params, new_params = NULL;
+    virTypedParameterPtr params = NULL, new_params = NULL;
 
     if (!PyArg_ParseTuple(args,
-                          (char *)"OOI:virDomainSetScedulerParametersFlags",
-                          &pyobj_domain, &info, &flags))
+                          (char *)"OOI|O:virDomainSetScedulerParametersFlags",
+                          &pyobj_domain, &info, &flags,
+                          &pyobj_schema))
         return NULL;
     domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
 
@@ -1056,6 +1505,13 @@ libvirt_virDomainSetSchedulerParametersFlags(PyObject *self ATTRIBUTE_UNUSED,
         return NULL;
     }
 
+    switch (setPyVirTypedParameterFromSchema(info, pyobj_schema, &new_params)) {
+    case -1:
+        return NULL;
+    case 1:
+        goto set;
+    }
+
     LIBVIRT_BEGIN_ALLOW_THREADS;
     c_retval = virDomainGetSchedulerType(domain, &nparams);
     LIBVIRT_END_ALLOW_THREADS;
@@ -1086,6 +1542,9 @@ libvirt_virDomainSetSchedulerParametersFlags(PyObject *self ATTRIBUTE_UNUSED,
     if (!new_params)
         goto cleanup;
 
+    libvirt_typedParamSchemaUpdate(pyobj_schema, params, nparams);
+
+ set:
     LIBVIRT_BEGIN_ALLOW_THREADS;
     i_retval = virDomainSetSchedulerParametersFlags(domain, new_params, size, flags);
     LIBVIRT_END_ALLOW_THREADS;
@@ -1099,7 +1558,7 @@ libvirt_virDomainSetSchedulerParametersFlags(PyObject *self ATTRIBUTE_UNUSED,
 
 cleanup:
     virTypedParamsFree(params, nparams);
-    virTypedParamsFree(new_params, nparams);
+    virTypedParamsFree(new_params, size);
     return ret;
 }
 
@@ -1109,6 +1568,7 @@ libvirt_virDomainSetBlkioParameters(PyObject *self ATTRIBUTE_UNUSED,
 {
     virDomainPtr domain;
     PyObject *pyobj_domain, *info;
+    PyObject *pyobj_schema = Py_None;
     PyObject *ret = NULL;
     int i_retval;
     int nparams = 0;
@@ -1117,8 +1577,9 @@ libvirt_virDomainSetBlkioParameters(PyObject *self ATTRIBUTE_UNUSED,
     virTypedParameterPtr params = NULL, new_params = NULL;
 
     if (!PyArg_ParseTuple(args,
-                          (char *)"OOI:virDomainSetBlkioParameters",
-                          &pyobj_domain, &info, &flags))
+                          (char *)"OOI|O:virDomainSetBlkioParameters",
+                          &pyobj_domain, &info, &flags,
+                          &pyobj_schema))
         return NULL;
     domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
 
@@ -1131,6 +1592,13 @@ libvirt_virDomainSetBlkioParameters(PyObject *self ATTRIBUTE_UNUSED,
         return NULL;
     }
 
+    switch (setPyVirTypedParameterFromSchema(info, pyobj_schema, &new_params)) {
+    case -1:
+        return NULL;
+    case 1:
+        goto set;
+    }
+
     LIBVIRT_BEGIN_ALLOW_THREADS;
     i_retval = virDomainGetBlkioParameters(domain, NULL, &nparams, flags);
     LIBVIRT_END_ALLOW_THREADS;
@@ -1160,6 +1628,9 @@ libvirt_virDomainSetBlkioParameters(PyObject *self ATTRIBUTE_UNUSED,
     if (!new_params)
         goto cleanup;
 
+    libvirt_typedParamSchemaUpdate(pyobj_schema, params, nparams);
+
+ set:
     LIBVIRT_BEGIN_ALLOW_THREADS;
     i_retval = virDomainSetBlkioParameters(domain, new_params, size, flags);
     LIBVIRT_END_ALLOW_THREADS;
@@ -1229,6 +1700,7 @@ libvirt_virDomainSetMemoryParameters(PyObject *self ATTRIBUTE_UNUSED,
 {
     virDomainPtr domain;
     PyObject *pyobj_domain, *info;
+    PyObject *pyobj_schema = Py_None;
     PyObject *ret = NULL;
     int i_retval;
     int nparams = 0;
@@ -1237,8 +1709,9 @@ libvirt_virDomainSetMemoryParameters(PyObject *self ATTRIBUTE_UNUSED,
     virTypedParameterPtr params = NULL, new_params = NULL;
 
     if (!PyArg_ParseTuple(args,
-                          (char *)"OOI:virDomainSetMemoryParameters",
-                          &pyobj_domain, &info, &flags))
+                          (char *)"OOI|O:virDomainSetMemoryParameters",
+                          &pyobj_domain, &info, &flags,
+                          &pyobj_schema))
         return NULL;
     domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
 
@@ -1251,6 +1724,13 @@ libvirt_virDomainSetMemoryParameters(PyObject *self ATTRIBUTE_UNUSED,
         return NULL;
     }
 
+    switch (setPyVirTypedParameterFromSchema(info, pyobj_schema, &new_params)) {
+    case -1:
+        return NULL;
+    case 1:
+        goto set;
+    }
+
     LIBVIRT_BEGIN_ALLOW_THREADS;
     i_retval = virDomainGetMemoryParameters(domain, NULL, &nparams, flags);
     LIBVIRT_END_ALLOW_THREADS;
@@ -1280,6 +1760,9 @@ libvirt_virDomainSetMemoryParameters(PyObject *self ATTRIBUTE_UNUSED,
     if (!new_params)
         goto cleanup;
 
+    libvirt_typedParamSchemaUpdate(pyobj_schema, params, nparams);
+
+ set:
     LIBVIRT_BEGIN_ALLOW_THREADS;
     i_retval = virDomainSetMemoryParameters(domain, new_params, size, flags);
     LIBVIRT_END_ALLOW_THREADS;
@@ -1349,6 +1832,7 @@ libvirt_virDomainSetNumaParameters(PyObject *self ATTRIBUTE_UNUSED,
 {
     virDomainPtr domain;
     PyObject *pyobj_domain, *info;
+    PyObject *pyobj_schema = Py_None;
     PyObject *ret = NULL;
     int i_retval;
     int nparams = 0;
@@ -1357,8 +1841,9 @@ libvirt_virDomainSetNumaParameters(PyObject *self ATTRIBUTE_UNUSED,
     virTypedParameterPtr params = NULL, new_params = NULL;
 
     if (!PyArg_ParseTuple(args,
-                          (char *)"OOI:virDomainSetNumaParameters",
-                          &pyobj_domain, &info, &flags))
+                          (char *)"OOI|O:virDomainSetNumaParameters",
+                          &pyobj_domain, &info, &flags,
+                          &pyobj_schema))
         return NULL;
     domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
 
@@ -1371,6 +1856,13 @@ libvirt_virDomainSetNumaParameters(PyObject *self ATTRIBUTE_UNUSED,
         return NULL;
     }
 
+    switch (setPyVirTypedParameterFromSchema(info, pyobj_schema, &new_params)) {
+    case -1:
+        return NULL;
+    case 1:
+        goto set;
+    }
+
     LIBVIRT_BEGIN_ALLOW_THREADS;
     i_retval = virDomainGetNumaParameters(domain, NULL, &nparams, flags);
     LIBVIRT_END_ALLOW_THREADS;
@@ -1400,6 +1892,9 @@ libvirt_virDomainSetNumaParameters(PyObject *self ATTRIBUTE_UNUSED,
     if (!new_params)
         goto cleanup;
 
+    libvirt_typedParamSchemaUpdate(pyobj_schema, params, nparams);
+
+ set:
     LIBVIRT_BEGIN_ALLOW_THREADS;
     i_retval = virDomainSetNumaParameters(domain, new_params, size, flags);
     LIBVIRT_END_ALLOW_THREADS;
@@ -1469,6 +1964,7 @@ libvirt_virDomainSetInterfaceParameters(PyObject *self ATTRIBUTE_UNUSED,
 {
     virDomainPtr domain;
     PyObject *pyobj_domain, *info;
+    PyObject *pyobj_schema = Py_None;
     PyObject *ret = NULL;
     int i_retval;
     int nparams = 0;
@@ -1478,8 +1974,9 @@ libvirt_virDomainSetInterfaceParameters(PyObject *self ATTRIBUTE_UNUSED,
     virTypedParameterPtr params = NULL, new_params = NULL;
 
     if (!PyArg_ParseTuple(args,
-                          (char *)"OzOI:virDomainSetInterfaceParameters",
-                          &pyobj_domain, &device, &info, &flags))
+                          (char *)"OzOI|O:virDomainSetInterfaceParameters",
+                          &pyobj_domain, &device, &info, &flags,
+                          &pyobj_schema))
         return NULL;
     domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
 
@@ -1492,6 +1989,13 @@ libvirt_virDomainSetInterfaceParameters(PyObject *self ATTRIBUTE_UNUSED,
         return NULL;
     }
 
+    switch (setPyVirTypedParameterFromSchema(info, pyobj_schema, &new_params)) {
+    case -1:
+        return NULL;
+    case 1:
+        goto set;
+    }
+
     LIBVIRT_BEGIN_ALLOW_THREADS;
     i_retval = virDomainGetInterfaceParameters(domain, device, NULL, &nparams, flags);
     LIBVIRT_END_ALLOW_THREADS;
@@ -1521,6 +2025,9 @@ libvirt_virDomainSetInterfaceParameters(PyObject *self ATTRIBUTE_UNUSED,
     if (!new_params)
         goto cleanup;
 
+    libvirt_typedParamSchemaUpdate(pyobj_schema, params, nparams);
+
+ set:
     LIBVIRT_BEGIN_ALLOW_THREADS;
     i_retval = virDomainSetInterfaceParameters(domain, device, new_params, size, flags);
     LIBVIRT_END_ALLOW_THREADS;
@@ -1597,12 +2104,16 @@ libvirt_virDomainGetVcpus(PyObject *self ATTRIBUTE_UNUSED,
     unsigned char *cpumap = NULL;
     size_t cpumaplen, i;
     int i_retval, cpunum;
+    int format = VIR_PY_CPUMAP_TUPLE;
 
-    if (!PyArg_ParseTuple(args, (char *)"O:virDomainGetVcpus",
-                          &pyobj_domain))
+    if (!PyArg_ParseTuple(args, (char *)"O|i:virDomainGetVcpus",
+                          &pyobj_domain, &format))
         return NULL;
     domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
 
+    if (libvirt_cpumapFormatCheck(format) < 0)
+        return NULL;
+
     if ((cpunum = getPyNodeCPUCount(virDomainGetConnect(domain))) < 0)
         return VIR_PY_INT_FAIL;
 
@@ -1673,19 +2184,10 @@ libvirt_virDomainGetVcpus(PyObject *self ATTRIBUTE_UNUSED,
             goto cleanup;
     }
     for (i = 0; i < dominfo.nrVirtCpu; i++) {
-        PyObject *info = PyTuple_New(cpunum);
-        size_t j;
+        PyObject *info = libvirt_cpumapWrap(VIR_GET_CPUMAP(cpumap, cpumaplen, i),
+                                            cpumaplen, cpunum, format, false);
         if (info == NULL)
             goto cleanup;
-        for (j = 0; j < cpunum; j++) {
-            PyObject *item = NULL;
-            if ((item = PyBool_FromLong(VIR_CPU_USABLE(cpumap, cpumaplen, i, j))) == NULL ||
-                PyTuple_SetItem(info, j, item) < 0) {
-                Py_DECREF(info);
-                Py_XDECREF(item);
-                goto cleanup;
-            }
-        }
         if (PyList_SetItem(pycpumap, i, info) < 0) {
             Py_DECREF(info);
             goto cleanup;
@@ -1718,8 +2220,7 @@ libvirt_virDomainPinVcpu(PyObject *self ATTRIBUTE_UNUSED,
     PyObject *pyobj_domain, *pycpumap;
     PyObject *ret = NULL;
     unsigned char *cpumap;
-    int cpumaplen, vcpu, tuple_size, cpunum;
-    size_t i;
+    int cpumaplen, vcpu, cpunum;
     int i_retval;
 
     if (!PyArg_ParseTuple(args, (char *)"OiO:virDomainPinVcpu",
@@ -1730,34 +2231,12 @@ libvirt_virDomainPinVcpu(PyObject *self ATTRIBUTE_UNUSED,
     if ((cpunum = getPyNodeCPUCount(virDomainGetConnect(domain))) < 0)
         return VIR_PY_INT_FAIL;
 
-    if (PyTuple_Check(pycpumap)) {
-        tuple_size = PyTuple_Size(pycpumap);
-        if (tuple_size == -1)
-            return ret;
-    } else {
-       PyErr_SetString(PyExc_TypeError, "Unexpected type, tuple is required");
-       return ret;
-    }
-
     cpumaplen = VIR_CPU_MAPLEN(cpunum);
     if (VIR_ALLOC_N(cpumap, cpumaplen) < 0)
         return PyErr_NoMemory();
 
-    for (i = 0; i < tuple_size; i++) {
-        PyObject *flag = PyTuple_GetItem(pycpumap, i);
-        bool b;
-
-        if (!flag || libvirt_boolUnwrap(flag, &b) < 0)
-            goto cleanup;
-
-        if (b)
-            VIR_USE_CPU(cpumap, i);
-        else
-            VIR_UNUSE_CPU(cpumap, i);
-    }
-
-    for (; i < cpunum; i++)
-        VIR_UNUSE_CPU(cpumap, i);
+    if (libvirt_cpumapUnwrap(pycpumap, cpumap, cpumaplen) < 0)
+        goto cleanup;
 
     LIBVIRT_BEGIN_ALLOW_THREADS;
     i_retval = virDomainPinVcpu(domain, vcpu, cpumap, cpumaplen);
@@ -1782,8 +2261,7 @@ libvirt_virDomainPinVcpuFlags(PyObject *self ATTRIBUTE_UNUSED,
     PyObject *pyobj_domain, *pycpumap;
     PyObject *ret = NULL;
     unsigned char *cpumap;
-    int cpumaplen, vcpu, tuple_size, cpunum;
-    size_t i;
+    int cpumaplen, vcpu, cpunum;
     unsigned int flags;
     int i_retval;
 
@@ -1795,34 +2273,12 @@ libvirt_virDomainPinVcpuFlags(PyObject *self ATTRIBUTE_UNUSED,
     if ((cpunum = getPyNodeCPUCount(virDomainGetConnect(domain))) < 0)
         return VIR_PY_INT_FAIL;
 
-    if (PyTuple_Check(pycpumap)) {
-        tuple_size = PyTuple_Size(pycpumap);
-        if (tuple_size == -1)
-            return ret;
-    } else {
-       PyErr_SetString(PyExc_TypeError, "Unexpected type, tuple is required");
-       return ret;
-    }
-
     cpumaplen = VIR_CPU_MAPLEN(cpunum);
     if (VIR_ALLOC_N(cpumap, cpumaplen) < 0)
         return PyErr_NoMemory();
 
-    for (i = 0; i < tuple_size; i++) {
-        PyObject *flag = PyTuple_GetItem(pycpumap, i);
-        bool b;
-
-        if (!flag || libvirt_boolUnwrap(flag, &b) < 0)
-            goto cleanup;
-
-        if (b)
-            VIR_USE_CPU(cpumap, i);
-        else
-            VIR_UNUSE_CPU(cpumap, i);
-    }
-
-    for (; i < cpunum; i++)
-        VIR_UNUSE_CPU(cpumap, i);
+    if (libvirt_cpumapUnwrap(pycpumap, cpumap, cpumaplen) < 0)
+        goto cleanup;
 
     LIBVIRT_BEGIN_ALLOW_THREADS;
     i_retval = virDomainPinVcpuFlags(domain, vcpu, cpumap, cpumaplen, flags);
@@ -1845,15 +2301,19 @@ libvirt_virDomainGetVcpuPinInfo(PyObject *self ATTRIBUTE_UNUSED,
     PyObject *pyobj_domain, *pycpumaps = NULL;
     virDomainInfo dominfo;
     unsigned char *cpumaps = NULL;
-    size_t cpumaplen, vcpu, pcpu;
+    size_t cpumaplen, vcpu;
     unsigned int flags;
     int i_retval, cpunum;
+    int format = VIR_PY_CPUMAP_TUPLE;
 
-    if (!PyArg_ParseTuple(args, (char *)"OI:virDomainGetVcpuPinInfo",
-                          &pyobj_domain, &flags))
+    if (!PyArg_ParseTuple(args, (char *)"OI|i:virDomainGetVcpuPinInfo",
+                          &pyobj_domain, &flags, &format))
         return NULL;
     domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
 
+    if (libvirt_cpumapFormatCheck(format) < 0)
+        return NULL;
+
     if ((cpunum = getPyNodeCPUCount(virDomainGetConnect(domain))) < 0)
         return VIR_PY_INT_FAIL;
 
@@ -1879,15 +2339,13 @@ libvirt_virDomainGetVcpuPinInfo(PyObject *self ATTRIBUTE_UNUSED,
         goto cleanup;
 
     for (vcpu = 0; vcpu < dominfo.nrVirtCpu; vcpu++) {
-        PyObject *mapinfo = PyTuple_New(cpunum);
+        PyObject *mapinfo = libvirt_cpumapWrap(VIR_GET_CPUMAP(cpumaps, cpumaplen,
+                                                              vcpu),
+                                               cpumaplen, cpunum, format, false);
         if (mapinfo == NULL)
             goto cleanup;
 
-        for (pcpu = 0; pcpu < cpunum; pcpu++) {
-            PyTuple_SetItem(mapinfo, pcpu,
-                            PyBool_FromLong(VIR_CPU_USABLE(cpumaps, cpumaplen, vcpu, pcpu)));
-        }
-        PyList_SetItem(pycpumaps, vcpu, mapinfo);
+        PyList_SET_ITEM(pycpumaps, vcpu, mapinfo);
     }
 
     VIR_FREE(cpumaps);
@@ -1911,8 +2369,7 @@ libvirt_virDomainPinEmulator(PyObject *self ATTRIBUTE_UNUSED,
     virDomainPtr domain;
     PyObject *pyobj_domain, *pycpumap;
     unsigned char *cpumap = NULL;
-    int cpumaplen, tuple_size, cpunum;
-    size_t i;
+    int cpumaplen, cpunum;
     int i_retval;
     unsigned int flags;
 
@@ -1927,35 +2384,14 @@ libvirt_virDomainPinEmulator(PyObject *self ATTRIBUTE_UNUSED,
 
     cpumaplen = VIR_CPU_MAPLEN(cpunum);
 
-    if (!PyTuple_Check(pycpumap)) {
-       PyErr_SetString(PyExc_TypeError, "Unexpected type, tuple is required");
-       return NULL;
-    }
-
-    if ((tuple_size = PyTuple_Size(pycpumap)) == -1)
-        return NULL;
-
     if (VIR_ALLOC_N(cpumap, cpumaplen) < 0)
         return PyErr_NoMemory();
 
-    for (i = 0; i < tuple_size; i++) {
-        PyObject *flag = PyTuple_GetItem(pycpumap, i);
-        bool b;
-
-        if (!flag || libvirt_boolUnwrap(flag, &b) < 0) {
-            VIR_FREE(cpumap);
-            return VIR_PY_INT_FAIL;
-        }
-
-        if (b)
-            VIR_USE_CPU(cpumap, i);
-        else
-            VIR_UNUSE_CPU(cpumap, i);
+    if (libvirt_cpumapUnwrap(pycpumap, cpumap, cpumaplen) < 0) {
+        VIR_FREE(cpumap);
+        return NULL;
     }
 
-    for (; i < cpunum; i++)
-        VIR_UNUSE_CPU(cpumap, i);
-
     LIBVIRT_BEGIN_ALLOW_THREADS;
     i_retval = virDomainPinEmulator(domain, cpumap, cpumaplen, flags);
     LIBVIRT_END_ALLOW_THREADS;
@@ -1978,17 +2414,20 @@ libvirt_virDomainGetEmulatorPinInfo(PyObject *self ATTRIBUTE_UNUSED,
     PyObject *pycpumap;
     unsigned char *cpumap;
     size_t cpumaplen;
-    size_t pcpu;
     unsigned int flags;
     int ret;
     int cpunum;
+    int format = VIR_PY_CPUMAP_TUPLE;
 
-    if (!PyArg_ParseTuple(args, (char *)"OI:virDomainEmulatorPinInfo",
-                          &pyobj_domain, &flags))
+    if (!PyArg_ParseTuple(args, (char *)"OI|i:virDomainEmulatorPinInfo",
+                          &pyobj_domain, &flags, &format))
         return NULL;
 
     domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
 
+    if (libvirt_cpumapFormatCheck(format) < 0)
+        return NULL;
+
     if ((cpunum = getPyNodeCPUCount(virDomainGetConnect(domain))) < 0)
         return VIR_PY_NONE;
 
@@ -2005,15 +2444,7 @@ libvirt_virDomainGetEmulatorPinInfo(PyObject *self ATTRIBUTE_UNUSED,
         return VIR_PY_NONE;
     }
 
-    if (!(pycpumap = PyTuple_New(cpunum))) {
-        VIR_FREE(cpumap);
-        return NULL;
-    }
-
-    for (pcpu = 0; pcpu < cpunum; pcpu++)
-        PyTuple_SET_ITEM(pycpumap, pcpu,
-                         PyBool_FromLong(VIR_CPU_USABLE(cpumap, cpumaplen,
-                                                        0, pcpu)));
+    pycpumap = libvirt_cpumapWrap(cpumap, cpumaplen, cpunum, format, false);
 
     VIR_FREE(cpumap);
     return pycpumap;
@@ -2031,14 +2462,18 @@ libvirt_virDomainGetIOThreadInfo(PyObject *self ATTRIBUTE_UNUSED,
     PyObject *py_iothrinfo = NULL;
     virDomainIOThreadInfoPtr *iothrinfo = NULL;
     unsigned int flags;
-    size_t pcpu, i;
+    size_t i;
     int niothreads, cpunum;
+    int format = VIR_PY_CPUMAP_TUPLE;
 
-    if (!PyArg_ParseTuple(args, (char *)"OI:virDomainGetIOThreadInfo",
-                          &pyobj_domain, &flags))
+    if (!PyArg_ParseTuple(args, (char *)"OI|i:virDomainGetIOThreadInfo",
+                          &pyobj_domain, &flags, &format))
         return NULL;
     domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
 
+    if (libvirt_cpumapFormatCheck(format) < 0)
+        return NULL;
+
     if ((cpunum = getPyNodeCPUCount(virDomainGetConnect(domain))) < 0)
         return VIR_PY_NONE;
 
@@ -2081,23 +2516,12 @@ libvirt_virDomainGetIOThreadInfo(PyObject *self ATTRIBUTE_UNUSED,
         }
 
         /* 1: CPU map */
-        if ((iothrmap = PyList_New(cpunum)) == NULL ||
+        if ((iothrmap = libvirt_cpumapWrap(iothr->cpumap, iothr->cpumaplen,
+                                           cpunum, format, true)) == NULL ||
             PyTuple_SetItem(iothrtpl, 1, iothrmap) < 0) {
             Py_XDECREF(iothrmap);
             goto cleanup;
         }
-        for (pcpu = 0; pcpu < cpunum; pcpu++) {
-            PyObject *pyused;
-            if ((pyused = PyBool_FromLong(VIR_CPU_USED(iothr->cpumap,
-                                                       pcpu))) == NULL) {
-                py_retval = VIR_PY_NONE;
-                goto cleanup;
-            }
-            if (PyList_SetItem(iothrmap, pcpu, pyused) < 0) {
-                Py_XDECREF(pyused);
-                goto cleanup;
-            }
-        }
     }
 
     py_retval = py_iothrinfo;
@@ -2121,8 +2545,7 @@ libvirt_virDomainPinIOThread(PyObject *self ATTRIBUTE_UNUSED,
     PyObject *pyobj_domain, *pycpumap;
     PyObject *ret = NULL;
     unsigned char *cpumap;
-    int cpumaplen, iothread_val, tuple_size, cpunum;
-    size_t i;
+    int cpumaplen, iothread_val, cpunum;
     unsigned int flags;
     int i_retval;
 
@@ -2134,33 +2557,12 @@ libvirt_virDomainPinIOThread(PyObject *self ATTRIBUTE_UNUSED,
     if ((cpunum = getPyNodeCPUCount(virDomainGetConnect(domain))) < 0)
         return VIR_PY_INT_FAIL;
 
-    if (PyTuple_Check(pycpumap)) {
-        if ((tuple_size = PyTuple_Size(pycpumap)) == -1)
-            return ret;
-    } else {
-        PyErr_SetString(PyExc_TypeError, "Unexpected type, tuple is required");
-        return ret;
-    }
-
     cpumaplen = VIR_CPU_MAPLEN(cpunum);
     if (VIR_ALLOC_N(cpumap, cpumaplen) < 0)
         return PyErr_NoMemory();
 
-    for (i = 0; i < tuple_size; i++) {
-        PyObject *flag = PyTuple_GetItem(pycpumap, i);
-        bool b;
-
-        if (!flag || libvirt_boolUnwrap(flag, &b) < 0)
-            goto cleanup;
-
-        if (b)
-            VIR_USE_CPU(cpumap, i);
-        else
-            VIR_UNUSE_CPU(cpumap, i);
-    }
-
-    for (; i < cpunum; i++)
-        VIR_UNUSE_CPU(cpumap, i);
+    if (libvirt_cpumapUnwrap(pycpumap, cpumap, cpumaplen) < 0)
+        goto cleanup;
 
     LIBVIRT_BEGIN_ALLOW_THREADS;
     i_retval = virDomainPinIOThread(domain, iothread_val,
@@ -2185,38 +2587,169 @@ cleanup:
  *									*
  ************************************************************************/
 
+/*
+ * The error handler and the event implementation are process wide in
+ * libvirt, and called from any thread.  The python objects backing
+ * them are only read and replaced with the GIL held.
+ */
 static PyObject *libvirt_virPythonErrorFuncHandler = NULL;
 static PyObject *libvirt_virPythonErrorFuncCtxt = NULL;
 
 static PyObject *
-libvirt_virGetLastError(PyObject *self ATTRIBUTE_UNUSED, PyObject *args ATTRIBUTE_UNUSED)
+libvirt_virErrorFieldWrap(virErrorPtr err, int field)
 {
-    virError *err;
-    PyObject *info;
+    switch (field) {
+    case 0:
+        return libvirt_intWrap((long) err->code);
+    case 1:
+        return libvirt_intWrap((long) err->domain);
+    case 2:
+        return libvirt_constcharPtrWrap(err->message);
+    case 3:
+        return libvirt_intWrap((long) err->level);
+    case 4:
+        return libvirt_constcharPtrWrap(err->str1);
+    case 5:
+        return libvirt_constcharPtrWrap(err->str2);
+    case 6:
+        return libvirt_constcharPtrWrap(err->str3);
+    case 7:
+        return libvirt_intWrap((long) err->int1);
+    case 8:
+        return libvirt_intWrap((long) err->int2);
+    }
+
+    PyErr_SetString(PyExc_IndexError, "error field out of range");
+    return NULL;
+}
 
-    if ((err = virGetLastError()) == NULL)
-        return VIR_PY_NONE;
+/* Returns the 9 fields of @err as a tuple, None on failure */
+static PyObject *
+libvirt_virErrorWrap(virErrorPtr err)
+{
+    PyObject *info;
+    int i;
 
     if ((info = PyTuple_New(9)) == NULL)
         return VIR_PY_NONE;
-    PyTuple_SetItem(info, 0, libvirt_intWrap((long) err->code));
-    PyTuple_SetItem(info, 1, libvirt_intWrap((long) err->domain));
-    PyTuple_SetItem(info, 2, libvirt_constcharPtrWrap(err->message));
-    PyTuple_SetItem(info, 3, libvirt_intWrap((long) err->level));
-    PyTuple_SetItem(info, 4, libvirt_constcharPtrWrap(err->str1));
-    PyTuple_SetItem(info, 5, libvirt_constcharPtrWrap(err->str2));
-    PyTuple_SetItem(info, 6, libvirt_constcharPtrWrap(err->str3));
-    PyTuple_SetItem(info, 7, libvirt_intWrap((long) err->int1));
-    PyTuple_SetItem(info, 8, libvirt_intWrap((long) err->int2));
+    for (i = 0; i < 9; i++)
+        PyTuple_SetItem(info, i, libvirt_virErrorFieldWrap(err, i));
 
     return info;
 }
 
+/*
+ * A copy of the last error kept by libvirtError, whose fields are only
+ * converted to python objects when asked for.
+ */
+#define VIR_PY_ERROR "virPyError"
+
+static void
+virPyErrorFree(virErrorPtr err)
+{
+    virResetError(err);
+    VIR_FREE(err);
+}
+
+static void
+libvirt_virPyErrorDestroy(void *ptr)
+{
+    virPyErrorFree(ptr);
+}
+
+static const virPyNativeType virPyErrorNative = {
+    VIR_PY_ERROR,
+    libvirt_virPyErrorDestroy,
+};
+
+static virErrorPtr
+libvirt_virPyErrorGet(PyObject *obj)
+{
+    return libvirt_nativeGet(obj, &virPyErrorNative);
+}
+
+/* Returns None if there is no last error, else a tuple of its copy and
+ * of its message, which is always needed for the exception */
+static PyObject *
+libvirt_virErrorCapture(PyObject *self ATTRIBUTE_UNUSED,
+                        PyObject *args ATTRIBUTE_UNUSED)
+{
+    virErrorPtr err;
+    PyObject *pyobj_err;
+
+    if (!virGetLastError())
+        return VIR_PY_NONE;
+
+    if (VIR_ALLOC(err) < 0)
+        return PyErr_NoMemory();
+    virCopyLastError(err);
+
+    pyobj_err = libvirt_nativeWrap(err, &virPyErrorNative);
+    if (!pyobj_err) {
+        virPyErrorFree(err);
+        return NULL;
+    }
+
+    return Py_BuildValue((char *) "(NN)", pyobj_err,
+                         libvirt_constcharPtrWrap(err->message));
+}
+
+static PyObject *
+libvirt_virErrorGetField(PyObject *self ATTRIBUTE_UNUSED,
+                         PyObject *args)
+{
+    PyObject *pyobj_err;
+    virErrorPtr err;
+    int field;
+
+    if (!PyArg_ParseTuple(args, (char *)"Oi:virErrorGetField",
+                          &pyobj_err, &field) ||
+        !(err = libvirt_virPyErrorGet(pyobj_err)))
+        return NULL;
+
+    return libvirt_virErrorFieldWrap(err, field);
+}
+
+static PyObject *
+libvirt_virErrorGetFields(PyObject *self ATTRIBUTE_UNUSED,
+                          PyObject *args)
+{
+    PyObject *pyobj_err;
+    virErrorPtr err;
+
+    if (!PyArg_ParseTuple(args, (char *)"O:virErrorGetFields", &pyobj_err) ||
+        !(err = libvirt_virPyErrorGet(pyobj_err)))
+        return NULL;
+
+    return libvirt_virErrorWrap(err);
+}
+
+/* Code of the last error, 0 if there is none, for the lookups which
+ * need to tell a missing object apart without raising anything */
+static PyObject *
+libvirt_virErrorLastCode(PyObject *self ATTRIBUTE_UNUSED,
+                         PyObject *args ATTRIBUTE_UNUSED)
+{
+    virErrorPtr err = virGetLastError();
+
+    return libvirt_intWrap(err ? (long) err->code : (long) VIR_ERR_OK);
+}
+
+static PyObject *
+libvirt_virGetLastError(PyObject *self ATTRIBUTE_UNUSED, PyObject *args ATTRIBUTE_UNUSED)
+{
+    virError *err;
+
+    if ((err = virGetLastError()) == NULL)
+        return VIR_PY_NONE;
+
+    return libvirt_virErrorWrap(err);
+}
+
 static PyObject *
 libvirt_virConnGetLastError(PyObject *self ATTRIBUTE_UNUSED, PyObject *args)
 {
     virError *err;
-    PyObject *info;
     virConnectPtr conn;
     PyObject *pyobj_conn;
 
@@ -2230,19 +2763,7 @@ libvirt_virConnGetLastError(PyObject *self ATTRIBUTE_UNUSED, PyObject *args)
     if (err == NULL)
         return VIR_PY_NONE;
 
-    if ((info = PyTuple_New(9)) == NULL)
-        return VIR_PY_NONE;
-    PyTuple_SetItem(info, 0, libvirt_intWrap((long) err->code));
-    PyTuple_SetItem(info, 1, libvirt_intWrap((long) err->domain));
-    PyTuple_SetItem(info, 2, libvirt_constcharPtrWrap(err->message));
-    PyTuple_SetItem(info, 3, libvirt_intWrap((long) err->level));
-    PyTuple_SetItem(info, 4, libvirt_constcharPtrWrap(err->str1));
-    PyTuple_SetItem(info, 5, libvirt_constcharPtrWrap(err->str2));
-    PyTuple_SetItem(info, 6, libvirt_constcharPtrWrap(err->str3));
-    PyTuple_SetItem(info, 7, libvirt_intWrap((long) err->int1));
-    PyTuple_SetItem(info, 8, libvirt_intWrap((long) err->int2));
-
-    return info;
+    return libvirt_virErrorWrap(err);
 }
 
 static void
@@ -2250,6 +2771,8 @@ libvirt_virErrorFuncHandler(ATTRIBUTE_UNUSED void *ctx, virErrorPtr err)
 {
     PyObject *list, *info;
     PyObject *result;
+    PyObject *handler;
+    PyObject *handlerCtxt;
 
     DEBUG("libvirt_virErrorFuncHandler(%p, %s, ...) called\n", ctx,
           err->message);
@@ -2257,31 +2780,36 @@ libvirt_virErrorFuncHandler(ATTRIBUTE_UNUSED void *ctx, virErrorPtr err)
     if ((err == NULL) || (err->code == VIR_ERR_OK))
         return;
 
+    /* Don't take the interpreter lock without a handler to call, it
+     * is checked again below with it held */
+    if (libvirt_virPythonErrorFuncHandler == NULL) {
+        virDefaultErrorFunc(err);
+        return;
+    }
+
     LIBVIRT_ENSURE_THREAD_STATE;
 
-    if ((libvirt_virPythonErrorFuncHandler == NULL) ||
-        (libvirt_virPythonErrorFuncHandler == Py_None)) {
+    /* The handler may replace itself while it runs */
+    handler = libvirt_virPythonErrorFuncHandler;
+    handlerCtxt = libvirt_virPythonErrorFuncCtxt;
+    Py_XINCREF(handler);
+    Py_XINCREF(handlerCtxt);
+
+    if ((handler == NULL) || (handler == Py_None)) {
         virDefaultErrorFunc(err);
+        Py_XDECREF(handlerCtxt);
     } else {
         list = PyTuple_New(2);
-        info = PyTuple_New(9);
-        PyTuple_SetItem(list, 0, libvirt_virPythonErrorFuncCtxt);
+        info = libvirt_virErrorWrap(err);
+        /* Steals the reference to handlerCtxt */
+        PyTuple_SetItem(list, 0, handlerCtxt);
         PyTuple_SetItem(list, 1, info);
-        Py_XINCREF(libvirt_virPythonErrorFuncCtxt);
-        PyTuple_SetItem(info, 0, libvirt_intWrap((long) err->code));
-        PyTuple_SetItem(info, 1, libvirt_intWrap((long) err->domain));
-        PyTuple_SetItem(info, 2, libvirt_constcharPtrWrap(err->message));
-        PyTuple_SetItem(info, 3, libvirt_intWrap((long) err->level));
-        PyTuple_SetItem(info, 4, libvirt_constcharPtrWrap(err->str1));
-        PyTuple_SetItem(info, 5, libvirt_constcharPtrWrap(err->str2));
-        PyTuple_SetItem(info, 6, libvirt_constcharPtrWrap(err->str3));
-        PyTuple_SetItem(info, 7, libvirt_intWrap((long) err->int1));
-        PyTuple_SetItem(info, 8, libvirt_intWrap((long) err->int2));
         /* TODO pass conn and dom if available */
-        result = PyEval_CallObject(libvirt_virPythonErrorFuncHandler, list);
+        result = PyEval_CallObject(handler, list);
         Py_XDECREF(list);
         Py_XDECREF(result);
     }
+    Py_XDECREF(handler);
 
     LIBVIRT_RELEASE_THREAD_STATE;
 }
@@ -2293,6 +2821,8 @@ libvirt_virRegisterErrorHandler(ATTRIBUTE_UNUSED PyObject * self,
     PyObject *py_retval;
     PyObject *pyobj_f;
     PyObject *pyobj_ctx;
+    PyObject *oldHandler = libvirt_virPythonErrorFuncHandler;
+    PyObject *oldCtxt = libvirt_virPythonErrorFuncCtxt;
 
     if (!PyArg_ParseTuple
         (args, (char *) "OO:xmlRegisterErrorHandler", &pyobj_f,
@@ -2303,12 +2833,6 @@ libvirt_virRegisterErrorHandler(ATTRIBUTE_UNUSED PyObject * self,
           pyobj_f);
 
     virSetErrorFunc(NULL, libvirt_virErrorFuncHandler);
-    if (libvirt_virPythonErrorFuncHandler != NULL) {
-        Py_XDECREF(libvirt_virPythonErrorFuncHandler);
-    }
-    if (libvirt_virPythonErrorFuncCtxt != NULL) {
-        Py_XDECREF(libvirt_virPythonErrorFuncCtxt);
-    }
 
     if ((pyobj_f == Py_None) && (pyobj_ctx == Py_None)) {
         libvirt_virPythonErrorFuncHandler = NULL;
@@ -2322,6 +2846,10 @@ libvirt_virRegisterErrorHandler(ATTRIBUTE_UNUSED PyObject * self,
         libvirt_virPythonErrorFuncCtxt = pyobj_ctx;
     }
 
+    /* Only release the previous handler once it can't be called */
+    Py_XDECREF(oldHandler);
+    Py_XDECREF(oldCtxt);
+
     py_retval = libvirt_intWrap(1);
     return py_retval;
 }
@@ -2635,6 +3163,323 @@ libvirt_virConnectListDomainsID(PyObject *self ATTRIBUTE_UNUSED,
     return py_retval;
 }
 
+#if LIBVIR_CHECK_VERSION(0, 9, 13)
+/*
+ * Lazy object lists
+ *
+ * The listAll* wrappers can return the array of object pointers they
+ * got from libvirt as is, held by a capsule, instead of a list of
+ * wrapped objects.  The python side then only wraps the elements which
+ * are accessed, and can list their names or UUIDs without wrapping
+ * anything, which matters for pools with many thousands of volumes.
+ */
+typedef enum {
+    VIR_PY_OBJECT_LIST_DOMAIN,
+    VIR_PY_OBJECT_LIST_DOMAIN_SNAPSHOT,
+    VIR_PY_OBJECT_LIST_NETWORK,
+    VIR_PY_OBJECT_LIST_INTERFACE,
+    VIR_PY_OBJECT_LIST_STORAGE_POOL,
+    VIR_PY_OBJECT_LIST_STORAGE_VOL,
+    VIR_PY_OBJECT_LIST_NODE_DEVICE,
+    VIR_PY_OBJECT_LIST_SECRET,
+    VIR_PY_OBJECT_LIST_NWFILTER,
+} virPyObjectListType;
+
+typedef struct {
+    int (*ref)(void *);
+    int (*free)(void *);
+    PyObject *(*wrap)(void *);
+    const char *(*name)(void *);
+    int (*uuid)(void *, char *);
+} virPyObjectListOps;
+
+/* The elements are held as void pointers, and handled through these
+ * per type wrappers rather than by calling the libvirt functions
+ * through pointers of another type */
+#define VIR_PY_OBJECT_LIST_THUNKS(type, getname)                        \
+static int                                                              \
+virPyObjectList##type##Ref(void *obj)                                   \
+{                                                                       \
+    return vir##type##Ref(obj);                                         \
+}                                                                       \
+                                                                        \
+static int                                                              \
+virPyObjectList##type##Free(void *obj)                                  \
+{                                                                       \
+    return vir##type##Free(obj);                                        \
+}                                                                       \
+                                                                        \
+static PyObject *                                                       \
+virPyObjectList##type##Wrap(void *obj)                                  \
+{                                                                       \
+    return libvirt_vir##type##PtrWrap(obj);                             \
+}                                                                       \
+                                                                        \
+static const char *                                                     \
+virPyObjectList##type##Name(void *obj)                                  \
+{                                                                       \
+    return getname(obj);                                                \
+}
+
+#define VIR_PY_OBJECT_LIST_UUID_THUNK(type)                             \
+static int                                                              \
+virPyObjectList##type##UUID(void *obj, char *buf)                       \
+{                                                                       \
+    return vir##type##GetUUIDString(obj, buf);                          \
+}
+
+VIR_PY_OBJECT_LIST_THUNKS(Domain, virDomainGetName)
+VIR_PY_OBJECT_LIST_THUNKS(DomainSnapshot, virDomainSnapshotGetName)
+VIR_PY_OBJECT_LIST_THUNKS(Network, virNetworkGetName)
+VIR_PY_OBJECT_LIST_THUNKS(Interface, virInterfaceGetName)
+VIR_PY_OBJECT_LIST_THUNKS(StoragePool, virStoragePoolGetName)
+VIR_PY_OBJECT_LIST_THUNKS(StorageVol, virStorageVolGetName)
+VIR_PY_OBJECT_LIST_THUNKS(NodeDevice, virNodeDeviceGetName)
+VIR_PY_OBJECT_LIST_THUNKS(Secret, virSecretGetUsageID)
+VIR_PY_OBJECT_LIST_THUNKS(NWFilter, virNWFilterGetName)
+VIR_PY_OBJECT_LIST_UUID_THUNK(Domain)
+VIR_PY_OBJECT_LIST_UUID_THUNK(Network)
+VIR_PY_OBJECT_LIST_UUID_THUNK(StoragePool)
+VIR_PY_OBJECT_LIST_UUID_THUNK(Secret)
+VIR_PY_OBJECT_LIST_UUID_THUNK(NWFilter)
+
+static const virPyObjectListOps virPyObjectListTypes[] = {
+    [VIR_PY_OBJECT_LIST_DOMAIN] = {
+        virPyObjectListDomainRef,
+        virPyObjectListDomainFree,
+        virPyObjectListDomainWrap,
+        virPyObjectListDomainName,
+        virPyObjectListDomainUUID,
+    },
+    [VIR_PY_OBJECT_LIST_DOMAIN_SNAPSHOT] = {
+        virPyObjectListDomainSnapshotRef,
+        virPyObjectListDomainSnapshotFree,
+        virPyObjectListDomainSnapshotWrap,
+        virPyObjectListDomainSnapshotName,
+        NULL,
+    },
+    [VIR_PY_OBJECT_LIST_NETWORK] = {
+        virPyObjectListNetworkRef,
+        virPyObjectListNetworkFree,
+        virPyObjectListNetworkWrap,
+        virPyObjectListNetworkName,
+        virPyObjectListNetworkUUID,
+    },
+    [VIR_PY_OBJECT_LIST_INTERFACE] = {
+        virPyObjectListInterfaceRef,
+        virPyObjectListInterfaceFree,
+        virPyObjectListInterfaceWrap,
+        virPyObjectListInterfaceName,
+        NULL,
+    },
+    [VIR_PY_OBJECT_LIST_STORAGE_POOL] = {
+        virPyObjectListStoragePoolRef,
+        virPyObjectListStoragePoolFree,
+        virPyObjectListStoragePoolWrap,
+        virPyObjectListStoragePoolName,
+        virPyObjectListStoragePoolUUID,
+    },
+    [VIR_PY_OBJECT_LIST_STORAGE_VOL] = {
+        virPyObjectListStorageVolRef,
+        virPyObjectListStorageVolFree,
+        virPyObjectListStorageVolWrap,
+        virPyObjectListStorageVolName,
+        NULL,
+    },
+    [VIR_PY_OBJECT_LIST_NODE_DEVICE] = {
+        virPyObjectListNodeDeviceRef,
+        virPyObjectListNodeDeviceFree,
+        virPyObjectListNodeDeviceWrap,
+        virPyObjectListNodeDeviceName,
+        NULL,
+    },
+    [VIR_PY_OBJECT_LIST_SECRET] = {
+        virPyObjectListSecretRef,
+        virPyObjectListSecretFree,
+        virPyObjectListSecretWrap,
+        virPyObjectListSecretName,
+        virPyObjectListSecretUUID,
+    },
+    [VIR_PY_OBJECT_LIST_NWFILTER] = {
+        virPyObjectListNWFilterRef,
+        virPyObjectListNWFilterFree,
+        virPyObjectListNWFilterWrap,
+        virPyObjectListNWFilterName,
+        virPyObjectListNWFilterUUID,
+    },
+};
+
+typedef struct {
+    const virPyObjectListOps *ops;
+    void **objs;
+    size_t nobjs;
+} virPyObjectList;
+typedef virPyObjectList *virPyObjectListPtr;
+
+#define VIR_PY_OBJECT_LIST "virPyObjectList"
+
+static void
+virPyObjectListFree(virPyObjectListPtr list)
+{
+    size_t i;
+
+    for (i = 0; i < list->nobjs; i++)
+        list->ops->free(list->objs[i]);
+    VIR_FREE(list->objs);
+    VIR_FREE(list);
+}
+
+static void
+libvirt_virPyObjectListDestroy(void *ptr)
+{
+    virPyObjectListFree(ptr);
+}
+
+static const virPyNativeType virPyObjectListNative = {
+    VIR_PY_OBJECT_LIST,
+    libvirt_virPyObjectListDestroy,
+};
+
+/* Wrap the array @objs of @nobjs objects of @type, which is stolen
+ * even on failure */
+static PyObject *
+libvirt_virPyObjectListWrap(virPyObjectListType type,
+                            void **objs,
+                            size_t nobjs)
+{
+    virPyObjectListPtr list;
+    PyObject *ret;
+    size_t i;
+
+    if (VIR_ALLOC(list) < 0) {
+        for (i = 0; i < nobjs; i++)
+            virPyObjectListTypes[type].free(objs[i]);
+        VIR_FREE(objs);
+        return PyErr_NoMemory();
+    }
+    list->ops = &virPyObjectListTypes[type];
+    list->objs = objs;
+    list->nobjs = nobjs;
+
+    ret = libvirt_nativeWrap(list, &virPyObjectListNative);
+    if (!ret)
+        virPyObjectListFree(list);
+    return ret;
+}
+
+static virPyObjectListPtr
+libvirt_virPyObjectListGet(PyObject *obj)
+{
+    return libvirt_nativeGet(obj, &virPyObjectListNative);
+}
+
+static PyObject *
+libvirt_virObjectListLength(PyObject *self ATTRIBUTE_UNUSED,
+                            PyObject *args)
+{
+    PyObject *pyobj_list;
+    virPyObjectListPtr list;
+
+    if (!PyArg_ParseTuple(args, (char *)"O:virObjectListLength", &pyobj_list) ||
+        !(list = libvirt_virPyObjectListGet(pyobj_list)))
+        return NULL;
+
+    return libvirt_ulonglongWrap(list->nobjs);
+}
+
+static PyObject *
+libvirt_virObjectListItem(PyObject *self ATTRIBUTE_UNUSED,
+                          PyObject *args)
+{
+    PyObject *pyobj_list;
+    PyObject *ret;
+    virPyObjectListPtr list;
+    Py_ssize_t idx;
+
+    if (!PyArg_ParseTuple(args, (char *)"On:virObjectListItem",
+                          &pyobj_list, &idx) ||
+        !(list = libvirt_virPyObjectListGet(pyobj_list)))
+        return NULL;
+
+    if (idx < 0 || (size_t) idx >= list->nobjs) {
+        PyErr_SetString(PyExc_IndexError, "list index out of range");
+        return NULL;
+    }
+
+    /* The wrapper steals a reference, the list keeps its own */
+    list->ops->ref(list->objs[idx]);
+    if (!(ret = list->ops->wrap(list->objs[idx])))
+        list->ops->free(list->objs[idx]);
+    return ret;
+}
+
+static PyObject *
+libvirt_virObjectListNames(PyObject *self ATTRIBUTE_UNUSED,
+                           PyObject *args)
+{
+    PyObject *pyobj_list;
+    PyObject *py_retval;
+    PyObject *item;
+    virPyObjectListPtr list;
+    size_t i;
+
+    if (!PyArg_ParseTuple(args, (char *)"O:virObjectListNames", &pyobj_list) ||
+        !(list = libvirt_virPyObjectListGet(pyobj_list)))
+        return NULL;
+
+    if (!(py_retval = PyList_New(list->nobjs)))
+        return NULL;
+
+    for (i = 0; i < list->nobjs; i++) {
+        if (!(item = libvirt_constcharPtrWrap(list->ops->name(list->objs[i])))) {
+            Py_DECREF(py_retval);
+            return NULL;
+        }
+        PyList_SET_ITEM(py_retval, i, item);
+    }
+
+    return py_retval;
+}
+
+static PyObject *
+libvirt_virObjectListUUIDs(PyObject *self ATTRIBUTE_UNUSED,
+                           PyObject *args)
+{
+    PyObject *pyobj_list;
+    PyObject *py_retval;
+    PyObject *item;
+    virPyObjectListPtr list;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    size_t i;
+
+    if (!PyArg_ParseTuple(args, (char *)"O:virObjectListUUIDs", &pyobj_list) ||
+        !(list = libvirt_virPyObjectListGet(pyobj_list)))
+        return NULL;
+
+    if (!list->ops->uuid) {
+        PyErr_SetString(PyExc_TypeError, "these objects have no UUID");
+        return NULL;
+    }
+
+    if (!(py_retval = PyList_New(list->nobjs)))
+        return NULL;
+
+    for (i = 0; i < list->nobjs; i++) {
+        if (list->ops->uuid(list->objs[i], uuidstr) < 0) {
+            Py_DECREF(py_retval);
+            return VIR_PY_NONE;
+        }
+        if (!(item = libvirt_constcharPtrWrap(uuidstr))) {
+            Py_DECREF(py_retval);
+            return NULL;
+        }
+        PyList_SET_ITEM(py_retval, i, item);
+    }
+
+    return py_retval;
+}
+#endif /* LIBVIR_CHECK_VERSION(0, 9, 13) */
+
 #if LIBVIR_CHECK_VERSION(0, 9, 13)
 static PyObject *
 libvirt_virConnectListAllDomains(PyObject *self ATTRIBUTE_UNUSED,
@@ -2648,9 +3493,10 @@ libvirt_virConnectListAllDomains(PyObject *self ATTRIBUTE_UNUSED,
     int c_retval = 0;
     size_t i;
     unsigned int flags;
+    int lazy = 0;
 
-    if (!PyArg_ParseTuple(args, (char *)"OI:virConnectListAllDomains",
-                          &pyobj_conn, &flags))
+    if (!PyArg_ParseTuple(args, (char *)"OI|i:virConnectListAllDomains",
+                          &pyobj_conn, &flags, &lazy))
         return NULL;
     conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
 
@@ -2660,6 +3506,10 @@ libvirt_virConnectListAllDomains(PyObject *self ATTRIBUTE_UNUSED,
     if (c_retval < 0)
         return VIR_PY_NONE;
 
+    if (lazy)
+        return libvirt_virPyObjectListWrap(VIR_PY_OBJECT_LIST_DOMAIN,
+                                           (void **) doms, c_retval);
+
     if (!(py_retval = PyList_New(c_retval)))
         goto cleanup;
 
@@ -2798,10 +3648,11 @@ libvirt_virDomainListAllSnapshots(PyObject *self ATTRIBUTE_UNUSED,
     virDomainPtr dom;
     PyObject *pyobj_dom;
     unsigned int flags;
+    int lazy = 0;
     PyObject *pyobj_snap;
 
-    if (!PyArg_ParseTuple(args, (char *)"OI:virDomainListAllSnapshots",
-                          &pyobj_dom, &flags))
+    if (!PyArg_ParseTuple(args, (char *)"OI|i:virDomainListAllSnapshots",
+                          &pyobj_dom, &flags, &lazy))
         return NULL;
     dom = (virDomainPtr) PyvirDomain_Get(pyobj_dom);
 
@@ -2811,6 +3662,10 @@ libvirt_virDomainListAllSnapshots(PyObject *self ATTRIBUTE_UNUSED,
     if (c_retval < 0)
         return VIR_PY_NONE;
 
+    if (lazy)
+        return libvirt_virPyObjectListWrap(VIR_PY_OBJECT_LIST_DOMAIN_SNAPSHOT,
+                                           (void **) snaps, c_retval);
+
     if (!(py_retval = PyList_New(c_retval)))
         goto cleanup;
 
@@ -2901,10 +3756,11 @@ libvirt_virDomainSnapshotListAllChildren(PyObject *self ATTRIBUTE_UNUSED,
     virDomainSnapshotPtr parent;
     PyObject *pyobj_parent;
     unsigned int flags;
+    int lazy = 0;
     PyObject *pyobj_snap;
 
-    if (!PyArg_ParseTuple(args, (char *)"OI:virDomainSnapshotListAllChildren",
-                          &pyobj_parent, &flags))
+    if (!PyArg_ParseTuple(args, (char *)"OI|i:virDomainSnapshotListAllChildren",
+                          &pyobj_parent, &flags, &lazy))
         return NULL;
     parent = (virDomainSnapshotPtr) PyvirDomainSnapshot_Get(pyobj_parent);
 
@@ -2914,6 +3770,10 @@ libvirt_virDomainSnapshotListAllChildren(PyObject *self ATTRIBUTE_UNUSED,
     if (c_retval < 0)
         return VIR_PY_NONE;
 
+    if (lazy)
+        return libvirt_virPyObjectListWrap(VIR_PY_OBJECT_LIST_DOMAIN_SNAPSHOT,
+                                           (void **) snaps, c_retval);
+
     if (!(py_retval = PyList_New(c_retval)))
         goto cleanup;
 
@@ -2987,7 +3847,7 @@ libvirt_virDomainGetInfo(PyObject *self ATTRIBUTE_UNUSED, PyObject *args) {
 }
 
 static PyObject *
-libvirt_virDomainGetState(PyObject *self ATTRIBUTE_UNUSED, PyObject *args)
+libvirt_virDomainGetState(PyObject *self ATTRIBUTE_UNUSED, LIBVIRT_FASTCALL_ARGS)
 {
     PyObject *py_retval;
     int c_retval;
@@ -2997,9 +3857,16 @@ libvirt_virDomainGetState(PyObject *self ATTRIBUTE_UNUSED, PyObject *args)
     int reason;
     unsigned int flags;
 
+#if LIBVIRT_HAVE_FASTCALL
+    if (libvirt_fastcallArgsCheck("virDomainGetState", nargs, 2) < 0 ||
+        libvirt_fastcallUintUnwrap(args[1], &flags) < 0)
+        return NULL;
+    pyobj_domain = args[0];
+#else
     if (!PyArg_ParseTuple(args, (char *)"OI:virDomainGetState",
                           &pyobj_domain, &flags))
         return NULL;
+#endif
 
     domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
 
@@ -3383,9 +4250,10 @@ libvirt_virConnectListAllNetworks(PyObject *self ATTRIBUTE_UNUSED,
     int c_retval = 0;
     size_t i;
     unsigned int flags;
+    int lazy = 0;
 
-    if (!PyArg_ParseTuple(args, (char *)"OI:virConnectListAllNetworks",
-                          &pyobj_conn, &flags))
+    if (!PyArg_ParseTuple(args, (char *)"OI|i:virConnectListAllNetworks",
+                          &pyobj_conn, &flags, &lazy))
         return NULL;
     conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
 
@@ -3395,6 +4263,10 @@ libvirt_virConnectListAllNetworks(PyObject *self ATTRIBUTE_UNUSED,
     if (c_retval < 0)
         return VIR_PY_NONE;
 
+    if (lazy)
+        return libvirt_virPyObjectListWrap(VIR_PY_OBJECT_LIST_NETWORK,
+                                           (void **) nets, c_retval);
+
     if (!(py_retval = PyList_New(c_retval)))
         goto cleanup;
 
@@ -3619,7 +4491,7 @@ libvirt_virNodeGetCPUStats(PyObject *self ATTRIBUTE_UNUSED, PyObject *args)
         goto error;
 
     for (i = 0; i < nparams; i++) {
-        key = libvirt_constcharPtrWrap(stats[i].field);
+        key = libvirt_typedParamFieldWrap(stats[i].field);
         val = libvirt_ulonglongWrap(stats[i].value);
 
         if (!key || !val || PyDict_SetItem(ret, key, val) < 0) {
@@ -3683,7 +4555,7 @@ libvirt_virNodeGetMemoryStats(PyObject *self ATTRIBUTE_UNUSED, PyObject *args)
         goto error;
 
     for (i = 0; i < nparams; i++) {
-        key = libvirt_constcharPtrWrap(stats[i].field);
+        key = libvirt_typedParamFieldWrap(stats[i].field);
         val = libvirt_ulonglongWrap(stats[i].value);
 
         if (!key || !val || PyDict_SetItem(ret, key, val) < 0) {
@@ -3826,9 +4698,10 @@ libvirt_virConnectListAllStoragePools(PyObject *self ATTRIBUTE_UNUSED,
     int c_retval = 0;
     size_t i;
     unsigned int flags;
+    int lazy = 0;
 
-    if (!PyArg_ParseTuple(args, (char *)"OI:virConnectListAllStoragePools",
-                          &pyobj_conn, &flags))
+    if (!PyArg_ParseTuple(args, (char *)"OI|i:virConnectListAllStoragePools",
+                          &pyobj_conn, &flags, &lazy))
         return NULL;
     conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
 
@@ -3838,6 +4711,10 @@ libvirt_virConnectListAllStoragePools(PyObject *self ATTRIBUTE_UNUSED,
     if (c_retval < 0)
         return VIR_PY_NONE;
 
+    if (lazy)
+        return libvirt_virPyObjectListWrap(VIR_PY_OBJECT_LIST_STORAGE_POOL,
+                                           (void **) pools, c_retval);
+
     if (!(py_retval = PyList_New(c_retval)))
         goto cleanup;
 
@@ -3927,10 +4804,11 @@ libvirt_virStoragePoolListAllVolumes(PyObject *self ATTRIBUTE_UNUSED,
     int c_retval = 0;
     size_t i;
     unsigned int flags;
+    int lazy = 0;
     PyObject *pyobj_pool;
 
-    if (!PyArg_ParseTuple(args, (char *)"OI:virStoragePoolListAllVolumes",
-                          &pyobj_pool, &flags))
+    if (!PyArg_ParseTuple(args, (char *)"OI|i:virStoragePoolListAllVolumes",
+                          &pyobj_pool, &flags, &lazy))
         return NULL;
 
     pool = (virStoragePoolPtr) PyvirStoragePool_Get(pyobj_pool);
@@ -3941,6 +4819,10 @@ libvirt_virStoragePoolListAllVolumes(PyObject *self ATTRIBUTE_UNUSED,
     if (c_retval < 0)
         return VIR_PY_NONE;
 
+    if (lazy)
+        return libvirt_virPyObjectListWrap(VIR_PY_OBJECT_LIST_STORAGE_VOL,
+                                           (void **) vols, c_retval);
+
     if (!(py_retval = PyList_New(c_retval)))
         goto cleanup;
 
@@ -4184,9 +5066,10 @@ libvirt_virConnectListAllNodeDevices(PyObject *self ATTRIBUTE_UNUSED,
     int c_retval = 0;
     size_t i;
     unsigned int flags;
+    int lazy = 0;
 
-    if (!PyArg_ParseTuple(args, (char *)"OI:virConnectListAllNodeDevices",
-                          &pyobj_conn, &flags))
+    if (!PyArg_ParseTuple(args, (char *)"OI|i:virConnectListAllNodeDevices",
+                          &pyobj_conn, &flags, &lazy))
         return NULL;
     conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
 
@@ -4196,6 +5079,10 @@ libvirt_virConnectListAllNodeDevices(PyObject *self ATTRIBUTE_UNUSED,
     if (c_retval < 0)
         return VIR_PY_NONE;
 
+    if (lazy)
+        return libvirt_virPyObjectListWrap(VIR_PY_OBJECT_LIST_NODE_DEVICE,
+                                           (void **) devices, c_retval);
+
     if (!(py_retval = PyList_New(c_retval)))
         goto cleanup;
 
@@ -4397,9 +5284,10 @@ libvirt_virConnectListAllSecrets(PyObject *self ATTRIBUTE_UNUSED,
     int c_retval = 0;
     size_t i;
     unsigned int flags;
+    int lazy = 0;
 
-    if (!PyArg_ParseTuple(args, (char *)"OI:virConnectListAllSecrets",
-                          &pyobj_conn, &flags))
+    if (!PyArg_ParseTuple(args, (char *)"OI|i:virConnectListAllSecrets",
+                          &pyobj_conn, &flags, &lazy))
         return NULL;
     conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
 
@@ -4409,6 +5297,10 @@ libvirt_virConnectListAllSecrets(PyObject *self ATTRIBUTE_UNUSED,
     if (c_retval < 0)
         return VIR_PY_NONE;
 
+    if (lazy)
+        return libvirt_virPyObjectListWrap(VIR_PY_OBJECT_LIST_SECRET,
+                                           (void **) secrets, c_retval);
+
     if (!(py_retval = PyList_New(c_retval)))
         goto cleanup;
 
@@ -4619,9 +5511,10 @@ libvirt_virConnectListAllNWFilters(PyObject *self ATTRIBUTE_UNUSED,
     int c_retval = 0;
     size_t i;
     unsigned int flags;
+    int lazy = 0;
 
-    if (!PyArg_ParseTuple(args, (char *)"OI:virConnectListAllNWFilters",
-                          &pyobj_conn, &flags))
+    if (!PyArg_ParseTuple(args, (char *)"OI|i:virConnectListAllNWFilters",
+                          &pyobj_conn, &flags, &lazy))
         return NULL;
     conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
 
@@ -4631,6 +5524,10 @@ libvirt_virConnectListAllNWFilters(PyObject *self ATTRIBUTE_UNUSED,
     if (c_retval < 0)
         return VIR_PY_NONE;
 
+    if (lazy)
+        return libvirt_virPyObjectListWrap(VIR_PY_OBJECT_LIST_NWFILTER,
+                                           (void **) filters, c_retval);
+
     if (!(py_retval = PyList_New(c_retval)))
         goto cleanup;
 
@@ -4777,9 +5674,10 @@ libvirt_virConnectListAllInterfaces(PyObject *self ATTRIBUTE_UNUSED,
     int c_retval = 0;
     size_t i;
     unsigned int flags;
+    int lazy = 0;
 
-    if (!PyArg_ParseTuple(args, (char *)"OI:virConnectListAllInterfaces",
-                          &pyobj_conn, &flags))
+    if (!PyArg_ParseTuple(args, (char *)"OI|i:virConnectListAllInterfaces",
+                          &pyobj_conn, &flags, &lazy))
         return NULL;
     conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
 
@@ -4789,6 +5687,10 @@ libvirt_virConnectListAllInterfaces(PyObject *self ATTRIBUTE_UNUSED,
     if (c_retval < 0)
         return VIR_PY_NONE;
 
+    if (lazy)
+        return libvirt_virPyObjectListWrap(VIR_PY_OBJECT_LIST_INTERFACE,
+                                           (void **) ifaces, c_retval);
+
     if (!(py_retval = PyList_New(c_retval)))
         goto cleanup;
 
@@ -4945,6 +5847,546 @@ cleanup:
 }
 #endif /* LIBVIR_CHECK_VERSION(1, 0, 3) */
 
+#if LIBVIR_CHECK_VERSION(1, 2, 9)
+/*
+ * Job progress monitor
+ *
+ * Polls virDomainGetJobStats from a native thread, keeping only the
+ * fields it needs in a virPyJobProgress, and only takes the interpreter
+ * lock to call python back when the job stalls, the memory dirty rate
+ * goes over a threshold, the monitor escalates a migration which does
+ * so, or the job ends.
+ */
+enum {
+    VIR_PY_JOB_MONITOR_STALLED = 1,
+    VIR_PY_JOB_MONITOR_DIRTY_RATE = 2,
+    VIR_PY_JOB_MONITOR_DOWNTIME = 3,
+    VIR_PY_JOB_MONITOR_POSTCOPY = 4,
+    VIR_PY_JOB_MONITOR_COMPLETED = 5,
+};
+
+typedef struct {
+    int type;
+    unsigned long long timeElapsed;
+    unsigned long long dataTotal;
+    unsigned long long dataProcessed;
+    unsigned long long dataRemaining;
+    unsigned long long memDirtyRate;
+    unsigned long long memIteration;
+    unsigned long long downtime;    /* last one set by the monitor */
+    unsigned int stalls;
+    bool postcopy;
+} virPyJobProgress;
+
+typedef struct {
+    PyThread_type_lock lock;        /* protects refs, stopped, completed
+                                     * and progress */
+    PyThread_type_lock wakeup;      /* held until the monitor is stopped */
+    int refs;
+    bool stopped;
+    bool completed;                 /* the end of the job was reported */
+    virDomainPtr dom;
+    PyObject *cb;                   /* protected by the GIL */
+    unsigned long long interval;    /* all times in milliseconds */
+    unsigned long long stallTime;
+    unsigned long long dirtyRate;
+    unsigned long long *downtimes;
+    size_t ndowntimes;
+    bool postcopy;
+    virPyJobProgress progress;
+} virPyJobMonitor;
+typedef virPyJobMonitor *virPyJobMonitorPtr;
+
+#define VIR_PY_JOB_MONITOR "virPyJobMonitor"
+
+static void
+virPyJobMonitorFree(virPyJobMonitorPtr mon)
+{
+    if (mon->dom)
+        virDomainFree(mon->dom);
+    VIR_FREE(mon->downtimes);
+    if (mon->wakeup)
+        PyThread_free_lock(mon->wakeup);
+    if (mon->lock)
+        PyThread_free_lock(mon->lock);
+    VIR_FREE(mon);
+}
+
+/* Drop a reference, with mon->lock held, which this releases */
+static void
+virPyJobMonitorUnref(virPyJobMonitorPtr mon)
+{
+    if (libvirt_unrefLocked(mon->lock, &mon->refs))
+        virPyJobMonitorFree(mon);
+}
+
+/* Stop @mon and drop its callback, with the GIL held */
+static void
+virPyJobMonitorStop(virPyJobMonitorPtr mon)
+{
+    PyThread_acquire_lock(mon->lock, WAIT_LOCK);
+    if (!mon->stopped) {
+        mon->stopped = true;
+        PyThread_release_lock(mon->wakeup);
+    }
+    PyThread_release_lock(mon->lock);
+
+    Py_CLEAR(mon->cb);
+}
+
+/* Sleep for the polling interval, returns true if stopped meanwhile */
+static bool
+virPyJobMonitorWait(virPyJobMonitorPtr mon)
+{
+    bool stopped;
+
+#if PY_VERSION_HEX >= 0x03020000
+    if (PyThread_acquire_lock_timed(mon->wakeup,
+                                    (PY_TIMEOUT_T) mon->interval * 1000,
+                                    0) == PY_LOCK_ACQUIRED)
+        PyThread_release_lock(mon->wakeup);
+#else
+    unsigned long long now;
+    unsigned long long deadline = 0;
+
+    if (virTimeMillisNow(&now) == 0)
+        deadline = now + mon->interval;
+    while (!PyThread_acquire_lock(mon->wakeup, NOWAIT_LOCK)) {
+        if (virTimeMillisNow(&now) < 0 || now >= deadline)
+            break;
+        usleep(1000);
+    }
+#endif
+
+    PyThread_acquire_lock(mon->lock, WAIT_LOCK);
+    stopped = mon->stopped;
+    PyThread_release_lock(mon->lock);
+
+    return stopped;
+}
+
+/* Update @progress with the fields of the job stats, leaving those
+ * missing untouched */
+static int
+virPyJobMonitorSample(virPyJobMonitorPtr mon,
+                      virPyJobProgress *progress,
+                      unsigned int flags)
+{
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    int type;
+
+    if (virDomainGetJobStats(mon->dom, &type, &params, &nparams, flags) < 0)
+        return -1;
+
+    progress->type = type;
+    virTypedParamsGetULLong(params, nparams, VIR_DOMAIN_JOB_TIME_ELAPSED,
+                            &progress->timeElapsed);
+    virTypedParamsGetULLong(params, nparams, VIR_DOMAIN_JOB_DATA_TOTAL,
+                            &progress->dataTotal);
+    virTypedParamsGetULLong(params, nparams, VIR_DOMAIN_JOB_DATA_PROCESSED,
+                            &progress->dataProcessed);
+    virTypedParamsGetULLong(params, nparams, VIR_DOMAIN_JOB_DATA_REMAINING,
+                            &progress->dataRemaining);
+    virTypedParamsGetULLong(params, nparams, VIR_DOMAIN_JOB_MEMORY_DIRTY_RATE,
+                            &progress->memDirtyRate);
+    virTypedParamsGetULLong(params, nparams, VIR_DOMAIN_JOB_MEMORY_ITERATION,
+                            &progress->memIteration);
+    virTypedParamsFree(params, nparams);
+
+    return 0;
+}
+
+static PyObject *
+libvirt_virPyJobProgressWrap(virPyJobProgress *progress)
+{
+    return Py_BuildValue((char *) "{s:i,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:I,s:N}",
+                         "type", progress->type,
+                         "time_elapsed", progress->timeElapsed,
+                         "data_total", progress->dataTotal,
+                         "data_processed", progress->dataProcessed,
+                         "data_remaining", progress->dataRemaining,
+                         "memory_dirty_rate", progress->memDirtyRate,
+                         "memory_iteration", progress->memIteration,
+                         "downtime", progress->downtime,
+                         "stalls", progress->stalls,
+                         "postcopy", PyBool_FromLong(progress->postcopy));
+}
+
+/* Call python back for @events, with the GIL held */
+static void
+virPyJobMonitorDeliver(virPyJobMonitorPtr mon,
+                       virPyJobProgress *progress,
+                       int *events,
+                       size_t nevents)
+{
+    PyObject *cb;
+    PyObject *dict;
+    PyObject *ret;
+    size_t i;
+
+    if (!(cb = mon->cb))
+        return;
+
+    if (!(dict = libvirt_virPyJobProgressWrap(progress))) {
+        PyErr_Print();
+        return;
+    }
+
+    Py_INCREF(cb);
+    for (i = 0; i < nevents; i++) {
+        /* Stopped by a callback, but the end of the job was claimed
+         * already and is reported anyway */
+        if (!mon->cb && events[i] != VIR_PY_JOB_MONITOR_COMPLETED)
+            continue;
+        if (!(ret = PyObject_CallFunction(cb, (char *) "iO", events[i], dict)))
+            PyErr_Print();
+        Py_XDECREF(ret);
+    }
+    Py_DECREF(cb);
+    Py_DECREF(dict);
+}
+
+/* Store @progress sampled by the monitor thread and report @events,
+ * unless stopped meanwhile.  With @done, the end of the job is only
+ * reported if virDomainJobMonitorFinish didn't already, which is
+ * decided with the GIL held since that runs with it.  */
+static void
+virPyJobMonitorPublish(virPyJobMonitorPtr mon,
+                       virPyJobProgress *progress,
+                       int *events,
+                       size_t nevents,
+                       bool done)
+{
+    bool stopped;
+
+    if (!nevents) {
+        PyThread_acquire_lock(mon->lock, WAIT_LOCK);
+        if (!mon->stopped)
+            mon->progress = *progress;
+        PyThread_release_lock(mon->lock);
+        return;
+    }
+
+    LIBVIRT_ENSURE_THREAD_STATE;
+
+    PyThread_acquire_lock(mon->lock, WAIT_LOCK);
+    if (!(stopped = mon->stopped)) {
+        mon->progress = *progress;
+        if (done)
+            mon->completed = true;
+    }
+    PyThread_release_lock(mon->lock);
+
+    if (!stopped)
+        virPyJobMonitorDeliver(mon, progress, events, nevents);
+
+    LIBVIRT_RELEASE_THREAD_STATE;
+}
+
+static void
+libvirt_virPyJobMonitorThread(void *opaque)
+{
+    virPyJobMonitorPtr mon = opaque;
+    virPyJobProgress progress;
+    unsigned long long now = 0;
+    unsigned long long progressAt = 0;
+    unsigned long long minRemaining = 0;
+    size_t nextDowntime = 0;
+    bool active = false;
+    bool dirty = false;
+    bool escalate;
+    bool done = false;
+    virErrorPtr err;
+    int events[4];
+    size_t nevents;
+
+    memset(&progress, 0, sizeof(progress));
+
+    while (!done && !virPyJobMonitorWait(mon)) {
+        nevents = 0;
+        escalate = false;
+
+        if (virPyJobMonitorSample(mon, &progress, 0) < 0) {
+            err = virGetLastError();
+            if (!err || err->code != VIR_ERR_NO_DOMAIN) {
+                /* Such as a transient RPC failure, try again */
+                virResetLastError();
+                continue;
+            }
+            virResetLastError();
+            /* Gone, as the source of a migration which succeeded is */
+            progress.type = VIR_DOMAIN_JOB_NONE;
+            done = true;
+        } else if (progress.type == VIR_DOMAIN_JOB_NONE) {
+            /* Not started yet */
+            if (!active)
+                continue;
+            if (virPyJobMonitorSample(mon, &progress,
+                                      VIR_DOMAIN_JOB_STATS_COMPLETED) < 0)
+                virResetLastError();
+            done = true;
+        } else {
+            ignore_value(virTimeMillisNow(&now));
+
+            if (!active || progress.dataRemaining < minRemaining) {
+                active = true;
+                minRemaining = progress.dataRemaining;
+                progressAt = now;
+            } else if (mon->stallTime && now - progressAt >= mon->stallTime) {
+                progressAt = now;
+                progress.stalls++;
+                events[nevents++] = VIR_PY_JOB_MONITOR_STALLED;
+                escalate = true;
+            }
+
+            if (mon->dirtyRate && progress.memDirtyRate >= mon->dirtyRate) {
+                if (!dirty) {
+                    dirty = true;
+                    events[nevents++] = VIR_PY_JOB_MONITOR_DIRTY_RATE;
+                    escalate = true;
+                }
+            } else {
+                dirty = false;
+            }
+
+            /* Allow a longer downtime first, then switch to post-copy */
+            if (escalate && nextDowntime < mon->ndowntimes) {
+                if (virDomainMigrateSetMaxDowntime(mon->dom,
+                                                   mon->downtimes[nextDowntime],
+                                                   0) == 0) {
+                    progress.downtime = mon->downtimes[nextDowntime];
+                    events[nevents++] = VIR_PY_JOB_MONITOR_DOWNTIME;
+                }
+                nextDowntime++;
+#if LIBVIR_CHECK_VERSION(1, 3, 3)
+            } else if (escalate && mon->postcopy) {
+                mon->postcopy = false;
+                if (virDomainMigrateStartPostCopy(mon->dom, 0) == 0) {
+                    progress.postcopy = true;
+                    events[nevents++] = VIR_PY_JOB_MONITOR_POSTCOPY;
+                }
+#endif
+            }
+        }
+
+        if (done)
+            events[nevents++] = VIR_PY_JOB_MONITOR_COMPLETED;
+
+        virPyJobMonitorPublish(mon, &progress, events, nevents, done);
+    }
+
+    if (done) {
+        /* Nothing left to report */
+        LIBVIRT_ENSURE_THREAD_STATE;
+        Py_CLEAR(mon->cb);
+        LIBVIRT_RELEASE_THREAD_STATE;
+    }
+
+    PyThread_acquire_lock(mon->lock, WAIT_LOCK);
+    virPyJobMonitorUnref(mon);
+}
+
+static void
+libvirt_virPyJobMonitorDestroy(void *ptr)
+{
+    virPyJobMonitorPtr mon = ptr;
+
+    virPyJobMonitorStop(mon);
+    PyThread_acquire_lock(mon->lock, WAIT_LOCK);
+    virPyJobMonitorUnref(mon);
+}
+
+static const virPyNativeType virPyJobMonitorNative = {
+    VIR_PY_JOB_MONITOR,
+    libvirt_virPyJobMonitorDestroy,
+};
+
+static virPyJobMonitorPtr
+libvirt_virPyJobMonitorGet(PyObject *obj)
+{
+    return libvirt_nativeGet(obj, &virPyJobMonitorNative);
+}
+
+static PyObject *
+libvirt_virDomainJobMonitorNew(PyObject *self ATTRIBUTE_UNUSED,
+                               PyObject *args)
+{
+    PyObject *pyobj_dom;
+    PyObject *pyobj_cb;
+    PyObject *pyobj_downtimes;
+    PyObject *ret;
+    virPyJobMonitorPtr mon;
+    unsigned long long interval;
+    unsigned long long stallTime;
+    unsigned long long dirtyRate;
+    int postcopy;
+    size_t i;
+
+    if (!PyArg_ParseTuple(args, (char *) "OOKKKOi:virDomainJobMonitorNew",
+                          &pyobj_dom, &pyobj_cb, &interval, &stallTime,
+                          &dirtyRate, &pyobj_downtimes, &postcopy))
+        return NULL;
+
+    if (!PyCallable_Check(pyobj_cb)) {
+        PyErr_SetString(PyExc_TypeError, "callback must be callable");
+        return NULL;
+    }
+    if (pyobj_downtimes != Py_None && !PyList_Check(pyobj_downtimes)) {
+        PyErr_SetString(PyExc_TypeError, "downtimes must be a list");
+        return NULL;
+    }
+    if (interval == 0) {
+        PyErr_SetString(PyExc_ValueError, "interval must not be 0");
+        return NULL;
+    }
+
+    if (VIR_ALLOC(mon) < 0)
+        return PyErr_NoMemory();
+    mon->refs = 1;
+    mon->interval = interval;
+    mon->stallTime = stallTime;
+    mon->dirtyRate = dirtyRate;
+    mon->postcopy = !!postcopy;
+
+    if (pyobj_downtimes != Py_None) {
+        mon->ndowntimes = PyList_Size(pyobj_downtimes);
+        if (VIR_ALLOC_N(mon->downtimes, mon->ndowntimes) < 0) {
+            PyErr_NoMemory();
+            goto error;
+        }
+        for (i = 0; i < mon->ndowntimes; i++) {
+            if (libvirt_ulonglongUnwrap(PyList_GetItem(pyobj_downtimes, i),
+                                        &mon->downtimes[i]) < 0)
+                goto error;
+        }
+    }
+
+    if (!(mon->lock = PyThread_allocate_lock()) ||
+        !(mon->wakeup = PyThread_allocate_lock())) {
+        PyErr_NoMemory();
+        goto error;
+    }
+    PyThread_acquire_lock(mon->wakeup, WAIT_LOCK);
+
+    mon->dom = (virDomainPtr) PyvirDomain_Get(pyobj_dom);
+    /* The monitor may outlive the python object */
+    virDomainRef(mon->dom);
+
+    if (!(ret = libvirt_nativeWrap(mon, &virPyJobMonitorNative)))
+        goto error;
+
+    /* From now on the capsule owns its reference */
+    Py_INCREF(pyobj_cb);
+    mon->cb = pyobj_cb;
+    mon->refs++;
+    if (PyThread_start_new_thread(libvirt_virPyJobMonitorThread,
+                                  mon) == (long) -1) {
+        mon->refs--;
+        Py_DECREF(ret);
+        PyErr_SetString(PyExc_RuntimeError,
+                        "cannot start job monitor thread");
+        return NULL;
+    }
+
+    return ret;
+
+ error:
+    virPyJobMonitorFree(mon);
+    return NULL;
+}
+
+static PyObject *
+libvirt_virDomainJobMonitorStop(PyObject *self ATTRIBUTE_UNUSED,
+                                PyObject *args)
+{
+    PyObject *pyobj_mon;
+    virPyJobMonitorPtr mon;
+
+    if (!PyArg_ParseTuple(args, (char *) "O:virDomainJobMonitorStop",
+                          &pyobj_mon) ||
+        !(mon = libvirt_virPyJobMonitorGet(pyobj_mon)))
+        return NULL;
+
+    virPyJobMonitorStop(mon);
+
+    return VIR_PY_NONE;
+}
+
+/* Stop the monitor, first reporting the end of the job if the monitor
+ * thread didn't yet: a synchronous migration typically returns before
+ * the next poll would notice it */
+static PyObject *
+libvirt_virDomainJobMonitorFinish(PyObject *self ATTRIBUTE_UNUSED,
+                                  PyObject *args)
+{
+    PyObject *pyobj_mon;
+    virPyJobMonitorPtr mon;
+    virPyJobProgress progress;
+    int event = VIR_PY_JOB_MONITOR_COMPLETED;
+    bool report = false;
+    int c_retval;
+
+    if (!PyArg_ParseTuple(args, (char *) "O:virDomainJobMonitorFinish",
+                          &pyobj_mon) ||
+        !(mon = libvirt_virPyJobMonitorGet(pyobj_mon)))
+        return NULL;
+
+    PyThread_acquire_lock(mon->lock, WAIT_LOCK);
+    if (!mon->stopped) {
+        mon->stopped = true;
+        PyThread_release_lock(mon->wakeup);
+        report = !mon->completed;
+        mon->completed = true;
+    }
+    progress = mon->progress;
+    PyThread_release_lock(mon->lock);
+
+    if (report) {
+        LIBVIRT_BEGIN_ALLOW_THREADS;
+        c_retval = virPyJobMonitorSample(mon, &progress,
+                                         VIR_DOMAIN_JOB_STATS_COMPLETED);
+        LIBVIRT_END_ALLOW_THREADS;
+
+        if (c_retval < 0) {
+            /* Gone, or its outcome can't be told */
+            progress.type = VIR_DOMAIN_JOB_NONE;
+            virResetLastError();
+        }
+
+        PyThread_acquire_lock(mon->lock, WAIT_LOCK);
+        mon->progress = progress;
+        PyThread_release_lock(mon->lock);
+
+        virPyJobMonitorDeliver(mon, &progress, &event, 1);
+    }
+
+    Py_CLEAR(mon->cb);
+
+    return VIR_PY_NONE;
+}
+
+static PyObject *
+libvirt_virDomainJobMonitorProgress(PyObject *self ATTRIBUTE_UNUSED,
+                                    PyObject *args)
+{
+    PyObject *pyobj_mon;
+    virPyJobMonitorPtr mon;
+    virPyJobProgress progress;
+
+    if (!PyArg_ParseTuple(args, (char *) "O:virDomainJobMonitorProgress",
+                          &pyobj_mon) ||
+        !(mon = libvirt_virPyJobMonitorGet(pyobj_mon)))
+        return NULL;
+
+    PyThread_acquire_lock(mon->lock, WAIT_LOCK);
+    progress = mon->progress;
+    PyThread_release_lock(mon->lock);
+
+    return libvirt_virPyJobProgressWrap(&progress);
+}
+#endif /* LIBVIR_CHECK_VERSION(1, 2, 9) */
+
 static PyObject *
 libvirt_virDomainGetBlockJobInfo(PyObject *self ATTRIBUTE_UNUSED,
                                  PyObject *args)
@@ -5014,6 +6456,7 @@ libvirt_virDomainSetBlockIoTune(PyObject *self ATTRIBUTE_UNUSED,
 {
     virDomainPtr domain;
     PyObject *pyobj_domain, *info;
+    PyObject *pyobj_schema = Py_None;
     PyObject *ret = NULL;
     int i_retval;
     int nparams = 0;
@@ -5022,8 +6465,9 @@ libvirt_virDomainSetBlockIoTune(PyObject *self ATTRIBUTE_UNUSED,
     unsigned int flags;
     virTypedParameterPtr params = NULL, new_params = NULL;
 
-    if (!PyArg_ParseTuple(args, (char *)"OzOI:virDomainSetBlockIoTune",
-                          &pyobj_domain, &disk, &info, &flags))
+    if (!PyArg_ParseTuple(args, (char *)"OzOI|O:virDomainSetBlockIoTune",
+                          &pyobj_domain, &disk, &info, &flags,
+                          &pyobj_schema))
         return NULL;
     domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
 
@@ -5036,6 +6480,13 @@ libvirt_virDomainSetBlockIoTune(PyObject *self ATTRIBUTE_UNUSED,
         return NULL;
     }
 
+    switch (setPyVirTypedParameterFromSchema(info, pyobj_schema, &new_params)) {
+    case -1:
+        return NULL;
+    case 1:
+        goto set;
+    }
+
     LIBVIRT_BEGIN_ALLOW_THREADS;
     i_retval = virDomainGetBlockIoTune(domain, disk, NULL, &nparams, flags);
     LIBVIRT_END_ALLOW_THREADS;
@@ -5065,6 +6516,9 @@ libvirt_virDomainSetBlockIoTune(PyObject *self ATTRIBUTE_UNUSED,
     if (!new_params)
         goto cleanup;
 
+    libvirt_typedParamSchemaUpdate(pyobj_schema, params, nparams);
+
+ set:
     LIBVIRT_BEGIN_ALLOW_THREADS;
     i_retval = virDomainSetBlockIoTune(domain, disk, new_params, size, flags);
     LIBVIRT_END_ALLOW_THREADS;
@@ -5756,50 +7210,48 @@ static PyObject *
 libvirt_virEventRegisterImpl(ATTRIBUTE_UNUSED PyObject * self,
                              PyObject * args)
 {
-    /* Unref the previously-registered impl (if any) */
-    Py_XDECREF(addHandleObj);
-    Py_XDECREF(updateHandleObj);
-    Py_XDECREF(removeHandleObj);
-    Py_XDECREF(addTimeoutObj);
-    Py_XDECREF(updateTimeoutObj);
-    Py_XDECREF(removeTimeoutObj);
-    VIR_FREE(addHandleName);
-    VIR_FREE(updateHandleName);
-    VIR_FREE(removeHandleName);
-    VIR_FREE(addTimeoutName);
-    VIR_FREE(updateTimeoutName);
-    VIR_FREE(removeTimeoutName);
+    PyObject **slots[] = {
+        &addHandleObj, &updateHandleObj, &removeHandleObj,
+        &addTimeoutObj, &updateTimeoutObj, &removeTimeoutObj,
+    };
+    PyObject *objs[6];
+    size_t i;
 
     /* Parse and check arguments */
     if (!PyArg_ParseTuple(args, (char *) "OOOOOO:virEventRegisterImpl",
-                          &addHandleObj, &updateHandleObj,
-                          &removeHandleObj, &addTimeoutObj,
-                          &updateTimeoutObj, &removeTimeoutObj) ||
-        !PyCallable_Check(addHandleObj) ||
-        !PyCallable_Check(updateHandleObj) ||
-        !PyCallable_Check(removeHandleObj) ||
-        !PyCallable_Check(addTimeoutObj) ||
-        !PyCallable_Check(updateTimeoutObj) ||
-        !PyCallable_Check(removeTimeoutObj))
+                          &objs[0], &objs[1], &objs[2],
+                          &objs[3], &objs[4], &objs[5]))
         return VIR_PY_INT_FAIL;
+    for (i = 0; i < 6; i++) {
+        if (!PyCallable_Check(objs[i]))
+            return VIR_PY_INT_FAIL;
+    }
 
     /* Get argument string representations (for error reporting) */
-    addHandleName = py_str(addHandleObj);
-    updateHandleName = py_str(updateHandleObj);
-    removeHandleName = py_str(removeHandleObj);
-    addTimeoutName = py_str(addTimeoutObj);
-    updateTimeoutName = py_str(updateTimeoutObj);
-    removeTimeoutName = py_str(removeTimeoutObj);
+    VIR_FREE(addHandleName);
+    VIR_FREE(updateHandleName);
+    VIR_FREE(removeHandleName);
+    VIR_FREE(addTimeoutName);
+    VIR_FREE(updateTimeoutName);
+    VIR_FREE(removeTimeoutName);
+    addHandleName = py_str(objs[0]);
+    updateHandleName = py_str(objs[1]);
+    removeHandleName = py_str(objs[2]);
+    addTimeoutName = py_str(objs[3]);
+    updateTimeoutName = py_str(objs[4]);
+    removeTimeoutName = py_str(objs[5]);
 
     /* Inc refs since we're holding on to these objects until
-     * the next call (if any) to this function.
+     * the next call (if any) to this function, and unref the
+     * previously-registered impl (if any).
      */
-    Py_INCREF(addHandleObj);
-    Py_INCREF(updateHandleObj);
-    Py_INCREF(removeHandleObj);
-    Py_INCREF(addTimeoutObj);
-    Py_INCREF(updateTimeoutObj);
-    Py_INCREF(removeTimeoutObj);
+    for (i = 0; i < 6; i++) {
+        PyObject *old = *slots[i];
+
+        Py_INCREF(objs[i]);
+        *slots[i] = objs[i];
+        Py_XDECREF(old);
+    }
 
     LIBVIRT_BEGIN_ALLOW_THREADS;
 
@@ -5873,2791 +7325,7802 @@ libvirt_virEventInvokeTimeoutCallback(PyObject *self ATTRIBUTE_UNUSED,
     return VIR_PY_INT_SUCCESS;
 }
 
+/*
+ * asyncio event loop implementation
+ *
+ * The handles and timeouts are tracked here, and only mirrored onto
+ * the asyncio loop: file descriptors are watched with add_reader() and
+ * add_writer(), and timeouts are scheduled with call_later().  libvirt
+ * may change them from any thread, so changes are only recorded under
+ * aioLock, and applied by libvirt_virEventAioSync which runs in the
+ * loop thread, scheduled with a single call_soon_threadsafe() for any
+ * number of changes.  Handles are removed and their free callbacks
+ * invoked by the sync too, so releasing a handle from within its own
+ * callback is safe.  aioLock is never held while taking the GIL.
+ */
+typedef struct {
+    int watch;
+    int fd;
+    int events;             /* events libvirt is interested in */
+    virEventHandleCallback cb;
+    void *opaque;
+    virFreeCallback ff;
+    bool deleted;
+    bool added;             /* not seen by a sync yet */
+    bool dirty;             /* loop registration is out of date */
+} virPyAioHandle;
+typedef virPyAioHandle *virPyAioHandlePtr;
+
+typedef struct {
+    int timer;
+    int frequency;          /* in milliseconds, -1 when disabled */
+    virEventTimeoutCallback cb;
+    void *opaque;
+    virFreeCallback ff;
+    bool deleted;
+    bool dirty;             /* loop scheduling is out of date */
+    PyObject *scheduled;    /* asyncio.TimerHandle, only used with the
+                             * GIL held in the loop thread */
+} virPyAioTimeout;
+typedef virPyAioTimeout *virPyAioTimeoutPtr;
+
+/* Events registered with the loop for a file descriptor, only used by
+ * the loop thread */
+typedef struct {
+    int fd;
+    int events;
+} virPyAioDescriptor;
+
+typedef struct {
+    virFreeCallback ff;
+    void *opaque;
+} virPyAioRelease;
+
+static PyObject *aioLoop;
+static PyObject *aioSyncFunc;
+static PyObject *aioHandleReadyFunc;
+static PyObject *aioTimeoutReadyFunc;
+static PyThread_type_lock aioLock;
+
+/* Protected by aioLock */
+static virPyAioHandlePtr *aioHandles;
+static size_t aioNHandles;
+static virPyAioTimeoutPtr *aioTimeouts;
+static size_t aioNTimeouts;
+static int aioNextWatch;
+static int aioNextTimer;
+static bool aioSyncPending;
+
+static virPyAioDescriptor *aioDescriptors;
+static size_t aioNDescriptors;
+
+static void libvirt_virEventAioSyncImpl(void);
+
+/* Note that the loop is out of date.  Must be called with aioLock held,
+ * returns true if the caller has to schedule a sync.  */
+static bool
+libvirt_virEventAioMarkDirty(void)
+{
+    if (aioSyncPending)
+        return false;
+    aioSyncPending = true;
+    return true;
+}
+
 static void
-libvirt_virEventHandleCallback(int watch,
-                               int fd,
-                               int events,
-                               void *opaque)
+libvirt_virEventAioWakeup(void)
 {
-    PyObject *pyobj_cbData = (PyObject *)opaque;
-    PyObject *pyobj_ret;
-    PyObject *python_cb;
+    PyObject *ret;
 
     LIBVIRT_ENSURE_THREAD_STATE;
 
-    /* Lookup the python callback */
-    python_cb = libvirt_lookupPythonFunc("_dispatchEventHandleCallback");
-    if (!python_cb) {
-        goto cleanup;
+    ret = PyObject_CallMethod(aioLoop, (char *) "call_soon_threadsafe",
+                              (char *) "O", aioSyncFunc);
+    if (!ret) {
+        DEBUG("%s - ret:%p\n", __FUNCTION__, ret);
+        PyErr_Print();
+    } else {
+        Py_DECREF(ret);
     }
 
-    Py_INCREF(pyobj_cbData);
+    LIBVIRT_RELEASE_THREAD_STATE;
+}
 
-    /* Call the pure python dispatcher */
-    pyobj_ret = PyObject_CallFunction(python_cb,
-                                      (char *)"iiiO",
-                                      watch, fd, events, pyobj_cbData);
-
-    Py_DECREF(pyobj_cbData);
+static virPyAioHandlePtr
+libvirt_virEventAioFindHandle(int watch)
+{
+    size_t i;
 
-    if (!pyobj_ret) {
-        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
-        PyErr_Print();
-    } else {
-        Py_DECREF(pyobj_ret);
+    for (i = 0; i < aioNHandles; i++) {
+        if (aioHandles[i]->watch == watch && !aioHandles[i]->deleted)
+            return aioHandles[i];
     }
 
-cleanup:
-    LIBVIRT_RELEASE_THREAD_STATE;
+    return NULL;
 }
 
-static PyObject *
-libvirt_virEventAddHandle(PyObject *self ATTRIBUTE_UNUSED,
-                          PyObject *args)
+static virPyAioTimeoutPtr
+libvirt_virEventAioFindTimeout(int timer)
 {
-    PyObject *py_retval;
-    PyObject *pyobj_cbData;
-    virEventHandleCallback cb = libvirt_virEventHandleCallback;
-    int events;
-    int fd;
-    int ret;
+    size_t i;
 
-    if (!PyArg_ParseTuple(args, (char *) "iiO:virEventAddHandle",
-                          &fd, &events, &pyobj_cbData)) {
-        DEBUG("%s failed to parse tuple\n", __FUNCTION__);
-        return VIR_PY_INT_FAIL;
+    for (i = 0; i < aioNTimeouts; i++) {
+        if (aioTimeouts[i]->timer == timer)
+            return aioTimeouts[i];
     }
 
-    Py_INCREF(pyobj_cbData);
+    return NULL;
+}
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    ret = virEventAddHandle(fd, events, cb, pyobj_cbData, NULL);
-    LIBVIRT_END_ALLOW_THREADS;
+static int
+libvirt_virEventAioAddHandleFunc(int fd,
+                                 int events,
+                                 virEventHandleCallback cb,
+                                 void *opaque,
+                                 virFreeCallback ff)
+{
+    virPyAioHandlePtr handle;
+    int watch = -1;
+    bool wakeup = false;
 
-    if (ret < 0) {
-        Py_DECREF(pyobj_cbData);
+    if (VIR_ALLOC(handle) < 0)
+        return -1;
+
+    handle->fd = fd;
+    handle->events = events;
+    handle->cb = cb;
+    handle->opaque = opaque;
+    handle->ff = ff;
+    handle->added = true;
+    handle->dirty = true;
+
+    PyThread_acquire_lock(aioLock, WAIT_LOCK);
+    if (VIR_REALLOC_N(aioHandles, aioNHandles + 1) < 0) {
+        VIR_FREE(handle);
+    } else {
+        watch = handle->watch = ++aioNextWatch;
+        aioHandles[aioNHandles++] = handle;
+        wakeup = libvirt_virEventAioMarkDirty();
     }
+    PyThread_release_lock(aioLock);
 
-    py_retval = libvirt_intWrap(ret);
-    return py_retval;
+    if (wakeup)
+        libvirt_virEventAioWakeup();
+
+    return watch;
 }
 
 static void
-libvirt_virEventTimeoutCallback(int timer,
-                                void *opaque)
+libvirt_virEventAioUpdateHandleFunc(int watch,
+                                    int events)
 {
-    PyObject *pyobj_cbData = (PyObject *)opaque;
-    PyObject *pyobj_ret;
-    PyObject *python_cb;
-
-    LIBVIRT_ENSURE_THREAD_STATE;
+    virPyAioHandlePtr handle;
+    bool wakeup = false;
 
-    /* Lookup the python callback */
-    python_cb = libvirt_lookupPythonFunc("_dispatchEventTimeoutCallback");
-    if (!python_cb) {
-        goto cleanup;
+    PyThread_acquire_lock(aioLock, WAIT_LOCK);
+    if ((handle = libvirt_virEventAioFindHandle(watch)) &&
+        handle->events != events) {
+        handle->events = events;
+        handle->dirty = true;
+        wakeup = libvirt_virEventAioMarkDirty();
     }
+    PyThread_release_lock(aioLock);
 
-    Py_INCREF(pyobj_cbData);
-
-    /* Call the pure python dispatcher */
-    pyobj_ret = PyObject_CallFunction(python_cb,
-                                      (char *)"iO",
-                                      timer, pyobj_cbData);
+    if (wakeup)
+        libvirt_virEventAioWakeup();
+}
 
-    Py_DECREF(pyobj_cbData);
+static int
+libvirt_virEventAioRemoveHandleFunc(int watch)
+{
+    virPyAioHandlePtr handle;
+    bool wakeup = false;
+    int ret = -1;
 
-    if (!pyobj_ret) {
-        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
-        PyErr_Print();
-    } else {
-        Py_DECREF(pyobj_ret);
+    PyThread_acquire_lock(aioLock, WAIT_LOCK);
+    if ((handle = libvirt_virEventAioFindHandle(watch))) {
+        handle->deleted = true;
+        handle->dirty = true;
+        wakeup = libvirt_virEventAioMarkDirty();
+        ret = 0;
     }
+    PyThread_release_lock(aioLock);
 
-cleanup:
-    LIBVIRT_RELEASE_THREAD_STATE;
+    if (wakeup)
+        libvirt_virEventAioWakeup();
+
+    return ret;
 }
 
-static PyObject *
-libvirt_virEventAddTimeout(PyObject *self ATTRIBUTE_UNUSED,
-                           PyObject *args)
+static int
+libvirt_virEventAioAddTimeoutFunc(int frequency,
+                                  virEventTimeoutCallback cb,
+                                  void *opaque,
+                                  virFreeCallback ff)
 {
-    PyObject *py_retval;
-    PyObject *pyobj_cbData;
-    virEventTimeoutCallback cb = libvirt_virEventTimeoutCallback;
-    int timeout;
-    int ret;
-
-    if (!PyArg_ParseTuple(args, (char *) "iO:virEventAddTimeout",
-                          &timeout, &pyobj_cbData)) {
-        DEBUG("%s failed to parse tuple\n", __FUNCTION__);
-        return VIR_PY_INT_FAIL;
-    }
+    virPyAioTimeoutPtr timeout;
+    int timer = -1;
+    bool wakeup = false;
 
-    Py_INCREF(pyobj_cbData);
+    if (VIR_ALLOC(timeout) < 0)
+        return -1;
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    ret = virEventAddTimeout(timeout, cb, pyobj_cbData, NULL);
-    LIBVIRT_END_ALLOW_THREADS;
+    timeout->frequency = frequency;
+    timeout->cb = cb;
+    timeout->opaque = opaque;
+    timeout->ff = ff;
+    timeout->dirty = true;
 
-    if (ret < 0) {
-        Py_DECREF(pyobj_cbData);
+    PyThread_acquire_lock(aioLock, WAIT_LOCK);
+    if (VIR_REALLOC_N(aioTimeouts, aioNTimeouts + 1) < 0) {
+        VIR_FREE(timeout);
+    } else {
+        timer = timeout->timer = ++aioNextTimer;
+        aioTimeouts[aioNTimeouts++] = timeout;
+        wakeup = libvirt_virEventAioMarkDirty();
     }
+    PyThread_release_lock(aioLock);
 
-    py_retval = libvirt_intWrap(ret);
-    return py_retval;
+    if (wakeup)
+        libvirt_virEventAioWakeup();
+
+    return timer;
 }
 
 static void
-libvirt_virConnectDomainEventFreeFunc(void *opaque)
+libvirt_virEventAioUpdateTimeoutFunc(int timer,
+                                     int frequency)
 {
-    PyObject *pyobj_conn = (PyObject*)opaque;
-    LIBVIRT_ENSURE_THREAD_STATE;
-    Py_DECREF(pyobj_conn);
-    LIBVIRT_RELEASE_THREAD_STATE;
+    virPyAioTimeoutPtr timeout;
+    bool wakeup = false;
+
+    PyThread_acquire_lock(aioLock, WAIT_LOCK);
+    if ((timeout = libvirt_virEventAioFindTimeout(timer)) &&
+        !timeout->deleted) {
+        /* Even an unchanged frequency restarts the timer */
+        timeout->frequency = frequency;
+        timeout->dirty = true;
+        wakeup = libvirt_virEventAioMarkDirty();
+    }
+    PyThread_release_lock(aioLock);
+
+    if (wakeup)
+        libvirt_virEventAioWakeup();
 }
 
 static int
-libvirt_virConnectDomainEventLifecycleCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
-                                               virDomainPtr dom,
-                                               int event,
-                                               int detail,
-                                               void *opaque)
+libvirt_virEventAioRemoveTimeoutFunc(int timer)
 {
-    PyObject *pyobj_cbData = (PyObject*)opaque;
-    PyObject *pyobj_dom;
-    PyObject *pyobj_ret = NULL;
-    PyObject *pyobj_conn;
-    PyObject *dictKey;
+    virPyAioTimeoutPtr timeout;
+    bool wakeup = false;
     int ret = -1;
 
-    LIBVIRT_ENSURE_THREAD_STATE;
-
-    if (!(dictKey = libvirt_constcharPtrWrap("conn")))
-        goto cleanup;
-    pyobj_conn = PyDict_GetItem(pyobj_cbData, dictKey);
-    Py_DECREF(dictKey);
-
-    /* Create a python instance of this virDomainPtr */
-    virDomainRef(dom);
-    if (!(pyobj_dom = libvirt_virDomainPtrWrap(dom))) {
-        virDomainFree(dom);
-        goto cleanup;
-    }
-    Py_INCREF(pyobj_cbData);
-
-    /* Call the Callback Dispatcher */
-    pyobj_ret = PyObject_CallMethod(pyobj_conn,
-                                    (char*)"_dispatchDomainEventLifecycleCallback",
-                                    (char*)"OiiO",
-                                    pyobj_dom,
-                                    event, detail,
-                                    pyobj_cbData);
-
-    Py_DECREF(pyobj_cbData);
-    Py_DECREF(pyobj_dom);
-
- cleanup:
-    if (!pyobj_ret) {
-        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
-        PyErr_Print();
-    } else {
-        Py_DECREF(pyobj_ret);
+    PyThread_acquire_lock(aioLock, WAIT_LOCK);
+    if ((timeout = libvirt_virEventAioFindTimeout(timer)) &&
+        !timeout->deleted) {
+        timeout->deleted = true;
+        timeout->dirty = true;
+        wakeup = libvirt_virEventAioMarkDirty();
         ret = 0;
     }
+    PyThread_release_lock(aioLock);
+
+    if (wakeup)
+        libvirt_virEventAioWakeup();
 
-    LIBVIRT_RELEASE_THREAD_STATE;
     return ret;
 }
 
-static int
-libvirt_virConnectDomainEventGenericCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
-                                             virDomainPtr dom,
-                                             void *opaque)
+/* Make the events watched by the loop for @fd match @events.  With
+ * @reset, the handles backing @fd changed: it may have been closed and
+ * reused for another file since it was registered, which the selector
+ * can't tell, so it is registered again from scratch.  */
+static void
+libvirt_virEventAioWatchFD(int fd,
+                           int events,
+                           bool reset)
 {
-    PyObject *pyobj_cbData = (PyObject*)opaque;
-    PyObject *pyobj_dom;
-    PyObject *pyobj_ret = NULL;
-    PyObject *pyobj_conn;
-    PyObject *dictKey;
-    int ret = -1;
-
-    LIBVIRT_ENSURE_THREAD_STATE;
+    virPyAioDescriptor *desc = NULL;
+    PyObject *ret;
+    int registered = 0;
+    size_t i;
 
-    if (!(dictKey = libvirt_constcharPtrWrap("conn")))
-        goto cleanup;
-    pyobj_conn = PyDict_GetItem(pyobj_cbData, dictKey);
-    Py_DECREF(dictKey);
+    events &= VIR_EVENT_HANDLE_READABLE | VIR_EVENT_HANDLE_WRITABLE;
 
-    /* Create a python instance of this virDomainPtr */
-    virDomainRef(dom);
-    if (!(pyobj_dom = libvirt_virDomainPtrWrap(dom))) {
-        virDomainFree(dom);
-        goto cleanup;
+    for (i = 0; i < aioNDescriptors; i++) {
+        if (aioDescriptors[i].fd == fd) {
+            desc = &aioDescriptors[i];
+            registered = desc->events;
+            break;
+        }
     }
-    Py_INCREF(pyobj_cbData);
 
-    /* Call the Callback Dispatcher */
-    pyobj_ret = PyObject_CallMethod(pyobj_conn,
-                                    (char*)"_dispatchDomainEventGenericCallback",
-                                    (char*)"OO",
-                                    pyobj_dom, pyobj_cbData);
+    if (reset && registered) {
+        if (registered & VIR_EVENT_HANDLE_READABLE) {
+            if (!(ret = PyObject_CallMethod(aioLoop, (char *) "remove_reader",
+                                            (char *) "i", fd)))
+                PyErr_Print();
+            Py_XDECREF(ret);
+        }
+        if (registered & VIR_EVENT_HANDLE_WRITABLE) {
+            if (!(ret = PyObject_CallMethod(aioLoop, (char *) "remove_writer",
+                                            (char *) "i", fd)))
+                PyErr_Print();
+            Py_XDECREF(ret);
+        }
+        registered = 0;
+    }
 
-    Py_DECREF(pyobj_cbData);
-    Py_DECREF(pyobj_dom);
+    if (events == registered) {
+        if (desc && !events)
+            *desc = aioDescriptors[--aioNDescriptors];
+        return;
+    }
 
- cleanup:
-    if (!pyobj_ret) {
-        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
-        PyErr_Print();
-    } else {
-        Py_DECREF(pyobj_ret);
-        ret = 0;
+    if ((events ^ registered) & VIR_EVENT_HANDLE_READABLE) {
+        if (events & VIR_EVENT_HANDLE_READABLE)
+            ret = PyObject_CallMethod(aioLoop, (char *) "add_reader",
+                                      (char *) "iOii", fd, aioHandleReadyFunc,
+                                      fd, VIR_EVENT_HANDLE_READABLE);
+        else
+            ret = PyObject_CallMethod(aioLoop, (char *) "remove_reader",
+                                      (char *) "i", fd);
+        if (!ret)
+            PyErr_Print();
+        Py_XDECREF(ret);
+    }
+
+    if ((events ^ registered) & VIR_EVENT_HANDLE_WRITABLE) {
+        if (events & VIR_EVENT_HANDLE_WRITABLE)
+            ret = PyObject_CallMethod(aioLoop, (char *) "add_writer",
+                                      (char *) "iOii", fd, aioHandleReadyFunc,
+                                      fd, VIR_EVENT_HANDLE_WRITABLE);
+        else
+            ret = PyObject_CallMethod(aioLoop, (char *) "remove_writer",
+                                      (char *) "i", fd);
+        if (!ret)
+            PyErr_Print();
+        Py_XDECREF(ret);
     }
 
-    LIBVIRT_RELEASE_THREAD_STATE;
-    return ret;
+    if (desc) {
+        if (events) {
+            desc->events = events;
+        } else {
+            *desc = aioDescriptors[--aioNDescriptors];
+        }
+    } else if (VIR_REALLOC_N(aioDescriptors, aioNDescriptors + 1) == 0) {
+        aioDescriptors[aioNDescriptors].fd = fd;
+        aioDescriptors[aioNDescriptors].events = events;
+        aioNDescriptors++;
+    }
 }
 
-static int
-libvirt_virConnectDomainEventRTCChangeCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
-                                               virDomainPtr dom,
-                                               long long utcoffset,
-                                               void *opaque)
+/* Bring the loop up to date with the handles and timeouts.  Must be
+ * called with the GIL held in the loop thread.  */
+static void
+libvirt_virEventAioSyncImpl(void)
 {
-    PyObject *pyobj_cbData = (PyObject*)opaque;
-    PyObject *pyobj_dom;
-    PyObject *pyobj_ret = NULL;
-    PyObject *pyobj_conn;
-    PyObject *dictKey;
-    int ret = -1;
+    int *fds = NULL;
+    int *fdEvents = NULL;
+    bool *fdReset = NULL;
+    size_t nfds = 0;
+    virPyAioTimeoutPtr *timeouts = NULL;
+    PyObject **cancelled = NULL;
+    size_t ntimeouts = 0;
+    virPyAioRelease *releases = NULL;
+    size_t nreleases = 0;
+    PyObject *scheduled;
+    PyObject *ret;
+    size_t i, j;
 
-    LIBVIRT_ENSURE_THREAD_STATE;
+    PyThread_acquire_lock(aioLock, WAIT_LOCK);
 
-    if (!(dictKey = libvirt_constcharPtrWrap("conn")))
-        goto cleanup;
-    pyobj_conn = PyDict_GetItem(pyobj_cbData, dictKey);
-    Py_DECREF(dictKey);
+    aioSyncPending = false;
 
-    /* Create a python instance of this virDomainPtr */
-    virDomainRef(dom);
-    if (!(pyobj_dom = libvirt_virDomainPtrWrap(dom))) {
-        virDomainFree(dom);
+    if (VIR_ALLOC_N(fds, aioNHandles + 1) < 0 ||
+        VIR_ALLOC_N(fdEvents, aioNHandles + 1) < 0 ||
+        VIR_ALLOC_N(fdReset, aioNHandles + 1) < 0 ||
+        VIR_ALLOC_N(timeouts, aioNTimeouts + 1) < 0 ||
+        VIR_ALLOC_N(cancelled, aioNTimeouts + 1) < 0 ||
+        VIR_ALLOC_N(releases, aioNHandles + aioNTimeouts + 1) < 0) {
+        /* Try again on the next change */
+        PyThread_release_lock(aioLock);
         goto cleanup;
     }
-    Py_INCREF(pyobj_cbData);
 
-    /* Call the Callback Dispatcher */
-    pyobj_ret = PyObject_CallMethod(pyobj_conn,
-                                    (char*)"_dispatchDomainEventRTCChangeCallback",
-                                    (char*)"OLO",
-                                    pyobj_dom,
-                                    (PY_LONG_LONG)utcoffset,
-                                    pyobj_cbData);
+    /* File descriptors of changed handles, to be registered again if
+     * a handle was added or removed on them */
+    for (i = 0; i < aioNHandles; i++) {
+        if (!aioHandles[i]->dirty)
+            continue;
+        aioHandles[i]->dirty = false;
 
-    Py_DECREF(pyobj_cbData);
-    Py_DECREF(pyobj_dom);
+        for (j = 0; j < nfds; j++) {
+            if (fds[j] == aioHandles[i]->fd)
+                break;
+        }
+        if (j == nfds)
+            fds[nfds++] = aioHandles[i]->fd;
+        if (aioHandles[i]->added || aioHandles[i]->deleted)
+            fdReset[j] = true;
+        aioHandles[i]->added = false;
+    }
 
- cleanup:
-    if (!pyobj_ret) {
-        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
-        PyErr_Print();
-    } else {
-        Py_DECREF(pyobj_ret);
-        ret = 0;
+    /* Drop the removed handles */
+    for (i = 0; i < aioNHandles; i++) {
+        if (!aioHandles[i]->deleted)
+            continue;
+
+        releases[nreleases].ff = aioHandles[i]->ff;
+        releases[nreleases].opaque = aioHandles[i]->opaque;
+        nreleases++;
+
+        VIR_FREE(aioHandles[i]);
+        aioHandles[i--] = aioHandles[--aioNHandles];
     }
 
-    LIBVIRT_RELEASE_THREAD_STATE;
-    return ret;
-}
+    /* Events wanted by all the handles sharing each of those fds */
+    for (i = 0; i < nfds; i++) {
+        for (j = 0; j < aioNHandles; j++) {
+            if (aioHandles[j]->fd == fds[i])
+                fdEvents[i] |= aioHandles[j]->events;
+        }
+    }
 
-static int
-libvirt_virConnectDomainEventWatchdogCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
-                                              virDomainPtr dom,
-                                              int action,
-                                              void *opaque)
-{
-    PyObject *pyobj_cbData = (PyObject*)opaque;
-    PyObject *pyobj_dom;
-    PyObject *pyobj_ret = NULL;
-    PyObject *pyobj_conn;
-    PyObject *dictKey;
-    int ret = -1;
+    for (i = 0; i < aioNTimeouts; i++) {
+        virPyAioTimeoutPtr timeout = aioTimeouts[i];
 
-    LIBVIRT_ENSURE_THREAD_STATE;
+        if (!timeout->dirty)
+            continue;
+        timeout->dirty = false;
 
-    if (!(dictKey = libvirt_constcharPtrWrap("conn")))
-        goto cleanup;
-    pyobj_conn = PyDict_GetItem(pyobj_cbData, dictKey);
-    Py_DECREF(dictKey);
+        cancelled[ntimeouts] = timeout->scheduled;
+        timeout->scheduled = NULL;
 
-    /* Create a python instance of this virDomainPtr */
-    virDomainRef(dom);
-    if (!(pyobj_dom = libvirt_virDomainPtrWrap(dom))) {
-        virDomainFree(dom);
-        goto cleanup;
-    }
-    Py_INCREF(pyobj_cbData);
+        if (timeout->deleted) {
+            releases[nreleases].ff = timeout->ff;
+            releases[nreleases].opaque = timeout->opaque;
+            nreleases++;
 
-    /* Call the Callback Dispatcher */
-    pyobj_ret = PyObject_CallMethod(pyobj_conn,
-                                    (char*)"_dispatchDomainEventWatchdogCallback",
-                                    (char*)"OiO",
-                                    pyobj_dom,
-                                    action,
-                                    pyobj_cbData);
+            VIR_FREE(aioTimeouts[i]);
+            aioTimeouts[i--] = aioTimeouts[--aioNTimeouts];
+            timeouts[ntimeouts++] = NULL;
+        } else {
+            timeouts[ntimeouts++] = timeout;
+        }
+    }
 
-    Py_DECREF(pyobj_cbData);
-    Py_DECREF(pyobj_dom);
+    /* Frequencies are only read below, when the timeouts can't go away
+     * since only this function frees them */
+    PyThread_release_lock(aioLock);
 
- cleanup:
-    if (!pyobj_ret) {
-        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
-        PyErr_Print();
-    } else {
-        Py_DECREF(pyobj_ret);
-        ret = 0;
-    }
+    for (i = 0; i < nfds; i++)
+        libvirt_virEventAioWatchFD(fds[i], fdEvents[i], fdReset[i]);
 
-    LIBVIRT_RELEASE_THREAD_STATE;
-    return ret;
-}
+    for (i = 0; i < ntimeouts; i++) {
+        int frequency;
+        int timer;
 
-static int
-libvirt_virConnectDomainEventIOErrorCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
-                                             virDomainPtr dom,
-                                             const char *srcPath,
-                                             const char *devAlias,
-                                             int action,
-                                             void *opaque)
-{
-    PyObject *pyobj_cbData = (PyObject*)opaque;
-    PyObject *pyobj_dom;
-    PyObject *pyobj_ret = NULL;
-    PyObject *pyobj_conn;
-    PyObject *dictKey;
-    int ret = -1;
+        if (cancelled[i]) {
+            if (!(ret = PyObject_CallMethod(cancelled[i], (char *) "cancel",
+                                            NULL)))
+                PyErr_Print();
+            Py_XDECREF(ret);
+            Py_DECREF(cancelled[i]);
+        }
 
-    LIBVIRT_ENSURE_THREAD_STATE;
+        if (!timeouts[i])
+            continue;
 
-    if (!(dictKey = libvirt_constcharPtrWrap("conn")))
-        goto cleanup;
-    pyobj_conn = PyDict_GetItem(pyobj_cbData, dictKey);
-    Py_DECREF(dictKey);
+        PyThread_acquire_lock(aioLock, WAIT_LOCK);
+        frequency = timeouts[i]->frequency;
+        timer = timeouts[i]->timer;
+        PyThread_release_lock(aioLock);
 
-    /* Create a python instance of this virDomainPtr */
-    virDomainRef(dom);
-    if (!(pyobj_dom = libvirt_virDomainPtrWrap(dom))) {
-        virDomainFree(dom);
-        goto cleanup;
-    }
-    Py_INCREF(pyobj_cbData);
+        if (frequency < 0)
+            continue;
 
-    /* Call the Callback Dispatcher */
-    pyobj_ret = PyObject_CallMethod(pyobj_conn,
-                                    (char*)"_dispatchDomainEventIOErrorCallback",
-                                    (char*)"OssiO",
-                                    pyobj_dom,
-                                    srcPath, devAlias, action,
-                                    pyobj_cbData);
+        if (!(scheduled = PyObject_CallMethod(aioLoop, (char *) "call_later",
+                                              (char *) "dOi",
+                                              frequency / 1000.0,
+                                              aioTimeoutReadyFunc, timer))) {
+            PyErr_Print();
+            continue;
+        }
 
-    Py_DECREF(pyobj_cbData);
-    Py_DECREF(pyobj_dom);
+        /* A change made in the meantime will cancel it on the next sync */
+        PyThread_acquire_lock(aioLock, WAIT_LOCK);
+        timeouts[i]->scheduled = scheduled;
+        PyThread_release_lock(aioLock);
+    }
 
- cleanup:
-    if (!pyobj_ret) {
-        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
-        PyErr_Print();
-    } else {
-        Py_DECREF(pyobj_ret);
-        ret = 0;
+    if (nreleases) {
+        LIBVIRT_BEGIN_ALLOW_THREADS;
+        for (i = 0; i < nreleases; i++) {
+            if (releases[i].ff)
+                releases[i].ff(releases[i].opaque);
+        }
+        LIBVIRT_END_ALLOW_THREADS;
     }
 
-    LIBVIRT_RELEASE_THREAD_STATE;
-    return ret;
+ cleanup:
+    VIR_FREE(fds);
+    VIR_FREE(fdEvents);
+    VIR_FREE(fdReset);
+    VIR_FREE(timeouts);
+    VIR_FREE(cancelled);
+    VIR_FREE(releases);
 }
 
-static int
-libvirt_virConnectDomainEventIOErrorReasonCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
-                                                   virDomainPtr dom,
-                                                   const char *srcPath,
-                                                   const char *devAlias,
-                                                   int action,
-                                                   const char *reason,
-                                                   void *opaque)
+static PyObject *
+libvirt_virEventAioSync(PyObject *self ATTRIBUTE_UNUSED,
+                        PyObject *args ATTRIBUTE_UNUSED)
 {
-    PyObject *pyobj_cbData = (PyObject*)opaque;
-    PyObject *pyobj_dom;
-    PyObject *pyobj_ret = NULL;
-    PyObject *pyobj_conn;
-    PyObject *dictKey;
-    int ret = -1;
+    libvirt_virEventAioSyncImpl();
+    return VIR_PY_NONE;
+}
 
-    LIBVIRT_ENSURE_THREAD_STATE;
+static PyObject *
+libvirt_virEventAioHandleReady(PyObject *self ATTRIBUTE_UNUSED,
+                               PyObject *args)
+{
+    virPyAioHandle *ready = NULL;
+    size_t nready = 0;
+    size_t i;
+    int fd;
+    int events;
 
-    if (!(dictKey = libvirt_constcharPtrWrap("conn")))
-        goto cleanup;
-    pyobj_conn = PyDict_GetItem(pyobj_cbData, dictKey);
-    Py_DECREF(dictKey);
+    if (!PyArg_ParseTuple(args, (char *) "ii:virEventAioHandleReady",
+                          &fd, &events))
+        return NULL;
 
-    /* Create a python instance of this virDomainPtr */
-    virDomainRef(dom);
-    if (!(pyobj_dom = libvirt_virDomainPtrWrap(dom))) {
-        virDomainFree(dom);
-        goto cleanup;
+    /* Handles can only be freed by the sync, which runs in this thread,
+     * so the copies stay valid after dropping the lock */
+    PyThread_acquire_lock(aioLock, WAIT_LOCK);
+    if (VIR_ALLOC_N(ready, aioNHandles + 1) == 0) {
+        for (i = 0; i < aioNHandles; i++) {
+            if (aioHandles[i]->fd == fd && !aioHandles[i]->deleted &&
+                (aioHandles[i]->events & events))
+                ready[nready++] = *aioHandles[i];
+        }
     }
-    Py_INCREF(pyobj_cbData);
-
-    /* Call the Callback Dispatcher */
-    pyobj_ret = PyObject_CallMethod(pyobj_conn,
-                                    (char*)"_dispatchDomainEventIOErrorReasonCallback",
-                                    (char*)"OssisO",
-                                    pyobj_dom,
-                                    srcPath, devAlias, action, reason,
-                                    pyobj_cbData);
+    PyThread_release_lock(aioLock);
 
-    Py_DECREF(pyobj_cbData);
-    Py_DECREF(pyobj_dom);
-
- cleanup:
-    if (!pyobj_ret) {
-        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
-        PyErr_Print();
-    } else {
-        Py_DECREF(pyobj_ret);
-        ret = 0;
-    }
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    for (i = 0; i < nready; i++)
+        ready[i].cb(ready[i].watch, fd, events, ready[i].opaque);
+    LIBVIRT_END_ALLOW_THREADS;
 
-    LIBVIRT_RELEASE_THREAD_STATE;
-    return ret;
+    VIR_FREE(ready);
+    return VIR_PY_NONE;
 }
 
-static int
-libvirt_virConnectDomainEventGraphicsCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
-                                              virDomainPtr dom,
-                                              int phase,
-                                              virDomainEventGraphicsAddressPtr local,
-                                              virDomainEventGraphicsAddressPtr remote,
-                                              const char *authScheme,
-                                              virDomainEventGraphicsSubjectPtr subject,
-                                              void *opaque)
+static PyObject *
+libvirt_virEventAioTimeoutReady(PyObject *self ATTRIBUTE_UNUSED,
+                                PyObject *args)
 {
-    PyObject *pyobj_cbData = (PyObject*)opaque;
-    PyObject *pyobj_dom;
-    PyObject *pyobj_ret = NULL;
-    PyObject *pyobj_conn;
-    PyObject *dictKey;
-    PyObject *pyobj_local;
-    PyObject *pyobj_remote;
-    PyObject *pyobj_subject;
-    int ret = -1;
-    size_t i;
-
-    LIBVIRT_ENSURE_THREAD_STATE;
+    virPyAioTimeoutPtr timeout;
+    virEventTimeoutCallback cb = NULL;
+    void *opaque = NULL;
+    PyObject *fired = NULL;
+    bool sync = false;
+    int timer;
 
-    if (!(dictKey = libvirt_constcharPtrWrap("conn")))
-        goto cleanup;
-    pyobj_conn = PyDict_GetItem(pyobj_cbData, dictKey);
-    Py_DECREF(dictKey);
+    if (!PyArg_ParseTuple(args, (char *) "i:virEventAioTimeoutReady",
+                          &timer))
+        return NULL;
 
-    /* Create a python instance of this virDomainPtr */
-    virDomainRef(dom);
-    if (!(pyobj_dom = libvirt_virDomainPtrWrap(dom))) {
-        virDomainFree(dom);
-        goto cleanup;
-    }
-    Py_INCREF(pyobj_cbData);
+    PyThread_acquire_lock(aioLock, WAIT_LOCK);
+    if ((timeout = libvirt_virEventAioFindTimeout(timer)) &&
+        !timeout->deleted && timeout->frequency >= 0) {
+        cb = timeout->cb;
+        opaque = timeout->opaque;
 
-    /* FIXME This code should check for errors... */
-    pyobj_local = PyDict_New();
-    PyDict_SetItem(pyobj_local,
-                   libvirt_constcharPtrWrap("family"),
-                   libvirt_intWrap(local->family));
-    PyDict_SetItem(pyobj_local,
-                   libvirt_constcharPtrWrap("node"),
-                   libvirt_constcharPtrWrap(local->node));
-    PyDict_SetItem(pyobj_local,
-                   libvirt_constcharPtrWrap("service"),
-                   libvirt_constcharPtrWrap(local->service));
-
-    pyobj_remote = PyDict_New();
-    PyDict_SetItem(pyobj_remote,
-                   libvirt_constcharPtrWrap("family"),
-                   libvirt_intWrap(remote->family));
-    PyDict_SetItem(pyobj_remote,
-                   libvirt_constcharPtrWrap("node"),
-                   libvirt_constcharPtrWrap(remote->node));
-    PyDict_SetItem(pyobj_remote,
-                   libvirt_constcharPtrWrap("service"),
-                   libvirt_constcharPtrWrap(remote->service));
-
-    pyobj_subject = PyList_New(subject->nidentity);
-    for (i = 0; i < subject->nidentity; i++) {
-        PyObject *pair = PyTuple_New(2);
-        PyTuple_SetItem(pair, 0, libvirt_constcharPtrWrap(subject->identities[i].type));
-        PyTuple_SetItem(pair, 1, libvirt_constcharPtrWrap(subject->identities[i].name));
-
-        PyList_SetItem(pyobj_subject, i, pair);
+        /* call_later() is one-shot, get the next expiry scheduled */
+        fired = timeout->scheduled;
+        timeout->scheduled = NULL;
+        timeout->dirty = true;
+        sync = libvirt_virEventAioMarkDirty();
     }
+    PyThread_release_lock(aioLock);
 
-    /* Call the Callback Dispatcher */
-    pyobj_ret = PyObject_CallMethod(pyobj_conn,
-                                    (char*)"_dispatchDomainEventGraphicsCallback",
-                                    (char*)"OiOOsOO",
-                                    pyobj_dom,
-                                    phase, pyobj_local, pyobj_remote,
-                                    authScheme, pyobj_subject,
-                                    pyobj_cbData);
-
-    Py_DECREF(pyobj_cbData);
-    Py_DECREF(pyobj_dom);
+    Py_XDECREF(fired);
 
- cleanup:
-    if (!pyobj_ret) {
-        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
-        PyErr_Print();
-    } else {
-        Py_DECREF(pyobj_ret);
-        ret = 0;
+    if (cb) {
+        LIBVIRT_BEGIN_ALLOW_THREADS;
+        cb(timer, opaque);
+        LIBVIRT_END_ALLOW_THREADS;
     }
 
-    LIBVIRT_RELEASE_THREAD_STATE;
-    return ret;
+    if (sync)
+        libvirt_virEventAioSyncImpl();
+
+    return VIR_PY_NONE;
 }
 
-static int
-libvirt_virConnectDomainEventBlockJobCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
-                                              virDomainPtr dom,
-                                              const char *disk,
-                                              int type,
-                                              int status,
-                                              void *opaque)
-{
-    PyObject *pyobj_cbData = (PyObject*)opaque;
-    PyObject *pyobj_dom;
-    PyObject *pyobj_ret = NULL;
-    PyObject *pyobj_conn;
-    PyObject *dictKey;
-    int ret = -1;
+static PyMethodDef libvirtAioMethods[] = {
+    {(char *) "virEventAioSync", libvirt_virEventAioSync, METH_NOARGS, NULL},
+    {(char *) "virEventAioHandleReady", libvirt_virEventAioHandleReady, METH_VARARGS, NULL},
+    {(char *) "virEventAioTimeoutReady", libvirt_virEventAioTimeoutReady, METH_VARARGS, NULL},
+};
 
-    LIBVIRT_ENSURE_THREAD_STATE;
+static PyObject *
+libvirt_virEventRegisterAsyncioImpl(PyObject *self ATTRIBUTE_UNUSED,
+                                    PyObject *args)
+{
+    PyObject *loop;
 
-    if (!(dictKey = libvirt_constcharPtrWrap("conn")))
-        goto cleanup;
-    pyobj_conn = PyDict_GetItem(pyobj_cbData, dictKey);
-    Py_DECREF(dictKey);
+    if (!PyArg_ParseTuple(args, (char *) "O:virEventRegisterAsyncioImpl",
+                          &loop))
+        return NULL;
 
-    /* Create a python instance of this virDomainPtr */
-    virDomainRef(dom);
-    if (!(pyobj_dom = libvirt_virDomainPtrWrap(dom))) {
-        virDomainFree(dom);
-        goto cleanup;
+    if (aioLoop) {
+        /* The handles already registered are tied to the first loop */
+        if (loop == aioLoop)
+            return VIR_PY_INT_SUCCESS;
+        PyErr_SetString(PyExc_RuntimeError,
+                        "an asyncio event loop is already registered");
+        return NULL;
     }
-    Py_INCREF(pyobj_cbData);
 
-    /* Call the Callback Dispatcher */
-    pyobj_ret = PyObject_CallMethod(pyobj_conn,
-                                    (char*)"_dispatchDomainEventBlockJobCallback",
-                                    (char*)"OsiiO",
-                                    pyobj_dom, disk, type, status, pyobj_cbData);
+    if (!aioLock && !(aioLock = PyThread_allocate_lock()))
+        return PyErr_NoMemory();
 
-    Py_DECREF(pyobj_cbData);
-    Py_DECREF(pyobj_dom);
+    if ((!aioSyncFunc &&
+         !(aioSyncFunc = PyCFunction_New(&libvirtAioMethods[0], NULL))) ||
+        (!aioHandleReadyFunc &&
+         !(aioHandleReadyFunc = PyCFunction_New(&libvirtAioMethods[1], NULL))) ||
+        (!aioTimeoutReadyFunc &&
+         !(aioTimeoutReadyFunc = PyCFunction_New(&libvirtAioMethods[2], NULL))))
+        return NULL;
 
- cleanup:
-    if (!pyobj_ret) {
-        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
-        PyErr_Print();
-    } else {
-        Py_DECREF(pyobj_ret);
-        ret = 0;
-    }
+    Py_INCREF(loop);
+    aioLoop = loop;
 
-    LIBVIRT_RELEASE_THREAD_STATE;
-    return ret;
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    virEventRegisterImpl(libvirt_virEventAioAddHandleFunc,
+                         libvirt_virEventAioUpdateHandleFunc,
+                         libvirt_virEventAioRemoveHandleFunc,
+                         libvirt_virEventAioAddTimeoutFunc,
+                         libvirt_virEventAioUpdateTimeoutFunc,
+                         libvirt_virEventAioRemoveTimeoutFunc);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    return VIR_PY_INT_SUCCESS;
 }
 
-static int
-libvirt_virConnectDomainEventDiskChangeCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
-                                                virDomainPtr dom,
-                                                const char *oldSrcPath,
-                                                const char *newSrcPath,
-                                                const char *devAlias,
-                                                int reason,
-                                                void *opaque)
-{
-    PyObject *pyobj_cbData = (PyObject*)opaque;
-    PyObject *pyobj_dom;
-    PyObject *pyobj_ret = NULL;
-    PyObject *pyobj_conn;
-    PyObject *dictKey;
-    int ret = -1;
+/*
+ * asyncio worker pool
+ *
+ * virAioSubmit queues a python callable to be run on one of a pool of
+ * native threads, and resolves an asyncio future in the loop thread
+ * with its outcome.  The libvirt wrappers drop the GIL around the
+ * libvirt call, so a worker only holds it to parse the arguments and
+ * convert the result, and the libvirt error raised by a failed call is
+ * read from the worker's own thread local error as usual.  Idle
+ * workers sleep on their own lock, which is released to wake them up.
+ *
+ * virAioBatch runs a list of calls on the same workers instead, and
+ * waits for all of them to complete.
+ */
+typedef struct _virPyAioBatch virPyAioBatch;
+typedef virPyAioBatch *virPyAioBatchPtr;
+struct _virPyAioBatch {
+    PyThread_type_lock done;    /* held until the last call completes */
+    PyObject *results;          /* (failed, result or exception) tuples */
+    size_t pending;             /* protected by the GIL */
+};
 
-    LIBVIRT_ENSURE_THREAD_STATE;
+typedef struct _virPyAioJob virPyAioJob;
+typedef virPyAioJob *virPyAioJobPtr;
+struct _virPyAioJob {
+    PyObject *loop;
+    PyObject *future;
+    virPyAioBatchPtr batch;     /* set instead of loop and future */
+    size_t index;               /* in batch->results */
+    PyObject *func;
+    PyObject *args;
+    PyObject *kwargs;
+    virPyAioJobPtr next;
+};
 
-    if (!(dictKey = libvirt_constcharPtrWrap("conn")))
-        goto cleanup;
-    pyobj_conn = PyDict_GetItem(pyobj_cbData, dictKey);
-    Py_DECREF(dictKey);
+typedef struct _virPyAioWorker virPyAioWorker;
+typedef virPyAioWorker *virPyAioWorkerPtr;
+struct _virPyAioWorker {
+    PyThread_type_lock wakeup;  /* held while the worker is idle */
+    virPyAioWorkerPtr next;     /* in the idle list */
+};
 
-    /* Create a python instance of this virDomainPtr */
-    virDomainRef(dom);
-    if (!(pyobj_dom = libvirt_virDomainPtrWrap(dom))) {
-        virDomainFree(dom);
-        goto cleanup;
-    }
-    Py_INCREF(pyobj_cbData);
+static PyThread_type_lock aioPoolLock;
+static PyObject *aioCompleteFunc;
 
-    /* Call the Callback Dispatcher */
-    pyobj_ret = PyObject_CallMethod(pyobj_conn,
-                                    (char*)"_dispatchDomainEventDiskChangeCallback",
-                                    (char*)"OsssiO",
-                                    pyobj_dom,
-                                    oldSrcPath, newSrcPath,
-                                    devAlias, reason, pyobj_cbData);
+/* Protected by aioPoolLock */
+static virPyAioJobPtr aioPoolHead;
+static virPyAioJobPtr aioPoolTail;
+static virPyAioWorkerPtr aioPoolIdle;
+static size_t aioPoolWorkers;
+static size_t aioPoolMaxWorkers = 32;
 
-    Py_DECREF(pyobj_cbData);
-    Py_DECREF(pyobj_dom);
+static void
+libvirt_virAioJobFree(virPyAioJobPtr job)
+{
+    Py_XDECREF(job->loop);
+    Py_XDECREF(job->future);
+    Py_DECREF(job->func);
+    Py_DECREF(job->args);
+    Py_XDECREF(job->kwargs);
+    VIR_FREE(job);
+}
 
- cleanup:
-    if (!pyobj_ret) {
-        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
+/* Store the outcome of a batch @job in its results, and wake up the
+ * waiter once it is the last one.  Must be called with the GIL held.  */
+static void
+libvirt_virAioBatchComplete(virPyAioJobPtr job,
+                            PyObject *result,
+                            PyObject *error)
+{
+    virPyAioBatchPtr batch = job->batch;
+    PyObject *item;
+
+    if (result)
+        item = Py_BuildValue((char *) "(OO)", Py_False, result);
+    else
+        item = Py_BuildValue((char *) "(OO)", Py_True,
+                             error ? error : Py_None);
+    if (!item || PyList_SetItem(batch->results, job->index, item) < 0)
         PyErr_Print();
+
+    if (--batch->pending == 0)
+        PyThread_release_lock(batch->done);
+}
+
+/* Run @job and hand its outcome over to the loop.  Must be called with
+ * the GIL held.  */
+static void
+libvirt_virAioJobRun(virPyAioJobPtr job)
+{
+    PyObject *result = NULL;
+    PyObject *type = NULL;
+    PyObject *value = NULL;
+    PyObject *traceback = NULL;
+    PyObject *ret;
+    int cancelled;
+
+    /* Don't bother with calls given up on while queued */
+    if (job->future) {
+        if (!(ret = PyObject_CallMethod(job->future, (char *) "cancelled",
+                                        NULL))) {
+            PyErr_Print();
+            return;
+        }
+        cancelled = PyObject_IsTrue(ret);
+        Py_DECREF(ret);
+        if (cancelled)
+            return;
+    }
+
+    if (!(result = PyObject_Call(job->func, job->args, job->kwargs))) {
+        PyErr_Fetch(&type, &value, &traceback);
+        PyErr_NormalizeException(&type, &value, &traceback);
+#if PY_MAJOR_VERSION > 2
+        if (value && traceback)
+            PyException_SetTraceback(value, traceback);
+#endif
+    }
+
+    if (job->batch) {
+        libvirt_virAioBatchComplete(job, result, value);
+        ret = NULL;
     } else {
-        Py_DECREF(pyobj_ret);
-        ret = 0;
+        ret = PyObject_CallMethod(job->loop, (char *) "call_soon_threadsafe",
+                                  (char *) "OOOO", aioCompleteFunc, job->future,
+                                  result ? result : Py_None,
+                                  value ? value : Py_None);
+        if (!ret) {
+            DEBUG("%s - ret:%p\n", __FUNCTION__, ret);
+            PyErr_Print();
+        }
     }
 
-    LIBVIRT_RELEASE_THREAD_STATE;
-    return ret;
+    Py_XDECREF(ret);
+    Py_XDECREF(result);
+    Py_XDECREF(type);
+    Py_XDECREF(value);
+    Py_XDECREF(traceback);
 }
 
-static int
-libvirt_virConnectDomainEventTrayChangeCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
-                                                virDomainPtr dom,
-                                                const char *devAlias,
-                                                int reason,
-                                                void *opaque)
+static void
+libvirt_virAioWorker(void *opaque)
 {
-    PyObject *pyobj_cbData = (PyObject*)opaque;
-    PyObject *pyobj_dom;
-    PyObject *pyobj_ret = NULL;
-    PyObject *pyobj_conn;
-    PyObject *dictKey;
-    int ret = -1;
+    virPyAioWorkerPtr self = opaque;
+    virPyAioJobPtr job;
+
+    for (;;) {
+        PyThread_acquire_lock(aioPoolLock, WAIT_LOCK);
+        if (!(job = aioPoolHead)) {
+            self->next = aioPoolIdle;
+            aioPoolIdle = self;
+            PyThread_release_lock(aioPoolLock);
+
+            /* Sleep until a submitter releases it */
+            PyThread_acquire_lock(self->wakeup, WAIT_LOCK);
+            continue;
+        }
+        if (!(aioPoolHead = job->next))
+            aioPoolTail = NULL;
+        PyThread_release_lock(aioPoolLock);
 
-    LIBVIRT_ENSURE_THREAD_STATE;
+        LIBVIRT_ENSURE_THREAD_STATE;
+        libvirt_virAioJobRun(job);
+        libvirt_virAioJobFree(job);
+        LIBVIRT_RELEASE_THREAD_STATE;
+    }
+}
 
-    if (!(dictKey = libvirt_constcharPtrWrap("conn")))
-        goto cleanup;
-    pyobj_conn = PyDict_GetItem(pyobj_cbData, dictKey);
-    Py_DECREF(dictKey);
+/* Start a new worker, which starts out idle.  Must be called with the
+ * pool lock held.  */
+static int
+libvirt_virAioStartWorker(void)
+{
+    virPyAioWorkerPtr worker;
 
-    /* Create a python instance of this virDomainPtr */
-    virDomainRef(dom);
-    if (!(pyobj_dom = libvirt_virDomainPtrWrap(dom))) {
-        virDomainFree(dom);
-        goto cleanup;
-    }
-    Py_INCREF(pyobj_cbData);
+    if (VIR_ALLOC(worker) < 0)
+        return -1;
 
-    /* Call the Callback Dispatcher */
-    pyobj_ret = PyObject_CallMethod(pyobj_conn,
-                                    (char*)"_dispatchDomainEventTrayChangeCallback",
-                                    (char*)"OsiO",
-                                    pyobj_dom,
-                                    devAlias, reason, pyobj_cbData);
+    if (!(worker->wakeup = PyThread_allocate_lock()))
+        goto error;
+    PyThread_acquire_lock(worker->wakeup, WAIT_LOCK);
 
-    Py_DECREF(pyobj_cbData);
-    Py_DECREF(pyobj_dom);
+    if (PyThread_start_new_thread(libvirt_virAioWorker, worker) == (long) -1)
+        goto error;
 
- cleanup:
-    if (!pyobj_ret) {
-        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
-        PyErr_Print();
-    } else {
-        Py_DECREF(pyobj_ret);
-        ret = 0;
-    }
+    aioPoolWorkers++;
+    return 0;
 
-    LIBVIRT_RELEASE_THREAD_STATE;
-    return ret;
+ error:
+    if (worker->wakeup)
+        PyThread_free_lock(worker->wakeup);
+    VIR_FREE(worker);
+    return -1;
 }
 
+/* Queue the @njobs @jobs, waking up or starting workers to run them.
+ * Must be called without the GIL held.  Returns -1, with none of the
+ * jobs queued, if there is no worker at all to run them.  */
 static int
-libvirt_virConnectDomainEventPMWakeupCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
-                                              virDomainPtr dom,
-                                              int reason,
-                                              void *opaque)
+libvirt_virAioQueue(virPyAioJobPtr *jobs,
+                    size_t njobs)
 {
-    PyObject *pyobj_cbData = (PyObject*)opaque;
-    PyObject *pyobj_dom;
-    PyObject *pyobj_ret = NULL;
-    PyObject *pyobj_conn;
-    PyObject *dictKey;
-    int ret = -1;
-
-    LIBVIRT_ENSURE_THREAD_STATE;
+    virPyAioJobPtr prevTail;
+    virPyAioWorkerPtr wakeup = NULL;
+    virPyAioWorkerPtr worker;
+    size_t i;
+    int ret = 0;
 
-    if (!(dictKey = libvirt_constcharPtrWrap("conn")))
-        goto cleanup;
-    pyobj_conn = PyDict_GetItem(pyobj_cbData, dictKey);
-    Py_DECREF(dictKey);
+    PyThread_acquire_lock(aioPoolLock, WAIT_LOCK);
 
-    /* Create a python instance of this virDomainPtr */
-    virDomainRef(dom);
-    if (!(pyobj_dom = libvirt_virDomainPtrWrap(dom))) {
-        virDomainFree(dom);
-        goto cleanup;
+    prevTail = aioPoolTail;
+    for (i = 0; i < njobs; i++) {
+        if (aioPoolTail)
+            aioPoolTail->next = jobs[i];
+        else
+            aioPoolHead = jobs[i];
+        aioPoolTail = jobs[i];
+    }
+
+    /* Without an idle worker a job waits for a busy one, unless the
+     * pool can grow */
+    for (i = 0; i < njobs; i++) {
+        if ((worker = aioPoolIdle)) {
+            aioPoolIdle = worker->next;
+            worker->next = wakeup;
+            wakeup = worker;
+        } else if (aioPoolWorkers >= aioPoolMaxWorkers) {
+            break;
+        } else if (libvirt_virAioStartWorker() < 0) {
+            if (aioPoolWorkers == 0)
+                ret = -1;
+            break;
+        }
     }
-    Py_INCREF(pyobj_cbData);
 
-    /* Call the Callback Dispatcher */
-    pyobj_ret = PyObject_CallMethod(pyobj_conn,
-                                    (char*)"_dispatchDomainEventPMWakeupCallback",
-                                    (char*)"OiO",
-                                    pyobj_dom,
-                                    reason,
-                                    pyobj_cbData);
+    if (ret < 0) {
+        /* Nobody would ever pick them up */
+        if ((aioPoolTail = prevTail))
+            prevTail->next = NULL;
+        else
+            aioPoolHead = NULL;
+    }
 
-    Py_DECREF(pyobj_cbData);
-    Py_DECREF(pyobj_dom);
+    PyThread_release_lock(aioPoolLock);
 
- cleanup:
-    if (!pyobj_ret) {
-        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
-        PyErr_Print();
-    } else {
-        Py_DECREF(pyobj_ret);
-        ret = 0;
+    /* A woken up worker may go idle again right away */
+    while ((worker = wakeup)) {
+        wakeup = worker->next;
+        PyThread_release_lock(worker->wakeup);
     }
 
-    LIBVIRT_RELEASE_THREAD_STATE;
     return ret;
 }
 
 static int
-libvirt_virConnectDomainEventPMSuspendCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
-                                               virDomainPtr dom,
-                                               int reason,
-                                               void *opaque)
+libvirt_virAioPoolInit(void)
 {
-    PyObject *pyobj_cbData = (PyObject*)opaque;
-    PyObject *pyobj_dom;
-    PyObject *pyobj_ret = NULL;
-    PyObject *pyobj_conn;
-    PyObject *dictKey;
-    int ret = -1;
-
-    LIBVIRT_ENSURE_THREAD_STATE;
+    if (!aioPoolLock) {
+#if PY_VERSION_HEX < 0x03070000
+        PyEval_InitThreads();
+#endif
+        if (!(aioPoolLock = PyThread_allocate_lock())) {
+            PyErr_NoMemory();
+            return -1;
+        }
+    }
 
-    if (!(dictKey = libvirt_constcharPtrWrap("conn")))
-        goto cleanup;
-    pyobj_conn = PyDict_GetItem(pyobj_cbData, dictKey);
-    Py_DECREF(dictKey);
+    return 0;
+}
 
-    /* Create a python instance of this virDomainPtr */
-    virDomainRef(dom);
-    if (!(pyobj_dom = libvirt_virDomainPtrWrap(dom))) {
-        virDomainFree(dom);
-        goto cleanup;
-    }
-    Py_INCREF(pyobj_cbData);
+static PyObject *
+libvirt_virAioComplete(PyObject *self ATTRIBUTE_UNUSED,
+                       PyObject *args)
+{
+    PyObject *future;
+    PyObject *result;
+    PyObject *error;
+    PyObject *ret;
+    int cancelled;
 
-    /* Call the Callback Dispatcher */
-    pyobj_ret = PyObject_CallMethod(pyobj_conn,
-                                    (char*)"_dispatchDomainEventPMSuspendCallback",
-                                    (char*)"OiO",
-                                    pyobj_dom,
-                                    reason,
-                                    pyobj_cbData);
+    if (!PyArg_ParseTuple(args, (char *) "OOO:virAioComplete",
+                          &future, &result, &error))
+        return NULL;
 
-    Py_DECREF(pyobj_cbData);
-    Py_DECREF(pyobj_dom);
+    if (!(ret = PyObject_CallMethod(future, (char *) "cancelled", NULL)))
+        return NULL;
+    cancelled = PyObject_IsTrue(ret);
+    Py_DECREF(ret);
+    if (cancelled)
+        return VIR_PY_NONE;
 
- cleanup:
-    if (!pyobj_ret) {
-        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
-        PyErr_Print();
-    } else {
-        Py_DECREF(pyobj_ret);
-        ret = 0;
-    }
+    if (error != Py_None)
+        ret = PyObject_CallMethod(future, (char *) "set_exception",
+                                  (char *) "O", error);
+    else
+        ret = PyObject_CallMethod(future, (char *) "set_result",
+                                  (char *) "O", result);
+    if (!ret)
+        return NULL;
 
-    LIBVIRT_RELEASE_THREAD_STATE;
-    return ret;
+    Py_DECREF(ret);
+    return VIR_PY_NONE;
 }
 
+static PyMethodDef libvirtAioCompleteMethod = {
+    (char *) "virAioComplete", libvirt_virAioComplete, METH_VARARGS, NULL
+};
 
-#ifdef VIR_DOMAIN_EVENT_ID_BALLOON_CHANGE
-static int
-libvirt_virConnectDomainEventBalloonChangeCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
-                                                   virDomainPtr dom,
-                                                   unsigned long long actual,
-                                                   void *opaque)
+static PyObject *
+libvirt_virAioSubmit(PyObject *self ATTRIBUTE_UNUSED,
+                     PyObject *args)
 {
-    PyObject *pyobj_cbData = (PyObject*)opaque;
-    PyObject *pyobj_dom;
-    PyObject *pyobj_ret = NULL;
-    PyObject *pyobj_conn;
-    PyObject *dictKey;
-    int ret = -1;
-
-    LIBVIRT_ENSURE_THREAD_STATE;
+    PyObject *loop;
+    PyObject *future;
+    PyObject *func;
+    PyObject *pyobj_args;
+    PyObject *kwargs;
+    virPyAioJobPtr job;
+    int ret;
 
-    if (!(dictKey = libvirt_constcharPtrWrap("conn")))
-        goto cleanup;
-    pyobj_conn = PyDict_GetItem(pyobj_cbData, dictKey);
-    Py_DECREF(dictKey);
+    if (!PyArg_ParseTuple(args, (char *) "OOOOO:virAioSubmit",
+                          &loop, &future, &func, &pyobj_args, &kwargs))
+        return NULL;
 
-    /* Create a python instance of this virDomainPtr */
-    virDomainRef(dom);
-    if (!(pyobj_dom = libvirt_virDomainPtrWrap(dom))) {
-        virDomainFree(dom);
-        goto cleanup;
+    if (!PyTuple_Check(pyobj_args) ||
+        (kwargs != Py_None && !PyDict_Check(kwargs))) {
+        PyErr_SetString(PyExc_TypeError,
+                        "expected an argument tuple and a keyword dict");
+        return NULL;
     }
-    Py_INCREF(pyobj_cbData);
 
-    /* Call the Callback Dispatcher */
-    pyobj_ret = PyObject_CallMethod(pyobj_conn,
-                                    (char*)"_dispatchDomainEventBalloonChangeCallback",
-                                    (char*)"OLO",
-                                    pyobj_dom,
-                                    (PY_LONG_LONG)actual,
-                                    pyobj_cbData);
+    if (libvirt_virAioPoolInit() < 0)
+        return NULL;
 
-    Py_DECREF(pyobj_cbData);
-    Py_DECREF(pyobj_dom);
+    if (!aioCompleteFunc &&
+        !(aioCompleteFunc = PyCFunction_New(&libvirtAioCompleteMethod, NULL)))
+        return NULL;
 
- cleanup:
-    if (!pyobj_ret) {
-        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
-        PyErr_Print();
-    } else {
-        Py_DECREF(pyobj_ret);
-        ret = 0;
+    if (VIR_ALLOC(job) < 0)
+        return PyErr_NoMemory();
+
+    Py_INCREF(loop);
+    Py_INCREF(future);
+    Py_INCREF(func);
+    Py_INCREF(pyobj_args);
+    job->loop = loop;
+    job->future = future;
+    job->func = func;
+    job->args = pyobj_args;
+    if (kwargs != Py_None) {
+        Py_INCREF(kwargs);
+        job->kwargs = kwargs;
     }
 
-    LIBVIRT_RELEASE_THREAD_STATE;
-    return ret;
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    ret = libvirt_virAioQueue(&job, 1);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (ret < 0) {
+        libvirt_virAioJobFree(job);
+        PyErr_SetString(PyExc_RuntimeError,
+                        "cannot start a libvirt worker thread");
+        return NULL;
+    }
+
+    return VIR_PY_NONE;
 }
-#endif /* VIR_DOMAIN_EVENT_ID_BALLOON_CHANGE */
 
-#ifdef VIR_DOMAIN_EVENT_ID_PMSUSPEND_DISK
-static int
-libvirt_virConnectDomainEventPMSuspendDiskCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
-                                                   virDomainPtr dom,
-                                                   int reason,
-                                                   void *opaque)
+static PyObject *
+libvirt_virAioBatch(PyObject *self ATTRIBUTE_UNUSED,
+                    PyObject *args)
 {
-    PyObject *pyobj_cbData = (PyObject*)opaque;
-    PyObject *pyobj_dom;
-    PyObject *pyobj_ret = NULL;
-    PyObject *pyobj_conn;
-    PyObject *dictKey;
-    int ret = -1;
+    PyObject *pyobj_calls;
+    PyObject *py_retval = NULL;
+    PyObject *call;
+    virPyAioBatch batch;
+    virPyAioJobPtr *jobs = NULL;
+    size_t njobs = 0;
+    size_t ncalls;
+    size_t i;
+    int ret;
 
-    LIBVIRT_ENSURE_THREAD_STATE;
+    if (!PyArg_ParseTuple(args, (char *) "O:virAioBatch", &pyobj_calls))
+        return NULL;
 
-    if (!(dictKey = libvirt_constcharPtrWrap("conn")))
+    if (!PyList_Check(pyobj_calls)) {
+        PyErr_SetString(PyExc_TypeError, "calls must be a list");
+        return NULL;
+    }
+
+    memset(&batch, 0, sizeof(batch));
+    ncalls = PyList_Size(pyobj_calls);
+    if (!(batch.results = PyList_New(ncalls)))
+        return NULL;
+    if (ncalls == 0)
+        return batch.results;
+
+    if (libvirt_virAioPoolInit() < 0)
         goto cleanup;
-    pyobj_conn = PyDict_GetItem(pyobj_cbData, dictKey);
-    Py_DECREF(dictKey);
 
-    /* Create a python instance of this virDomainPtr */
-    virDomainRef(dom);
-    if (!(pyobj_dom = libvirt_virDomainPtrWrap(dom))) {
-        virDomainFree(dom);
+    if (!(batch.done = PyThread_allocate_lock()) ||
+        VIR_ALLOC_N(jobs, ncalls) < 0) {
+        PyErr_NoMemory();
         goto cleanup;
     }
-    Py_INCREF(pyobj_cbData);
 
-    /* Call the Callback Dispatcher */
-    pyobj_ret = PyObject_CallMethod(pyobj_conn,
-                                    (char*)"_dispatchDomainEventPMSuspendDiskCallback",
-                                    (char*)"OiO",
-                                    pyobj_dom,
-                                    reason,
-                                    pyobj_cbData);
+    for (i = 0; i < ncalls; i++) {
+        PyObject *func;
+        PyObject *pyobj_args;
+        PyObject *kwargs;
 
-    Py_DECREF(pyobj_cbData);
-    Py_DECREF(pyobj_dom);
+        call = PyList_GetItem(pyobj_calls, i);
+        if (!PyArg_ParseTuple(call, (char *) "OOO", &func, &pyobj_args, &kwargs))
+            goto cleanup;
+        if (!PyTuple_Check(pyobj_args) ||
+            (kwargs != Py_None && !PyDict_Check(kwargs))) {
+            PyErr_SetString(PyExc_TypeError,
+                            "expected an argument tuple and a keyword dict");
+            goto cleanup;
+        }
+
+        if (VIR_ALLOC(jobs[i]) < 0) {
+            PyErr_NoMemory();
+            goto cleanup;
+        }
+        njobs++;
+
+        Py_INCREF(func);
+        Py_INCREF(pyobj_args);
+        jobs[i]->batch = &batch;
+        jobs[i]->index = i;
+        jobs[i]->func = func;
+        jobs[i]->args = pyobj_args;
+        if (kwargs != Py_None) {
+            Py_INCREF(kwargs);
+            jobs[i]->kwargs = kwargs;
+        }
+        jobs[i]->next = NULL;
+    }
+
+    batch.pending = ncalls;
+    PyThread_acquire_lock(batch.done, WAIT_LOCK);
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    ret = libvirt_virAioQueue(jobs, njobs);
+    if (ret == 0) {
+        /* Released by the worker completing the last call */
+        PyThread_acquire_lock(batch.done, WAIT_LOCK);
+        PyThread_release_lock(batch.done);
+    }
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (ret < 0) {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "cannot start a libvirt worker thread");
+        goto cleanup;
+    }
+
+    /* The workers freed the jobs */
+    njobs = 0;
+    py_retval = batch.results;
+    batch.results = NULL;
 
  cleanup:
-    if (!pyobj_ret) {
-        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
-        PyErr_Print();
+    for (i = 0; i < njobs; i++)
+        libvirt_virAioJobFree(jobs[i]);
+    VIR_FREE(jobs);
+    if (batch.done)
+        PyThread_free_lock(batch.done);
+    Py_XDECREF(batch.results);
+    return py_retval;
+}
+
+static PyObject *
+libvirt_virAioSetMaxWorkers(PyObject *self ATTRIBUTE_UNUSED,
+                            PyObject *args)
+{
+    unsigned int max;
+
+    if (!PyArg_ParseTuple(args, (char *) "I:virAioSetMaxWorkers", &max))
+        return NULL;
+
+    if (max == 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "at least one worker thread is needed");
+        return NULL;
+    }
+
+    /* Workers above the new limit are kept, but no more are started */
+    if (aioPoolLock) {
+        LIBVIRT_BEGIN_ALLOW_THREADS;
+        PyThread_acquire_lock(aioPoolLock, WAIT_LOCK);
+        aioPoolMaxWorkers = max;
+        PyThread_release_lock(aioPoolLock);
+        LIBVIRT_END_ALLOW_THREADS;
     } else {
-        Py_DECREF(pyobj_ret);
-        ret = 0;
+        aioPoolMaxWorkers = max;
     }
 
-    LIBVIRT_RELEASE_THREAD_STATE;
-    return ret;
+    return VIR_PY_INT_SUCCESS;
 }
-#endif /* VIR_DOMAIN_EVENT_ID_PMSUSPEND_DISK */
 
-#ifdef VIR_DOMAIN_EVENT_ID_DEVICE_REMOVED
-static int
-libvirt_virConnectDomainEventDeviceRemovedCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
-                                                   virDomainPtr dom,
-                                                   const char *devAlias,
-                                                   void *opaque)
+static void
+libvirt_virEventHandleCallback(int watch,
+                               int fd,
+                               int events,
+                               void *opaque)
 {
-    PyObject *pyobj_cbData = (PyObject*)opaque;
-    PyObject *pyobj_dom;
-    PyObject *pyobj_ret = NULL;
-    PyObject *pyobj_conn;
-    PyObject *dictKey;
-    int ret = -1;
+    PyObject *pyobj_cbData = (PyObject *)opaque;
+    PyObject *pyobj_ret;
+    PyObject *python_cb;
 
     LIBVIRT_ENSURE_THREAD_STATE;
 
-    if (!(dictKey = libvirt_constcharPtrWrap("conn")))
-        goto cleanup;
-    pyobj_conn = PyDict_GetItem(pyobj_cbData, dictKey);
-    Py_DECREF(dictKey);
-
-    /* Create a python instance of this virDomainPtr */
-    virDomainRef(dom);
-    if (!(pyobj_dom = libvirt_virDomainPtrWrap(dom))) {
-        virDomainFree(dom);
+    /* Lookup the python callback */
+    python_cb = libvirt_lookupPythonFunc("_dispatchEventHandleCallback");
+    if (!python_cb) {
         goto cleanup;
     }
+
     Py_INCREF(pyobj_cbData);
 
-    /* Call the Callback Dispatcher */
-    pyobj_ret = PyObject_CallMethod(pyobj_conn,
-                                    (char*)"_dispatchDomainEventDeviceRemovedCallback",
-                                    (char*)"OsO",
-                                    pyobj_dom, devAlias, pyobj_cbData);
+    /* Call the pure python dispatcher */
+    pyobj_ret = PyObject_CallFunction(python_cb,
+                                      (char *)"iiiO",
+                                      watch, fd, events, pyobj_cbData);
 
     Py_DECREF(pyobj_cbData);
-    Py_DECREF(pyobj_dom);
 
- cleanup:
     if (!pyobj_ret) {
         DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
         PyErr_Print();
     } else {
         Py_DECREF(pyobj_ret);
-        ret = 0;
     }
 
+cleanup:
     LIBVIRT_RELEASE_THREAD_STATE;
-    return ret;
 }
-#endif /* VIR_DOMAIN_EVENT_ID_DEVICE_REMOVED */
 
-#ifdef VIR_DOMAIN_EVENT_ID_TUNABLE
-static int
-libvirt_virConnectDomainEventTunableCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
-                                             virDomainPtr dom,
-                                             virTypedParameterPtr params,
-                                             int nparams,
-                                             void *opaque)
+static PyObject *
+libvirt_virEventAddHandle(PyObject *self ATTRIBUTE_UNUSED,
+                          PyObject *args)
 {
-    PyObject *pyobj_cbData = (PyObject*)opaque;
-    PyObject *pyobj_dom;
-    PyObject *pyobj_ret = NULL;
-    PyObject *pyobj_conn;
-    PyObject *dictKey;
-    PyObject *pyobj_dict = NULL;
-    int ret = -1;
+    PyObject *py_retval;
+    PyObject *pyobj_cbData;
+    virEventHandleCallback cb = libvirt_virEventHandleCallback;
+    int events;
+    int fd;
+    int ret;
 
-    LIBVIRT_ENSURE_THREAD_STATE;
+    if (!PyArg_ParseTuple(args, (char *) "iiO:virEventAddHandle",
+                          &fd, &events, &pyobj_cbData)) {
+        DEBUG("%s failed to parse tuple\n", __FUNCTION__);
+        return VIR_PY_INT_FAIL;
+    }
 
-    pyobj_dict = getPyVirTypedParameter(params, nparams);
-    if (!pyobj_dict)
-        goto cleanup;
+    Py_INCREF(pyobj_cbData);
 
-    if (!(dictKey = libvirt_constcharPtrWrap("conn")))
-        goto cleanup;
-    pyobj_conn = PyDict_GetItem(pyobj_cbData, dictKey);
-    Py_DECREF(dictKey);
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    ret = virEventAddHandle(fd, events, cb, pyobj_cbData, NULL);
+    LIBVIRT_END_ALLOW_THREADS;
 
-    /* Create a python instance of this virDomainPtr */
-    virDomainRef(dom);
-    if (!(pyobj_dom = libvirt_virDomainPtrWrap(dom))) {
-        virDomainFree(dom);
+    if (ret < 0) {
+        Py_DECREF(pyobj_cbData);
+    }
+
+    py_retval = libvirt_intWrap(ret);
+    return py_retval;
+}
+
+static void
+libvirt_virEventTimeoutCallback(int timer,
+                                void *opaque)
+{
+    PyObject *pyobj_cbData = (PyObject *)opaque;
+    PyObject *pyobj_ret;
+    PyObject *python_cb;
+
+    LIBVIRT_ENSURE_THREAD_STATE;
+
+    /* Lookup the python callback */
+    python_cb = libvirt_lookupPythonFunc("_dispatchEventTimeoutCallback");
+    if (!python_cb) {
         goto cleanup;
     }
+
     Py_INCREF(pyobj_cbData);
 
-    /* Call the Callback Dispatcher */
-    pyobj_ret = PyObject_CallMethod(pyobj_conn,
-                                    (char*)"_dispatchDomainEventTunableCallback",
-                                    (char*)"OOO",
-                                    pyobj_dom, pyobj_dict, pyobj_cbData);
+    /* Call the pure python dispatcher */
+    pyobj_ret = PyObject_CallFunction(python_cb,
+                                      (char *)"iO",
+                                      timer, pyobj_cbData);
 
     Py_DECREF(pyobj_cbData);
-    Py_DECREF(pyobj_dom);
 
- cleanup:
     if (!pyobj_ret) {
         DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
         PyErr_Print();
-        Py_XDECREF(pyobj_dict);
     } else {
         Py_DECREF(pyobj_ret);
-        ret = 0;
     }
 
+cleanup:
     LIBVIRT_RELEASE_THREAD_STATE;
-    return ret;
-
 }
-#endif /* VIR_DOMAIN_EVENT_ID_TUNABLE */
 
-#ifdef VIR_DOMAIN_EVENT_ID_AGENT_LIFECYCLE
-static int
-libvirt_virConnectDomainEventAgentLifecycleCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
-                                                    virDomainPtr dom,
-                                                    int state,
-                                                    int reason,
-                                                    void *opaque)
+static PyObject *
+libvirt_virEventAddTimeout(PyObject *self ATTRIBUTE_UNUSED,
+                           PyObject *args)
 {
-    PyObject *pyobj_cbData = (PyObject*)opaque;
-    PyObject *pyobj_dom;
-    PyObject *pyobj_ret = NULL;
-    PyObject *pyobj_conn;
-    PyObject *dictKey;
-    int ret = -1;
+    PyObject *py_retval;
+    PyObject *pyobj_cbData;
+    virEventTimeoutCallback cb = libvirt_virEventTimeoutCallback;
+    int timeout;
+    int ret;
 
-    LIBVIRT_ENSURE_THREAD_STATE;
+    if (!PyArg_ParseTuple(args, (char *) "iO:virEventAddTimeout",
+                          &timeout, &pyobj_cbData)) {
+        DEBUG("%s failed to parse tuple\n", __FUNCTION__);
+        return VIR_PY_INT_FAIL;
+    }
 
-    if (!(dictKey = libvirt_constcharPtrWrap("conn")))
-        goto cleanup;
-    pyobj_conn = PyDict_GetItem(pyobj_cbData, dictKey);
-    Py_DECREF(dictKey);
+    Py_INCREF(pyobj_cbData);
 
-    /* Create a python instance of this virDomainPtr */
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    ret = virEventAddTimeout(timeout, cb, pyobj_cbData, NULL);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (ret < 0) {
+        Py_DECREF(pyobj_cbData);
+    }
+
+    py_retval = libvirt_intWrap(ret);
+    return py_retval;
+}
+
+typedef struct _virPyDomainEventBatch virPyDomainEventBatch;
+typedef virPyDomainEventBatch *virPyDomainEventBatchPtr;
+
+/* Python side of a domain event registration.  The user callback and
+ * the objects it is called with are resolved once when the callback is
+ * registered, so delivering an event doesn't need any lookup.  */
+typedef struct {
+    int eventID;
+    PyObject *conn;         /* virConnect instance */
+    PyObject *cb;           /* user callback */
+    PyObject *opaque;       /* user data */
+    PyObject *wrapDomain;   /* virConnect._wrapDomain */
+    virPyDomainEventBatchPtr batch; /* set for batched delivery, in which
+                                     * case the fields above are unused */
+} virPyDomainEventCallback;
+typedef virPyDomainEventCallback *virPyDomainEventCallbackPtr;
+
+typedef enum {
+    VIR_PY_DOMAIN_EVENT_ARG_INT,
+    VIR_PY_DOMAIN_EVENT_ARG_LLONG,
+    VIR_PY_DOMAIN_EVENT_ARG_ULLONG,
+    VIR_PY_DOMAIN_EVENT_ARG_STRING,
+    VIR_PY_DOMAIN_EVENT_ARG_PARAMS,
+    VIR_PY_DOMAIN_EVENT_ARG_GRAPHICS_ADDRESS,
+    VIR_PY_DOMAIN_EVENT_ARG_GRAPHICS_SUBJECT
+} virPyDomainEventArgType;
+
+typedef struct {
+    virPyDomainEventArgType type;
+    union {
+        int i;
+        long long l;
+        unsigned long long ul;
+        const char *s;
+        struct {
+            virTypedParameterPtr params;
+            int nparams;
+        } p;
+        virDomainEventGraphicsAddressPtr addr;
+        virDomainEventGraphicsSubjectPtr subject;
+    } value;
+} virPyDomainEventArg;
+
+/* The graphics event has the longest argument list */
+#define VIR_PY_DOMAIN_EVENT_MAX_ARGS 5
+
+/* The event specific arguments of a domain event, in the order they
+ * are passed to the python callback.  */
+typedef struct {
+    virDomainPtr dom;
+    size_t nargs;
+    virPyDomainEventArg args[VIR_PY_DOMAIN_EVENT_MAX_ARGS];
+} virPyDomainEvent;
+typedef virPyDomainEvent *virPyDomainEventPtr;
+
+static virPyDomainEventArg *
+virPyDomainEventAddArg(virPyDomainEventPtr event,
+                       virPyDomainEventArgType type)
+{
+    virPyDomainEventArg *arg = &event->args[event->nargs++];
+
+    arg->type = type;
+    return arg;
+}
+
+static void
+virPyDomainEventAddInt(virPyDomainEventPtr event, int value)
+{
+    virPyDomainEventAddArg(event, VIR_PY_DOMAIN_EVENT_ARG_INT)->value.i = value;
+}
+
+static void ATTRIBUTE_UNUSED
+virPyDomainEventAddULLong(virPyDomainEventPtr event, unsigned long long value)
+{
+    virPyDomainEventAddArg(event, VIR_PY_DOMAIN_EVENT_ARG_ULLONG)->value.ul = value;
+}
+
+static void
+virPyDomainEventAddLLong(virPyDomainEventPtr event, long long value)
+{
+    virPyDomainEventAddArg(event, VIR_PY_DOMAIN_EVENT_ARG_LLONG)->value.l = value;
+}
+
+static void
+virPyDomainEventAddString(virPyDomainEventPtr event, const char *value)
+{
+    virPyDomainEventAddArg(event, VIR_PY_DOMAIN_EVENT_ARG_STRING)->value.s = value;
+}
+
+/* Return a new reference to python version of @arg, or NULL on failure,
+ * after raising a python exception */
+static PyObject *
+libvirt_virPyDomainEventArgWrap(const virPyDomainEventArg *arg)
+{
+    PyObject *ret = NULL;
+    PyObject *pair;
+    size_t i;
+
+    switch (arg->type) {
+    case VIR_PY_DOMAIN_EVENT_ARG_INT:
+        return libvirt_intWrap(arg->value.i);
+
+    case VIR_PY_DOMAIN_EVENT_ARG_LLONG:
+        return libvirt_longlongWrap(arg->value.l);
+
+    case VIR_PY_DOMAIN_EVENT_ARG_ULLONG:
+        return libvirt_ulonglongWrap(arg->value.ul);
+
+    case VIR_PY_DOMAIN_EVENT_ARG_STRING:
+        return libvirt_constcharPtrWrap(arg->value.s);
+
+    case VIR_PY_DOMAIN_EVENT_ARG_PARAMS:
+        return getPyVirTypedParameter(arg->value.p.params,
+                                      arg->value.p.nparams);
+
+    case VIR_PY_DOMAIN_EVENT_ARG_GRAPHICS_ADDRESS:
+        return Py_BuildValue((char *)"{s:i,s:z,s:z}",
+                             "family", arg->value.addr->family,
+                             "node", arg->value.addr->node,
+                             "service", arg->value.addr->service);
+
+    case VIR_PY_DOMAIN_EVENT_ARG_GRAPHICS_SUBJECT:
+        if (!(ret = PyList_New(arg->value.subject->nidentity)))
+            return NULL;
+
+        for (i = 0; i < arg->value.subject->nidentity; i++) {
+            if (!(pair = Py_BuildValue((char *)"(zz)",
+                                       arg->value.subject->identities[i].type,
+                                       arg->value.subject->identities[i].name))) {
+                Py_DECREF(ret);
+                return NULL;
+            }
+            PyList_SET_ITEM(ret, i, pair);
+        }
+        return ret;
+    }
+
+    PyErr_Format(PyExc_LookupError,
+                 "Event argument type \"%d\" not recognized", arg->type);
+    return NULL;
+}
+
+/* Call @callable with the @nargs positional arguments in @args */
+static PyObject *
+libvirt_callObject(PyObject *callable,
+                   PyObject **args,
+                   size_t nargs)
+{
+#if PY_VERSION_HEX >= 0x03090000
+    return PyObject_Vectorcall(callable, args, nargs, NULL);
+#else
+    PyObject *pyobj_args;
+    PyObject *ret;
+    size_t i;
+
+    if (!(pyobj_args = PyTuple_New(nargs)))
+        return NULL;
+
+    for (i = 0; i < nargs; i++) {
+        Py_INCREF(args[i]);
+        PyTuple_SET_ITEM(pyobj_args, i, args[i]);
+    }
+
+    ret = PyObject_Call(callable, pyobj_args, NULL);
+    Py_DECREF(pyobj_args);
+    return ret;
+#endif
+}
+
+/* Return the virDomain python instance for @dom, or NULL on failure,
+ * after raising a python exception */
+static PyObject *
+libvirt_virPyDomainEventWrapDomain(virPyDomainEventCallbackPtr cbdata,
+                                   virDomainPtr dom)
+{
+    PyObject *pyobj_dom;
+    PyObject *ret;
+
+    /* libvirt_virDomainPtrWrap steals the reference */
     virDomainRef(dom);
     if (!(pyobj_dom = libvirt_virDomainPtrWrap(dom))) {
         virDomainFree(dom);
+        return NULL;
+    }
+
+    ret = libvirt_callObject(cbdata->wrapDomain, &pyobj_dom, 1);
+    Py_DECREF(pyobj_dom);
+    return ret;
+}
+
+/* Call the user callback as cb(conn, dom, <event args>, opaque).  Must
+ * be called with the GIL held.  */
+static int
+libvirt_virConnectDomainEventDispatch(virPyDomainEventCallbackPtr cbdata,
+                                      const virPyDomainEvent *event)
+{
+    PyObject *pyobj_args[VIR_PY_DOMAIN_EVENT_MAX_ARGS + 3] = { NULL };
+    PyObject *pyobj_ret = NULL;
+    size_t nargs = 0;
+    size_t i;
+
+    Py_INCREF(cbdata->conn);
+    pyobj_args[nargs++] = cbdata->conn;
+
+    if (!(pyobj_args[nargs++] = libvirt_virPyDomainEventWrapDomain(cbdata,
+                                                                   event->dom)))
         goto cleanup;
+
+    for (i = 0; i < event->nargs; i++) {
+        if (!(pyobj_args[nargs++] = libvirt_virPyDomainEventArgWrap(&event->args[i])))
+            goto cleanup;
     }
-    Py_INCREF(pyobj_cbData);
 
-    /* Call the Callback Dispatcher */
-    pyobj_ret = PyObject_CallMethod(pyobj_conn,
-                                    (char*)"_dispatchDomainEventAgentLifecycleCallback",
-                                    (char*)"OiiO",
-                                    pyobj_dom, state, reason, pyobj_cbData);
+    Py_INCREF(cbdata->opaque);
+    pyobj_args[nargs++] = cbdata->opaque;
 
-    Py_DECREF(pyobj_cbData);
-    Py_DECREF(pyobj_dom);
+    pyobj_ret = libvirt_callObject(cbdata->cb, pyobj_args, nargs);
+
+ cleanup:
+    for (i = 0; i < nargs; i++)
+        Py_XDECREF(pyobj_args[i]);
+
+    if (!pyobj_ret) {
+        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
+        PyErr_Print();
+        return -1;
+    }
+
+    Py_DECREF(pyobj_ret);
+    return 0;
+}
+
+static int
+virPyDomainEventBatchQueue(virPyDomainEventBatchPtr batch,
+                           int eventID,
+                           const virPyDomainEvent *event);
+static void
+virPyDomainEventBatchUnref(virPyDomainEventBatchPtr batch);
+
+/* Common tail of all the domain event callbacks below */
+static int
+libvirt_virConnectDomainEventDeliver(void *opaque,
+                                     const virPyDomainEvent *event)
+{
+    virPyDomainEventCallbackPtr cbdata = opaque;
+    int ret;
+
+    if (cbdata->batch)
+        return virPyDomainEventBatchQueue(cbdata->batch, cbdata->eventID,
+                                          event);
+
+    LIBVIRT_ENSURE_THREAD_STATE;
+    ret = libvirt_virConnectDomainEventDispatch(cbdata, event);
+    LIBVIRT_RELEASE_THREAD_STATE;
+
+    return ret;
+}
+
+static void
+libvirt_virConnectDomainEventFreeFunc(void *opaque)
+{
+    virPyDomainEventCallbackPtr cbdata = opaque;
+
+    LIBVIRT_ENSURE_THREAD_STATE;
+    Py_XDECREF(cbdata->conn);
+    Py_XDECREF(cbdata->cb);
+    Py_XDECREF(cbdata->opaque);
+    Py_XDECREF(cbdata->wrapDomain);
+    LIBVIRT_RELEASE_THREAD_STATE;
+
+    if (cbdata->batch)
+        virPyDomainEventBatchUnref(cbdata->batch);
+
+    VIR_FREE(cbdata);
+}
+
+static int
+libvirt_virConnectDomainEventLifecycleCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                               virDomainPtr dom,
+                                               int event,
+                                               int detail,
+                                               void *opaque)
+{
+    virPyDomainEvent ev = { dom, 0 };
+
+    virPyDomainEventAddInt(&ev, event);
+    virPyDomainEventAddInt(&ev, detail);
+
+    return libvirt_virConnectDomainEventDeliver(opaque, &ev);
+}
+
+static int
+libvirt_virConnectDomainEventGenericCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                             virDomainPtr dom,
+                                             void *opaque)
+{
+    virPyDomainEvent ev = { dom, 0 };
+
+    return libvirt_virConnectDomainEventDeliver(opaque, &ev);
+}
+
+static int
+libvirt_virConnectDomainEventRTCChangeCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                               virDomainPtr dom,
+                                               long long utcoffset,
+                                               void *opaque)
+{
+    virPyDomainEvent ev = { dom, 0 };
+
+    virPyDomainEventAddLLong(&ev, utcoffset);
+
+    return libvirt_virConnectDomainEventDeliver(opaque, &ev);
+}
+
+static int
+libvirt_virConnectDomainEventWatchdogCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                              virDomainPtr dom,
+                                              int action,
+                                              void *opaque)
+{
+    virPyDomainEvent ev = { dom, 0 };
+
+    virPyDomainEventAddInt(&ev, action);
+
+    return libvirt_virConnectDomainEventDeliver(opaque, &ev);
+}
+
+static int
+libvirt_virConnectDomainEventIOErrorCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                             virDomainPtr dom,
+                                             const char *srcPath,
+                                             const char *devAlias,
+                                             int action,
+                                             void *opaque)
+{
+    virPyDomainEvent ev = { dom, 0 };
+
+    virPyDomainEventAddString(&ev, srcPath);
+    virPyDomainEventAddString(&ev, devAlias);
+    virPyDomainEventAddInt(&ev, action);
+
+    return libvirt_virConnectDomainEventDeliver(opaque, &ev);
+}
+
+static int
+libvirt_virConnectDomainEventIOErrorReasonCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                                   virDomainPtr dom,
+                                                   const char *srcPath,
+                                                   const char *devAlias,
+                                                   int action,
+                                                   const char *reason,
+                                                   void *opaque)
+{
+    virPyDomainEvent ev = { dom, 0 };
+
+    virPyDomainEventAddString(&ev, srcPath);
+    virPyDomainEventAddString(&ev, devAlias);
+    virPyDomainEventAddInt(&ev, action);
+    virPyDomainEventAddString(&ev, reason);
+
+    return libvirt_virConnectDomainEventDeliver(opaque, &ev);
+}
+
+static int
+libvirt_virConnectDomainEventGraphicsCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                              virDomainPtr dom,
+                                              int phase,
+                                              virDomainEventGraphicsAddressPtr local,
+                                              virDomainEventGraphicsAddressPtr remote,
+                                              const char *authScheme,
+                                              virDomainEventGraphicsSubjectPtr subject,
+                                              void *opaque)
+{
+    virPyDomainEvent ev = { dom, 0 };
+
+    virPyDomainEventAddInt(&ev, phase);
+    virPyDomainEventAddArg(&ev, VIR_PY_DOMAIN_EVENT_ARG_GRAPHICS_ADDRESS)->value.addr = local;
+    virPyDomainEventAddArg(&ev, VIR_PY_DOMAIN_EVENT_ARG_GRAPHICS_ADDRESS)->value.addr = remote;
+    virPyDomainEventAddString(&ev, authScheme);
+    virPyDomainEventAddArg(&ev, VIR_PY_DOMAIN_EVENT_ARG_GRAPHICS_SUBJECT)->value.subject = subject;
+
+    return libvirt_virConnectDomainEventDeliver(opaque, &ev);
+}
+
+static int
+libvirt_virConnectDomainEventBlockJobCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                              virDomainPtr dom,
+                                              const char *disk,
+                                              int type,
+                                              int status,
+                                              void *opaque)
+{
+    virPyDomainEvent ev = { dom, 0 };
+
+    virPyDomainEventAddString(&ev, disk);
+    virPyDomainEventAddInt(&ev, type);
+    virPyDomainEventAddInt(&ev, status);
+
+    return libvirt_virConnectDomainEventDeliver(opaque, &ev);
+}
+
+static int
+libvirt_virConnectDomainEventDiskChangeCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                                virDomainPtr dom,
+                                                const char *oldSrcPath,
+                                                const char *newSrcPath,
+                                                const char *devAlias,
+                                                int reason,
+                                                void *opaque)
+{
+    virPyDomainEvent ev = { dom, 0 };
+
+    virPyDomainEventAddString(&ev, oldSrcPath);
+    virPyDomainEventAddString(&ev, newSrcPath);
+    virPyDomainEventAddString(&ev, devAlias);
+    virPyDomainEventAddInt(&ev, reason);
+
+    return libvirt_virConnectDomainEventDeliver(opaque, &ev);
+}
+
+static int
+libvirt_virConnectDomainEventTrayChangeCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                                virDomainPtr dom,
+                                                const char *devAlias,
+                                                int reason,
+                                                void *opaque)
+{
+    virPyDomainEvent ev = { dom, 0 };
+
+    virPyDomainEventAddString(&ev, devAlias);
+    virPyDomainEventAddInt(&ev, reason);
+
+    return libvirt_virConnectDomainEventDeliver(opaque, &ev);
+}
+
+static int
+libvirt_virConnectDomainEventPMWakeupCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                              virDomainPtr dom,
+                                              int reason,
+                                              void *opaque)
+{
+    virPyDomainEvent ev = { dom, 0 };
+
+    virPyDomainEventAddInt(&ev, reason);
+
+    return libvirt_virConnectDomainEventDeliver(opaque, &ev);
+}
+
+static int
+libvirt_virConnectDomainEventPMSuspendCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                               virDomainPtr dom,
+                                               int reason,
+                                               void *opaque)
+{
+    virPyDomainEvent ev = { dom, 0 };
+
+    virPyDomainEventAddInt(&ev, reason);
+
+    return libvirt_virConnectDomainEventDeliver(opaque, &ev);
+}
+
+
+#ifdef VIR_DOMAIN_EVENT_ID_BALLOON_CHANGE
+static int
+libvirt_virConnectDomainEventBalloonChangeCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                                   virDomainPtr dom,
+                                                   unsigned long long actual,
+                                                   void *opaque)
+{
+    virPyDomainEvent ev = { dom, 0 };
+
+    virPyDomainEventAddULLong(&ev, actual);
+
+    return libvirt_virConnectDomainEventDeliver(opaque, &ev);
+}
+#endif /* VIR_DOMAIN_EVENT_ID_BALLOON_CHANGE */
+
+#ifdef VIR_DOMAIN_EVENT_ID_PMSUSPEND_DISK
+static int
+libvirt_virConnectDomainEventPMSuspendDiskCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                                   virDomainPtr dom,
+                                                   int reason,
+                                                   void *opaque)
+{
+    virPyDomainEvent ev = { dom, 0 };
+
+    virPyDomainEventAddInt(&ev, reason);
+
+    return libvirt_virConnectDomainEventDeliver(opaque, &ev);
+}
+#endif /* VIR_DOMAIN_EVENT_ID_PMSUSPEND_DISK */
+
+#ifdef VIR_DOMAIN_EVENT_ID_DEVICE_REMOVED
+static int
+libvirt_virConnectDomainEventDeviceRemovedCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                                   virDomainPtr dom,
+                                                   const char *devAlias,
+                                                   void *opaque)
+{
+    virPyDomainEvent ev = { dom, 0 };
+
+    virPyDomainEventAddString(&ev, devAlias);
+
+    return libvirt_virConnectDomainEventDeliver(opaque, &ev);
+}
+#endif /* VIR_DOMAIN_EVENT_ID_DEVICE_REMOVED */
+
+#ifdef VIR_DOMAIN_EVENT_ID_TUNABLE
+static int
+libvirt_virConnectDomainEventTunableCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                             virDomainPtr dom,
+                                             virTypedParameterPtr params,
+                                             int nparams,
+                                             void *opaque)
+{
+    virPyDomainEvent ev = { dom, 0 };
+    virPyDomainEventArg *arg;
+
+    arg = virPyDomainEventAddArg(&ev, VIR_PY_DOMAIN_EVENT_ARG_PARAMS);
+    arg->value.p.params = params;
+    arg->value.p.nparams = nparams;
+
+    return libvirt_virConnectDomainEventDeliver(opaque, &ev);
+}
+#endif /* VIR_DOMAIN_EVENT_ID_TUNABLE */
+
+#ifdef VIR_DOMAIN_EVENT_ID_AGENT_LIFECYCLE
+static int
+libvirt_virConnectDomainEventAgentLifecycleCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                                    virDomainPtr dom,
+                                                    int state,
+                                                    int reason,
+                                                    void *opaque)
+{
+    virPyDomainEvent ev = { dom, 0 };
+
+    virPyDomainEventAddInt(&ev, state);
+    virPyDomainEventAddInt(&ev, reason);
+
+    return libvirt_virConnectDomainEventDeliver(opaque, &ev);
+}
+#endif /* VIR_DOMAIN_EVENT_ID_AGENT_LIFECYCLE */
+
+#ifdef VIR_DOMAIN_EVENT_ID_DEVICE_ADDED
+static int
+libvirt_virConnectDomainEventDeviceAddedCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                                 virDomainPtr dom,
+                                                 const char *devAlias,
+                                                 void *opaque)
+{
+    virPyDomainEvent ev = { dom, 0 };
+
+    virPyDomainEventAddString(&ev, devAlias);
+
+    return libvirt_virConnectDomainEventDeliver(opaque, &ev);
+}
+#endif /* VIR_DOMAIN_EVENT_ID_DEVICE_ADDED */
+
+/* Return the C callback handling @eventID, or NULL if it is unknown */
+static virConnectDomainEventGenericCallback
+libvirt_virConnectDomainEventCallbackFor(int eventID)
+{
+    switch ((virDomainEventID) eventID) {
+    case VIR_DOMAIN_EVENT_ID_LIFECYCLE:
+        return VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventLifecycleCallback);
+    case VIR_DOMAIN_EVENT_ID_REBOOT:
+        return VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventGenericCallback);
+    case VIR_DOMAIN_EVENT_ID_RTC_CHANGE:
+        return VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventRTCChangeCallback);
+    case VIR_DOMAIN_EVENT_ID_WATCHDOG:
+        return VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventWatchdogCallback);
+    case VIR_DOMAIN_EVENT_ID_IO_ERROR:
+        return VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventIOErrorCallback);
+    case VIR_DOMAIN_EVENT_ID_IO_ERROR_REASON:
+        return VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventIOErrorReasonCallback);
+    case VIR_DOMAIN_EVENT_ID_GRAPHICS:
+        return VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventGraphicsCallback);
+    case VIR_DOMAIN_EVENT_ID_CONTROL_ERROR:
+        return VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventGenericCallback);
+    case VIR_DOMAIN_EVENT_ID_BLOCK_JOB:
+#ifdef VIR_DOMAIN_EVENT_ID_BLOCK_JOB_2
+    case VIR_DOMAIN_EVENT_ID_BLOCK_JOB_2:
+#endif /* VIR_DOMAIN_EVENT_ID_BLOCK_JOB_2 */
+        return VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventBlockJobCallback);
+    case VIR_DOMAIN_EVENT_ID_DISK_CHANGE:
+        return VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventDiskChangeCallback);
+    case VIR_DOMAIN_EVENT_ID_TRAY_CHANGE:
+        return VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventTrayChangeCallback);
+    case VIR_DOMAIN_EVENT_ID_PMWAKEUP:
+        return VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventPMWakeupCallback);
+    case VIR_DOMAIN_EVENT_ID_PMSUSPEND:
+        return VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventPMSuspendCallback);
+#ifdef VIR_DOMAIN_EVENT_ID_BALLOON_CHANGE
+    case VIR_DOMAIN_EVENT_ID_BALLOON_CHANGE:
+        return VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventBalloonChangeCallback);
+#endif /* VIR_DOMAIN_EVENT_ID_BALLOON_CHANGE */
+#ifdef VIR_DOMAIN_EVENT_ID_PMSUSPEND_DISK
+    case VIR_DOMAIN_EVENT_ID_PMSUSPEND_DISK:
+        return VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventPMSuspendDiskCallback);
+#endif /* VIR_DOMAIN_EVENT_ID_PMSUSPEND_DISK */
+#ifdef VIR_DOMAIN_EVENT_ID_DEVICE_REMOVED
+    case VIR_DOMAIN_EVENT_ID_DEVICE_REMOVED:
+        return VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventDeviceRemovedCallback);
+#endif /* VIR_DOMAIN_EVENT_ID_DEVICE_REMOVED */
+#ifdef VIR_DOMAIN_EVENT_ID_TUNABLE
+    case VIR_DOMAIN_EVENT_ID_TUNABLE:
+        return VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventTunableCallback);
+#endif /* VIR_DOMAIN_EVENT_ID_TUNABLE */
+#ifdef VIR_DOMAIN_EVENT_ID_AGENT_LIFECYCLE
+    case VIR_DOMAIN_EVENT_ID_AGENT_LIFECYCLE:
+        return VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventAgentLifecycleCallback);
+#endif /* VIR_DOMAIN_EVENT_ID_AGENT_LIFECYCLE */
+#ifdef VIR_DOMAIN_EVENT_ID_DEVICE_ADDED
+    case VIR_DOMAIN_EVENT_ID_DEVICE_ADDED:
+        return VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventDeviceAddedCallback);
+#endif /* VIR_DOMAIN_EVENT_ID_DEVICE_ADDED */
+    case VIR_DOMAIN_EVENT_ID_LAST:
+        break;
+    }
+
+    return NULL;
+}
+
+/* Resolve the registration data in @pyobj_cbData, returning NULL if it
+ * is incomplete */
+static virPyDomainEventCallbackPtr
+libvirt_virPyDomainEventCallbackNew(PyObject *pyobj_cbData,
+                                    int eventID)
+{
+    virPyDomainEventCallbackPtr cbdata;
+
+    if (VIR_ALLOC(cbdata) < 0)
+        return NULL;
+
+    cbdata->eventID = eventID;
+    cbdata->conn = PyDict_GetItemString(pyobj_cbData, "conn");
+    cbdata->cb = PyDict_GetItemString(pyobj_cbData, "cb");
+    cbdata->opaque = PyDict_GetItemString(pyobj_cbData, "opaque");
+
+    if (!cbdata->conn || !cbdata->cb || !cbdata->opaque) {
+        VIR_FREE(cbdata);
+        return NULL;
+    }
+
+    /* Goes through the connection's domain object cache, if enabled */
+    if (!(cbdata->wrapDomain = PyObject_GetAttrString(cbdata->conn,
+                                                      "_wrapDomain"))) {
+        DEBUG("%s: Error finding _wrapDomain\n", __FUNCTION__);
+        PyErr_Clear();
+        VIR_FREE(cbdata);
+        return NULL;
+    }
+
+    Py_INCREF(cbdata->conn);
+    Py_INCREF(cbdata->cb);
+    Py_INCREF(cbdata->opaque);
+
+    return cbdata;
+}
+
+static PyObject *
+libvirt_virConnectDomainEventRegisterAny(ATTRIBUTE_UNUSED PyObject *self,
+                                         PyObject *args)
+{
+    PyObject *py_retval;        /* return value */
+    PyObject *pyobj_conn;       /* virConnectPtr */
+    PyObject *pyobj_dom;
+    PyObject *pyobj_cbData;     /* hash of callback data */
+    int eventID;
+    virConnectPtr conn;
+    int ret = 0;
+    virConnectDomainEventGenericCallback cb = NULL;
+    virPyDomainEventCallbackPtr cbdata = NULL;
+    virDomainPtr dom;
+
+    if (!PyArg_ParseTuple
+        (args, (char *) "OOiO:virConnectDomainEventRegisterAny",
+         &pyobj_conn, &pyobj_dom, &eventID, &pyobj_cbData)) {
+        DEBUG("%s failed parsing tuple\n", __FUNCTION__);
+        return VIR_PY_INT_FAIL;
+    }
+
+    DEBUG("libvirt_virConnectDomainEventRegister(%p %p %d %p) called\n",
+           pyobj_conn, pyobj_dom, eventID, pyobj_cbData);
+    conn = PyvirConnect_Get(pyobj_conn);
+    if (pyobj_dom == Py_None)
+        dom = NULL;
+    else
+        dom = PyvirDomain_Get(pyobj_dom);
+
+    if (!(cb = libvirt_virConnectDomainEventCallbackFor(eventID)))
+        return VIR_PY_INT_FAIL;
+
+    if (!(cbdata = libvirt_virPyDomainEventCallbackNew(pyobj_cbData, eventID)))
+        return VIR_PY_INT_FAIL;
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    ret = virConnectDomainEventRegisterAny(conn, dom, eventID,
+                                           cb, cbdata,
+                                           libvirt_virConnectDomainEventFreeFunc);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (ret < 0)
+        libvirt_virConnectDomainEventFreeFunc(cbdata);
+
+    py_retval = libvirt_intWrap(ret);
+    return py_retval;
+}
+
+/*
+ * Batched domain event delivery
+ *
+ * All the event IDs registered by virConnectDomainEventRegisterBatch
+ * share one batch.  Each event is copied into the batch queue without
+ * taking the GIL, and the queue is handed to python as a single list
+ * once max_batch events are pending, or max_delay_ms after the first
+ * of them was queued.  The batch lock is never taken with the GIL held,
+ * since updating the flush timer may need the GIL itself when the event
+ * loop is implemented in python.
+ */
+typedef struct {
+    int eventID;
+    virPyDomainEvent event;
+} virPyQueuedDomainEvent;
+
+struct _virPyDomainEventBatch {
+    PyThread_type_lock lock;
+    size_t refs;                        /* registrations + creator */
+    int timer;                          /* flush timer, -1 if none */
+    bool armed;                         /* flush timer is enabled */
+    size_t maxBatch;
+    int maxDelay;                       /* in milliseconds */
+    virPyDomainEventCallbackPtr target; /* cb(conn, events, opaque) */
+    virPyQueuedDomainEvent *events;     /* maxBatch entries, or NULL */
+    size_t nevents;
+};
+
+static int
+virPyStrdup(char **dst,
+            const char *src)
+{
+    *dst = NULL;
+    if (src && !(*dst = strdup(src)))
+        return -1;
+    return 0;
+}
+
+static int
+virPyTypedParamsCopy(virTypedParameterPtr *dst,
+                     int *ndst,
+                     virTypedParameterPtr src,
+                     int nsrc)
+{
+    virTypedParameterPtr params = NULL;
+    int i;
+
+    *dst = NULL;
+    *ndst = 0;
+
+    if (nsrc <= 0)
+        return 0;
+
+    if (VIR_ALLOC_N(params, nsrc) < 0)
+        return -1;
+
+    for (i = 0; i < nsrc; i++) {
+        params[i] = src[i];
+        if (src[i].type == VIR_TYPED_PARAM_STRING &&
+            virPyStrdup(&params[i].value.s, src[i].value.s) < 0) {
+            virTypedParamsFree(params, i);
+            return -1;
+        }
+    }
+
+    *dst = params;
+    *ndst = nsrc;
+    return 0;
+}
+
+/* Release the copy of an event made by virPyDomainEventCopy */
+static void
+virPyDomainEventClear(virPyDomainEventPtr event)
+{
+    size_t i;
+    int j;
+
+    for (i = 0; i < event->nargs; i++) {
+        virPyDomainEventArg *arg = &event->args[i];
+
+        switch (arg->type) {
+        case VIR_PY_DOMAIN_EVENT_ARG_STRING:
+            VIR_FREE(arg->value.s);
+            break;
+
+        case VIR_PY_DOMAIN_EVENT_ARG_PARAMS:
+            virTypedParamsFree(arg->value.p.params, arg->value.p.nparams);
+            break;
+
+        case VIR_PY_DOMAIN_EVENT_ARG_GRAPHICS_ADDRESS:
+            if (arg->value.addr) {
+                VIR_FREE(arg->value.addr->node);
+                VIR_FREE(arg->value.addr->service);
+                VIR_FREE(arg->value.addr);
+            }
+            break;
+
+        case VIR_PY_DOMAIN_EVENT_ARG_GRAPHICS_SUBJECT:
+            if (arg->value.subject) {
+                for (j = 0; j < arg->value.subject->nidentity; j++) {
+                    VIR_FREE(arg->value.subject->identities[j].type);
+                    VIR_FREE(arg->value.subject->identities[j].name);
+                }
+                VIR_FREE(arg->value.subject->identities);
+                VIR_FREE(arg->value.subject);
+            }
+            break;
+
+        case VIR_PY_DOMAIN_EVENT_ARG_INT:
+        case VIR_PY_DOMAIN_EVENT_ARG_LLONG:
+        case VIR_PY_DOMAIN_EVENT_ARG_ULLONG:
+            break;
+        }
+    }
+    event->nargs = 0;
+
+    if (event->dom) {
+        virDomainFree(event->dom);
+        event->dom = NULL;
+    }
+}
+
+/* Make a copy of @src which outlives the libvirt callback it was
+ * received in.  On failure @dst holds whatever was copied so far and
+ * must still be released with virPyDomainEventClear.  */
+static int
+virPyDomainEventCopy(virPyDomainEventPtr dst,
+                     const virPyDomainEvent *src)
+{
+    size_t i;
+    int j;
+
+    memset(dst, 0, sizeof(*dst));
+
+    virDomainRef(src->dom);
+    dst->dom = src->dom;
+
+    for (i = 0; i < src->nargs; i++) {
+        const virPyDomainEventArg *from = &src->args[i];
+        virPyDomainEventArg *to = virPyDomainEventAddArg(dst, from->type);
+        char *str;
+
+        switch (from->type) {
+        case VIR_PY_DOMAIN_EVENT_ARG_INT:
+        case VIR_PY_DOMAIN_EVENT_ARG_LLONG:
+        case VIR_PY_DOMAIN_EVENT_ARG_ULLONG:
+            to->value = from->value;
+            break;
+
+        case VIR_PY_DOMAIN_EVENT_ARG_STRING:
+            if (virPyStrdup(&str, from->value.s) < 0)
+                return -1;
+            to->value.s = str;
+            break;
+
+        case VIR_PY_DOMAIN_EVENT_ARG_PARAMS:
+            if (virPyTypedParamsCopy(&to->value.p.params,
+                                     &to->value.p.nparams,
+                                     from->value.p.params,
+                                     from->value.p.nparams) < 0)
+                return -1;
+            break;
+
+        case VIR_PY_DOMAIN_EVENT_ARG_GRAPHICS_ADDRESS:
+            if (VIR_ALLOC(to->value.addr) < 0)
+                return -1;
+            to->value.addr->family = from->value.addr->family;
+            if (virPyStrdup(&to->value.addr->node,
+                            from->value.addr->node) < 0 ||
+                virPyStrdup(&to->value.addr->service,
+                            from->value.addr->service) < 0)
+                return -1;
+            break;
+
+        case VIR_PY_DOMAIN_EVENT_ARG_GRAPHICS_SUBJECT:
+            if (VIR_ALLOC(to->value.subject) < 0 ||
+                VIR_ALLOC_N(to->value.subject->identities,
+                            from->value.subject->nidentity) < 0)
+                return -1;
+            to->value.subject->nidentity = from->value.subject->nidentity;
+            for (j = 0; j < from->value.subject->nidentity; j++) {
+                if (virPyStrdup(&to->value.subject->identities[j].type,
+                                from->value.subject->identities[j].type) < 0 ||
+                    virPyStrdup(&to->value.subject->identities[j].name,
+                                from->value.subject->identities[j].name) < 0)
+                    return -1;
+            }
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/* Return the (eventID, dom, <event args>) tuple describing @event */
+static PyObject *
+libvirt_virPyDomainEventTuple(virPyDomainEventCallbackPtr cbdata,
+                              int eventID,
+                              const virPyDomainEvent *event)
+{
+    PyObject *tuple;
+    PyObject *item;
+    size_t i;
+
+    if (!(tuple = PyTuple_New(event->nargs + 2)))
+        return NULL;
+
+    if (!(item = libvirt_intWrap(eventID)))
+        goto error;
+    PyTuple_SET_ITEM(tuple, 0, item);
+
+    if (!(item = libvirt_virPyDomainEventWrapDomain(cbdata, event->dom)))
+        goto error;
+    PyTuple_SET_ITEM(tuple, 1, item);
+
+    for (i = 0; i < event->nargs; i++) {
+        if (!(item = libvirt_virPyDomainEventArgWrap(&event->args[i])))
+            goto error;
+        PyTuple_SET_ITEM(tuple, i + 2, item);
+    }
+
+    return tuple;
+
+ error:
+    Py_DECREF(tuple);
+    return NULL;
+}
+
+/* Call the batch callback as cb(conn, events, opaque), consuming the
+ * @nevents queued @events.  Must be called without the GIL held.  */
+static int
+virPyDomainEventBatchDeliver(virPyDomainEventBatchPtr batch,
+                             virPyQueuedDomainEvent *events,
+                             size_t nevents)
+{
+    virPyDomainEventCallbackPtr target = batch->target;
+    PyObject *pyobj_args[3];
+    PyObject *pyobj_list;
+    PyObject *pyobj_ret = NULL;
+    PyObject *item;
+    size_t i;
+    int ret = -1;
+
+    LIBVIRT_ENSURE_THREAD_STATE;
+
+    if (!(pyobj_list = PyList_New(nevents)))
+        goto cleanup;
+
+    for (i = 0; i < nevents; i++) {
+        if (!(item = libvirt_virPyDomainEventTuple(target, events[i].eventID,
+                                                   &events[i].event)))
+            goto cleanup;
+        PyList_SET_ITEM(pyobj_list, i, item);
+    }
+
+    pyobj_args[0] = target->conn;
+    pyobj_args[1] = pyobj_list;
+    pyobj_args[2] = target->opaque;
+
+    pyobj_ret = libvirt_callObject(target->cb, pyobj_args, 3);
+
+ cleanup:
+    Py_XDECREF(pyobj_list);
+
+    if (!pyobj_ret) {
+        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
+        PyErr_Print();
+    } else {
+        Py_DECREF(pyobj_ret);
+        ret = 0;
+    }
+
+    LIBVIRT_RELEASE_THREAD_STATE;
+
+    for (i = 0; i < nevents; i++)
+        virPyDomainEventClear(&events[i].event);
+    VIR_FREE(events);
+
+    return ret;
+}
+
+/* Take the pending events out of @batch and disable the flush timer.
+ * Must be called with the batch lock held.  */
+static virPyQueuedDomainEvent *
+virPyDomainEventBatchSteal(virPyDomainEventBatchPtr batch,
+                           size_t *nevents)
+{
+    virPyQueuedDomainEvent *events = batch->events;
+
+    *nevents = batch->nevents;
+    batch->events = NULL;
+    batch->nevents = 0;
+
+    if (batch->armed) {
+        virEventUpdateTimeout(batch->timer, -1);
+        batch->armed = false;
+    }
+
+    return events;
+}
+
+static int
+virPyDomainEventBatchQueue(virPyDomainEventBatchPtr batch,
+                           int eventID,
+                           const virPyDomainEvent *event)
+{
+    virPyQueuedDomainEvent *queued;
+    virPyQueuedDomainEvent *full = NULL;
+    size_t nfull = 0;
+    int ret = -1;
+
+    PyThread_acquire_lock(batch->lock, WAIT_LOCK);
+
+    if (!batch->events &&
+        VIR_ALLOC_N(batch->events, batch->maxBatch) < 0)
+        goto cleanup;
+
+    queued = &batch->events[batch->nevents];
+    if (virPyDomainEventCopy(&queued->event, event) < 0) {
+        virPyDomainEventClear(&queued->event);
+        goto cleanup;
+    }
+    queued->eventID = eventID;
+    batch->nevents++;
+
+    if (batch->nevents == batch->maxBatch) {
+        full = virPyDomainEventBatchSteal(batch, &nfull);
+    } else if (!batch->armed) {
+        virEventUpdateTimeout(batch->timer, batch->maxDelay);
+        batch->armed = true;
+    }
+
+    ret = 0;
+
+ cleanup:
+    PyThread_release_lock(batch->lock);
+
+    if (full)
+        ret = virPyDomainEventBatchDeliver(batch, full, nfull);
+
+    return ret;
+}
+
+static void
+virPyDomainEventBatchTimeout(int timer ATTRIBUTE_UNUSED,
+                             void *opaque)
+{
+    virPyDomainEventBatchPtr batch = opaque;
+    virPyQueuedDomainEvent *events;
+    size_t nevents;
+
+    PyThread_acquire_lock(batch->lock, WAIT_LOCK);
+    events = virPyDomainEventBatchSteal(batch, &nevents);
+    PyThread_release_lock(batch->lock);
+
+    if (events)
+        virPyDomainEventBatchDeliver(batch, events, nevents);
+}
+
+/* Free callback of the flush timer, events still queued when the last
+ * registration goes away are dropped */
+static void
+virPyDomainEventBatchFree(void *opaque)
+{
+    virPyDomainEventBatchPtr batch = opaque;
+    size_t i;
+
+    for (i = 0; i < batch->nevents; i++)
+        virPyDomainEventClear(&batch->events[i].event);
+    VIR_FREE(batch->events);
+
+    if (batch->target)
+        libvirt_virConnectDomainEventFreeFunc(batch->target);
+    if (batch->lock)
+        PyThread_free_lock(batch->lock);
+
+    VIR_FREE(batch);
+}
+
+/* Must be called without the GIL held */
+static void
+virPyDomainEventBatchUnref(virPyDomainEventBatchPtr batch)
+{
+    size_t refs;
+
+    PyThread_acquire_lock(batch->lock, WAIT_LOCK);
+    refs = --batch->refs;
+    PyThread_release_lock(batch->lock);
+
+    if (refs > 0)
+        return;
+
+    /* The event loop calls virPyDomainEventBatchFree once the timer
+     * is gone */
+    if (batch->timer < 0 || virEventRemoveTimeout(batch->timer) < 0)
+        virPyDomainEventBatchFree(batch);
+}
+
+static virPyDomainEventBatchPtr
+virPyDomainEventBatchNew(PyObject *pyobj_cbData,
+                         size_t maxBatch,
+                         int maxDelay)
+{
+    virPyDomainEventBatchPtr batch;
+
+    if (VIR_ALLOC(batch) < 0)
+        return NULL;
+
+    batch->refs = 1;
+    batch->timer = -1;
+    batch->maxBatch = maxBatch;
+    batch->maxDelay = maxDelay;
+
+    if (!(batch->lock = PyThread_allocate_lock()) ||
+        !(batch->target = libvirt_virPyDomainEventCallbackNew(pyobj_cbData, -1)))
+        goto error;
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    batch->timer = virEventAddTimeout(-1, virPyDomainEventBatchTimeout,
+                                      batch, virPyDomainEventBatchFree);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (batch->timer < 0)
+        goto error;
+
+    return batch;
+
+ error:
+    virPyDomainEventBatchFree(batch);
+    return NULL;
+}
+
+static PyObject *
+libvirt_virConnectDomainEventRegisterBatch(ATTRIBUTE_UNUSED PyObject *self,
+                                           PyObject *args)
+{
+    PyObject *py_retval = NULL;
+    PyObject *pyobj_conn;
+    PyObject *pyobj_dom;
+    PyObject *pyobj_eventIDs;
+    PyObject *pyobj_cbData;
+    PyObject *pyobj_error = NULL;
+    PyObject *pyobj_errorClass;
+    PyObject *item;
+    unsigned int maxBatch;
+    int maxDelay;
+    virConnectPtr conn;
+    virDomainPtr dom;
+    virPyDomainEventBatchPtr batch = NULL;
+    virPyDomainEventCallbackPtr *cbdata = NULL;
+    int *eventIDs = NULL;
+    int *callbackIDs = NULL;
+    size_t neventIDs;
+    size_t ncallbacks = 0;
+    size_t i;
+
+    if (!PyArg_ParseTuple
+        (args, (char *) "OOOOIi:virConnectDomainEventRegisterBatch",
+         &pyobj_conn, &pyobj_dom, &pyobj_eventIDs, &pyobj_cbData,
+         &maxBatch, &maxDelay))
+        return NULL;
+
+    if (!PyList_Check(pyobj_eventIDs)) {
+        PyErr_SetString(PyExc_TypeError, "eventIDs must be a list");
+        return NULL;
+    }
+
+    if (maxBatch == 0 || maxDelay < 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "max_batch must be positive and max_delay_ms "
+                        "must not be negative");
+        return NULL;
+    }
+
+    conn = PyvirConnect_Get(pyobj_conn);
+    if (pyobj_dom == Py_None)
+        dom = NULL;
+    else
+        dom = PyvirDomain_Get(pyobj_dom);
+
+    neventIDs = PyList_Size(pyobj_eventIDs);
+    if (VIR_ALLOC_N(eventIDs, neventIDs) < 0 ||
+        VIR_ALLOC_N(callbackIDs, neventIDs) < 0 ||
+        VIR_ALLOC_N(cbdata, neventIDs) < 0) {
+        PyErr_NoMemory();
+        goto cleanup;
+    }
+
+    for (i = 0; i < neventIDs; i++) {
+        item = PyList_GetItem(pyobj_eventIDs, i);
+        if (libvirt_intUnwrap(item, &eventIDs[i]) < 0)
+            goto cleanup;
+
+        if (!libvirt_virConnectDomainEventCallbackFor(eventIDs[i])) {
+            PyErr_Format(PyExc_ValueError,
+                         "Domain event ID %d cannot be batched", eventIDs[i]);
+            goto cleanup;
+        }
+
+        if (VIR_ALLOC(cbdata[i]) < 0) {
+            PyErr_NoMemory();
+            goto cleanup;
+        }
+        cbdata[i]->eventID = eventIDs[i];
+    }
+
+    if (!(batch = virPyDomainEventBatchNew(pyobj_cbData, maxBatch, maxDelay))) {
+        py_retval = VIR_PY_INT_FAIL;
+        goto cleanup;
+    }
+
+    /* Nothing can reach the batch before the first registration, so its
+     * references don't need the lock yet */
+    for (i = 0; i < neventIDs; i++) {
+        cbdata[i]->batch = batch;
+        batch->refs++;
+    }
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    for (i = 0; i < neventIDs; i++) {
+        int ret;
+
+        ret = virConnectDomainEventRegisterAny(conn, dom, eventIDs[i],
+                                               libvirt_virConnectDomainEventCallbackFor(eventIDs[i]),
+                                               cbdata[i],
+                                               libvirt_virConnectDomainEventFreeFunc);
+        if (ret < 0)
+            break;
+
+        cbdata[i] = NULL;
+        callbackIDs[ncallbacks++] = ret;
+    }
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (ncallbacks < neventIDs) {
+        /* Grab the error before deregistering resets it */
+        if ((pyobj_errorClass = libvirt_lookupPythonFunc("libvirtError")))
+            pyobj_error = PyObject_CallFunction(pyobj_errorClass, (char *) "s",
+                                                "virConnectDomainEventRegisterBatch() failed");
+
+        LIBVIRT_BEGIN_ALLOW_THREADS;
+        for (i = 0; i < ncallbacks; i++)
+            virConnectDomainEventDeregisterAny(conn, callbackIDs[i]);
+        LIBVIRT_END_ALLOW_THREADS;
+
+        if (pyobj_error) {
+            PyErr_SetObject((PyObject *) Py_TYPE(pyobj_error), pyobj_error);
+            Py_DECREF(pyobj_error);
+        } else if (!PyErr_Occurred()) {
+            py_retval = VIR_PY_INT_FAIL;
+        }
+        goto cleanup;
+    }
+
+    if (!(py_retval = PyList_New(ncallbacks)))
+        goto cleanup;
+
+    for (i = 0; i < ncallbacks; i++)
+        PyList_SET_ITEM(py_retval, i, libvirt_intWrap(callbackIDs[i]));
+
+ cleanup:
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    for (i = 0; cbdata && i < neventIDs; i++) {
+        if (cbdata[i])
+            libvirt_virConnectDomainEventFreeFunc(cbdata[i]);
+    }
+    if (batch)
+        virPyDomainEventBatchUnref(batch);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    VIR_FREE(cbdata);
+    VIR_FREE(callbackIDs);
+    VIR_FREE(eventIDs);
+    return py_retval;
+}
+
+static PyObject *
+libvirt_virConnectDomainEventDeregisterAny(ATTRIBUTE_UNUSED PyObject *self,
+                                           PyObject *args)
+{
+    PyObject *py_retval;
+    PyObject *pyobj_conn;
+    int callbackID;
+    virConnectPtr conn;
+    int ret = 0;
+
+    if (!PyArg_ParseTuple
+        (args, (char *) "Oi:virConnectDomainEventDeregister",
+         &pyobj_conn, &callbackID))
+        return NULL;
+
+    DEBUG("libvirt_virConnectDomainEventDeregister(%p) called\n", pyobj_conn);
+
+    conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+
+    ret = virConnectDomainEventDeregisterAny(conn, callbackID);
+
+    LIBVIRT_END_ALLOW_THREADS;
+    py_retval = libvirt_intWrap(ret);
+    return py_retval;
+}
+
+#if LIBVIR_CHECK_VERSION(1, 2, 1)
+static void
+libvirt_virConnectNetworkEventFreeFunc(void *opaque)
+{
+    PyObject *pyobj_conn = (PyObject*)opaque;
+    LIBVIRT_ENSURE_THREAD_STATE;
+    Py_DECREF(pyobj_conn);
+    LIBVIRT_RELEASE_THREAD_STATE;
+}
+
+static int
+libvirt_virConnectNetworkEventLifecycleCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                                virNetworkPtr net,
+                                                int event,
+                                                int detail,
+                                                void *opaque)
+{
+    PyObject *pyobj_cbData = (PyObject*)opaque;
+    PyObject *pyobj_net;
+    PyObject *pyobj_ret = NULL;
+    PyObject *pyobj_conn;
+    PyObject *dictKey;
+    int ret = -1;
+
+    LIBVIRT_ENSURE_THREAD_STATE;
+
+    if (!(dictKey = libvirt_constcharPtrWrap("conn")))
+        goto cleanup;
+    pyobj_conn = PyDict_GetItem(pyobj_cbData, dictKey);
+    Py_DECREF(dictKey);
+
+    /* Create a python instance of this virNetworkPtr */
+    virNetworkRef(net);
+    if (!(pyobj_net = libvirt_virNetworkPtrWrap(net))) {
+        virNetworkFree(net);
+        goto cleanup;
+    }
+    Py_INCREF(pyobj_cbData);
+
+    /* Call the Callback Dispatcher */
+    pyobj_ret = PyObject_CallMethod(pyobj_conn,
+                                    (char*)"_dispatchNetworkEventLifecycleCallback",
+                                    (char*)"OiiO",
+                                    pyobj_net,
+                                    event,
+                                    detail,
+                                    pyobj_cbData);
+
+    Py_DECREF(pyobj_cbData);
+    Py_DECREF(pyobj_net);
+
+ cleanup:
+    if (!pyobj_ret) {
+        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
+        PyErr_Print();
+    } else {
+        Py_DECREF(pyobj_ret);
+        ret = 0;
+    }
+
+    LIBVIRT_RELEASE_THREAD_STATE;
+    return ret;
+}
+
+static PyObject *
+libvirt_virConnectNetworkEventRegisterAny(PyObject *self ATTRIBUTE_UNUSED,
+                                          PyObject *args)
+{
+    PyObject *py_retval;        /* return value */
+    PyObject *pyobj_conn;       /* virConnectPtr */
+    PyObject *pyobj_net;
+    PyObject *pyobj_cbData;     /* hash of callback data */
+    int eventID;
+    virConnectPtr conn;
+    int ret = 0;
+    virConnectNetworkEventGenericCallback cb = NULL;
+    virNetworkPtr net;
+
+    if (!PyArg_ParseTuple
+        (args, (char *) "OOiO:virConnectNetworkEventRegisterAny",
+         &pyobj_conn, &pyobj_net, &eventID, &pyobj_cbData)) {
+        DEBUG("%s failed parsing tuple\n", __FUNCTION__);
+        return VIR_PY_INT_FAIL;
+    }
+
+    DEBUG("libvirt_virConnectNetworkEventRegister(%p %p %d %p) called\n",
+           pyobj_conn, pyobj_net, eventID, pyobj_cbData);
+    conn = PyvirConnect_Get(pyobj_conn);
+    if (pyobj_net == Py_None)
+        net = NULL;
+    else
+        net = PyvirNetwork_Get(pyobj_net);
+
+    switch ((virNetworkEventID) eventID) {
+    case VIR_NETWORK_EVENT_ID_LIFECYCLE:
+        cb = VIR_NETWORK_EVENT_CALLBACK(libvirt_virConnectNetworkEventLifecycleCallback);
+        break;
+
+    case VIR_NETWORK_EVENT_ID_LAST:
+        break;
+    }
+
+    if (!cb) {
+        return VIR_PY_INT_FAIL;
+    }
+
+    Py_INCREF(pyobj_cbData);
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    ret = virConnectNetworkEventRegisterAny(conn, net, eventID,
+                                            cb, pyobj_cbData,
+                                            libvirt_virConnectNetworkEventFreeFunc);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (ret < 0) {
+        Py_DECREF(pyobj_cbData);
+    }
+
+    py_retval = libvirt_intWrap(ret);
+    return py_retval;
+}
+
+static PyObject
+*libvirt_virConnectNetworkEventDeregisterAny(PyObject *self ATTRIBUTE_UNUSED,
+                                             PyObject *args)
+{
+    PyObject *py_retval;
+    PyObject *pyobj_conn;
+    int callbackID;
+    virConnectPtr conn;
+    int ret = 0;
+
+    if (!PyArg_ParseTuple
+        (args, (char *) "Oi:virConnectNetworkEventDeregister",
+         &pyobj_conn, &callbackID))
+        return NULL;
+
+    DEBUG("libvirt_virConnectNetworkEventDeregister(%p) called\n", pyobj_conn);
+
+    conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+
+    ret = virConnectNetworkEventDeregisterAny(conn, callbackID);
+
+    LIBVIRT_END_ALLOW_THREADS;
+    py_retval = libvirt_intWrap(ret);
+    return py_retval;
+}
+#endif /* LIBVIR_CHECK_VERSION(1, 2, 1)*/
+
+#if LIBVIR_CHECK_VERSION(0, 10, 0)
+static void
+libvirt_virConnectCloseCallbackDispatch(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                        int reason,
+                                        void *opaque)
+{
+    PyObject *pyobj_cbData = (PyObject*)opaque;
+    PyObject *pyobj_ret;
+    PyObject *pyobj_conn;
+    PyObject *dictKey;
+
+    LIBVIRT_ENSURE_THREAD_STATE;
+
+    Py_INCREF(pyobj_cbData);
+
+    dictKey = libvirt_constcharPtrWrap("conn");
+    pyobj_conn = PyDict_GetItem(pyobj_cbData, dictKey);
+    Py_DECREF(dictKey);
+
+    /* Call the Callback Dispatcher */
+    pyobj_ret = PyObject_CallMethod(pyobj_conn,
+                                    (char*)"_dispatchCloseCallback",
+                                    (char*)"iO",
+                                    reason,
+                                    pyobj_cbData);
+
+    Py_DECREF(pyobj_cbData);
+
+    if (!pyobj_ret) {
+        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
+        PyErr_Print();
+    } else {
+        Py_DECREF(pyobj_ret);
+    }
+
+    LIBVIRT_RELEASE_THREAD_STATE;
+}
+
+static PyObject *
+libvirt_virConnectRegisterCloseCallback(ATTRIBUTE_UNUSED PyObject * self,
+                                        PyObject * args)
+{
+    PyObject *py_retval;        /* return value */
+    PyObject *pyobj_conn;       /* virConnectPtr */
+    PyObject *pyobj_cbData;     /* hash of callback data */
+    virConnectPtr conn;
+    int ret = 0;
+
+    if (!PyArg_ParseTuple
+        (args, (char *) "OO:virConnectRegisterCloseCallback",
+         &pyobj_conn, &pyobj_cbData)) {
+        DEBUG("%s failed parsing tuple\n", __FUNCTION__);
+        return VIR_PY_INT_FAIL;
+    }
+
+    DEBUG("libvirt_virConnectRegisterCloseCallback(%p %p) called\n",
+           pyobj_conn, pyobj_cbData);
+    conn = PyvirConnect_Get(pyobj_conn);
+
+    Py_INCREF(pyobj_cbData);
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    ret = virConnectRegisterCloseCallback(conn,
+                                          libvirt_virConnectCloseCallbackDispatch,
+                                          pyobj_cbData,
+                                          libvirt_virConnectDomainEventFreeFunc);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (ret < 0) {
+        Py_DECREF(pyobj_cbData);
+    }
+
+    py_retval = libvirt_intWrap(ret);
+    return py_retval;
+}
+
+static PyObject *
+libvirt_virConnectUnregisterCloseCallback(ATTRIBUTE_UNUSED PyObject * self,
+                                          PyObject * args)
+{
+    PyObject *py_retval;
+    PyObject *pyobj_conn;
+    virConnectPtr conn;
+    int ret = 0;
+
+    if (!PyArg_ParseTuple
+        (args, (char *) "O:virConnectDomainEventUnregister",
+         &pyobj_conn))
+        return NULL;
+
+    DEBUG("libvirt_virConnectDomainEventUnregister(%p) called\n",
+          pyobj_conn);
+
+    conn = PyvirConnect_Get(pyobj_conn);
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+
+    ret = virConnectUnregisterCloseCallback(conn,
+                                            libvirt_virConnectCloseCallbackDispatch);
+
+    LIBVIRT_END_ALLOW_THREADS;
+    py_retval = libvirt_intWrap(ret);
+    return py_retval;
+}
+#endif /* LIBVIR_CHECK_VERSION(0, 10, 0) */
+
+static void
+libvirt_virStreamEventFreeFunc(void *opaque)
+{
+    PyObject *pyobj_stream = (PyObject*)opaque;
+    LIBVIRT_ENSURE_THREAD_STATE;
+    Py_DECREF(pyobj_stream);
+    LIBVIRT_RELEASE_THREAD_STATE;
+}
+
+static void
+libvirt_virStreamEventCallback(virStreamPtr st ATTRIBUTE_UNUSED,
+                               int events,
+                               void *opaque)
+{
+    PyObject *pyobj_cbData = (PyObject *)opaque;
+    PyObject *pyobj_stream;
+    PyObject *pyobj_ret;
+    PyObject *dictKey;
+
+    LIBVIRT_ENSURE_THREAD_STATE;
+
+    Py_INCREF(pyobj_cbData);
+    dictKey = libvirt_constcharPtrWrap("stream");
+    pyobj_stream = PyDict_GetItem(pyobj_cbData, dictKey);
+    Py_DECREF(dictKey);
+
+    /* Call the pure python dispatcher */
+    pyobj_ret = PyObject_CallMethod(pyobj_stream,
+                                    (char *)"_dispatchStreamEventCallback",
+                                    (char *)"iO",
+                                    events, pyobj_cbData);
+
+    Py_DECREF(pyobj_cbData);
+
+    if (!pyobj_ret) {
+        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
+        PyErr_Print();
+    } else {
+        Py_DECREF(pyobj_ret);
+    }
+
+    LIBVIRT_RELEASE_THREAD_STATE;
+}
+
+static PyObject *
+libvirt_virStreamEventAddCallback(PyObject *self ATTRIBUTE_UNUSED,
+                                  PyObject *args)
+{
+    PyObject *py_retval;
+    PyObject *pyobj_stream;
+    PyObject *pyobj_cbData;
+    virStreamPtr stream;
+    virStreamEventCallback cb = libvirt_virStreamEventCallback;
+    int ret;
+    int events;
+
+    if (!PyArg_ParseTuple(args, (char *) "OiO:virStreamEventAddCallback",
+                          &pyobj_stream, &events, &pyobj_cbData)) {
+        DEBUG("%s failed to parse tuple\n", __FUNCTION__);
+        return VIR_PY_INT_FAIL;
+    }
+
+    DEBUG("libvirt_virStreamEventAddCallback(%p, %d, %p) called\n",
+          pyobj_stream, events, pyobj_cbData);
+    stream = PyvirStream_Get(pyobj_stream);
+
+    Py_INCREF(pyobj_cbData);
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    ret = virStreamEventAddCallback(stream, events, cb, pyobj_cbData,
+                                    libvirt_virStreamEventFreeFunc);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (ret < 0) {
+        Py_DECREF(pyobj_cbData);
+    }
+
+    py_retval = libvirt_intWrap(ret);
+    return py_retval;
+}
+
+static PyObject *
+libvirt_virStreamRecv(PyObject *self ATTRIBUTE_UNUSED,
+                      PyObject *args)
+{
+    PyObject *pyobj_stream;
+    PyObject *rv;
+    virStreamPtr stream;
+    char *buf = NULL;
+    int ret;
+    int nbytes;
+
+    if (!PyArg_ParseTuple(args, (char *) "Oi:virStreamRecv",
+                          &pyobj_stream, &nbytes)) {
+        DEBUG("%s failed to parse tuple\n", __FUNCTION__);
+        return VIR_PY_NONE;
+    }
+    stream = PyvirStream_Get(pyobj_stream);
+
+    if (VIR_ALLOC_N(buf, nbytes+1 > 0 ? nbytes+1 : 1) < 0)
+        return VIR_PY_NONE;
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    ret = virStreamRecv(stream, buf, nbytes);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    buf[ret > -1 ? ret : 0] = '\0';
+    DEBUG("StreamRecv ret=%d strlen=%d\n", ret, (int) strlen(buf));
+
+    if (ret == -2)
+        return libvirt_intWrap(ret);
+    if (ret < 0)
+        return VIR_PY_NONE;
+    rv = libvirt_charPtrSizeWrap((char *) buf, (Py_ssize_t) ret);
+    VIR_FREE(buf);
+    return rv;
+}
+
+#ifdef LIBVIRT_HAVE_PY_BUFFER
+static PyObject *
+libvirt_virStreamRecvInto(PyObject *self ATTRIBUTE_UNUSED,
+                          PyObject *args)
+{
+    PyObject *pyobj_stream;
+    Py_buffer buf;
+    virStreamPtr stream;
+    Py_ssize_t nbytes = -1;
+    int ret;
+
+    if (!PyArg_ParseTuple(args, (char *) "Ow*|n:virStreamRecvInto",
+                          &pyobj_stream, &buf, &nbytes)) {
+        DEBUG("%s failed to parse tuple\n", __FUNCTION__);
+        return NULL;
+    }
+    stream = PyvirStream_Get(pyobj_stream);
+
+    if (nbytes < 0 || nbytes > buf.len)
+        nbytes = buf.len;
+    if (nbytes > INT_MAX)
+        nbytes = INT_MAX;
+
+    /* The buffer export stays locked until PyBuffer_Release, so the
+     * object can't be resized or freed while we wait without the GIL */
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    ret = virStreamRecv(stream, buf.buf, nbytes);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    PyBuffer_Release(&buf);
+
+    DEBUG("StreamRecvInto ret=%d\n", ret);
+
+    if (ret < 0 && ret != -2)
+        return VIR_PY_NONE;
+    return libvirt_intWrap(ret);
+}
+#endif /* LIBVIRT_HAVE_PY_BUFFER */
+
+static PyObject *
+libvirt_virStreamSend(PyObject *self ATTRIBUTE_UNUSED,
+                      PyObject *args)
+{
+    PyObject *py_retval;
+    PyObject *pyobj_stream;
+    PyObject *pyobj_data;
+    virStreamPtr stream;
+    char *data;
+    Py_ssize_t datalen;
+    int ret;
+#ifdef LIBVIRT_HAVE_PY_BUFFER
+    Py_buffer view;
+    bool have_view = false;
+#endif
+
+    if (!PyArg_ParseTuple(args, (char *) "OO:virStreamRecv",
+                          &pyobj_stream, &pyobj_data)) {
+        DEBUG("%s failed to parse tuple\n", __FUNCTION__);
+        return VIR_PY_INT_FAIL;
+    }
+    stream = PyvirStream_Get(pyobj_stream);
+
+#ifdef LIBVIRT_HAVE_PY_BUFFER
+    /* Send straight out of any object exporting a buffer (bytes,
+     * bytearray, memoryview, mmap, ...), without copying it first.
+     * Python 2 strings keep using the old conversion, so that unicode
+     * objects are still encoded rather than sent as raw code points. */
+# if PY_MAJOR_VERSION < 3
+    if (PyString_Check(pyobj_data) || PyUnicode_Check(pyobj_data)) {
+        libvirt_charPtrSizeUnwrap(pyobj_data, &data, &datalen);
+    } else
+# endif
+    if (PyObject_GetBuffer(pyobj_data, &view, PyBUF_SIMPLE) == 0) {
+        have_view = true;
+        data = view.buf;
+        datalen = view.len;
+    } else {
+# if PY_MAJOR_VERSION < 3
+        /* mmap only has the old style buffer interface in python 2 */
+        const void *buf;
+
+        PyErr_Clear();
+        if (PyObject_AsReadBuffer(pyobj_data, &buf, &datalen) < 0)
+            return NULL;
+        data = (char *) buf;
+# else
+        return NULL;
+# endif
+    }
+#else
+    libvirt_charPtrSizeUnwrap(pyobj_data, &data, &datalen);
+#endif
+
+    if (datalen > INT_MAX)
+        datalen = INT_MAX;
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    ret = virStreamSend(stream, data, datalen);
+    LIBVIRT_END_ALLOW_THREADS;
+
+#ifdef LIBVIRT_HAVE_PY_BUFFER
+    if (have_view)
+        PyBuffer_Release(&view);
+#endif
+
+    DEBUG("StreamSend ret=%d\n", ret);
+
+    py_retval = libvirt_intWrap(ret);
+    return py_retval;
+}
+
+/* Outcome of one run of the stream <-> file descriptor pump */
+typedef enum {
+    VIR_PY_STREAM_PUMP_DONE,       /* end of data reached */
+    VIR_PY_STREAM_PUMP_PROGRESS,   /* progress report is due */
+    VIR_PY_STREAM_PUMP_ERROR,      /* libvirt error */
+    VIR_PY_STREAM_PUMP_AGAIN,      /* stream is nonblocking */
+    VIR_PY_STREAM_PUMP_IO_ERROR    /* file descriptor error, errno is set */
+} virPyStreamPumpStatus;
+
+/* Sparse modes of the pump, as VIR_PYTHON_STREAM_SPARSE_* in python */
+enum {
+    VIR_PY_STREAM_SPARSE_NONE = 0,   /* every byte is moved */
+    VIR_PY_STREAM_SPARSE_LOCAL = 1,  /* holes made or skipped on the fd */
+    VIR_PY_STREAM_SPARSE_STREAM = 2, /* and carried by the stream too */
+};
+
+/* Granularity of the zero detection */
+#define VIR_PY_STREAM_SPARSE_BLOCK 4096
+
+static const char virPyStreamZeros[64 * 1024];
+
+typedef struct {
+    virStreamPtr stream;
+    int fd;
+    char *buf;
+    size_t chunk;
+    int sparse;
+    bool seekable;                  /* fd is a regular file */
+    off_t offset;                   /* of fd, when seekable */
+    off_t size;                     /* of the file, as far as written */
+    unsigned long long logical;     /* bytes of stream content */
+    unsigned long long physical;    /* of them moved as data, not holes */
+} virPyStreamPump;
+typedef virPyStreamPump *virPyStreamPumpPtr;
+
+/* Whether the @len bytes at @buf are all zero.  Once the first 16
+ * are known to be, comparing the buffer with itself shifted by 16
+ * leaves the scan to the vectorized memcmp of the C library.  */
+static bool
+virPyStreamIsZero(const char *buf,
+                  size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len && i < 16; i++) {
+        if (buf[i])
+            return false;
+    }
+    return len <= 16 || memcmp(buf, buf + 16, len - 16) == 0;
+}
+
+/* Length of the run of blocks at @buf, at most @len bytes long, that
+ * are all zero if @zero is true, or all contain data otherwise.  @buf
+ * lies at @offset of the file, and the blocks are aligned to the file
+ * rather than to @buf so that a hole always covers whole file blocks
+ * however the data was cut into buffers.  */
+static size_t
+virPyStreamBlockRun(const char *buf,
+                    size_t len,
+                    off_t offset,
+                    bool zero)
+{
+    size_t run = 0;
+    size_t block;
+
+    while (run < len) {
+        block = VIR_PY_STREAM_SPARSE_BLOCK -
+            (size_t) ((offset + run) % VIR_PY_STREAM_SPARSE_BLOCK);
+        block = MIN(len - run, block);
+        if (virPyStreamIsZero(buf + run, block) != zero)
+            break;
+        run += block;
+    }
+    return run;
+}
+
+static int
+virPyStreamPumpWrite(virPyStreamPumpPtr pump,
+                     const char *buf,
+                     size_t len)
+{
+    ssize_t written;
+    size_t done;
+
+    for (done = 0; done < len; done += written) {
+        if ((written = write(pump->fd, buf + done, len - done)) < 0) {
+            if (errno != EINTR)
+                return -1;
+            written = 0;
+        }
+    }
+    pump->logical += len;
+    pump->physical += len;
+    pump->offset += len;
+    if (pump->offset > pump->size)
+        pump->size = pump->offset;
+    return 0;
+}
+
+static int
+virPyStreamPumpWriteZeros(virPyStreamPumpPtr pump,
+                          unsigned long long len)
+{
+    size_t n;
+
+    while (len) {
+        n = MIN(len, sizeof(virPyStreamZeros));
+        if (virPyStreamPumpWrite(pump, virPyStreamZeros, n) < 0)
+            return -1;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Leave a hole of @len bytes in the file at fd: beyond its end this
+ * is a seek, within it the range is punched if the file system can,
+ * and zeros are written to whatever else can't seek.  */
+static int
+virPyStreamPumpHole(virPyStreamPumpPtr pump,
+                    unsigned long long len)
+{
+    off_t inside;
+
+    if (!pump->seekable || pump->sparse == VIR_PY_STREAM_SPARSE_NONE)
+        return virPyStreamPumpWriteZeros(pump, len);
+
+    inside = 0;
+    if (pump->offset < pump->size)
+        inside = MIN((off_t) len, pump->size - pump->offset);
+    if (inside) {
+#ifdef FALLOC_FL_PUNCH_HOLE
+        if (fallocate(pump->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                      pump->offset, inside) < 0)
+#endif
+        {
+            if (virPyStreamPumpWriteZeros(pump, inside) < 0)
+                return -1;
+            len -= inside;
+            inside = 0;
+        }
+    }
+
+    if (lseek(pump->fd, pump->offset + len, SEEK_SET) < 0)
+        return -1;
+    pump->logical += len;
+    pump->offset += len;
+    return 0;
+}
+
+/* Write @len received bytes, leaving holes for their zero blocks */
+static int
+virPyStreamPumpWriteSparse(virPyStreamPumpPtr pump,
+                           const char *buf,
+                           size_t len)
+{
+    size_t done;
+    size_t run;
+    bool zero = false;
+
+    if (pump->sparse == VIR_PY_STREAM_SPARSE_NONE || !pump->seekable)
+        return virPyStreamPumpWrite(pump, buf, len);
+
+    for (done = 0; done < len; done += run, zero = !zero) {
+        if (!(run = virPyStreamBlockRun(buf + done, len - done,
+                                        pump->offset, zero)))
+            continue;
+        if ((zero ? virPyStreamPumpHole(pump, run) :
+             virPyStreamPumpWrite(pump, buf + done, run)) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* Give the file its full size if the stream ended in a hole */
+static int
+virPyStreamPumpTruncate(virPyStreamPumpPtr pump)
+{
+    if (!pump->seekable || pump->offset <= pump->size)
+        return 0;
+    return ftruncate(pump->fd, pump->offset);
+}
+
+/* Move data from the stream to fd until the end of the stream or
+ * until @deadline (in milliseconds, 0 for none) passes.  Must be
+ * called without the GIL held.  */
+static virPyStreamPumpStatus
+virPyStreamPumpRecv(virPyStreamPumpPtr pump,
+                    unsigned long long deadline)
+{
+    unsigned long long now;
+    int got;
+#if LIBVIR_CHECK_VERSION(3, 4, 0)
+    long long length;
+#endif
+
+    for (;;) {
+#if LIBVIR_CHECK_VERSION(3, 4, 0)
+        if (pump->sparse == VIR_PY_STREAM_SPARSE_STREAM)
+            got = virStreamRecvFlags(pump->stream, pump->buf, pump->chunk,
+                                     VIR_STREAM_RECV_STOP_AT_HOLE);
+        else
+#endif
+            got = virStreamRecv(pump->stream, pump->buf, pump->chunk);
+
+        if (got == -2)
+            return VIR_PY_STREAM_PUMP_AGAIN;
+#if LIBVIR_CHECK_VERSION(3, 4, 0)
+        if (got == -3) {
+            if (virStreamRecvHole(pump->stream, &length, 0) < 0)
+                return VIR_PY_STREAM_PUMP_ERROR;
+            if (virPyStreamPumpHole(pump, length) < 0)
+                return VIR_PY_STREAM_PUMP_IO_ERROR;
+        } else
+#endif
+        if (got < 0) {
+            return VIR_PY_STREAM_PUMP_ERROR;
+        } else if (got == 0) {
+            if (virPyStreamPumpTruncate(pump) < 0)
+                return VIR_PY_STREAM_PUMP_IO_ERROR;
+            return VIR_PY_STREAM_PUMP_DONE;
+        } else if (virPyStreamPumpWriteSparse(pump, pump->buf, got) < 0) {
+            return VIR_PY_STREAM_PUMP_IO_ERROR;
+        }
+
+        if (deadline && virTimeMillisNow(&now) == 0 && now >= deadline)
+            return VIR_PY_STREAM_PUMP_PROGRESS;
+    }
+}
+
+/* Returns -1 on libvirt errors and -2 if the stream would block */
+static int
+virPyStreamPumpSendData(virPyStreamPumpPtr pump,
+                        const char *buf,
+                        size_t len)
+{
+    size_t done;
+    int sent;
+
+    /* Count as they go the bytes sent before the stream would block */
+    for (done = 0; done < len; done += sent) {
+        if ((sent = virStreamSend(pump->stream, buf + done, len - done)) < 0)
+            return sent;
+        pump->logical += sent;
+        pump->physical += sent;
+    }
+    return 0;
+}
+
+static int
+virPyStreamPumpSendHole(virPyStreamPumpPtr pump,
+                        unsigned long long len)
+{
+    size_t n;
+    int ret;
+
+#if LIBVIR_CHECK_VERSION(3, 4, 0)
+    if (pump->sparse == VIR_PY_STREAM_SPARSE_STREAM) {
+        if (virStreamSendHole(pump->stream, len, 0) < 0)
+            return -1;
+        pump->logical += len;
+        return 0;
+    }
+#endif
+
+    while (len) {
+        n = MIN(len, sizeof(virPyStreamZeros));
+        if ((ret = virPyStreamPumpSendData(pump, virPyStreamZeros, n)) < 0)
+            return ret;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Send @len bytes read from fd, as holes for their zero blocks if
+ * the stream can carry them */
+static int
+virPyStreamPumpSendSparse(virPyStreamPumpPtr pump,
+                          const char *buf,
+                          size_t len)
+{
+    size_t done;
+    size_t run;
+    bool zero = false;
+    int ret;
+
+    if (pump->sparse != VIR_PY_STREAM_SPARSE_STREAM)
+        return virPyStreamPumpSendData(pump, buf, len);
+
+    for (done = 0; done < len; done += run, zero = !zero) {
+        if (!(run = virPyStreamBlockRun(buf + done, len - done,
+                                        pump->offset + done, zero)))
+            continue;
+        if ((ret = zero ? virPyStreamPumpSendHole(pump, run) :
+             virPyStreamPumpSendData(pump, buf + done, run)) < 0)
+            return ret;
+    }
+    return 0;
+}
+
+#define VIR_PY_STREAM_PUMP_SEND_STATUS(ret) \
+    ((ret) == -2 ? VIR_PY_STREAM_PUMP_AGAIN : VIR_PY_STREAM_PUMP_ERROR)
+
+/* Move data from fd to the stream until the end of file or until
+ * @deadline (in milliseconds, 0 for none) passes.  In sparse mode, the
+ * holes of the file are skipped without reading them where the system
+ * can tell them.  Must be called without the GIL held.  */
+static virPyStreamPumpStatus
+virPyStreamPumpSend(virPyStreamPumpPtr pump,
+                    unsigned long long deadline)
+{
+    unsigned long long now;
+    ssize_t got;
+    int ret;
+#ifdef SEEK_DATA
+    struct stat sb;
+    off_t data;
+#endif
+
+    for (;;) {
+#ifdef SEEK_DATA
+        if (pump->sparse != VIR_PY_STREAM_SPARSE_NONE && pump->seekable) {
+            data = lseek(pump->fd, pump->offset, SEEK_DATA);
+            if (data < 0 && errno == ENXIO) {
+                /* Nothing but a hole up to the end of the file */
+                if (fstat(pump->fd, &sb) < 0)
+                    return VIR_PY_STREAM_PUMP_IO_ERROR;
+                if (sb.st_size > pump->offset &&
+                    (ret = virPyStreamPumpSendHole(pump, sb.st_size -
+                                                   pump->offset)) < 0)
+                    return VIR_PY_STREAM_PUMP_SEND_STATUS(ret);
+                pump->offset = sb.st_size;
+                return VIR_PY_STREAM_PUMP_DONE;
+            } else if (data < 0) {
+                /* Not supported here, read everything */
+                pump->seekable = false;
+            } else if (data > pump->offset) {
+                if ((ret = virPyStreamPumpSendHole(pump, data -
+                                                   pump->offset)) < 0)
+                    return VIR_PY_STREAM_PUMP_SEND_STATUS(ret);
+                pump->offset = data;
+            }
+        }
+#endif
+
+        if ((got = read(pump->fd, pump->buf, pump->chunk)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return VIR_PY_STREAM_PUMP_IO_ERROR;
+        }
+        if (got == 0)
+            return VIR_PY_STREAM_PUMP_DONE;
+
+        if ((ret = virPyStreamPumpSendSparse(pump, pump->buf, got)) < 0)
+            return VIR_PY_STREAM_PUMP_SEND_STATUS(ret);
+        pump->offset += got;
+
+        if (deadline && virTimeMillisNow(&now) == 0 && now >= deadline)
+            return VIR_PY_STREAM_PUMP_PROGRESS;
+    }
+}
+
+/* Common driver of virStreamRecvToFD and virStreamSendFromFD.  The data
+ * is moved without the GIL held, which is only taken back to report
+ * progress through the python dispatcher at most every @interval
+ * milliseconds.  Returns the number of bytes of stream content
+ * transferred or, in sparse mode, a (logical, physical) tuple of it
+ * and of the part of it moved as data rather than holes.  If the
+ * stream would block, a (-2, transferred) tuple is returned instead,
+ * transferred being that result for the data moved until then.  */
+static PyObject *
+libvirt_virStreamPumpFD(PyObject *args,
+                        const char *format,
+                        bool receive)
+{
+    PyObject *pyobj_stream;
+    PyObject *pyobj_cbData;
+    PyObject *pyobj_ret;
+    PyObject *pyobj_pystream = NULL;
+    PyObject *pyobj_count;
+    virPyStreamPump pump;
+    virPyStreamPumpStatus status;
+    unsigned long long deadline;
+    unsigned int chunk;
+    unsigned int interval;
+    struct stat sb;
+    int fd;
+    int sparse;
+    int saved_errno;
+
+    if (!PyArg_ParseTuple(args, (char *) format,
+                          &pyobj_stream, &fd, &chunk,
+                          &pyobj_cbData, &interval, &sparse))
+        return NULL;
+
+    if (pyobj_cbData != Py_None &&
+        !(pyobj_pystream = PyDict_GetItemString(pyobj_cbData, "stream"))) {
+        PyErr_SetString(PyExc_KeyError, "stream");
+        return NULL;
+    }
+
+    if (sparse < VIR_PY_STREAM_SPARSE_NONE ||
+        sparse > VIR_PY_STREAM_SPARSE_STREAM) {
+        PyErr_SetString(PyExc_ValueError, "unknown sparse mode");
+        return NULL;
+    }
+#if !LIBVIR_CHECK_VERSION(3, 4, 0)
+    if (sparse == VIR_PY_STREAM_SPARSE_STREAM) {
+        PyErr_SetString(PyExc_NotImplementedError,
+                        "sparse streams need libvirt 3.4.0 or newer");
+        return NULL;
+    }
+#endif
+
+    memset(&pump, 0, sizeof(pump));
+    pump.stream = PyvirStream_Get(pyobj_stream);
+    pump.fd = fd;
+    pump.chunk = chunk ? chunk : 256 * 1024;
+    pump.sparse = sparse;
+
+    /* Holes are only made in, or looked for in, regular files */
+    if (sparse != VIR_PY_STREAM_SPARSE_NONE &&
+        fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) &&
+        (pump.offset = lseek(fd, 0, SEEK_CUR)) >= 0) {
+        pump.seekable = true;
+        pump.size = sb.st_size;
+    }
+
+    if (VIR_ALLOC_N(pump.buf, pump.chunk) < 0)
+        return PyErr_NoMemory();
+
+    do {
+        LIBVIRT_BEGIN_ALLOW_THREADS;
+        deadline = 0;
+        if (pyobj_pystream && virTimeMillisNow(&deadline) == 0)
+            deadline += interval;
+
+        if (receive)
+            status = virPyStreamPumpRecv(&pump, deadline);
+        else
+            status = virPyStreamPumpSend(&pump, deadline);
+
+        if (status == VIR_PY_STREAM_PUMP_IO_ERROR) {
+            saved_errno = errno;
+            virStreamAbort(pump.stream);
+            errno = saved_errno;
+        }
+        LIBVIRT_END_ALLOW_THREADS;
+
+        if (status == VIR_PY_STREAM_PUMP_IO_ERROR) {
+            PyErr_SetFromErrno(PyExc_OSError);
+            goto error;
+        }
+
+        if (pyobj_pystream &&
+            (status == VIR_PY_STREAM_PUMP_PROGRESS ||
+             status == VIR_PY_STREAM_PUMP_DONE)) {
+            pyobj_ret = PyObject_CallMethod(pyobj_pystream,
+                                            (char *)"_dispatchStreamProgressCallback",
+                                            (char *)"KO",
+                                            pump.logical, pyobj_cbData);
+            if (!pyobj_ret) {
+                LIBVIRT_BEGIN_ALLOW_THREADS;
+                virStreamAbort(pump.stream);
+                LIBVIRT_END_ALLOW_THREADS;
+                goto error;
+            }
+            Py_DECREF(pyobj_ret);
+        }
+    } while (status == VIR_PY_STREAM_PUMP_PROGRESS);
+
+    VIR_FREE(pump.buf);
+
+    if (status == VIR_PY_STREAM_PUMP_ERROR)
+        return VIR_PY_NONE;
+    if (sparse != VIR_PY_STREAM_SPARSE_NONE)
+        pyobj_count = Py_BuildValue((char *) "(KK)",
+                                    pump.logical, pump.physical);
+    else
+        pyobj_count = libvirt_ulonglongWrap(pump.logical);
+    if (pyobj_count && status == VIR_PY_STREAM_PUMP_AGAIN)
+        return Py_BuildValue((char *) "(iN)", -2, pyobj_count);
+    return pyobj_count;
+
+ error:
+    VIR_FREE(pump.buf);
+    return NULL;
+}
+
+static PyObject *
+libvirt_virStreamRecvToFD(PyObject *self ATTRIBUTE_UNUSED,
+                          PyObject *args)
+{
+    return libvirt_virStreamPumpFD(args, "OiIOIi:virStreamRecvToFD", true);
+}
+
+static PyObject *
+libvirt_virStreamSendFromFD(PyObject *self ATTRIBUTE_UNUSED,
+                            PyObject *args)
+{
+    return libvirt_virStreamPumpFD(args, "OiIOIi:virStreamSendFromFD", false);
+}
+
+/* Native console multiplexer: the data of many nonblocking console
+ * streams is moved by the event loop straight to a file descriptor
+ * and/or a ring buffer per console, without the GIL, python is only
+ * called back when a console gets closed by its stream.  */
+enum {
+    VIR_PY_CONSOLE_OPEN = 0,
+    VIR_PY_CONSOLE_EOF = 1,
+    VIR_PY_CONSOLE_ERROR = 2,
+    VIR_PY_CONSOLE_SINK_ERROR = 3,
+    VIR_PY_CONSOLE_DETACHED = 4,
+};
+
+#define VIR_PY_CONSOLE_CHUNK (16 * 1024)
+
+typedef struct _virPyConsoleMux virPyConsoleMux;
+typedef virPyConsoleMux *virPyConsoleMuxPtr;
+
+typedef struct {
+    virPyConsoleMuxPtr mux;
+    virStreamPtr stream;
+    int refs;                       /* protected by mux->lock, as are */
+    int id;                         /* all the fields below */
+    int state;
+    int fd;                         /* -1 if none */
+    char *ring;
+    size_t ringSize;
+    size_t ringStart;
+    size_t ringUsed;
+    unsigned long long received;
+    unsigned long long dropped;     /* on a nonblocking fd when full */
+} virPyConsole;
+typedef virPyConsole *virPyConsolePtr;
+
+struct _virPyConsoleMux {
+    PyThread_type_lock lock;        /* protects refs and consoles */
+    int refs;
+    int lastID;
+    virPyConsolePtr *consoles;
+    size_t nconsoles;
+    PyObject *cb;                   /* set once, released with the GIL */
+};
+
+#define VIR_PY_CONSOLE_MUX "virPyConsoleMux"
+
+static void
+virPyConsoleMuxFree(virPyConsoleMuxPtr mux)
+{
+    VIR_FREE(mux->consoles);
+    if (mux->cb) {
+        LIBVIRT_ENSURE_THREAD_STATE;
+        Py_DECREF(mux->cb);
+        LIBVIRT_RELEASE_THREAD_STATE;
+    }
+    if (mux->lock)
+        PyThread_free_lock(mux->lock);
+    VIR_FREE(mux);
+}
+
+/* Drop a reference, with mux->lock held, which this releases */
+static void
+virPyConsoleMuxUnref(virPyConsoleMuxPtr mux)
+{
+    if (libvirt_unrefLocked(mux->lock, &mux->refs))
+        virPyConsoleMuxFree(mux);
+}
+
+/* Drop a reference, with console->mux->lock held, which this releases */
+static void
+virPyConsoleUnref(virPyConsolePtr console)
+{
+    if (--console->refs > 0) {
+        PyThread_release_lock(console->mux->lock);
+        return;
+    }
+
+    virPyConsoleMuxUnref(console->mux);
+    virStreamFree(console->stream);
+    VIR_FREE(console->ring);
+    VIR_FREE(console);
+}
+
+/* Remove the console @id from @mux, with mux->lock held, returning it
+ * with the reference of the multiplexer, or NULL if there is none */
+static virPyConsolePtr
+virPyConsoleMuxRemove(virPyConsoleMuxPtr mux,
+                      int id)
+{
+    virPyConsolePtr console;
+    size_t i;
+
+    for (i = 0; i < mux->nconsoles; i++) {
+        if (mux->consoles[i]->id != id)
+            continue;
+        console = mux->consoles[i];
+        mux->consoles[i] = mux->consoles[--mux->nconsoles];
+        return console;
+    }
+    return NULL;
+}
+
+static virPyConsolePtr
+virPyConsoleMuxFind(virPyConsoleMuxPtr mux,
+                    int id)
+{
+    size_t i;
+
+    for (i = 0; i < mux->nconsoles; i++) {
+        if (mux->consoles[i]->id == id)
+            return mux->consoles[i];
+    }
+    return NULL;
+}
+
+/* Append @len bytes to the ring of @console, overwriting the oldest
+ * ones once full, with mux->lock held */
+static void
+virPyConsoleRingAppend(virPyConsolePtr console,
+                       const char *buf,
+                       size_t len)
+{
+    size_t pos;
+    size_t n;
+
+    if (len >= console->ringSize) {
+        memcpy(console->ring, buf + len - console->ringSize,
+               console->ringSize);
+        console->ringStart = 0;
+        console->ringUsed = console->ringSize;
+        return;
+    }
+
+    pos = (console->ringStart + console->ringUsed) % console->ringSize;
+    n = MIN(len, console->ringSize - pos);
+    memcpy(console->ring + pos, buf, n);
+    memcpy(console->ring, buf + n, len - n);
+
+    console->ringUsed += len;
+    if (console->ringUsed > console->ringSize) {
+        console->ringStart = (console->ringStart + console->ringUsed -
+                              console->ringSize) % console->ringSize;
+        console->ringUsed = console->ringSize;
+    }
+}
+
+/* Hand @len received bytes to the sinks of @console.  Data that a
+ * nonblocking file descriptor can't take right away is dropped, so a
+ * slow reader never stalls the event loop.  Returns -1 with errno set
+ * if writing to the file descriptor failed.  */
+static int
+virPyConsoleSink(virPyConsolePtr console,
+                 const char *buf,
+                 size_t len)
+{
+    PyThread_type_lock lock = console->mux->lock;
+    ssize_t written;
+    size_t done;
+
+    PyThread_acquire_lock(lock, WAIT_LOCK);
+    console->received += len;
+    if (console->ringSize)
+        virPyConsoleRingAppend(console, buf, len);
+    PyThread_release_lock(lock);
+
+    if (console->fd < 0)
+        return 0;
+
+    for (done = 0; done < len; done += written) {
+        if ((written = write(console->fd, buf + done, len - done)) >= 0)
+            continue;
+        if (errno == EINTR) {
+            written = 0;
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            return -1;
+
+        PyThread_acquire_lock(lock, WAIT_LOCK);
+        console->dropped += len - done;
+        PyThread_release_lock(lock);
+        break;
+    }
+    return 0;
+}
+
+static void
+libvirt_virPyConsoleEventFree(void *opaque)
+{
+    virPyConsolePtr console = opaque;
+
+    PyThread_acquire_lock(console->mux->lock, WAIT_LOCK);
+    virPyConsoleUnref(console);
+}
+
+static void
+libvirt_virPyConsoleEvent(virStreamPtr st,
+                          int events,
+                          void *opaque)
+{
+    virPyConsolePtr console = opaque;
+    virPyConsoleMuxPtr mux = console->mux;
+    virErrorPtr err;
+    PyObject *pyobj_ret;
+    char buf[VIR_PY_CONSOLE_CHUNK];
+    char msg[512];
+    int state = VIR_PY_CONSOLE_OPEN;
+    int got;
+
+    PyThread_acquire_lock(mux->lock, WAIT_LOCK);
+    if (console->state != VIR_PY_CONSOLE_OPEN) {
+        PyThread_release_lock(mux->lock);
+        return;
+    }
+    console->refs++;
+    PyThread_release_lock(mux->lock);
+
+    msg[0] = '\0';
+    while (state == VIR_PY_CONSOLE_OPEN) {
+        if ((got = virStreamRecv(st, buf, sizeof(buf))) == -2)
+            break;
+
+        if (got == 0) {
+            state = VIR_PY_CONSOLE_EOF;
+        } else if (got < 0) {
+            state = VIR_PY_CONSOLE_ERROR;
+            if ((err = virGetLastError()) && err->message)
+                snprintf(msg, sizeof(msg), "%s", err->message);
+        } else if (virPyConsoleSink(console, buf, got) < 0) {
+            state = VIR_PY_CONSOLE_SINK_ERROR;
+            snprintf(msg, sizeof(msg), "%s", strerror(errno));
+        }
+    }
+
+    if (state == VIR_PY_CONSOLE_OPEN) {
+        if (events & VIR_STREAM_EVENT_ERROR)
+            state = VIR_PY_CONSOLE_ERROR;
+        else if (events & VIR_STREAM_EVENT_HANGUP)
+            state = VIR_PY_CONSOLE_EOF;
+    }
+
+    /* Unless detached meanwhile, the console is closed here */
+    PyThread_acquire_lock(mux->lock, WAIT_LOCK);
+    if (state != VIR_PY_CONSOLE_OPEN) {
+        if (console->state == VIR_PY_CONSOLE_OPEN)
+            console->state = state;
+        else
+            state = VIR_PY_CONSOLE_OPEN;
+    }
+    PyThread_release_lock(mux->lock);
+
+    if (state != VIR_PY_CONSOLE_OPEN) {
+        virStreamEventRemoveCallback(st);
+        if (state == VIR_PY_CONSOLE_EOF)
+            virStreamFinish(st);
+        else
+            virStreamAbort(st);
+
+        if (mux->cb) {
+            LIBVIRT_ENSURE_THREAD_STATE;
+            pyobj_ret = PyObject_CallFunction(mux->cb, (char *) "iiz",
+                                              console->id, state,
+                                              msg[0] ? msg : NULL);
+            if (!pyobj_ret) {
+                DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
+                PyErr_Print();
+            } else {
+                Py_DECREF(pyobj_ret);
+            }
+            LIBVIRT_RELEASE_THREAD_STATE;
+        }
+    }
+
+    PyThread_acquire_lock(mux->lock, WAIT_LOCK);
+    virPyConsoleUnref(console);
+}
+
+/* Detach @console, already removed from its multiplexer, stopping its
+ * stream if still open, and drop the reference of the multiplexer.
+ * Must be called without the GIL held.  */
+static void
+virPyConsoleDetach(virPyConsolePtr console)
+{
+    PyThread_type_lock lock = console->mux->lock;
+    bool open;
+
+    PyThread_acquire_lock(lock, WAIT_LOCK);
+    if ((open = console->state == VIR_PY_CONSOLE_OPEN))
+        console->state = VIR_PY_CONSOLE_DETACHED;
+    PyThread_release_lock(lock);
+
+    if (open) {
+        virStreamEventRemoveCallback(console->stream);
+        virStreamAbort(console->stream);
+    }
+
+    PyThread_acquire_lock(lock, WAIT_LOCK);
+    virPyConsoleUnref(console);
+}
+
+/* Detach all the consoles of @mux, must be called with the GIL held */
+static void
+virPyConsoleMuxClose(virPyConsoleMuxPtr mux)
+{
+    virPyConsolePtr *consoles;
+    size_t nconsoles;
+    size_t i;
+
+    PyThread_acquire_lock(mux->lock, WAIT_LOCK);
+    consoles = mux->consoles;
+    nconsoles = mux->nconsoles;
+    mux->consoles = NULL;
+    mux->nconsoles = 0;
+    PyThread_release_lock(mux->lock);
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    for (i = 0; i < nconsoles; i++)
+        virPyConsoleDetach(consoles[i]);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    VIR_FREE(consoles);
+}
+
+static void
+libvirt_virPyConsoleMuxDestroy(void *ptr)
+{
+    virPyConsoleMuxPtr mux = ptr;
+
+    virPyConsoleMuxClose(mux);
+    PyThread_acquire_lock(mux->lock, WAIT_LOCK);
+    virPyConsoleMuxUnref(mux);
+}
+
+static const virPyNativeType virPyConsoleMuxNative = {
+    VIR_PY_CONSOLE_MUX,
+    libvirt_virPyConsoleMuxDestroy,
+};
+
+static virPyConsoleMuxPtr
+libvirt_virPyConsoleMuxGet(PyObject *obj)
+{
+    return libvirt_nativeGet(obj, &virPyConsoleMuxNative);
+}
+
+static PyObject *
+libvirt_virConsoleMuxNew(PyObject *self ATTRIBUTE_UNUSED,
+                         PyObject *args)
+{
+    PyObject *pyobj_cb;
+    PyObject *ret;
+    virPyConsoleMuxPtr mux;
+
+    if (!PyArg_ParseTuple(args, (char *) "O:virConsoleMuxNew", &pyobj_cb))
+        return NULL;
+
+    if (pyobj_cb != Py_None && !PyCallable_Check(pyobj_cb)) {
+        PyErr_SetString(PyExc_TypeError, "callback must be callable");
+        return NULL;
+    }
+
+    if (VIR_ALLOC(mux) < 0)
+        return PyErr_NoMemory();
+    mux->refs = 1;
+
+    if (!(mux->lock = PyThread_allocate_lock())) {
+        virPyConsoleMuxFree(mux);
+        return PyErr_NoMemory();
+    }
+
+    if (!(ret = libvirt_nativeWrap(mux, &virPyConsoleMuxNative))) {
+        virPyConsoleMuxFree(mux);
+        return NULL;
+    }
+
+    if (pyobj_cb != Py_None) {
+        Py_INCREF(pyobj_cb);
+        mux->cb = pyobj_cb;
+    }
+    return ret;
+}
+
+static PyObject *
+libvirt_virConsoleMuxAttach(PyObject *self ATTRIBUTE_UNUSED,
+                            PyObject *args)
+{
+    PyObject *pyobj_mux;
+    PyObject *pyobj_stream;
+    virPyConsoleMuxPtr mux;
+    virPyConsolePtr console;
+    unsigned int ringSize;
+    int fd;
+    int id;
+    int ret;
+
+    if (!PyArg_ParseTuple(args, (char *) "OOiI:virConsoleMuxAttach",
+                          &pyobj_mux, &pyobj_stream, &fd, &ringSize) ||
+        !(mux = libvirt_virPyConsoleMuxGet(pyobj_mux)))
+        return NULL;
+
+    if (VIR_ALLOC(console) < 0)
+        return PyErr_NoMemory();
+    if (ringSize && VIR_ALLOC_N(console->ring, ringSize) < 0) {
+        VIR_FREE(console);
+        return PyErr_NoMemory();
+    }
+    console->mux = mux;
+    console->fd = fd;
+    console->ringSize = ringSize;
+    console->state = VIR_PY_CONSOLE_OPEN;
+    /* One reference for the multiplexer, one for the event callback */
+    console->refs = 2;
+    console->stream = PyvirStream_Get(pyobj_stream);
+    virStreamRef(console->stream);
+
+    PyThread_acquire_lock(mux->lock, WAIT_LOCK);
+    if (VIR_REALLOC_N(mux->consoles, mux->nconsoles + 1) < 0) {
+        PyThread_release_lock(mux->lock);
+        virStreamFree(console->stream);
+        VIR_FREE(console->ring);
+        VIR_FREE(console);
+        return PyErr_NoMemory();
+    }
+    id = console->id = ++mux->lastID;
+    mux->consoles[mux->nconsoles++] = console;
+    mux->refs++;
+    PyThread_release_lock(mux->lock);
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    ret = virStreamEventAddCallback(console->stream,
+                                    VIR_STREAM_EVENT_READABLE |
+                                    VIR_STREAM_EVENT_ERROR |
+                                    VIR_STREAM_EVENT_HANGUP,
+                                    libvirt_virPyConsoleEvent, console,
+                                    libvirt_virPyConsoleEventFree);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (ret < 0) {
+        PyThread_acquire_lock(mux->lock, WAIT_LOCK);
+        virPyConsoleMuxRemove(mux, id);
+        console->refs--;
+        console->state = VIR_PY_CONSOLE_DETACHED;
+        virPyConsoleUnref(console);
+        return VIR_PY_NONE;
+    }
+
+    return libvirt_intWrap(id);
+}
+
+static PyObject *
+libvirt_virConsoleMuxDetach(PyObject *self ATTRIBUTE_UNUSED,
+                            PyObject *args)
+{
+    PyObject *pyobj_mux;
+    virPyConsoleMuxPtr mux;
+    virPyConsolePtr console;
+    int id;
+
+    if (!PyArg_ParseTuple(args, (char *) "Oi:virConsoleMuxDetach",
+                          &pyobj_mux, &id) ||
+        !(mux = libvirt_virPyConsoleMuxGet(pyobj_mux)))
+        return NULL;
+
+    PyThread_acquire_lock(mux->lock, WAIT_LOCK);
+    console = virPyConsoleMuxRemove(mux, id);
+    PyThread_release_lock(mux->lock);
+
+    if (!console) {
+        PyErr_SetString(PyExc_KeyError, "no such console");
+        return NULL;
+    }
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    virPyConsoleDetach(console);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    return VIR_PY_INT_SUCCESS;
+}
+
+static PyObject *
+libvirt_virConsoleMuxClose(PyObject *self ATTRIBUTE_UNUSED,
+                           PyObject *args)
+{
+    PyObject *pyobj_mux;
+    virPyConsoleMuxPtr mux;
+
+    if (!PyArg_ParseTuple(args, (char *) "O:virConsoleMuxClose",
+                          &pyobj_mux) ||
+        !(mux = libvirt_virPyConsoleMuxGet(pyobj_mux)))
+        return NULL;
+
+    virPyConsoleMuxClose(mux);
+
+    return VIR_PY_INT_SUCCESS;
+}
+
+/* Return the content of the ring of a console, oldest byte first,
+ * emptying it if asked to */
+static PyObject *
+libvirt_virConsoleMuxRead(PyObject *self ATTRIBUTE_UNUSED,
+                          PyObject *args)
+{
+    PyObject *pyobj_mux;
+    PyObject *ret;
+    virPyConsoleMuxPtr mux;
+    virPyConsolePtr console;
+    char *data = NULL;
+    size_t len = 0;
+    size_t n;
+    int clear;
+    int id;
+
+    if (!PyArg_ParseTuple(args, (char *) "Oii:virConsoleMuxRead",
+                          &pyobj_mux, &id, &clear) ||
+        !(mux = libvirt_virPyConsoleMuxGet(pyobj_mux)))
+        return NULL;
+
+    /* Copied out first, no python object is created with the lock
+     * held as its deallocation could come back here */
+    PyThread_acquire_lock(mux->lock, WAIT_LOCK);
+    if (!(console = virPyConsoleMuxFind(mux, id))) {
+        PyThread_release_lock(mux->lock);
+        PyErr_SetString(PyExc_KeyError, "no such console");
+        return NULL;
+    }
+    if (console->ringUsed && VIR_ALLOC_N(data, console->ringUsed) < 0) {
+        PyThread_release_lock(mux->lock);
+        return PyErr_NoMemory();
+    }
+    if (console->ringUsed) {
+        len = console->ringUsed;
+        n = MIN(len, console->ringSize - console->ringStart);
+        memcpy(data, console->ring + console->ringStart, n);
+        memcpy(data + n, console->ring, len - n);
+    }
+    if (clear) {
+        console->ringStart = 0;
+        console->ringUsed = 0;
+    }
+    PyThread_release_lock(mux->lock);
+
+    ret = libvirt_charPtrSizeWrap(data ? data : (char *) "", len);
+    VIR_FREE(data);
+    return ret;
+}
+
+static PyObject *
+libvirt_virConsoleMuxInfo(PyObject *self ATTRIBUTE_UNUSED,
+                          PyObject *args)
+{
+    PyObject *pyobj_mux;
+    virPyConsoleMuxPtr mux;
+    virPyConsolePtr console;
+    unsigned long long received;
+    unsigned long long dropped;
+    size_t buffered;
+    int state;
+    int id;
+
+    if (!PyArg_ParseTuple(args, (char *) "Oi:virConsoleMuxInfo",
+                          &pyobj_mux, &id) ||
+        !(mux = libvirt_virPyConsoleMuxGet(pyobj_mux)))
+        return NULL;
+
+    PyThread_acquire_lock(mux->lock, WAIT_LOCK);
+    if (!(console = virPyConsoleMuxFind(mux, id))) {
+        PyThread_release_lock(mux->lock);
+        PyErr_SetString(PyExc_KeyError, "no such console");
+        return NULL;
+    }
+    state = console->state;
+    received = console->received;
+    dropped = console->dropped;
+    buffered = console->ringUsed;
+    PyThread_release_lock(mux->lock);
+
+    return Py_BuildValue((char *) "{s:i,s:K,s:K,s:K}",
+                         "state", state,
+                         "received", received,
+                         "dropped", dropped,
+                         "buffered", (unsigned long long) buffered);
+}
+
+static PyObject *
+libvirt_virDomainSendKey(PyObject *self ATTRIBUTE_UNUSED,
+                         PyObject *args)
+{
+    PyObject *py_retval;
+    virDomainPtr domain;
+    PyObject *pyobj_domain;
+    PyObject *pyobj_list;
+    int codeset;
+    int holdtime;
+    unsigned int flags;
+    int ret;
+    size_t i;
+    unsigned int keycodes[VIR_DOMAIN_SEND_KEY_MAX_KEYS];
+    unsigned int nkeycodes;
+
+    if (!PyArg_ParseTuple(args, (char *)"OiiOiI:virDomainSendKey",
+                          &pyobj_domain, &codeset, &holdtime, &pyobj_list,
+                          &nkeycodes, &flags)) {
+        DEBUG("%s failed to parse tuple\n", __FUNCTION__);
+        return VIR_PY_INT_FAIL;
+    }
+    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+
+    if (!PyList_Check(pyobj_list)) {
+        return VIR_PY_INT_FAIL;
+    }
+
+    if (nkeycodes != PyList_Size(pyobj_list) ||
+        nkeycodes > VIR_DOMAIN_SEND_KEY_MAX_KEYS) {
+        return VIR_PY_INT_FAIL;
+    }
+
+    for (i = 0; i < nkeycodes; i++) {
+        if (libvirt_uintUnwrap(PyList_GetItem(pyobj_list, i), &keycodes[i]) < 0)
+            return NULL;
+    }
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    ret = virDomainSendKey(domain, codeset, holdtime, keycodes, nkeycodes, flags);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    DEBUG("virDomainSendKey ret=%d\n", ret);
+
+    py_retval = libvirt_intWrap(ret);
+    return py_retval;
+}
+
+#if LIBVIR_CHECK_VERSION(1, 0, 3)
+static PyObject *
+libvirt_virDomainMigrateGetCompressionCache(PyObject *self ATTRIBUTE_UNUSED,
+                                            PyObject *args)
+{
+    PyObject *pyobj_domain;
+    virDomainPtr domain;
+    unsigned int flags;
+    unsigned long long cacheSize;
+    int rc;
+
+    if (!PyArg_ParseTuple(args,
+                          (char *) "OI:virDomainMigrateGetCompressionCache",
+                          &pyobj_domain, &flags))
+        return VIR_PY_NONE;
+
+    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    rc = virDomainMigrateGetCompressionCache(domain, &cacheSize, flags);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (rc < 0)
+        return VIR_PY_NONE;
+
+    return libvirt_ulonglongWrap(cacheSize);
+}
+#endif /* LIBVIR_CHECK_VERSION(1, 0, 3) */
+
+static PyObject *
+libvirt_virDomainMigrateGetMaxSpeed(PyObject *self ATTRIBUTE_UNUSED, PyObject *args) {
+    PyObject *py_retval;
+    int c_retval;
+    unsigned long bandwidth;
+    virDomainPtr domain;
+    PyObject *pyobj_domain;
+    unsigned int flags = 0;
+
+    if (!PyArg_ParseTuple(args, (char *)"OI:virDomainMigrateGetMaxSpeed",
+                          &pyobj_domain, &flags))
+        return NULL;
+
+    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    c_retval = virDomainMigrateGetMaxSpeed(domain, &bandwidth, flags);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (c_retval < 0)
+        return VIR_PY_INT_FAIL;
+    py_retval = libvirt_ulongWrap(bandwidth);
+    return py_retval;
+}
+
+#if LIBVIR_CHECK_VERSION(1, 1, 0)
+static PyObject *
+libvirt_virDomainMigrate3(PyObject *self ATTRIBUTE_UNUSED,
+                          PyObject *args)
+{
+    PyObject *pyobj_domain;
+    virDomainPtr domain;
+    PyObject *pyobj_dconn;
+    virConnectPtr dconn;
+    PyObject *dict;
+    unsigned int flags;
+    virTypedParameterPtr params;
+    int nparams;
+    virDomainPtr ddom = NULL;
+
+    if (!PyArg_ParseTuple(args, (char *) "OOOI:virDomainMigrate3",
+                          &pyobj_domain, &pyobj_dconn, &dict, &flags))
+        return NULL;
+
+    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+    dconn = (virConnectPtr) PyvirConnect_Get(pyobj_dconn);
+
+    if (virPyDictToTypedParams(dict, &params, &nparams, NULL, 0) < 0)
+        return NULL;
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    ddom = virDomainMigrate3(domain, dconn, params, nparams, flags);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    virTypedParamsFree(params, nparams);
+    return libvirt_virDomainPtrWrap(ddom);
+}
+
+static PyObject *
+libvirt_virDomainMigrateToURI3(PyObject *self ATTRIBUTE_UNUSED,
+                               PyObject *args)
+{
+    PyObject *pyobj_domain;
+    virDomainPtr domain;
+    char *dconnuri;
+    PyObject *dict;
+    unsigned int flags;
+    virTypedParameterPtr params;
+    int nparams;
+    int ret = -1;
+
+    if (!PyArg_ParseTuple(args, (char *) "OzOI:virDomainMigrate3",
+                          &pyobj_domain, &dconnuri, &dict, &flags))
+        return NULL;
+
+    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+
+    if (virPyDictToTypedParams(dict, &params, &nparams, NULL, 0) < 0)
+        return NULL;
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    ret = virDomainMigrateToURI3(domain, dconnuri, params, nparams, flags);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    virTypedParamsFree(params, nparams);
+    return libvirt_intWrap(ret);
+}
+#endif /* LIBVIR_CHECK_VERSION(1, 1, 0) */
+
+static PyObject *
+libvirt_virDomainBlockPeek(PyObject *self ATTRIBUTE_UNUSED,
+                           PyObject *args) {
+    PyObject *py_retval = NULL;
+    int c_retval;
+    virDomainPtr domain;
+    PyObject *pyobj_domain;
+    const char *disk;
+    unsigned long long offset;
+    size_t size;
+    char *buf;
+    unsigned int flags;
+
+    if (!PyArg_ParseTuple(args, (char *)"OzLnI:virDomainBlockPeek", &pyobj_domain,
+                          &disk, &offset, &size, &flags))
+        return NULL;
+
+    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+
+    if (VIR_ALLOC_N(buf, size) < 0)
+        return VIR_PY_NONE;
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    c_retval = virDomainBlockPeek(domain, disk, offset, size, buf, flags);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (c_retval < 0) {
+        py_retval = VIR_PY_NONE;
+        goto cleanup;
+    }
+
+    py_retval = libvirt_charPtrSizeWrap(buf, size);
+
+cleanup:
+    VIR_FREE(buf);
+    return py_retval;
+}
+
+static PyObject *
+libvirt_virDomainMemoryPeek(PyObject *self ATTRIBUTE_UNUSED,
+                            PyObject *args) {
+    PyObject *py_retval = NULL;
+    int c_retval;
+    virDomainPtr domain;
+    PyObject *pyobj_domain;
+    unsigned long long start;
+    size_t size;
+    char *buf;
+    unsigned int flags;
+
+    if (!PyArg_ParseTuple(args, (char *)"OLnI:virDomainMemoryPeek", &pyobj_domain,
+                          &start, &size, &flags))
+        return NULL;
+
+    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+
+    if (VIR_ALLOC_N(buf, size) < 0)
+        return VIR_PY_NONE;
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    c_retval = virDomainMemoryPeek(domain, start, size, buf, flags);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (c_retval < 0) {
+        py_retval = VIR_PY_NONE;
+        goto cleanup;
+    }
+
+    py_retval = libvirt_charPtrSizeWrap(buf, size);
+
+cleanup:
+    VIR_FREE(buf);
+    return py_retval;
+}
+
+#ifdef LIBVIRT_HAVE_PY_BUFFER
+static PyObject *
+libvirt_virDomainBlockPeekInto(PyObject *self ATTRIBUTE_UNUSED,
+                               PyObject *args)
+{
+    int c_retval;
+    virDomainPtr domain;
+    PyObject *pyobj_domain;
+    const char *disk;
+    unsigned long long offset;
+    Py_buffer buf;
+    unsigned int flags;
+
+    if (!PyArg_ParseTuple(args, (char *)"OzLw*I:virDomainBlockPeekInto",
+                          &pyobj_domain, &disk, &offset, &buf, &flags))
+        return NULL;
+
+    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+
+    /* The buffer export stays locked until PyBuffer_Release, so the
+     * object can't be resized or freed while we wait without the GIL */
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    c_retval = virDomainBlockPeek(domain, disk, offset, buf.len, buf.buf, flags);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    PyBuffer_Release(&buf);
+
+    if (c_retval < 0)
+        return VIR_PY_INT_FAIL;
+
+    return VIR_PY_INT_SUCCESS;
+}
+
+static PyObject *
+libvirt_virDomainMemoryPeekInto(PyObject *self ATTRIBUTE_UNUSED,
+                                PyObject *args)
+{
+    int c_retval;
+    virDomainPtr domain;
+    PyObject *pyobj_domain;
+    unsigned long long start;
+    Py_buffer buf;
+    unsigned int flags;
+
+    if (!PyArg_ParseTuple(args, (char *)"OLw*I:virDomainMemoryPeekInto",
+                          &pyobj_domain, &start, &buf, &flags))
+        return NULL;
+
+    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    c_retval = virDomainMemoryPeek(domain, start, buf.len, buf.buf, flags);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    PyBuffer_Release(&buf);
+
+    if (c_retval < 0)
+        return VIR_PY_INT_FAIL;
+
+    return VIR_PY_INT_SUCCESS;
+}
+
+typedef struct {
+    unsigned long long offset;
+    size_t size;
+} virPyPeekRange;
+
+/* Parse a list of (offset, size) tuples, checking they fit in @buflen
+ * bytes when laid out one after the other.  Return the number of
+ * ranges, or -1 after raising a python exception.  */
+static Py_ssize_t
+libvirt_virPyPeekRangesParse(PyObject *pyranges,
+                             Py_ssize_t buflen,
+                             virPyPeekRange **ranges)
+{
+    Py_ssize_t nranges, i;
+    size_t total = 0;
+
+    *ranges = NULL;
+
+    if (!PyList_Check(pyranges)) {
+        PyErr_SetString(PyExc_TypeError, "ranges must be a list");
+        return -1;
+    }
+
+    nranges = PyList_GET_SIZE(pyranges);
+    if (VIR_ALLOC_N(*ranges, nranges + 1) < 0) {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    for (i = 0; i < nranges; i++) {
+        PyObject *range = PyList_GET_ITEM(pyranges, i);
+        unsigned long long size;
+
+        if (!PyTuple_Check(range) || PyTuple_GET_SIZE(range) != 2) {
+            PyErr_SetString(PyExc_TypeError,
+                            "ranges must be (offset, size) tuples");
+            goto error;
+        }
+
+        if (libvirt_ulonglongUnwrap(PyTuple_GET_ITEM(range, 0),
+                                    &(*ranges)[i].offset) < 0 ||
+            libvirt_ulonglongUnwrap(PyTuple_GET_ITEM(range, 1), &size) < 0)
+            goto error;
+
+        if (size > buflen - total) {
+            PyErr_SetString(PyExc_ValueError,
+                            "buffer too small for the requested ranges");
+            goto error;
+        }
+        (*ranges)[i].size = size;
+        total += size;
+    }
+
+    return nranges;
+
+ error:
+    VIR_FREE(*ranges);
+    return -1;
+}
+
+static PyObject *
+libvirt_virDomainBlockPeekRangesInto(PyObject *self ATTRIBUTE_UNUSED,
+                                     PyObject *args)
+{
+    PyObject *py_retval = NULL;
+    virDomainPtr domain;
+    PyObject *pyobj_domain, *pyranges;
+    const char *disk;
+    Py_buffer buf;
+    unsigned int flags;
+    virPyPeekRange *ranges = NULL;
+    Py_ssize_t nranges, i;
+    char *data;
+    int c_retval = 0;
+
+    if (!PyArg_ParseTuple(args, (char *)"OzOw*I:virDomainBlockPeekRangesInto",
+                          &pyobj_domain, &disk, &pyranges, &buf, &flags))
+        return NULL;
+
+    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+
+    if ((nranges = libvirt_virPyPeekRangesParse(pyranges, buf.len,
+                                                &ranges)) < 0)
+        goto cleanup;
+
+    data = buf.buf;
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    for (i = 0; i < nranges && c_retval == 0; i++) {
+        c_retval = virDomainBlockPeek(domain, disk, ranges[i].offset,
+                                      ranges[i].size, data, flags);
+        data += ranges[i].size;
+    }
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (c_retval < 0)
+        py_retval = VIR_PY_INT_FAIL;
+    else
+        py_retval = libvirt_ulonglongWrap(data - (char *) buf.buf);
+
+ cleanup:
+    PyBuffer_Release(&buf);
+    VIR_FREE(ranges);
+    return py_retval;
+}
+
+static PyObject *
+libvirt_virDomainMemoryPeekRangesInto(PyObject *self ATTRIBUTE_UNUSED,
+                                      PyObject *args)
+{
+    PyObject *py_retval = NULL;
+    virDomainPtr domain;
+    PyObject *pyobj_domain, *pyranges;
+    Py_buffer buf;
+    unsigned int flags;
+    virPyPeekRange *ranges = NULL;
+    Py_ssize_t nranges, i;
+    char *data;
+    int c_retval = 0;
+
+    if (!PyArg_ParseTuple(args, (char *)"OOw*I:virDomainMemoryPeekRangesInto",
+                          &pyobj_domain, &pyranges, &buf, &flags))
+        return NULL;
+
+    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+
+    if ((nranges = libvirt_virPyPeekRangesParse(pyranges, buf.len,
+                                                &ranges)) < 0)
+        goto cleanup;
+
+    data = buf.buf;
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    for (i = 0; i < nranges && c_retval == 0; i++) {
+        c_retval = virDomainMemoryPeek(domain, ranges[i].offset,
+                                       ranges[i].size, data, flags);
+        data += ranges[i].size;
+    }
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (c_retval < 0)
+        py_retval = VIR_PY_INT_FAIL;
+    else
+        py_retval = libvirt_ulonglongWrap(data - (char *) buf.buf);
+
+ cleanup:
+    PyBuffer_Release(&buf);
+    VIR_FREE(ranges);
+    return py_retval;
+}
+#endif /* LIBVIRT_HAVE_PY_BUFFER */
+
+#if LIBVIR_CHECK_VERSION(0, 10, 2)
+static PyObject *
+libvirt_virNodeSetMemoryParameters(PyObject *self ATTRIBUTE_UNUSED,
+                                   PyObject *args)
+{
+    virConnectPtr conn;
+    PyObject *pyobj_conn, *info;
+    PyObject *pyobj_schema = Py_None;
+    PyObject *ret = NULL;
+    int i_retval;
+    int nparams = 0;
+    Py_ssize_t size = 0;
+    unsigned int flags;
+    virTypedParameterPtr params = NULL, new_params = NULL;
+
+    if (!PyArg_ParseTuple(args,
+                          (char *)"OOI|O:virNodeSetMemoryParameters",
+                          &pyobj_conn, &info, &flags,
+                          &pyobj_schema))
+        return NULL;
+    conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
+
+    if ((size = PyDict_Size(info)) < 0)
+        return NULL;
+
+    if (size == 0) {
+        PyErr_Format(PyExc_LookupError,
+                     "Need non-empty dictionary to set attributes");
+        return NULL;
+    }
+
+    switch (setPyVirTypedParameterFromSchema(info, pyobj_schema, &new_params)) {
+    case -1:
+        return NULL;
+    case 1:
+        goto set;
+    }
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    i_retval = virNodeGetMemoryParameters(conn, NULL, &nparams, flags);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (i_retval < 0)
+        return VIR_PY_INT_FAIL;
+
+    if (nparams == 0) {
+        PyErr_Format(PyExc_LookupError,
+                     "no settable attributes");
+        return NULL;
+    }
+
+    if (VIR_ALLOC_N(params, nparams) < 0)
+        return PyErr_NoMemory();
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    i_retval = virNodeGetMemoryParameters(conn, params, &nparams, flags);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (i_retval < 0) {
+        ret = VIR_PY_INT_FAIL;
+        goto cleanup;
+    }
+
+    new_params = setPyVirTypedParameter(info, params, nparams);
+    if (!new_params)
+        goto cleanup;
+
+    libvirt_typedParamSchemaUpdate(pyobj_schema, params, nparams);
+
+ set:
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    i_retval = virNodeSetMemoryParameters(conn, new_params, size, flags);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (i_retval < 0) {
+        ret = VIR_PY_INT_FAIL;
+        goto cleanup;
+    }
+
+    ret = VIR_PY_INT_SUCCESS;
+
+cleanup:
+    virTypedParamsFree(params, nparams);
+    virTypedParamsFree(new_params, size);
+    return ret;
+}
+
+static PyObject *
+libvirt_virNodeGetMemoryParameters(PyObject *self ATTRIBUTE_UNUSED,
+                                   PyObject *args)
+{
+    virConnectPtr conn;
+    PyObject *pyobj_conn;
+    PyObject *ret = NULL;
+    int i_retval;
+    int nparams = 0;
+    unsigned int flags;
+    virTypedParameterPtr params;
+
+    if (!PyArg_ParseTuple(args, (char *)"OI:virNodeGetMemoryParameters",
+                          &pyobj_conn, &flags))
+        return NULL;
+    conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    i_retval = virNodeGetMemoryParameters(conn, NULL, &nparams, flags);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (i_retval < 0)
+        return VIR_PY_NONE;
+
+    if (!nparams)
+        return PyDict_New();
+
+    if (VIR_ALLOC_N(params, nparams) < 0)
+        return PyErr_NoMemory();
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    i_retval = virNodeGetMemoryParameters(conn, params, &nparams, flags);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (i_retval < 0) {
+        ret = VIR_PY_NONE;
+        goto cleanup;
+    }
+
+    ret = getPyVirTypedParameter(params, nparams);
+
+cleanup:
+    virTypedParamsFree(params, nparams);
+    return ret;
+}
+#endif /* LIBVIR_CHECK_VERSION(0, 10, 2) */
+
+#if LIBVIR_CHECK_VERSION(1, 0, 0)
+static PyObject *
+libvirt_virNodeGetCPUMap(PyObject *self ATTRIBUTE_UNUSED,
+                         PyObject *args)
+{
+    virConnectPtr conn;
+    PyObject *pyobj_conn;
+    PyObject *ret = NULL;
+    PyObject *pycpumap = NULL;
+    PyObject *pycpunum = NULL;
+    PyObject *pyonline = NULL;
+    int i_retval;
+    unsigned char *cpumap = NULL;
+    unsigned int online = 0;
+    unsigned int flags;
+    int format = VIR_PY_CPUMAP_TUPLE;
+
+    if (!PyArg_ParseTuple(args, (char *)"OI|i:virNodeGetCPUMap",
+                          &pyobj_conn, &flags, &format))
+        return NULL;
+    conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
+
+    if (libvirt_cpumapFormatCheck(format) < 0)
+        return NULL;
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    i_retval = virNodeGetCPUMap(conn, &cpumap, &online, flags);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (i_retval < 0)
+        return VIR_PY_NONE;
+
+    if ((ret = PyTuple_New(3)) == NULL)
+        goto error;
+
+    /* 0: number of CPUs */
+    if ((pycpunum = libvirt_intWrap(i_retval)) == NULL ||
+        PyTuple_SetItem(ret, 0, pycpunum) < 0)
+        goto error;
+
+    /* 1: CPU map */
+    if ((pycpumap = libvirt_cpumapWrap(cpumap, VIR_CPU_MAPLEN(i_retval),
+                                       i_retval, format, true)) == NULL ||
+        PyTuple_SetItem(ret, 1, pycpumap) < 0)
+        goto error;
+
+    /* 2: number of online CPUs */
+    if ((pyonline = libvirt_uintWrap(online)) == NULL ||
+        PyTuple_SetItem(ret, 2, pyonline) < 0)
+        goto error;
+
+cleanup:
+    VIR_FREE(cpumap);
+    return ret;
+error:
+    Py_XDECREF(ret);
+    Py_XDECREF(pycpumap);
+    Py_XDECREF(pycpunum);
+    Py_XDECREF(pyonline);
+    ret = NULL;
+    goto cleanup;
+}
+#endif /* LIBVIR_CHECK_VERSION(1, 0, 0) */
+
+
+#if LIBVIR_CHECK_VERSION(1, 1, 1)
+static PyObject *
+libvirt_virDomainCreateWithFiles(PyObject *self ATTRIBUTE_UNUSED, PyObject *args) {
+    PyObject *py_retval = NULL;
+    int c_retval;
+    virDomainPtr domain;
+    PyObject *pyobj_domain;
+    PyObject *pyobj_files;
+    unsigned int flags;
+    unsigned int nfiles;
+    int *files = NULL;
+    size_t i;
+
+    if (!PyArg_ParseTuple(args, (char *)"OOI:virDomainCreateWithFiles",
+                          &pyobj_domain, &pyobj_files, &flags))
+        return NULL;
+    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+
+    nfiles = PyList_Size(pyobj_files);
+
+    if (VIR_ALLOC_N(files, nfiles) < 0)
+        return PyErr_NoMemory();
+
+    for (i = 0; i < nfiles; i++) {
+        PyObject *pyfd;
+        int fd;
+
+        pyfd = PyList_GetItem(pyobj_files, i);
+
+        if (libvirt_intUnwrap(pyfd, &fd) < 0)
+            goto cleanup;
+
+        files[i] = fd;
+    }
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    c_retval = virDomainCreateWithFiles(domain, nfiles, files, flags);
+    LIBVIRT_END_ALLOW_THREADS;
+    py_retval = libvirt_intWrap((int) c_retval);
+
+cleanup:
+    VIR_FREE(files);
+    return py_retval;
+}
+
+
+static PyObject *
+libvirt_virDomainCreateXMLWithFiles(PyObject *self ATTRIBUTE_UNUSED, PyObject *args) {
+    PyObject *py_retval = NULL;
+    virDomainPtr c_retval;
+    virConnectPtr conn;
+    PyObject *pyobj_conn;
+    char * xmlDesc;
+    PyObject *pyobj_files;
+    unsigned int flags;
+    unsigned int nfiles;
+    int *files = NULL;
+    size_t i;
+
+    if (!PyArg_ParseTuple(args, (char *)"OzOI:virDomainCreateXMLWithFiles",
+                          &pyobj_conn, &xmlDesc, &pyobj_files, &flags))
+        return NULL;
+    conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
+
+    nfiles = PyList_Size(pyobj_files);
+
+    if (VIR_ALLOC_N(files, nfiles) < 0)
+        return PyErr_NoMemory();
+
+    for (i = 0; i < nfiles; i++) {
+        PyObject *pyfd;
+        int fd;
+
+        pyfd = PyList_GetItem(pyobj_files, i);
+
+        if (libvirt_intUnwrap(pyfd, &fd) < 0)
+            goto cleanup;
+
+        files[i] = fd;
+    }
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    c_retval = virDomainCreateXMLWithFiles(conn, xmlDesc, nfiles, files, flags);
+    LIBVIRT_END_ALLOW_THREADS;
+    py_retval = libvirt_virDomainPtrWrap((virDomainPtr) c_retval);
+
+cleanup:
+    VIR_FREE(files);
+    return py_retval;
+}
+#endif /* LIBVIR_CHECK_VERSION(1, 1, 1) */
+
+
+#if LIBVIR_CHECK_VERSION(1, 2, 5)
+static PyObject *
+libvirt_virDomainFSFreeze(PyObject *self ATTRIBUTE_UNUSED, PyObject *args) {
+    PyObject *py_retval = NULL;
+    int c_retval;
+    virDomainPtr domain;
+    PyObject *pyobj_domain;
+    PyObject *pyobj_list;
+    unsigned int flags;
+    unsigned int nmountpoints = 0;
+    char **mountpoints = NULL;
+    size_t i = 0, j;
+
+    if (!PyArg_ParseTuple(args, (char *)"OOI:virDomainFSFreeze",
+                          &pyobj_domain, &pyobj_list, &flags))
+        return NULL;
+    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+
+    if (PyList_Check(pyobj_list)) {
+        nmountpoints = PyList_Size(pyobj_list);
+
+        if (VIR_ALLOC_N(mountpoints, nmountpoints) < 0)
+            return PyErr_NoMemory();
+
+        for (i = 0; i < nmountpoints; i++) {
+            if (libvirt_charPtrUnwrap(PyList_GetItem(pyobj_list, i),
+                                      mountpoints+i) < 0 ||
+                mountpoints[i] == NULL)
+                goto cleanup;
+        }
+    }
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    c_retval = virDomainFSFreeze(domain, (const char **) mountpoints,
+                                 nmountpoints, flags);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    py_retval = libvirt_intWrap(c_retval);
+
+cleanup:
+    for (j = 0 ; j < i ; j++)
+        VIR_FREE(mountpoints[j]);
+    VIR_FREE(mountpoints);
+    return py_retval;
+}
+
+
+static PyObject *
+libvirt_virDomainFSThaw(PyObject *self ATTRIBUTE_UNUSED, PyObject *args) {
+    PyObject *py_retval = NULL;
+    int c_retval;
+    virDomainPtr domain;
+    PyObject *pyobj_domain;
+    PyObject *pyobj_list;
+    unsigned int flags;
+    unsigned int nmountpoints = 0;
+    char **mountpoints = NULL;
+    size_t i = 0, j;
+
+    if (!PyArg_ParseTuple(args, (char *)"OOI:virDomainFSThaw",
+                          &pyobj_domain, &pyobj_list, &flags))
+        return NULL;
+    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+
+    if (PyList_Check(pyobj_list)) {
+        nmountpoints = PyList_Size(pyobj_list);
+
+        if (VIR_ALLOC_N(mountpoints, nmountpoints) < 0)
+            return PyErr_NoMemory();
+
+        for (i = 0; i < nmountpoints; i++) {
+            if (libvirt_charPtrUnwrap(PyList_GetItem(pyobj_list, i),
+                                      mountpoints+i) < 0 ||
+                mountpoints[i] == NULL)
+                goto cleanup;
+        }
+    }
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    c_retval = virDomainFSThaw(domain, (const char **) mountpoints,
+                               nmountpoints, flags);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    py_retval = libvirt_intWrap(c_retval);
+
+ cleanup:
+    for (j = 0 ; j < i ; j++)
+        VIR_FREE(mountpoints[j]);
+    VIR_FREE(mountpoints);
+    return py_retval;
+}
+
+static PyObject *
+libvirt_virDomainGetTime(PyObject *self ATTRIBUTE_UNUSED, PyObject *args) {
+    PyObject *py_retval = NULL;
+    PyObject *dict = NULL;
+    PyObject *pyobj_domain, *pyobj_seconds, *pyobj_nseconds;
+    virDomainPtr domain;
+    long long seconds;
+    unsigned int nseconds;
+    unsigned int flags;
+    int c_retval;
+
+    if (!PyArg_ParseTuple(args, (char*)"OI:virDomainGetTime",
+                          &pyobj_domain, &flags))
+        return NULL;
+    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+
+    if (!(dict = PyDict_New()))
+        goto cleanup;
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    c_retval = virDomainGetTime(domain, &seconds, &nseconds, flags);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (c_retval < 0) {
+        py_retval = VIR_PY_NONE;
+        goto cleanup;
+    }
+
+    if (!(pyobj_seconds = libvirt_longlongWrap(seconds)) ||
+        PyDict_SetItemString(dict, "seconds", pyobj_seconds) < 0)
+        goto cleanup;
+    Py_DECREF(pyobj_seconds);
+
+    if (!(pyobj_nseconds = libvirt_uintWrap(nseconds)) ||
+        PyDict_SetItemString(dict, "nseconds", pyobj_nseconds) < 0)
+        goto cleanup;
+    Py_DECREF(pyobj_nseconds);
+
+    py_retval = dict;
+    dict = NULL;
+ cleanup:
+    Py_XDECREF(dict);
+    return py_retval;
+}
+
+
+static PyObject *
+libvirt_virDomainSetTime(PyObject *self ATTRIBUTE_UNUSED, PyObject *args) {
+    PyObject *py_retval = NULL;
+    PyObject *pyobj_domain;
+    PyObject *pyobj_seconds;
+    PyObject *pyobj_nseconds;
+    PyObject *py_dict;
+    virDomainPtr domain;
+    long long seconds = 0;
+    unsigned int nseconds = 0;
+    unsigned int flags;
+    ssize_t py_dict_size = 0;
+    int c_retval;
+
+    if (!PyArg_ParseTuple(args, (char*)"OOI:virDomainSetTime",
+                          &pyobj_domain, &py_dict, &flags))
+        return NULL;
+    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+
+    if (PyDict_Check(py_dict)) {
+        py_dict_size = PyDict_Size(py_dict);
+        if ((pyobj_seconds = PyDict_GetItemString(py_dict, "seconds"))) {
+            if (libvirt_longlongUnwrap(pyobj_seconds, &seconds) < 0) {
+                PyErr_Format(PyExc_LookupError, "malformed 'seconds'");
+                goto cleanup;
+            }
+        } else {
+            PyErr_Format(PyExc_LookupError, "Dictionary must contains 'seconds'");
+            goto cleanup;
+        }
+
+        if ((pyobj_nseconds = PyDict_GetItemString(py_dict, "nseconds"))) {
+            if (libvirt_uintUnwrap(pyobj_nseconds, &nseconds) < 0) {
+                PyErr_Format(PyExc_LookupError, "malformed 'nseconds'");
+                goto cleanup;
+            }
+        } else if (py_dict_size > 1) {
+            PyErr_Format(PyExc_LookupError, "Dictionary contains unknown key");
+            goto cleanup;
+        }
+    } else if (py_dict != Py_None || !flags) {
+        PyErr_Format(PyExc_TypeError, "time must be a dictionary "
+                     "or None with flags set");
+        goto cleanup;
+    }
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    c_retval = virDomainSetTime(domain, seconds, nseconds, flags);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    py_retval = libvirt_intWrap(c_retval);
+
+ cleanup:
+    return py_retval;
+}
+#endif /* LIBVIR_CHECK_VERSION(1, 2, 5) */
+
+
+#if LIBVIR_CHECK_VERSION(1, 2, 6)
+static PyObject *
+libvirt_virNodeGetFreePages(PyObject *self ATTRIBUTE_UNUSED,
+                            PyObject *args) {
+    PyObject *py_retval = NULL;
+    PyObject *pyobj_conn;
+    PyObject *pyobj_pagesize;
+    PyObject *pyobj_counts = NULL;
+    virConnectPtr conn;
+    unsigned int *pages = NULL;
+    int startCell;
+    unsigned int cellCount;
+    unsigned int flags;
+    unsigned long long *counts = NULL;
+    int c_retval;
+    ssize_t pyobj_pagesize_size, i, j;
+
+    if (!PyArg_ParseTuple(args, (char *)"OOiiI:virNodeGetFreePages",
+                          &pyobj_conn, &pyobj_pagesize, &startCell,
+                          &cellCount, &flags))
+        return NULL;
+
+    if (!PyList_Check(pyobj_pagesize)) {
+        PyErr_Format(PyExc_TypeError, "pagesize must be list");
+        return NULL;
+    }
+
+    if (cellCount == 0) {
+        PyErr_Format(PyExc_LookupError, "cellCount must not be zero");
+        return NULL;
+    }
+
+    conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
+
+    pyobj_pagesize_size = PyList_Size(pyobj_pagesize);
+    if (VIR_ALLOC_N(pages, pyobj_pagesize_size) < 0 ||
+        VIR_ALLOC_N(counts, pyobj_pagesize_size * cellCount) < 0 ||
+        !(pyobj_counts = PyDict_New()))
+        goto cleanup;
+
+    for (i = 0; i < pyobj_pagesize_size; i++) {
+        PyObject *tmp = PyList_GetItem(pyobj_pagesize, i);
+
+        if (libvirt_uintUnwrap(tmp, &pages[i]) < 0)
+            goto cleanup;
+    }
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    c_retval = virNodeGetFreePages(conn,
+                                   pyobj_pagesize_size, pages,
+                                   startCell, cellCount,
+                                   counts, flags);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (c_retval < 0) {
+        py_retval = VIR_PY_NONE;
+        goto cleanup;
+    }
+
+    for (i = 0; i < c_retval;) {
+        PyObject *per_node = NULL;
+        PyObject *node = NULL;
+
+        if (!(per_node = PyDict_New()) ||
+            !(node = libvirt_intWrap(startCell + i/pyobj_pagesize_size))) {
+            Py_XDECREF(per_node);
+            Py_XDECREF(node);
+            goto cleanup;
+        }
+
+        for (j = 0; j < pyobj_pagesize_size; j ++) {
+            PyObject *page = NULL;
+            PyObject *count = NULL;
+
+            if (!(page = libvirt_intWrap(pages[j])) ||
+                !(count = libvirt_intWrap(counts[i + j])) ||
+                PyDict_SetItem(per_node, page, count) < 0) {
+                Py_XDECREF(page);
+                Py_XDECREF(count);
+                Py_XDECREF(per_node);
+                Py_XDECREF(node);
+                goto cleanup;
+            }
+        }
+        i += pyobj_pagesize_size;
+
+        if (PyDict_SetItem(pyobj_counts, node, per_node) < 0) {
+            Py_XDECREF(per_node);
+            Py_XDECREF(node);
+            goto cleanup;
+        }
+    }
+
+    py_retval = pyobj_counts;
+    pyobj_counts = NULL;
+ cleanup:
+    Py_XDECREF(pyobj_counts);
+    VIR_FREE(pages);
+    VIR_FREE(counts);
+    return py_retval;
+}
+
+
+static PyObject *
+libvirt_virNetworkDHCPLeaseWrap(virNetworkDHCPLeasePtr lease)
+{
+    PyObject *py_lease;
+
+    if ((py_lease = PyDict_New()) == NULL)
+        return NULL;
+
+#define VIR_SET_LEASE_ITEM(NAME, VALUE_OBJ_FUNC)                            \
+    do {                                                                    \
+        PyObject *tmp_val;                                                  \
+                                                                            \
+        if (!(tmp_val = VALUE_OBJ_FUNC))                                    \
+            goto error;                                                     \
+                                                                            \
+        if (PyDict_SetItemString(py_lease, NAME, tmp_val) < 0) {            \
+            Py_DECREF(tmp_val);                                             \
+            goto error;                                                     \
+        }                                                                   \
+    } while (0)
+
+    VIR_SET_LEASE_ITEM("iface", libvirt_charPtrWrap(lease->iface));
+    VIR_SET_LEASE_ITEM("expirytime", libvirt_longlongWrap(lease->expirytime));
+    VIR_SET_LEASE_ITEM("type", libvirt_intWrap(lease->type));
+    VIR_SET_LEASE_ITEM("mac", libvirt_charPtrWrap(lease->mac));
+    VIR_SET_LEASE_ITEM("ipaddr", libvirt_charPtrWrap(lease->ipaddr));
+    VIR_SET_LEASE_ITEM("prefix", libvirt_uintWrap(lease->prefix));
+    VIR_SET_LEASE_ITEM("hostname", libvirt_charPtrWrap(lease->hostname));
+    VIR_SET_LEASE_ITEM("clientid", libvirt_charPtrWrap(lease->clientid));
+    VIR_SET_LEASE_ITEM("iaid", libvirt_charPtrWrap(lease->iaid));
+
+#undef VIR_SET_LEASE_ITEM
+
+    return py_lease;
+
+ error:
+    Py_DECREF(py_lease);
+    return NULL;
+}
+
+static PyObject *
+libvirt_virNetworkGetDHCPLeases(PyObject *self ATTRIBUTE_UNUSED,
+                                PyObject *args)
+{
+    PyObject *py_retval = NULL;
+    PyObject *py_lease = NULL;
+    virNetworkPtr network;
+    PyObject *pyobj_network;
+    unsigned int flags;
+    virNetworkDHCPLeasePtr *leases = NULL;
+    int leases_count;
+    char *mac = NULL;
+    size_t i;
+
+    if (!PyArg_ParseTuple(args, (char *) "OzI:virNetworkDHCPLeasePtr",
+                          &pyobj_network, &mac, &flags))
+        return NULL;
+
+    network = (virNetworkPtr) PyvirNetwork_Get(pyobj_network);
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    leases_count = virNetworkGetDHCPLeases(network, mac, &leases, flags);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (leases_count < 0) {
+        py_retval = VIR_PY_NONE;
+        goto cleanup;
+    }
+
+    if (!(py_retval = PyList_New(leases_count)))
+        goto no_memory;
+
+    for (i = 0; i < leases_count; i++) {
+        if ((py_lease = libvirt_virNetworkDHCPLeaseWrap(leases[i])) == NULL)
+            goto no_memory;
+
+        if (PyList_SetItem(py_retval, i, py_lease) < 0)
+            goto no_memory;
+
+        py_lease = NULL;
+    }
+
+ cleanup:
+    Py_XDECREF(py_lease);
+    if (leases) {
+        for (i = 0; i < leases_count; i++)
+            virNetworkDHCPLeaseFree(leases[i]);
+    }
+    VIR_FREE(leases);
+
+    return py_retval;
+
+ no_memory:
+    Py_XDECREF(py_retval);
+    py_retval = PyErr_NoMemory();
+    goto cleanup;
+}
+
+/*
+ * DHCP lease cache
+ *
+ * Keeps the leases of a network as returned by libvirt, along with
+ * arrays of them sorted by MAC address, IP address and hostname, so
+ * that point queries only convert the leases they return.  The cache
+ * is refreshed when it is invalidated, typically by a network event,
+ * or older than the maximum age given by the caller; all of it is
+ * protected by the GIL.
+ */
+typedef enum {
+    VIR_PY_LEASE_MAC,
+    VIR_PY_LEASE_IPADDR,
+    VIR_PY_LEASE_HOSTNAME,
+
+    VIR_PY_LEASE_LAST
+} virPyLeaseField;
 
- cleanup:
-    if (!pyobj_ret) {
-        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
-        PyErr_Print();
-    } else {
-        Py_DECREF(pyobj_ret);
-        ret = 0;
-    }
+typedef struct {
+    virNetworkDHCPLeasePtr *leases;
+    size_t nleases;
+    virNetworkDHCPLeasePtr *index[VIR_PY_LEASE_LAST];
+    size_t nindex[VIR_PY_LEASE_LAST];
+} virPyLeaseTable;
+typedef virPyLeaseTable *virPyLeaseTablePtr;
 
-    LIBVIRT_RELEASE_THREAD_STATE;
-    return ret;
+typedef struct {
+    virNetworkPtr net;
+    virPyLeaseTablePtr table;   /* NULL until first refreshed */
+    unsigned long long fetched; /* in milliseconds */
+    bool valid;
+} virPyLeaseCache;
+typedef virPyLeaseCache *virPyLeaseCachePtr;
+
+#define VIR_PY_LEASE_CACHE "virPyLeaseCache"
 
+static const char *
+virPyLeaseFieldGet(virNetworkDHCPLeasePtr lease,
+                   virPyLeaseField field)
+{
+    switch (field) {
+    case VIR_PY_LEASE_MAC:
+        return lease->mac;
+    case VIR_PY_LEASE_IPADDR:
+        return lease->ipaddr;
+    case VIR_PY_LEASE_HOSTNAME:
+    case VIR_PY_LEASE_LAST:
+        break;
+    }
+    return lease->hostname;
 }
-#endif /* VIR_DOMAIN_EVENT_ID_AGENT_LIFECYCLE */
 
-#ifdef VIR_DOMAIN_EVENT_ID_DEVICE_ADDED
+/* MAC addresses and hostnames don't care about case */
 static int
-libvirt_virConnectDomainEventDeviceAddedCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
-                                                 virDomainPtr dom,
-                                                 const char *devAlias,
-                                                 void *opaque)
+virPyLeaseFieldCompare(virPyLeaseField field,
+                       const char *a,
+                       const char *b)
 {
-    PyObject *pyobj_cbData = (PyObject*)opaque;
-    PyObject *pyobj_dom;
-    PyObject *pyobj_ret = NULL;
-    PyObject *pyobj_conn;
-    PyObject *dictKey;
-    int ret = -1;
-
-    LIBVIRT_ENSURE_THREAD_STATE;
+    if (field == VIR_PY_LEASE_IPADDR)
+        return strcmp(a, b);
+    return strcasecmp(a, b);
+}
 
-    if (!(dictKey = libvirt_constcharPtrWrap("conn")))
-        goto cleanup;
-    pyobj_conn = PyDict_GetItem(pyobj_cbData, dictKey);
-    Py_DECREF(dictKey);
+#define VIR_PY_LEASE_COMPARE(NAME, FIELD)                                   \
+static int                                                                  \
+NAME(const void *a, const void *b)                                          \
+{                                                                           \
+    return virPyLeaseFieldCompare(FIELD,                                    \
+        virPyLeaseFieldGet(*(virNetworkDHCPLeasePtr const *) a, FIELD),     \
+        virPyLeaseFieldGet(*(virNetworkDHCPLeasePtr const *) b, FIELD));    \
+}
 
-    /* Create a python instance of this virDomainPtr */
-    virDomainRef(dom);
-    if (!(pyobj_dom = libvirt_virDomainPtrWrap(dom))) {
-        virDomainFree(dom);
-        goto cleanup;
-    }
-    Py_INCREF(pyobj_cbData);
+VIR_PY_LEASE_COMPARE(virPyLeaseCompareMac, VIR_PY_LEASE_MAC)
+VIR_PY_LEASE_COMPARE(virPyLeaseCompareIPAddr, VIR_PY_LEASE_IPADDR)
+VIR_PY_LEASE_COMPARE(virPyLeaseCompareHostname, VIR_PY_LEASE_HOSTNAME)
 
-    /* Call the Callback Dispatcher */
-    pyobj_ret = PyObject_CallMethod(pyobj_conn,
-                                    (char*)"_dispatchDomainEventDeviceAddedCallback",
-                                    (char*)"OsO",
-                                    pyobj_dom, devAlias, pyobj_cbData);
+#undef VIR_PY_LEASE_COMPARE
 
-    Py_DECREF(pyobj_cbData);
-    Py_DECREF(pyobj_dom);
+static int (*const virPyLeaseCompare[VIR_PY_LEASE_LAST])(const void *,
+                                                         const void *) = {
+    virPyLeaseCompareMac,
+    virPyLeaseCompareIPAddr,
+    virPyLeaseCompareHostname,
+};
 
- cleanup:
-    if (!pyobj_ret) {
-        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
-        PyErr_Print();
-    } else {
-        Py_DECREF(pyobj_ret);
-        ret = 0;
-    }
+static void
+virPyLeaseTableFree(virPyLeaseTablePtr table)
+{
+    size_t i;
 
-    LIBVIRT_RELEASE_THREAD_STATE;
-    return ret;
+    if (!table)
+        return;
 
+    for (i = 0; i < table->nleases; i++) {
+        if (table->leases[i])
+            virNetworkDHCPLeaseFree(table->leases[i]);
+    }
+    VIR_FREE(table->leases);
+    for (i = 0; i < VIR_PY_LEASE_LAST; i++)
+        VIR_FREE(table->index[i]);
+    VIR_FREE(table);
 }
-#endif /* VIR_DOMAIN_EVENT_ID_DEVICE_ADDED */
 
-static PyObject *
-libvirt_virConnectDomainEventRegisterAny(ATTRIBUTE_UNUSED PyObject *self,
-                                         PyObject *args)
+/* Index the @nleases @leases, which are stolen even on failure */
+static virPyLeaseTablePtr
+virPyLeaseTableNew(virNetworkDHCPLeasePtr *leases,
+                   size_t nleases)
 {
-    PyObject *py_retval;        /* return value */
-    PyObject *pyobj_conn;       /* virConnectPtr */
-    PyObject *pyobj_dom;
-    PyObject *pyobj_cbData;     /* hash of callback data */
-    int eventID;
-    virConnectPtr conn;
-    int ret = 0;
-    virConnectDomainEventGenericCallback cb = NULL;
-    virDomainPtr dom;
+    virPyLeaseTablePtr table;
+    size_t i, j;
 
-    if (!PyArg_ParseTuple
-        (args, (char *) "OOiO:virConnectDomainEventRegisterAny",
-         &pyobj_conn, &pyobj_dom, &eventID, &pyobj_cbData)) {
-        DEBUG("%s failed parsing tuple\n", __FUNCTION__);
-        return VIR_PY_INT_FAIL;
+    if (VIR_ALLOC(table) < 0) {
+        for (i = 0; i < nleases; i++)
+            virNetworkDHCPLeaseFree(leases[i]);
+        VIR_FREE(leases);
+        return NULL;
     }
+    table->leases = leases;
+    table->nleases = nleases;
 
-    DEBUG("libvirt_virConnectDomainEventRegister(%p %p %d %p) called\n",
-           pyobj_conn, pyobj_dom, eventID, pyobj_cbData);
-    conn = PyvirConnect_Get(pyobj_conn);
-    if (pyobj_dom == Py_None)
-        dom = NULL;
-    else
-        dom = PyvirDomain_Get(pyobj_dom);
+    for (i = 0; i < VIR_PY_LEASE_LAST; i++) {
+        if (VIR_ALLOC_N(table->index[i], nleases + 1) < 0) {
+            virPyLeaseTableFree(table);
+            return NULL;
+        }
 
-    switch ((virDomainEventID) eventID) {
-    case VIR_DOMAIN_EVENT_ID_LIFECYCLE:
-        cb = VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventLifecycleCallback);
-        break;
-    case VIR_DOMAIN_EVENT_ID_REBOOT:
-        cb = VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventGenericCallback);
-        break;
-    case VIR_DOMAIN_EVENT_ID_RTC_CHANGE:
-        cb = VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventRTCChangeCallback);
-        break;
-    case VIR_DOMAIN_EVENT_ID_WATCHDOG:
-        cb = VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventWatchdogCallback);
-        break;
-    case VIR_DOMAIN_EVENT_ID_IO_ERROR:
-        cb = VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventIOErrorCallback);
-        break;
-    case VIR_DOMAIN_EVENT_ID_IO_ERROR_REASON:
-        cb = VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventIOErrorReasonCallback);
-        break;
-    case VIR_DOMAIN_EVENT_ID_GRAPHICS:
-        cb = VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventGraphicsCallback);
-        break;
-    case VIR_DOMAIN_EVENT_ID_CONTROL_ERROR:
-        cb = VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventGenericCallback);
-        break;
-    case VIR_DOMAIN_EVENT_ID_BLOCK_JOB:
-#ifdef VIR_DOMAIN_EVENT_ID_BLOCK_JOB_2
-    case VIR_DOMAIN_EVENT_ID_BLOCK_JOB_2:
-#endif /* VIR_DOMAIN_EVENT_ID_BLOCK_JOB_2 */
-        cb = VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventBlockJobCallback);
-        break;
-    case VIR_DOMAIN_EVENT_ID_DISK_CHANGE:
-        cb = VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventDiskChangeCallback);
-        break;
-    case VIR_DOMAIN_EVENT_ID_TRAY_CHANGE:
-        cb = VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventTrayChangeCallback);
-        break;
-    case VIR_DOMAIN_EVENT_ID_PMWAKEUP:
-        cb = VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventPMWakeupCallback);
-        break;
-    case VIR_DOMAIN_EVENT_ID_PMSUSPEND:
-        cb = VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventPMSuspendCallback);
-        break;
-#ifdef VIR_DOMAIN_EVENT_ID_BALLOON_CHANGE
-    case VIR_DOMAIN_EVENT_ID_BALLOON_CHANGE:
-        cb = VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventBalloonChangeCallback);
-        break;
-#endif /* VIR_DOMAIN_EVENT_ID_BALLOON_CHANGE */
-#ifdef VIR_DOMAIN_EVENT_ID_PMSUSPEND_DISK
-    case VIR_DOMAIN_EVENT_ID_PMSUSPEND_DISK:
-        cb = VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventPMSuspendDiskCallback);
-        break;
-#endif /* VIR_DOMAIN_EVENT_ID_PMSUSPEND_DISK */
-#ifdef VIR_DOMAIN_EVENT_ID_DEVICE_REMOVED
-    case VIR_DOMAIN_EVENT_ID_DEVICE_REMOVED:
-        cb = VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventDeviceRemovedCallback);
-        break;
-#endif /* VIR_DOMAIN_EVENT_ID_DEVICE_REMOVED */
-#ifdef VIR_DOMAIN_EVENT_ID_TUNABLE
-    case VIR_DOMAIN_EVENT_ID_TUNABLE:
-        cb = VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventTunableCallback);
-        break;
-#endif /* VIR_DOMAIN_EVENT_ID_TUNABLE */
-#ifdef VIR_DOMAIN_EVENT_ID_AGENT_LIFECYCLE
-    case VIR_DOMAIN_EVENT_ID_AGENT_LIFECYCLE:
-        cb = VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventAgentLifecycleCallback);
-        break;
-#endif /* VIR_DOMAIN_EVENT_ID_AGENT_LIFECYCLE */
-#ifdef VIR_DOMAIN_EVENT_ID_DEVICE_ADDED
-    case VIR_DOMAIN_EVENT_ID_DEVICE_ADDED:
-        cb = VIR_DOMAIN_EVENT_CALLBACK(libvirt_virConnectDomainEventDeviceAddedCallback);
-        break;
-#endif /* VIR_DOMAIN_EVENT_ID_DEVICE_ADDED */
-    case VIR_DOMAIN_EVENT_ID_LAST:
-        break;
+        /* Leases without that field can't be looked up by it */
+        for (j = 0; j < nleases; j++) {
+            if (virPyLeaseFieldGet(leases[j], i))
+                table->index[i][table->nindex[i]++] = leases[j];
+        }
+        qsort(table->index[i], table->nindex[i], sizeof(*table->index[i]),
+              virPyLeaseCompare[i]);
     }
 
-    if (!cb) {
-        return VIR_PY_INT_FAIL;
+    return table;
+}
+
+/* Returns the position in the index of @field of the first lease
+ * matching @key, and their number in @count */
+static size_t
+virPyLeaseTableFind(virPyLeaseTablePtr table,
+                    virPyLeaseField field,
+                    const char *key,
+                    size_t *count)
+{
+    virNetworkDHCPLeasePtr *index = table->index[field];
+    size_t lo = 0;
+    size_t hi = table->nindex[field];
+    size_t n = 0;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (virPyLeaseFieldCompare(field, virPyLeaseFieldGet(index[mid], field),
+                                   key) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
 
-    Py_INCREF(pyobj_cbData);
+    while (lo + n < table->nindex[field] &&
+           virPyLeaseFieldCompare(field,
+                                  virPyLeaseFieldGet(index[lo + n], field),
+                                  key) == 0)
+        n++;
 
+    *count = n;
+    return lo;
+}
+
+/* Fetch the leases of @mac, or all of them if NULL, and put them in
+ * the cache in place of the former ones.  Must be called with the GIL
+ * held, which is released while querying libvirt */
+static int
+virPyLeaseCacheRefresh(virPyLeaseCachePtr cache,
+                       const char *mac)
+{
+    virNetworkDHCPLeasePtr *leases = NULL;
+    virPyLeaseTablePtr table;
+    virPyLeaseTablePtr old;
+    unsigned long long now = 0;
+    int nleases;
+    size_t i;
+
+    /* Merging needs a full table to start from */
+    if (!cache->valid || !cache->table)
+        mac = NULL;
+
+ retry:
     LIBVIRT_BEGIN_ALLOW_THREADS;
-    ret = virConnectDomainEventRegisterAny(conn, dom, eventID,
-                                           cb, pyobj_cbData,
-                                           libvirt_virConnectDomainEventFreeFunc);
+    nleases = virNetworkGetDHCPLeases(cache->net, mac, &leases, 0);
     LIBVIRT_END_ALLOW_THREADS;
+    if (nleases < 0)
+        return -1;
 
-    if (ret < 0) {
-        Py_DECREF(pyobj_cbData);
+    /* Another thread may have invalidated the table, or dropped it in
+     * a failed refresh, while the GIL was released */
+    old = cache->table;
+    if (mac && (!cache->valid || !old)) {
+        for (i = 0; i < nleases; i++)
+            virNetworkDHCPLeaseFree(leases[i]);
+        VIR_FREE(leases);
+        mac = NULL;
+        goto retry;
     }
 
-    py_retval = libvirt_intWrap(ret);
-    return py_retval;
-}
+    if (mac) {
+        /* Move over the leases of the other MAC addresses */
+        size_t nkept = 0;
 
-static PyObject *
-libvirt_virConnectDomainEventDeregisterAny(ATTRIBUTE_UNUSED PyObject *self,
-                                           PyObject *args)
-{
-    PyObject *py_retval;
-    PyObject *pyobj_conn;
-    int callbackID;
-    virConnectPtr conn;
-    int ret = 0;
+        if (VIR_REALLOC_N(leases, nleases + old->nleases + 1) < 0) {
+            for (i = 0; i < nleases; i++)
+                virNetworkDHCPLeaseFree(leases[i]);
+            VIR_FREE(leases);
+            PyErr_NoMemory();
+            return -1;
+        }
+        for (i = 0; i < old->nleases; i++) {
+            if (old->leases[i]->mac &&
+                virPyLeaseFieldCompare(VIR_PY_LEASE_MAC,
+                                       old->leases[i]->mac, mac) == 0)
+                continue;
+            leases[nleases + nkept++] = old->leases[i];
+            old->leases[i] = NULL;
+        }
+        nleases += nkept;
+    }
 
-    if (!PyArg_ParseTuple
-        (args, (char *) "Oi:virConnectDomainEventDeregister",
-         &pyobj_conn, &callbackID))
-        return NULL;
+    if (!(table = virPyLeaseTableNew(leases, nleases))) {
+        if (mac) {
+            /* Along with the leases moved over */
+            cache->table = NULL;
+            cache->valid = false;
+            virPyLeaseTableFree(old);
+        }
+        PyErr_NoMemory();
+        return -1;
+    }
 
-    DEBUG("libvirt_virConnectDomainEventDeregister(%p) called\n", pyobj_conn);
+    if (!mac) {
+        ignore_value(virTimeMillisNow(&now));
+        cache->fetched = now;
+    }
 
-    conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
+    cache->table = table;
+    cache->valid = true;
+    virPyLeaseTableFree(old);
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
+    return 0;
+}
 
-    ret = virConnectDomainEventDeregisterAny(conn, callbackID);
+/* Refresh the cache if invalidated or older than @max_age milliseconds,
+ * -1 meaning that it never expires */
+static int
+virPyLeaseCacheCheck(virPyLeaseCachePtr cache,
+                     long long max_age)
+{
+    unsigned long long now = 0;
 
-    LIBVIRT_END_ALLOW_THREADS;
-    py_retval = libvirt_intWrap(ret);
-    return py_retval;
+    if (cache->valid && cache->table) {
+        if (max_age < 0)
+            return 0;
+        if (virTimeMillisNow(&now) == 0 &&
+            now - cache->fetched <= (unsigned long long) max_age)
+            return 0;
+    }
+
+    return virPyLeaseCacheRefresh(cache, NULL);
 }
 
-#if LIBVIR_CHECK_VERSION(1, 2, 1)
 static void
-libvirt_virConnectNetworkEventFreeFunc(void *opaque)
+virPyLeaseCacheFree(virPyLeaseCachePtr cache)
 {
-    PyObject *pyobj_conn = (PyObject*)opaque;
-    LIBVIRT_ENSURE_THREAD_STATE;
-    Py_DECREF(pyobj_conn);
-    LIBVIRT_RELEASE_THREAD_STATE;
+    virPyLeaseTableFree(cache->table);
+    virNetworkFree(cache->net);
+    VIR_FREE(cache);
 }
 
-static int
-libvirt_virConnectNetworkEventLifecycleCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
-                                                virNetworkPtr net,
-                                                int event,
-                                                int detail,
-                                                void *opaque)
+static void
+libvirt_virPyLeaseCacheDestroy(void *ptr)
 {
-    PyObject *pyobj_cbData = (PyObject*)opaque;
-    PyObject *pyobj_net;
-    PyObject *pyobj_ret = NULL;
-    PyObject *pyobj_conn;
-    PyObject *dictKey;
-    int ret = -1;
-
-    LIBVIRT_ENSURE_THREAD_STATE;
+    virPyLeaseCacheFree(ptr);
+}
 
-    if (!(dictKey = libvirt_constcharPtrWrap("conn")))
-        goto cleanup;
-    pyobj_conn = PyDict_GetItem(pyobj_cbData, dictKey);
-    Py_DECREF(dictKey);
+static const virPyNativeType virPyLeaseCacheNative = {
+    VIR_PY_LEASE_CACHE,
+    libvirt_virPyLeaseCacheDestroy,
+};
 
-    /* Create a python instance of this virNetworkPtr */
-    virNetworkRef(net);
-    if (!(pyobj_net = libvirt_virNetworkPtrWrap(net))) {
-        virNetworkFree(net);
-        goto cleanup;
-    }
-    Py_INCREF(pyobj_cbData);
+static virPyLeaseCachePtr
+libvirt_virPyLeaseCacheGet(PyObject *obj)
+{
+    return libvirt_nativeGet(obj, &virPyLeaseCacheNative);
+}
 
-    /* Call the Callback Dispatcher */
-    pyobj_ret = PyObject_CallMethod(pyobj_conn,
-                                    (char*)"_dispatchNetworkEventLifecycleCallback",
-                                    (char*)"OiiO",
-                                    pyobj_net,
-                                    event,
-                                    detail,
-                                    pyobj_cbData);
+static PyObject *
+libvirt_virNetworkLeaseCacheNew(PyObject *self ATTRIBUTE_UNUSED,
+                                PyObject *args)
+{
+    PyObject *pyobj_network;
+    PyObject *ret;
+    virPyLeaseCachePtr cache;
 
-    Py_DECREF(pyobj_cbData);
-    Py_DECREF(pyobj_net);
+    if (!PyArg_ParseTuple(args, (char *) "O:virNetworkLeaseCacheNew",
+                          &pyobj_network))
+        return NULL;
 
- cleanup:
-    if (!pyobj_ret) {
-        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
-        PyErr_Print();
-    } else {
-        Py_DECREF(pyobj_ret);
-        ret = 0;
-    }
+    if (VIR_ALLOC(cache) < 0)
+        return PyErr_NoMemory();
+    cache->net = (virNetworkPtr) PyvirNetwork_Get(pyobj_network);
+    virNetworkRef(cache->net);
 
-    LIBVIRT_RELEASE_THREAD_STATE;
+    ret = libvirt_nativeWrap(cache, &virPyLeaseCacheNative);
+    if (!ret)
+        virPyLeaseCacheFree(cache);
     return ret;
 }
 
 static PyObject *
-libvirt_virConnectNetworkEventRegisterAny(PyObject *self ATTRIBUTE_UNUSED,
-                                          PyObject *args)
+libvirt_virNetworkLeaseCacheRefresh(PyObject *self ATTRIBUTE_UNUSED,
+                                    PyObject *args)
 {
-    PyObject *py_retval;        /* return value */
-    PyObject *pyobj_conn;       /* virConnectPtr */
-    PyObject *pyobj_net;
-    PyObject *pyobj_cbData;     /* hash of callback data */
-    int eventID;
-    virConnectPtr conn;
-    int ret = 0;
-    virConnectNetworkEventGenericCallback cb = NULL;
-    virNetworkPtr net;
+    PyObject *pyobj_cache;
+    virPyLeaseCachePtr cache;
+    char *mac;
 
-    if (!PyArg_ParseTuple
-        (args, (char *) "OOiO:virConnectNetworkEventRegisterAny",
-         &pyobj_conn, &pyobj_net, &eventID, &pyobj_cbData)) {
-        DEBUG("%s failed parsing tuple\n", __FUNCTION__);
-        return VIR_PY_INT_FAIL;
-    }
+    if (!PyArg_ParseTuple(args, (char *) "Oz:virNetworkLeaseCacheRefresh",
+                          &pyobj_cache, &mac) ||
+        !(cache = libvirt_virPyLeaseCacheGet(pyobj_cache)))
+        return NULL;
 
-    DEBUG("libvirt_virConnectNetworkEventRegister(%p %p %d %p) called\n",
-           pyobj_conn, pyobj_net, eventID, pyobj_cbData);
-    conn = PyvirConnect_Get(pyobj_conn);
-    if (pyobj_net == Py_None)
-        net = NULL;
-    else
-        net = PyvirNetwork_Get(pyobj_net);
+    if (virPyLeaseCacheRefresh(cache, mac) < 0)
+        return PyErr_Occurred() ? NULL : VIR_PY_INT_FAIL;
 
-    switch ((virNetworkEventID) eventID) {
-    case VIR_NETWORK_EVENT_ID_LIFECYCLE:
-        cb = VIR_NETWORK_EVENT_CALLBACK(libvirt_virConnectNetworkEventLifecycleCallback);
-        break;
+    return VIR_PY_INT_SUCCESS;
+}
 
-    case VIR_NETWORK_EVENT_ID_LAST:
-        break;
-    }
+static PyObject *
+libvirt_virNetworkLeaseCacheInvalidate(PyObject *self ATTRIBUTE_UNUSED,
+                                       PyObject *args)
+{
+    PyObject *pyobj_cache;
+    virPyLeaseCachePtr cache;
 
-    if (!cb) {
-        return VIR_PY_INT_FAIL;
+    if (!PyArg_ParseTuple(args, (char *) "O:virNetworkLeaseCacheInvalidate",
+                          &pyobj_cache) ||
+        !(cache = libvirt_virPyLeaseCacheGet(pyobj_cache)))
+        return NULL;
+
+    cache->valid = false;
+
+    return VIR_PY_NONE;
+}
+
+static PyObject *
+libvirt_virNetworkLeaseCacheLookup(PyObject *self ATTRIBUTE_UNUSED,
+                                   PyObject *args)
+{
+    PyObject *pyobj_cache;
+    PyObject *py_retval;
+    PyObject *py_lease;
+    virPyLeaseCachePtr cache;
+    int field;
+    char *key;
+    long long max_age;
+    size_t first, count;
+    size_t i;
+
+    if (!PyArg_ParseTuple(args, (char *) "OisL:virNetworkLeaseCacheLookup",
+                          &pyobj_cache, &field, &key, &max_age) ||
+        !(cache = libvirt_virPyLeaseCacheGet(pyobj_cache)))
+        return NULL;
+
+    if (field < 0 || field >= VIR_PY_LEASE_LAST) {
+        PyErr_SetString(PyExc_ValueError, "unknown lease field");
+        return NULL;
     }
 
-    Py_INCREF(pyobj_cbData);
+    if (virPyLeaseCacheCheck(cache, max_age) < 0)
+        return PyErr_Occurred() ? NULL : VIR_PY_NONE;
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    ret = virConnectNetworkEventRegisterAny(conn, net, eventID,
-                                            cb, pyobj_cbData,
-                                            libvirt_virConnectNetworkEventFreeFunc);
-    LIBVIRT_END_ALLOW_THREADS;
+    first = virPyLeaseTableFind(cache->table, field, key, &count);
 
-    if (ret < 0) {
-        Py_DECREF(pyobj_cbData);
+    if (!(py_retval = PyList_New(count)))
+        return NULL;
+
+    for (i = 0; i < count; i++) {
+        if (!(py_lease = libvirt_virNetworkDHCPLeaseWrap(cache->table->index[field][first + i]))) {
+            Py_DECREF(py_retval);
+            return PyErr_NoMemory();
+        }
+        PyList_SET_ITEM(py_retval, i, py_lease);
     }
 
-    py_retval = libvirt_intWrap(ret);
     return py_retval;
 }
 
-static PyObject
-*libvirt_virConnectNetworkEventDeregisterAny(PyObject *self ATTRIBUTE_UNUSED,
-                                             PyObject *args)
+static PyObject *
+libvirt_virNetworkLeaseCacheList(PyObject *self ATTRIBUTE_UNUSED,
+                                 PyObject *args)
 {
+    PyObject *pyobj_cache;
     PyObject *py_retval;
-    PyObject *pyobj_conn;
-    int callbackID;
-    virConnectPtr conn;
-    int ret = 0;
+    PyObject *py_lease;
+    virPyLeaseCachePtr cache;
+    long long max_age;
+    size_t i;
 
-    if (!PyArg_ParseTuple
-        (args, (char *) "Oi:virConnectNetworkEventDeregister",
-         &pyobj_conn, &callbackID))
+    if (!PyArg_ParseTuple(args, (char *) "OL:virNetworkLeaseCacheList",
+                          &pyobj_cache, &max_age) ||
+        !(cache = libvirt_virPyLeaseCacheGet(pyobj_cache)))
         return NULL;
 
-    DEBUG("libvirt_virConnectNetworkEventDeregister(%p) called\n", pyobj_conn);
-
-    conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
+    if (virPyLeaseCacheCheck(cache, max_age) < 0)
+        return PyErr_Occurred() ? NULL : VIR_PY_NONE;
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
+    if (!(py_retval = PyList_New(cache->table->nleases)))
+        return NULL;
 
-    ret = virConnectNetworkEventDeregisterAny(conn, callbackID);
+    for (i = 0; i < cache->table->nleases; i++) {
+        if (!(py_lease = libvirt_virNetworkDHCPLeaseWrap(cache->table->leases[i]))) {
+            Py_DECREF(py_retval);
+            return PyErr_NoMemory();
+        }
+        PyList_SET_ITEM(py_retval, i, py_lease);
+    }
 
-    LIBVIRT_END_ALLOW_THREADS;
-    py_retval = libvirt_intWrap(ret);
     return py_retval;
 }
-#endif /* LIBVIR_CHECK_VERSION(1, 2, 1)*/
 
-#if LIBVIR_CHECK_VERSION(0, 10, 0)
-static void
-libvirt_virConnectCloseCallbackDispatch(virConnectPtr conn ATTRIBUTE_UNUSED,
-                                        int reason,
-                                        void *opaque)
+#endif /* LIBVIR_CHECK_VERSION(1, 2, 6) */
+
+#if LIBVIR_CHECK_VERSION(1, 2, 8)
+
+static PyObject *
+convertDomainStatsRecord(virDomainStatsRecordPtr *records,
+                         int nrecords)
 {
-    PyObject *pyobj_cbData = (PyObject*)opaque;
-    PyObject *pyobj_ret;
-    PyObject *pyobj_conn;
-    PyObject *dictKey;
+    PyObject *py_retval;
+    PyObject *py_record;
+    PyObject *py_record_domain = NULL;
+    PyObject *py_record_stats = NULL;
+    size_t i;
 
-    LIBVIRT_ENSURE_THREAD_STATE;
+    if (!(py_retval = PyList_New(nrecords)))
+        return NULL;
 
-    Py_INCREF(pyobj_cbData);
+    for (i = 0; i < nrecords; i++) {
+        if (!(py_record = PyTuple_New(2)))
+            goto error;
 
-    dictKey = libvirt_constcharPtrWrap("conn");
-    pyobj_conn = PyDict_GetItem(pyobj_cbData, dictKey);
-    Py_DECREF(dictKey);
+        /* libvirt_virDomainPtrWrap steals the object */
+        virDomainRef(records[i]->dom);
+        if (!(py_record_domain = libvirt_virDomainPtrWrap(records[i]->dom))) {
+            virDomainFree(records[i]->dom);
+            goto error;
+        }
 
-    /* Call the Callback Dispatcher */
-    pyobj_ret = PyObject_CallMethod(pyobj_conn,
-                                    (char*)"_dispatchCloseCallback",
-                                    (char*)"iO",
-                                    reason,
-                                    pyobj_cbData);
+        if (!(py_record_stats = getPyVirTypedParameter(records[i]->params,
+                                                       records[i]->nparams)))
+            goto error;
 
-    Py_DECREF(pyobj_cbData);
+        if (PyTuple_SetItem(py_record, 0, py_record_domain) < 0)
+            goto error;
 
-    if (!pyobj_ret) {
-        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
-        PyErr_Print();
-    } else {
-        Py_DECREF(pyobj_ret);
-    }
+        py_record_domain = NULL;
 
-    LIBVIRT_RELEASE_THREAD_STATE;
-}
+        if (PyTuple_SetItem(py_record, 1, py_record_stats) < 0)
+            goto error;
 
-static PyObject *
-libvirt_virConnectRegisterCloseCallback(ATTRIBUTE_UNUSED PyObject * self,
-                                        PyObject * args)
-{
-    PyObject *py_retval;        /* return value */
-    PyObject *pyobj_conn;       /* virConnectPtr */
-    PyObject *pyobj_cbData;     /* hash of callback data */
-    virConnectPtr conn;
-    int ret = 0;
+        py_record_stats = NULL;
 
-    if (!PyArg_ParseTuple
-        (args, (char *) "OO:virConnectRegisterCloseCallback",
-         &pyobj_conn, &pyobj_cbData)) {
-        DEBUG("%s failed parsing tuple\n", __FUNCTION__);
-        return VIR_PY_INT_FAIL;
+        if (PyList_SetItem(py_retval, i, py_record) < 0)
+            goto error;
+
+        py_record = NULL;
     }
 
-    DEBUG("libvirt_virConnectRegisterCloseCallback(%p %p) called\n",
-           pyobj_conn, pyobj_cbData);
-    conn = PyvirConnect_Get(pyobj_conn);
+    return py_retval;
 
-    Py_INCREF(pyobj_cbData);
+ error:
+    Py_XDECREF(py_retval);
+    Py_XDECREF(py_record);
+    Py_XDECREF(py_record_domain);
+    Py_XDECREF(py_record_stats);
+    return NULL;
+}
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    ret = virConnectRegisterCloseCallback(conn,
-                                          libvirt_virConnectCloseCallbackDispatch,
-                                          pyobj_cbData,
-                                          libvirt_virConnectDomainEventFreeFunc);
-    LIBVIRT_END_ALLOW_THREADS;
 
-    if (ret < 0) {
-        Py_DECREF(pyobj_cbData);
-    }
+/* One column of the struct-of-arrays form of a stats record list.
+ * Numeric values are packed into @data in their native C type, one
+ * slot per record, while strings are collected into the @strings list.
+ * Records that lack the field keep a zero (or None) in their slot. */
+typedef struct {
+    int type;
+    size_t size;
+    char *data;
+    PyObject *strings;
+} virPyDomainStatsColumn;
+typedef virPyDomainStatsColumn *virPyDomainStatsColumnPtr;
 
-    py_retval = libvirt_intWrap(ret);
-    return py_retval;
+static size_t
+virPyTypedParamValueSize(int type)
+{
+    switch (type) {
+    case VIR_TYPED_PARAM_INT:
+        return sizeof(int);
+    case VIR_TYPED_PARAM_UINT:
+        return sizeof(unsigned int);
+    case VIR_TYPED_PARAM_LLONG:
+        return sizeof(long long);
+    case VIR_TYPED_PARAM_ULLONG:
+        return sizeof(unsigned long long);
+    case VIR_TYPED_PARAM_DOUBLE:
+        return sizeof(double);
+    case VIR_TYPED_PARAM_BOOLEAN:
+        return sizeof(char);
+    default:
+        return 0;
+    }
 }
 
+/* Convert a stats record list into a (uuids, columns) tuple, where
+ * uuids is the list of domain UUID strings in record order and columns
+ * maps every field name to a (type, values) tuple.  For numeric types
+ * values is a bytes object holding one native value per record, for
+ * strings it is a list.  A field reported with different types by
+ * different records keeps the type of its first occurrence, values
+ * of any other type are left out.  Return NULL on failure, after
+ * raising a python exception. */
 static PyObject *
-libvirt_virConnectUnregisterCloseCallback(ATTRIBUTE_UNUSED PyObject * self,
-                                          PyObject * args)
+convertDomainStatsRecordColumns(virDomainStatsRecordPtr *records,
+                                int nrecords)
 {
-    PyObject *py_retval;
-    PyObject *pyobj_conn;
-    virConnectPtr conn;
-    int ret = 0;
+    PyObject *py_retval = NULL;
+    PyObject *py_uuids = NULL;
+    PyObject *py_columns = NULL;
+    PyObject *py_index = NULL;
+    PyObject *key = NULL;
+    PyObject *val = NULL;
+    PyObject *py_column;
+    virPyDomainStatsColumnPtr columns = NULL;
+    virPyDomainStatsColumnPtr column;
+    const virTypedParameter *param;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    size_t ncolumns = 0;
+    size_t i, j, k;
+    long idx;
 
-    if (!PyArg_ParseTuple
-        (args, (char *) "O:virConnectDomainEventUnregister",
-         &pyobj_conn))
-        return NULL;
+    if (!(py_uuids = PyList_New(nrecords)) ||
+        !(py_columns = PyDict_New()) ||
+        !(py_index = PyDict_New()))
+        goto error;
+
+    for (i = 0; i < nrecords; i++) {
+        if (virDomainGetUUIDString(records[i]->dom, uuidstr) < 0) {
+            PyErr_SetString(PyExc_RuntimeError,
+                            "cannot get domain UUID");
+            goto error;
+        }
+
+        if (!(val = libvirt_constcharPtrWrap(uuidstr)) ||
+            PyList_SetItem(py_uuids, i, val) < 0)
+            goto error;
+        val = NULL;
+
+        for (j = 0; j < records[i]->nparams; j++) {
+            param = &records[i]->params[j];
+
+            if (!(key = libvirt_typedParamFieldWrap(param->field)))
+                goto error;
+
+            if ((val = PyDict_GetItem(py_index, key))) {
+                idx = PyLong_AsLong(val);
+                val = NULL;
+            } else {
+                if (param->type != VIR_TYPED_PARAM_STRING &&
+                    !virPyTypedParamValueSize(param->type)) {
+                    PyErr_Format(PyExc_LookupError,
+                                 "Type value \"%d\" not recognized",
+                                 param->type);
+                    goto error;
+                }
+
+                if (VIR_REALLOC_N(columns, ncolumns + 1) < 0) {
+                    PyErr_NoMemory();
+                    goto error;
+                }
 
-    DEBUG("libvirt_virConnectDomainEventUnregister(%p) called\n",
-          pyobj_conn);
+                column = &columns[ncolumns];
+                memset(column, 0, sizeof(*column));
+                idx = ncolumns++;
+
+                column->type = param->type;
+                if (column->type == VIR_TYPED_PARAM_STRING) {
+                    if (!(column->strings = PyList_New(nrecords)))
+                        goto error;
+                    for (k = 0; k < nrecords; k++) {
+                        Py_INCREF(Py_None);
+                        PyList_SET_ITEM(column->strings, k, Py_None);
+                    }
+                } else {
+                    column->size = virPyTypedParamValueSize(column->type);
+                    if (VIR_ALLOC_N(column->data,
+                                    column->size * nrecords) < 0) {
+                        PyErr_NoMemory();
+                        goto error;
+                    }
+                }
 
-    conn = PyvirConnect_Get(pyobj_conn);
+                if (!(val = libvirt_longWrap(idx)) ||
+                    PyDict_SetItem(py_index, key, val) < 0)
+                    goto error;
+                Py_CLEAR(val);
+            }
+            Py_CLEAR(key);
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
+            column = &columns[idx];
+            if (column->type != param->type)
+                continue;
 
-    ret = virConnectUnregisterCloseCallback(conn,
-                                            libvirt_virConnectCloseCallbackDispatch);
+            switch (param->type) {
+            case VIR_TYPED_PARAM_INT:
+                ((int *) column->data)[i] = param->value.i;
+                break;
+            case VIR_TYPED_PARAM_UINT:
+                ((unsigned int *) column->data)[i] = param->value.ui;
+                break;
+            case VIR_TYPED_PARAM_LLONG:
+                ((long long *) column->data)[i] = param->value.l;
+                break;
+            case VIR_TYPED_PARAM_ULLONG:
+                ((unsigned long long *) column->data)[i] = param->value.ul;
+                break;
+            case VIR_TYPED_PARAM_DOUBLE:
+                ((double *) column->data)[i] = param->value.d;
+                break;
+            case VIR_TYPED_PARAM_BOOLEAN:
+                column->data[i] = param->value.b;
+                break;
+            case VIR_TYPED_PARAM_STRING:
+                if (!(val = libvirt_constcharPtrWrap(param->value.s)) ||
+                    PyList_SetItem(column->strings, i, val) < 0)
+                    goto error;
+                val = NULL;
+                break;
+            }
+        }
+    }
 
-    LIBVIRT_END_ALLOW_THREADS;
-    py_retval = libvirt_intWrap(ret);
-    return py_retval;
-}
-#endif /* LIBVIR_CHECK_VERSION(0, 10, 0) */
+    /* Walk the index once more to emit the columns keyed by field */
+    {
+#if PY_MAJOR_VERSION == 2 && PY_MINOR_VERSION <= 4
+        int pos = 0;
+#else
+        Py_ssize_t pos = 0;
+#endif
+        PyObject *py_key;
+        PyObject *py_idx;
 
-static void
-libvirt_virStreamEventFreeFunc(void *opaque)
-{
-    PyObject *pyobj_stream = (PyObject*)opaque;
-    LIBVIRT_ENSURE_THREAD_STATE;
-    Py_DECREF(pyobj_stream);
-    LIBVIRT_RELEASE_THREAD_STATE;
-}
+        while (PyDict_Next(py_index, &pos, &py_key, &py_idx)) {
+            column = &columns[PyLong_AsLong(py_idx)];
 
-static void
-libvirt_virStreamEventCallback(virStreamPtr st ATTRIBUTE_UNUSED,
-                               int events,
-                               void *opaque)
-{
-    PyObject *pyobj_cbData = (PyObject *)opaque;
-    PyObject *pyobj_stream;
-    PyObject *pyobj_ret;
-    PyObject *dictKey;
+            if (column->type == VIR_TYPED_PARAM_STRING) {
+                val = column->strings;
+                column->strings = NULL;
+            } else if (!(val = libvirt_charPtrSizeWrap(column->data,
+                                                       column->size * nrecords))) {
+                goto error;
+            }
 
-    LIBVIRT_ENSURE_THREAD_STATE;
+            if (!(py_column = Py_BuildValue((char *)"(iN)", column->type, val))) {
+                val = NULL;
+                goto error;
+            }
+            val = NULL;
 
-    Py_INCREF(pyobj_cbData);
-    dictKey = libvirt_constcharPtrWrap("stream");
-    pyobj_stream = PyDict_GetItem(pyobj_cbData, dictKey);
-    Py_DECREF(dictKey);
+            if (PyDict_SetItem(py_columns, py_key, py_column) < 0) {
+                Py_DECREF(py_column);
+                goto error;
+            }
+            Py_DECREF(py_column);
+        }
+    }
 
-    /* Call the pure python dispatcher */
-    pyobj_ret = PyObject_CallMethod(pyobj_stream,
-                                    (char *)"_dispatchStreamEventCallback",
-                                    (char *)"iO",
-                                    events, pyobj_cbData);
+    if (!(py_retval = PyTuple_New(2)))
+        goto error;
 
-    Py_DECREF(pyobj_cbData);
+    PyTuple_SET_ITEM(py_retval, 0, py_uuids);
+    PyTuple_SET_ITEM(py_retval, 1, py_columns);
+    py_uuids = py_columns = NULL;
 
-    if (!pyobj_ret) {
-        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
-        PyErr_Print();
-    } else {
-        Py_DECREF(pyobj_ret);
+ cleanup:
+    for (i = 0; i < ncolumns; i++) {
+        VIR_FREE(columns[i].data);
+        Py_XDECREF(columns[i].strings);
     }
+    VIR_FREE(columns);
+    Py_XDECREF(py_index);
+    return py_retval;
 
-    LIBVIRT_RELEASE_THREAD_STATE;
+ error:
+    Py_XDECREF(py_uuids);
+    Py_XDECREF(py_columns);
+    Py_XDECREF(key);
+    Py_XDECREF(val);
+    goto cleanup;
 }
 
+
 static PyObject *
-libvirt_virStreamEventAddCallback(PyObject *self ATTRIBUTE_UNUSED,
-                                  PyObject *args)
+libvirt_virConnectGetAllDomainStats(PyObject *self ATTRIBUTE_UNUSED,
+                                    PyObject *args)
 {
+    PyObject *pyobj_conn;
     PyObject *py_retval;
-    PyObject *pyobj_stream;
-    PyObject *pyobj_cbData;
-    virStreamPtr stream;
-    virStreamEventCallback cb = libvirt_virStreamEventCallback;
-    int ret;
-    int events;
-
-    if (!PyArg_ParseTuple(args, (char *) "OiO:virStreamEventAddCallback",
-                          &pyobj_stream, &events, &pyobj_cbData)) {
-        DEBUG("%s failed to parse tuple\n", __FUNCTION__);
-        return VIR_PY_INT_FAIL;
-    }
-
-    DEBUG("libvirt_virStreamEventAddCallback(%p, %d, %p) called\n",
-          pyobj_stream, events, pyobj_cbData);
-    stream = PyvirStream_Get(pyobj_stream);
+    virConnectPtr conn;
+    virDomainStatsRecordPtr *records;
+    int nrecords;
+    unsigned int flags;
+    unsigned int stats;
 
-    Py_INCREF(pyobj_cbData);
+    if (!PyArg_ParseTuple(args, (char *)"OII:virConnectGetAllDomainStats",
+                          &pyobj_conn, &stats, &flags))
+        return NULL;
+    conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
 
     LIBVIRT_BEGIN_ALLOW_THREADS;
-    ret = virStreamEventAddCallback(stream, events, cb, pyobj_cbData,
-                                    libvirt_virStreamEventFreeFunc);
+    nrecords = virConnectGetAllDomainStats(conn, stats, &records, flags);
     LIBVIRT_END_ALLOW_THREADS;
 
-    if (ret < 0) {
-        Py_DECREF(pyobj_cbData);
-    }
+    if (nrecords < 0)
+        return VIR_PY_NONE;
+
+    if (!(py_retval = convertDomainStatsRecord(records, nrecords)))
+        py_retval = VIR_PY_NONE;
+
+    virDomainStatsRecordListFree(records);
 
-    py_retval = libvirt_intWrap(ret);
     return py_retval;
 }
 
+
 static PyObject *
-libvirt_virStreamRecv(PyObject *self ATTRIBUTE_UNUSED,
-                      PyObject *args)
+libvirt_virConnectGetAllDomainStatsColumns(PyObject *self ATTRIBUTE_UNUSED,
+                                           PyObject *args)
 {
-    PyObject *pyobj_stream;
-    PyObject *rv;
-    virStreamPtr stream;
-    char *buf = NULL;
-    int ret;
-    int nbytes;
-
-    if (!PyArg_ParseTuple(args, (char *) "Oi:virStreamRecv",
-                          &pyobj_stream, &nbytes)) {
-        DEBUG("%s failed to parse tuple\n", __FUNCTION__);
-        return VIR_PY_NONE;
-    }
-    stream = PyvirStream_Get(pyobj_stream);
+    PyObject *pyobj_conn;
+    PyObject *py_retval;
+    virConnectPtr conn;
+    virDomainStatsRecordPtr *records;
+    int nrecords;
+    unsigned int flags;
+    unsigned int stats;
 
-    if (VIR_ALLOC_N(buf, nbytes+1 > 0 ? nbytes+1 : 1) < 0)
-        return VIR_PY_NONE;
+    if (!PyArg_ParseTuple(args, (char *)"OII:virConnectGetAllDomainStatsColumns",
+                          &pyobj_conn, &stats, &flags))
+        return NULL;
+    conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
 
     LIBVIRT_BEGIN_ALLOW_THREADS;
-    ret = virStreamRecv(stream, buf, nbytes);
+    nrecords = virConnectGetAllDomainStats(conn, stats, &records, flags);
     LIBVIRT_END_ALLOW_THREADS;
 
-    buf[ret > -1 ? ret : 0] = '\0';
-    DEBUG("StreamRecv ret=%d strlen=%d\n", ret, (int) strlen(buf));
-
-    if (ret == -2)
-        return libvirt_intWrap(ret);
-    if (ret < 0)
+    if (nrecords < 0)
         return VIR_PY_NONE;
-    rv = libvirt_charPtrSizeWrap((char *) buf, (Py_ssize_t) ret);
-    VIR_FREE(buf);
-    return rv;
+
+    py_retval = convertDomainStatsRecordColumns(records, nrecords);
+
+    virDomainStatsRecordListFree(records);
+
+    return py_retval;
 }
 
+
 static PyObject *
-libvirt_virStreamSend(PyObject *self ATTRIBUTE_UNUSED,
-                      PyObject *args)
+libvirt_virDomainListGetStats(PyObject *self ATTRIBUTE_UNUSED,
+                              PyObject *args)
 {
+    PyObject *pyobj_conn;
     PyObject *py_retval;
-    PyObject *pyobj_stream;
-    PyObject *pyobj_data;
-    virStreamPtr stream;
-    char *data;
-    Py_ssize_t datalen;
-    int ret;
+    PyObject *py_domlist;
+    virDomainStatsRecordPtr *records = NULL;
+    virDomainPtr *doms = NULL;
+    int nrecords;
+    int ndoms;
+    size_t i;
+    unsigned int flags;
+    unsigned int stats;
 
-    if (!PyArg_ParseTuple(args, (char *) "OO:virStreamRecv",
-                          &pyobj_stream, &pyobj_data)) {
-        DEBUG("%s failed to parse tuple\n", __FUNCTION__);
-        return VIR_PY_INT_FAIL;
+    if (!PyArg_ParseTuple(args, (char *)"OOII:virDomainListGetStats",
+                          &pyobj_conn, &py_domlist, &stats, &flags))
+        return NULL;
+
+    if (PyList_Check(py_domlist)) {
+        ndoms = PyList_Size(py_domlist);
+
+        if (VIR_ALLOC_N(doms, ndoms + 1) < 0)
+            return PyErr_NoMemory();
+
+        for (i = 0; i < ndoms; i++)
+            doms[i] = PyvirDomain_Get(PyList_GetItem(py_domlist, i));
     }
-    stream = PyvirStream_Get(pyobj_stream);
-    libvirt_charPtrSizeUnwrap(pyobj_data, &data, &datalen);
 
     LIBVIRT_BEGIN_ALLOW_THREADS;
-    ret = virStreamSend(stream, data, datalen);
+    nrecords = virDomainListGetStats(doms, stats, &records, flags);
     LIBVIRT_END_ALLOW_THREADS;
 
-    DEBUG("StreamSend ret=%d\n", ret);
+    if (nrecords < 0) {
+        py_retval = VIR_PY_NONE;
+        goto cleanup;
+    }
+
+    if (!(py_retval = convertDomainStatsRecord(records, nrecords)))
+        py_retval = VIR_PY_NONE;
+
+ cleanup:
+    virDomainStatsRecordListFree(records);
+    VIR_FREE(doms);
 
-    py_retval = libvirt_intWrap(ret);
     return py_retval;
 }
 
-static PyObject *
-libvirt_virDomainSendKey(PyObject *self ATTRIBUTE_UNUSED,
-                         PyObject *args)
-{
-    PyObject *py_retval;
-    virDomainPtr domain;
-    PyObject *pyobj_domain;
-    PyObject *pyobj_list;
-    int codeset;
-    int holdtime;
-    unsigned int flags;
-    int ret;
-    size_t i;
-    unsigned int keycodes[VIR_DOMAIN_SEND_KEY_MAX_KEYS];
-    unsigned int nkeycodes;
 
-    if (!PyArg_ParseTuple(args, (char *)"OiiOiI:virDomainSendKey",
-                          &pyobj_domain, &codeset, &holdtime, &pyobj_list,
-                          &nkeycodes, &flags)) {
-        DEBUG("%s failed to parse tuple\n", __FUNCTION__);
-        return VIR_PY_INT_FAIL;
-    }
-    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+/*
+ * Domain stats sampler
+ *
+ * Turns the cumulative counters reported by successive stats queries
+ * into per-second rates.  Only the counters of the previous sample are
+ * kept, packed in an array per domain, with the domains sorted by UUID
+ * so that domains appearing or going away between samples are matched
+ * up cheaply.  A counter going backwards, as when a domain restarts,
+ * is taken as a reset and gets no rate for that sample.
+ */
+typedef struct {
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    virTypedParameterPtr counters;
+    size_t ncounters;
+} virPyStatsDomainSample;
 
-    if (!PyList_Check(pyobj_list)) {
-        return VIR_PY_INT_FAIL;
-    }
+typedef struct {
+    virPyStatsDomainSample *domains;
+    size_t ndomains;
+    double timestamp;
+} virPyDomainStatsSampler;
+typedef virPyDomainStatsSampler *virPyDomainStatsSamplerPtr;
+
+#define VIR_PY_DOMAIN_STATS_SAMPLER "virPyDomainStatsSampler"
+
+/* The cumulative fields of the domain stats, '#' standing for the
+ * index of a vCPU, interface, disk, monitor or NUMA node.  Anything
+ * else, such as balloon.current or cpu.cache.monitor.N.bytes, is a
+ * gauge that gets no rate.  */
+static const char *virPyStatsCounterFields[] = {
+    "cpu.time", "cpu.user", "cpu.system",
+    "cpu.haltpoll.success.time", "cpu.haltpoll.fail.time",
+    "balloon.swap_in", "balloon.swap_out",
+    "balloon.major_fault", "balloon.minor_fault",
+    "vcpu.#.time", "vcpu.#.wait", "vcpu.#.delay",
+    "net.#.rx.bytes", "net.#.rx.pkts", "net.#.rx.errs", "net.#.rx.drop",
+    "net.#.tx.bytes", "net.#.tx.pkts", "net.#.tx.errs", "net.#.tx.drop",
+    "block.#.rd.reqs", "block.#.rd.bytes", "block.#.rd.times",
+    "block.#.wr.reqs", "block.#.wr.bytes", "block.#.wr.times",
+    "block.#.fl.reqs", "block.#.fl.times",
+    "memory.bandwidth.monitor.#.node.#.bytes.local",
+    "memory.bandwidth.monitor.#.node.#.bytes.total",
+    "perf.mbmt", "perf.mbml",
+    "perf.cpu_cycles", "perf.instructions",
+    "perf.cache_references", "perf.cache_misses",
+    "perf.branch_instructions", "perf.branch_misses",
+    "perf.bus_cycles", "perf.ref_cpu_cycles",
+    "perf.stalled_cycles_frontend", "perf.stalled_cycles_backend",
+    "perf.cpu_clock", "perf.task_clock",
+    "perf.page_faults", "perf.page_faults_min", "perf.page_faults_maj",
+    "perf.context_switches", "perf.cpu_migrations",
+    "perf.alignment_faults", "perf.emulation_faults",
+    NULL
+};
 
-    if (nkeycodes != PyList_Size(pyobj_list) ||
-        nkeycodes > VIR_DOMAIN_SEND_KEY_MAX_KEYS) {
-        return VIR_PY_INT_FAIL;
+static bool
+virPyStatsFieldMatch(const char *field,
+                     const char *pattern)
+{
+    for (; *pattern; pattern++) {
+        if (*pattern == '#') {
+            if (!isdigit((unsigned char) *field))
+                return false;
+            while (isdigit((unsigned char) *field))
+                field++;
+        } else if (*field++ != *pattern) {
+            return false;
+        }
     }
+    return *field == '\0';
+}
 
-    for (i = 0; i < nkeycodes; i++) {
-        if (libvirt_uintUnwrap(PyList_GetItem(pyobj_list, i), &keycodes[i]) < 0)
-            return NULL;
-    }
+static bool
+virPyStatsIsCounter(const virTypedParameter *param)
+{
+    size_t i;
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    ret = virDomainSendKey(domain, codeset, holdtime, keycodes, nkeycodes, flags);
-    LIBVIRT_END_ALLOW_THREADS;
+    switch (param->type) {
+    case VIR_TYPED_PARAM_INT:
+    case VIR_TYPED_PARAM_UINT:
+    case VIR_TYPED_PARAM_LLONG:
+    case VIR_TYPED_PARAM_ULLONG:
+        break;
+    default:
+        return false;
+    }
 
-    DEBUG("virDomainSendKey ret=%d\n", ret);
+    for (i = 0; virPyStatsCounterFields[i]; i++) {
+        if (virPyStatsFieldMatch(param->field, virPyStatsCounterFields[i]))
+            return true;
+    }
 
-    py_retval = libvirt_intWrap(ret);
-    return py_retval;
+    return false;
 }
 
-#if LIBVIR_CHECK_VERSION(1, 0, 3)
-static PyObject *
-libvirt_virDomainMigrateGetCompressionCache(PyObject *self ATTRIBUTE_UNUSED,
-                                            PyObject *args)
+/* Store the per-second rate from @prev to @cur in @rate, return false
+ * if the counter went backwards */
+static bool
+virPyStatsCounterRate(const virTypedParameter *prev,
+                      const virTypedParameter *cur,
+                      double interval,
+                      double *rate)
 {
-    PyObject *pyobj_domain;
-    virDomainPtr domain;
-    unsigned int flags;
-    unsigned long long cacheSize;
-    int rc;
-
-    if (!PyArg_ParseTuple(args,
-                          (char *) "OI:virDomainMigrateGetCompressionCache",
-                          &pyobj_domain, &flags))
-        return VIR_PY_NONE;
+    switch (cur->type) {
+    case VIR_TYPED_PARAM_INT:
+        if (cur->value.i < prev->value.i)
+            return false;
+        *rate = ((double) cur->value.i - prev->value.i) / interval;
+        return true;
+    case VIR_TYPED_PARAM_UINT:
+        if (cur->value.ui < prev->value.ui)
+            return false;
+        *rate = (cur->value.ui - prev->value.ui) / interval;
+        return true;
+    case VIR_TYPED_PARAM_LLONG:
+        if (cur->value.l < prev->value.l)
+            return false;
+        *rate = ((double) cur->value.l - prev->value.l) / interval;
+        return true;
+    case VIR_TYPED_PARAM_ULLONG:
+        if (cur->value.ul < prev->value.ul)
+            return false;
+        *rate = (cur->value.ul - prev->value.ul) / interval;
+        return true;
+    }
+    return false;
+}
 
-    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+static int
+virPyStatsDomainSampleCompare(const void *a,
+                              const void *b)
+{
+    return memcmp(((const virPyStatsDomainSample *) a)->uuid,
+                  ((const virPyStatsDomainSample *) b)->uuid,
+                  VIR_UUID_BUFLEN);
+}
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    rc = virDomainMigrateGetCompressionCache(domain, &cacheSize, flags);
-    LIBVIRT_END_ALLOW_THREADS;
+static void
+virPyStatsDomainSamplesFree(virPyStatsDomainSample *domains,
+                            size_t ndomains)
+{
+    size_t i;
 
-    if (rc < 0)
-        return VIR_PY_NONE;
+    for (i = 0; i < ndomains; i++)
+        VIR_FREE(domains[i].counters);
+    VIR_FREE(domains);
+}
 
-    return libvirt_ulonglongWrap(cacheSize);
+static void
+virPyDomainStatsSamplerFree(virPyDomainStatsSamplerPtr sampler)
+{
+    if (!sampler)
+        return;
+    virPyStatsDomainSamplesFree(sampler->domains, sampler->ndomains);
+    VIR_FREE(sampler);
 }
-#endif /* LIBVIR_CHECK_VERSION(1, 0, 3) */
 
-static PyObject *
-libvirt_virDomainMigrateGetMaxSpeed(PyObject *self ATTRIBUTE_UNUSED, PyObject *args) {
-    PyObject *py_retval;
-    int c_retval;
-    unsigned long bandwidth;
-    virDomainPtr domain;
-    PyObject *pyobj_domain;
-    unsigned int flags = 0;
+static void
+libvirt_virPyDomainStatsSamplerDestroy(void *ptr)
+{
+    virPyDomainStatsSamplerFree(ptr);
+}
 
-    if (!PyArg_ParseTuple(args, (char *)"OI:virDomainMigrateGetMaxSpeed",
-                          &pyobj_domain, &flags))
-        return NULL;
+static const virPyNativeType virPyDomainStatsSamplerNative = {
+    VIR_PY_DOMAIN_STATS_SAMPLER,
+    libvirt_virPyDomainStatsSamplerDestroy,
+};
 
-    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+static PyObject *
+libvirt_virDomainStatsSamplerNew(PyObject *self ATTRIBUTE_UNUSED,
+                                 PyObject *args ATTRIBUTE_UNUSED)
+{
+    virPyDomainStatsSamplerPtr sampler;
+    PyObject *ret;
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    c_retval = virDomainMigrateGetMaxSpeed(domain, &bandwidth, flags);
-    LIBVIRT_END_ALLOW_THREADS;
+    if (VIR_ALLOC(sampler) < 0)
+        return PyErr_NoMemory();
 
-    if (c_retval < 0)
-        return VIR_PY_INT_FAIL;
-    py_retval = libvirt_ulongWrap(bandwidth);
-    return py_retval;
+    ret = libvirt_nativeWrap(sampler, &virPyDomainStatsSamplerNative);
+    if (!ret)
+        virPyDomainStatsSamplerFree(sampler);
+    return ret;
 }
 
-#if LIBVIR_CHECK_VERSION(1, 1, 0)
+/* Record the counters of @record in @sample, and return the dict of
+ * their rates since @prev, which may be NULL */
 static PyObject *
-libvirt_virDomainMigrate3(PyObject *self ATTRIBUTE_UNUSED,
-                          PyObject *args)
+virPyStatsDomainSampleFill(virPyStatsDomainSample *sample,
+                           const virPyStatsDomainSample *prev,
+                           virDomainStatsRecordPtr record,
+                           double interval)
 {
-    PyObject *pyobj_domain;
-    virDomainPtr domain;
-    PyObject *pyobj_dconn;
-    virConnectPtr dconn;
-    PyObject *dict;
-    unsigned int flags;
-    virTypedParameterPtr params;
-    int nparams;
-    virDomainPtr ddom = NULL;
+    PyObject *py_rates;
+    size_t i, j;
 
-    if (!PyArg_ParseTuple(args, (char *) "OOOI:virDomainMigrate3",
-                          &pyobj_domain, &pyobj_dconn, &dict, &flags))
-        return NULL;
+    if (VIR_ALLOC_N(sample->counters, record->nparams + 1) < 0)
+        return PyErr_NoMemory();
 
-    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
-    dconn = (virConnectPtr) PyvirConnect_Get(pyobj_dconn);
+    for (i = 0; i < record->nparams; i++) {
+        if (virPyStatsIsCounter(&record->params[i]))
+            sample->counters[sample->ncounters++] = record->params[i];
+    }
 
-    if (virPyDictToTypedParams(dict, &params, &nparams, NULL, 0) < 0)
+    if (!(py_rates = PyDict_New()))
         return NULL;
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    ddom = virDomainMigrate3(domain, dconn, params, nparams, flags);
-    LIBVIRT_END_ALLOW_THREADS;
-
-    virTypedParamsFree(params, nparams);
-    return libvirt_virDomainPtrWrap(ddom);
-}
-
-static PyObject *
-libvirt_virDomainMigrateToURI3(PyObject *self ATTRIBUTE_UNUSED,
-                               PyObject *args)
-{
-    PyObject *pyobj_domain;
-    virDomainPtr domain;
-    char *dconnuri;
-    PyObject *dict;
-    unsigned int flags;
-    virTypedParameterPtr params;
-    int nparams;
-    int ret = -1;
+    if (!prev || interval <= 0)
+        return py_rates;
 
-    if (!PyArg_ParseTuple(args, (char *) "OzOI:virDomainMigrate3",
-                          &pyobj_domain, &dconnuri, &dict, &flags))
-        return NULL;
+    for (i = 0; i < sample->ncounters; i++) {
+        const virTypedParameter *cur = &sample->counters[i];
+        const virTypedParameter *old = NULL;
+        PyObject *key, *val;
+        double rate;
 
-    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+        /* Fields usually come in the same order every time */
+        if (i < prev->ncounters && STREQ(prev->counters[i].field, cur->field)) {
+            old = &prev->counters[i];
+        } else {
+            for (j = 0; j < prev->ncounters; j++) {
+                if (STREQ(prev->counters[j].field, cur->field)) {
+                    old = &prev->counters[j];
+                    break;
+                }
+            }
+        }
 
-    if (virPyDictToTypedParams(dict, &params, &nparams, NULL, 0) < 0)
-        return NULL;
+        if (!old || old->type != cur->type ||
+            !virPyStatsCounterRate(old, cur, interval, &rate))
+            continue;
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    ret = virDomainMigrateToURI3(domain, dconnuri, params, nparams, flags);
-    LIBVIRT_END_ALLOW_THREADS;
+        if (!(key = libvirt_typedParamFieldWrap(cur->field)) ||
+            !(val = PyFloat_FromDouble(rate)) ||
+            PyDict_SetItem(py_rates, key, val) < 0) {
+            Py_XDECREF(key);
+            Py_XDECREF(val);
+            Py_DECREF(py_rates);
+            return NULL;
+        }
+        Py_DECREF(key);
+        Py_DECREF(val);
+    }
 
-    virTypedParamsFree(params, nparams);
-    return libvirt_intWrap(ret);
+    return py_rates;
 }
-#endif /* LIBVIR_CHECK_VERSION(1, 1, 0) */
 
 static PyObject *
-libvirt_virDomainBlockPeek(PyObject *self ATTRIBUTE_UNUSED,
-                           PyObject *args) {
+libvirt_virDomainStatsSamplerSample(PyObject *self ATTRIBUTE_UNUSED,
+                                    PyObject *args)
+{
+    PyObject *pyobj_sampler, *pyobj_conn, *py_domlist;
     PyObject *py_retval = NULL;
-    int c_retval;
-    virDomainPtr domain;
-    PyObject *pyobj_domain;
-    const char *disk;
-    unsigned long long offset;
-    size_t size;
-    char *buf;
-    unsigned int flags;
+    PyObject *py_records = NULL;
+    virPyDomainStatsSamplerPtr sampler;
+    virConnectPtr conn;
+    virDomainPtr *doms = NULL;
+    virDomainStatsRecordPtr *records = NULL;
+    virPyStatsDomainSample *domains = NULL;
+    virPyStatsDomainSample *prev;
+    unsigned int stats, flags;
+    double now, interval;
+    int nrecords;
+    size_t i;
 
-    if (!PyArg_ParseTuple(args, (char *)"OzLnI:virDomainBlockPeek", &pyobj_domain,
-                          &disk, &offset, &size, &flags))
+    if (!PyArg_ParseTuple(args, (char *)"OOOII:virDomainStatsSamplerSample",
+                          &pyobj_sampler, &pyobj_conn, &py_domlist,
+                          &stats, &flags))
         return NULL;
 
-    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+    if (!(sampler = libvirt_nativeGet(pyobj_sampler,
+                                      &virPyDomainStatsSamplerNative)))
+        return NULL;
+    conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
 
-    if (VIR_ALLOC_N(buf, size) < 0)
-        return VIR_PY_NONE;
+    if (PyList_Check(py_domlist)) {
+        Py_ssize_t ndoms = PyList_Size(py_domlist);
+
+        if (VIR_ALLOC_N(doms, ndoms + 1) < 0)
+            return PyErr_NoMemory();
+
+        for (i = 0; i < ndoms; i++)
+            doms[i] = PyvirDomain_Get(PyList_GetItem(py_domlist, i));
+    }
 
     LIBVIRT_BEGIN_ALLOW_THREADS;
-    c_retval = virDomainBlockPeek(domain, disk, offset, size, buf, flags);
+    if (doms)
+        nrecords = virDomainListGetStats(doms, stats, &records, flags);
+    else
+        nrecords = virConnectGetAllDomainStats(conn, stats, &records, flags);
+    now = virTimeSecondsNow();
     LIBVIRT_END_ALLOW_THREADS;
 
-    if (c_retval < 0) {
+    if (nrecords < 0) {
         py_retval = VIR_PY_NONE;
         goto cleanup;
     }
 
-    py_retval = libvirt_charPtrSizeWrap(buf, size);
+    interval = sampler->timestamp > 0 ? now - sampler->timestamp : 0;
 
-cleanup:
-    VIR_FREE(buf);
-    return py_retval;
-}
+    if (VIR_ALLOC_N(domains, nrecords + 1) < 0) {
+        PyErr_NoMemory();
+        goto error;
+    }
 
-static PyObject *
-libvirt_virDomainMemoryPeek(PyObject *self ATTRIBUTE_UNUSED,
-                            PyObject *args) {
-    PyObject *py_retval = NULL;
-    int c_retval;
-    virDomainPtr domain;
-    PyObject *pyobj_domain;
-    unsigned long long start;
-    size_t size;
-    char *buf;
-    unsigned int flags;
+    if (!(py_records = PyList_New(nrecords)))
+        goto error;
 
-    if (!PyArg_ParseTuple(args, (char *)"OLnI:virDomainMemoryPeek", &pyobj_domain,
-                          &start, &size, &flags))
-        return NULL;
+    for (i = 0; i < nrecords; i++) {
+        PyObject *py_rates, *py_dom, *py_record;
 
-    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+        if (virDomainGetUUID(records[i]->dom, domains[i].uuid) < 0) {
+            PyErr_SetString(PyExc_RuntimeError, "cannot get domain UUID");
+            goto error;
+        }
 
-    if (VIR_ALLOC_N(buf, size) < 0)
-        return VIR_PY_NONE;
+        prev = bsearch(&domains[i], sampler->domains, sampler->ndomains,
+                       sizeof(*sampler->domains),
+                       virPyStatsDomainSampleCompare);
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    c_retval = virDomainMemoryPeek(domain, start, size, buf, flags);
-    LIBVIRT_END_ALLOW_THREADS;
+        if (!(py_rates = virPyStatsDomainSampleFill(&domains[i], prev,
+                                                    records[i], interval)))
+            goto error;
 
-    if (c_retval < 0) {
-        py_retval = VIR_PY_NONE;
-        goto cleanup;
+        /* libvirt_virDomainPtrWrap steals the object */
+        virDomainRef(records[i]->dom);
+        if (!(py_dom = libvirt_virDomainPtrWrap(records[i]->dom))) {
+            virDomainFree(records[i]->dom);
+            Py_DECREF(py_rates);
+            goto error;
+        }
+
+        if (!(py_record = Py_BuildValue((char *)"(NN)", py_dom, py_rates)))
+            goto error;
+        PyList_SET_ITEM(py_records, i, py_record);
     }
 
-    py_retval = libvirt_charPtrSizeWrap(buf, size);
+    qsort(domains, nrecords, sizeof(*domains), virPyStatsDomainSampleCompare);
 
-cleanup:
-    VIR_FREE(buf);
-    return py_retval;
-}
+    virPyStatsDomainSamplesFree(sampler->domains, sampler->ndomains);
+    sampler->domains = domains;
+    sampler->ndomains = nrecords;
+    sampler->timestamp = now;
+    domains = NULL;
 
-#if LIBVIR_CHECK_VERSION(0, 10, 2)
-static PyObject *
-libvirt_virNodeSetMemoryParameters(PyObject *self ATTRIBUTE_UNUSED,
-                                   PyObject *args)
-{
-    virConnectPtr conn;
-    PyObject *pyobj_conn, *info;
-    PyObject *ret = NULL;
-    int i_retval;
-    int nparams = 0;
-    Py_ssize_t size = 0;
-    unsigned int flags;
-    virTypedParameterPtr params, new_params = NULL;
+    py_retval = Py_BuildValue((char *)"(dN)", interval, py_records);
+    py_records = NULL;
 
-    if (!PyArg_ParseTuple(args,
-                          (char *)"OOI:virNodeSetMemoryParameters",
-                          &pyobj_conn, &info, &flags))
-        return NULL;
-    conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
+ cleanup:
+    virDomainStatsRecordListFree(records);
+    VIR_FREE(doms);
+    return py_retval;
 
-    if ((size = PyDict_Size(info)) < 0)
-        return NULL;
+ error:
+    if (domains)
+        virPyStatsDomainSamplesFree(domains, nrecords);
+    Py_XDECREF(py_records);
+    goto cleanup;
+}
 
-    if (size == 0) {
-        PyErr_Format(PyExc_LookupError,
-                     "Need non-empty dictionary to set attributes");
-        return NULL;
-    }
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    i_retval = virNodeGetMemoryParameters(conn, NULL, &nparams, flags);
-    LIBVIRT_END_ALLOW_THREADS;
+/*
+ * Parallel stats collection
+ *
+ * Runs virConnectGetAllDomainStats on many connections from a pool of
+ * native threads, while the caller waits without the interpreter
+ * lock and only takes it back to convert the results.  A query taking
+ * longer than the timeout is abandoned: its worker is replaced so the
+ * other hosts keep being queried, and the collection is freed by
+ * whichever of the caller or the workers is done with it last.
+ */
+typedef struct {
+    virConnectPtr conn;
+    virDomainStatsRecordPtr *records;
+    int nrecords;
+    virErrorPtr error;
+    double started;
+    bool done;
+    bool abandoned;
+    bool stranded;          /* no worker was left to start it */
+} virPyStatsCollectJob;
 
-    if (i_retval < 0)
-        return VIR_PY_INT_FAIL;
+typedef struct {
+    PyThread_type_lock lock;
+    PyThread_type_lock wakeup;
+    bool waiting;
+    int refs;
+    size_t nworkers;        /* workers not given up on */
+    unsigned int stats;
+    unsigned int flags;
+    virPyStatsCollectJob *jobs;
+    size_t njobs;
+    size_t next;
+} virPyStatsCollection;
+typedef virPyStatsCollection *virPyStatsCollectionPtr;
 
-    if (nparams == 0) {
-        PyErr_Format(PyExc_LookupError,
-                     "no settable attributes");
-        return NULL;
-    }
+static void
+virPyStatsCollectionFree(virPyStatsCollectionPtr c)
+{
+    size_t i;
 
-    if (VIR_ALLOC_N(params, nparams) < 0)
-        return PyErr_NoMemory();
+    for (i = 0; i < c->njobs; i++) {
+        if (c->jobs[i].records)
+            virDomainStatsRecordListFree(c->jobs[i].records);
+        if (c->jobs[i].error)
+            virFreeError(c->jobs[i].error);
+        if (c->jobs[i].conn)
+            virConnectClose(c->jobs[i].conn);
+    }
+    VIR_FREE(c->jobs);
+    if (c->wakeup)
+        PyThread_free_lock(c->wakeup);
+    if (c->lock)
+        PyThread_free_lock(c->lock);
+    VIR_FREE(c);
+}
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    i_retval = virNodeGetMemoryParameters(conn, params, &nparams, flags);
-    LIBVIRT_END_ALLOW_THREADS;
+/* Drop a reference, with c->lock held, which this releases */
+static void
+virPyStatsCollectionUnref(virPyStatsCollectionPtr c)
+{
+    if (libvirt_unrefLocked(c->lock, &c->refs))
+        virPyStatsCollectionFree(c);
+}
 
-    if (i_retval < 0) {
-        ret = VIR_PY_INT_FAIL;
-        goto cleanup;
+/* Wake up the caller if waiting, with c->lock held */
+static void
+virPyStatsCollectionWakeup(virPyStatsCollectionPtr c)
+{
+    if (c->waiting) {
+        c->waiting = false;
+        PyThread_release_lock(c->wakeup);
     }
+}
 
-    new_params = setPyVirTypedParameter(info, params, nparams);
-    if (!new_params)
-        goto cleanup;
-
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    i_retval = virNodeSetMemoryParameters(conn, new_params, size, flags);
-    LIBVIRT_END_ALLOW_THREADS;
+static void
+libvirt_virPyStatsCollectWorker(void *opaque)
+{
+    virPyStatsCollectionPtr c = opaque;
+    virPyStatsCollectJob *job;
+    virDomainStatsRecordPtr *records;
+    int nrecords;
 
-    if (i_retval < 0) {
-        ret = VIR_PY_INT_FAIL;
-        goto cleanup;
+    PyThread_acquire_lock(c->lock, WAIT_LOCK);
+    while (c->next < c->njobs) {
+        job = &c->jobs[c->next++];
+        job->started = virTimeSecondsNow();
+        PyThread_release_lock(c->lock);
+
+        records = NULL;
+        nrecords = virConnectGetAllDomainStats(job->conn, c->stats,
+                                               &records, c->flags);
+
+        PyThread_acquire_lock(c->lock, WAIT_LOCK);
+        job->records = records;
+        job->nrecords = nrecords;
+        if (nrecords < 0)
+            job->error = virSaveLastError();
+        job->done = true;
+
+        /* Another worker took over when this one was given up on */
+        if (job->abandoned)
+            goto cleanup;
+        virPyStatsCollectionWakeup(c);
     }
+    c->nworkers--;
 
-    ret = VIR_PY_INT_SUCCESS;
+ cleanup:
+    virPyStatsCollectionUnref(c);
+}
 
-cleanup:
-    virTypedParamsFree(params, nparams);
-    virTypedParamsFree(new_params, nparams);
-    return ret;
+/* Start a worker, with c->lock held */
+static int
+virPyStatsCollectionStartWorker(virPyStatsCollectionPtr c)
+{
+    c->refs++;
+    if (PyThread_start_new_thread(libvirt_virPyStatsCollectWorker,
+                                  c) == (long) -1) {
+        c->refs--;
+        return -1;
+    }
+    c->nworkers++;
+    return 0;
 }
 
-static PyObject *
-libvirt_virNodeGetMemoryParameters(PyObject *self ATTRIBUTE_UNUSED,
-                                   PyObject *args)
+/* Wait on c->wakeup for up to @timeout seconds, forever if negative,
+ * with c->lock held */
+static void
+virPyStatsCollectionWait(virPyStatsCollectionPtr c,
+                         double timeout)
 {
-    virConnectPtr conn;
-    PyObject *pyobj_conn;
-    PyObject *ret = NULL;
-    int i_retval;
-    int nparams = 0;
-    unsigned int flags;
-    virTypedParameterPtr params;
+    c->waiting = true;
+    PyThread_release_lock(c->lock);
 
-    if (!PyArg_ParseTuple(args, (char *)"OI:virNodeGetMemoryParameters",
-                          &pyobj_conn, &flags))
-        return NULL;
-    conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
+#if PY_VERSION_HEX >= 0x03020000
+    PyThread_acquire_lock_timed(c->wakeup,
+                                timeout < 0 ? -1 : (PY_TIMEOUT_T) (timeout * 1e6),
+                                0);
+#else
+    if (timeout < 0) {
+        PyThread_acquire_lock(c->wakeup, WAIT_LOCK);
+    } else {
+        double deadline = virTimeSecondsNow() + timeout;
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    i_retval = virNodeGetMemoryParameters(conn, NULL, &nparams, flags);
-    LIBVIRT_END_ALLOW_THREADS;
+        while (!PyThread_acquire_lock(c->wakeup, NOWAIT_LOCK) &&
+               virTimeSecondsNow() < deadline)
+            usleep(1000);
+    }
+#endif
 
-    if (i_retval < 0)
-        return VIR_PY_NONE;
+    PyThread_acquire_lock(c->lock, WAIT_LOCK);
+    if (c->waiting)
+        c->waiting = false;
+    else
+        /* Woken up after the wait timed out, lock the wakeup back */
+        PyThread_acquire_lock(c->wakeup, NOWAIT_LOCK);
+}
 
-    if (!nparams)
-        return PyDict_New();
+static PyObject *
+libvirt_virPyStatsCollectJobResult(virPyStatsCollectJob *job)
+{
+    virErrorPtr err = job->error;
 
-    if (VIR_ALLOC_N(params, nparams) < 0)
-        return PyErr_NoMemory();
+    if (job->abandoned)
+        return Py_BuildValue((char *)"(i(iisiOOOii))", 2,
+                             VIR_ERR_OPERATION_TIMEOUT, VIR_FROM_NONE,
+                             "virConnectGetAllDomainStats() timed out",
+                             VIR_ERR_ERROR, Py_None, Py_None, Py_None, 0, 0);
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    i_retval = virNodeGetMemoryParameters(conn, params, &nparams, flags);
-    LIBVIRT_END_ALLOW_THREADS;
+    if (job->stranded)
+        return Py_BuildValue((char *)"(i(iisiOOOii))", 1,
+                             VIR_ERR_OPERATION_FAILED, VIR_FROM_NONE,
+                             "cannot start stats worker",
+                             VIR_ERR_ERROR, Py_None, Py_None, Py_None, 0, 0);
 
-    if (i_retval < 0) {
-        ret = VIR_PY_NONE;
-        goto cleanup;
-    }
+    if (job->nrecords >= 0)
+        return Py_BuildValue((char *)"(iN)", 0,
+                             convertDomainStatsRecord(job->records,
+                                                      job->nrecords));
 
-    ret = getPyVirTypedParameter(params, nparams);
+    if (!err)
+        return Py_BuildValue((char *)"(iO)", 1, Py_None);
 
-cleanup:
-    virTypedParamsFree(params, nparams);
-    return ret;
+    return Py_BuildValue((char *)"(i(iizizzzii))", 1,
+                         err->code, err->domain, err->message, err->level,
+                         err->str1, err->str2, err->str3,
+                         err->int1, err->int2);
 }
-#endif /* LIBVIR_CHECK_VERSION(0, 10, 2) */
 
-#if LIBVIR_CHECK_VERSION(1, 0, 0)
 static PyObject *
-libvirt_virNodeGetCPUMap(PyObject *self ATTRIBUTE_UNUSED,
-                         PyObject *args)
+libvirt_virConnectCollectStats(PyObject *self ATTRIBUTE_UNUSED,
+                               PyObject *args)
 {
-    virConnectPtr conn;
-    PyObject *pyobj_conn;
-    PyObject *ret = NULL;
-    PyObject *pycpumap = NULL;
-    PyObject *pyused = NULL;
-    PyObject *pycpunum = NULL;
-    PyObject *pyonline = NULL;
-    int i_retval;
-    unsigned char *cpumap = NULL;
-    unsigned int online = 0;
-    unsigned int flags;
+    PyObject *py_connlist;
+    PyObject *py_retval = NULL;
+    virPyStatsCollectionPtr c = NULL;
+    unsigned int stats, flags;
+    int max_parallel, timeout_ms;
+    double timeout;
     size_t i;
 
-    if (!PyArg_ParseTuple(args, (char *)"OI:virNodeGetCPUMap",
-                          &pyobj_conn, &flags))
+    if (!PyArg_ParseTuple(args, (char *)"OIIii:virConnectCollectStats",
+                          &py_connlist, &stats, &flags,
+                          &max_parallel, &timeout_ms))
         return NULL;
-    conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
-
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    i_retval = virNodeGetCPUMap(conn, &cpumap, &online, flags);
-    LIBVIRT_END_ALLOW_THREADS;
 
-    if (i_retval < 0)
-        return VIR_PY_NONE;
+    if (!PyList_Check(py_connlist)) {
+        PyErr_SetString(PyExc_TypeError, "connections must be a list");
+        return NULL;
+    }
+    if (max_parallel <= 0)
+        max_parallel = 1;
+    timeout = timeout_ms < 0 ? -1 : timeout_ms / 1000.0;
 
-    if ((ret = PyTuple_New(3)) == NULL)
-        goto error;
+    if (VIR_ALLOC(c) < 0 ||
+        VIR_ALLOC_N(c->jobs, PyList_GET_SIZE(py_connlist) + 1) < 0) {
+        PyErr_NoMemory();
+        goto cleanup;
+    }
+    c->njobs = PyList_GET_SIZE(py_connlist);
+    c->stats = stats;
+    c->flags = flags;
+    c->refs = 1;
 
-    /* 0: number of CPUs */
-    if ((pycpunum = libvirt_intWrap(i_retval)) == NULL ||
-        PyTuple_SetItem(ret, 0, pycpunum) < 0)
-        goto error;
+    for (i = 0; i < c->njobs; i++) {
+        virConnectPtr conn = PyvirConnect_Get(PyList_GET_ITEM(py_connlist, i));
 
-    /* 1: CPU map */
-    if ((pycpumap = PyList_New(i_retval)) == NULL)
-        goto error;
+        if (!conn) {
+            PyErr_SetString(PyExc_TypeError, "expected a connection");
+            goto cleanup;
+        }
+        /* The workers may still use it after we return */
+        virConnectRef(conn);
+        c->jobs[i].conn = conn;
+    }
 
-    for (i = 0; i < i_retval; i++) {
-        if ((pyused = PyBool_FromLong(VIR_CPU_USED(cpumap, i))) == NULL)
-            goto error;
-        if (PyList_SetItem(pycpumap, i, pyused) < 0)
-            goto error;
+    if (!(c->lock = PyThread_allocate_lock()) ||
+        !(c->wakeup = PyThread_allocate_lock())) {
+        PyErr_NoMemory();
+        goto cleanup;
     }
+    PyThread_acquire_lock(c->wakeup, WAIT_LOCK);
 
-    if (PyTuple_SetItem(ret, 1, pycpumap) < 0)
-        goto error;
+    PyThread_acquire_lock(c->lock, WAIT_LOCK);
+    for (i = 0; i < c->njobs && i < max_parallel; i++) {
+        if (virPyStatsCollectionStartWorker(c) < 0)
+            break;
+    }
+    PyThread_release_lock(c->lock);
 
-    /* 2: number of online CPUs */
-    if ((pyonline = libvirt_uintWrap(online)) == NULL ||
-        PyTuple_SetItem(ret, 2, pyonline) < 0)
-        goto error;
+    if (c->njobs && !c->nworkers) {
+        PyErr_SetString(PyExc_RuntimeError, "cannot start stats worker");
+        goto cleanup;
+    }
 
-cleanup:
-    VIR_FREE(cpumap);
-    return ret;
-error:
-    Py_XDECREF(ret);
-    Py_XDECREF(pycpumap);
-    Py_XDECREF(pyused);
-    Py_XDECREF(pycpunum);
-    Py_XDECREF(pyonline);
-    ret = NULL;
-    goto cleanup;
-}
-#endif /* LIBVIR_CHECK_VERSION(1, 0, 0) */
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    PyThread_acquire_lock(c->lock, WAIT_LOCK);
+    while (true) {
+        double now = virTimeSecondsNow();
+        double wait = -1;
+        size_t pending = 0;
 
+        for (i = 0; i < c->njobs; i++) {
+            virPyStatsCollectJob *job = &c->jobs[i];
 
-#if LIBVIR_CHECK_VERSION(1, 1, 1)
-static PyObject *
-libvirt_virDomainCreateWithFiles(PyObject *self ATTRIBUTE_UNUSED, PyObject *args) {
-    PyObject *py_retval = NULL;
-    int c_retval;
-    virDomainPtr domain;
-    PyObject *pyobj_domain;
-    PyObject *pyobj_files;
-    unsigned int flags;
-    unsigned int nfiles;
-    int *files = NULL;
-    size_t i;
+            if (job->done || job->abandoned || job->started <= 0 ||
+                timeout < 0 || job->started + timeout > now)
+                continue;
 
-    if (!PyArg_ParseTuple(args, (char *)"OOI:virDomainCreateWithFiles",
-                          &pyobj_domain, &pyobj_files, &flags))
-        return NULL;
-    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+            /* Its worker is left behind, try to replace it */
+            job->abandoned = true;
+            c->nworkers--;
+            if (c->next < c->njobs)
+                ignore_value(virPyStatsCollectionStartWorker(c));
+        }
 
-    nfiles = PyList_Size(pyobj_files);
+        /* Fail the jobs nobody is left to start rather than wait for
+         * them for ever */
+        if (!c->nworkers) {
+            for (; c->next < c->njobs; c->next++)
+                c->jobs[c->next].stranded = true;
+        }
 
-    if (VIR_ALLOC_N(files, nfiles) < 0)
-        return PyErr_NoMemory();
+        for (i = 0; i < c->njobs; i++) {
+            virPyStatsCollectJob *job = &c->jobs[i];
+            double left;
 
-    for (i = 0; i < nfiles; i++) {
-        PyObject *pyfd;
-        int fd;
+            if (job->done || job->abandoned || job->stranded)
+                continue;
 
-        pyfd = PyList_GetItem(pyobj_files, i);
+            pending++;
+            if (timeout >= 0) {
+                /* Jobs not started yet get their deadline once they are */
+                left = job->started > 0 ? job->started + timeout - now : timeout;
+                if (wait < 0 || left < wait)
+                    wait = left;
+            }
+        }
 
-        if (libvirt_intUnwrap(pyfd, &fd) < 0)
-            goto cleanup;
+        if (!pending)
+            break;
 
-        files[i] = fd;
+        virPyStatsCollectionWait(c, wait);
     }
-
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    c_retval = virDomainCreateWithFiles(domain, nfiles, files, flags);
+    PyThread_release_lock(c->lock);
     LIBVIRT_END_ALLOW_THREADS;
-    py_retval = libvirt_intWrap((int) c_retval);
-
-cleanup:
-    VIR_FREE(files);
-    return py_retval;
-}
 
+    /* Jobs are either marked done, which leaves them alone, or
+     * abandoned, which we don't look at, so no lock is needed */
+    if (!(py_retval = PyList_New(c->njobs)))
+        goto cleanup;
 
-static PyObject *
-libvirt_virDomainCreateXMLWithFiles(PyObject *self ATTRIBUTE_UNUSED, PyObject *args) {
-    PyObject *py_retval = NULL;
-    virDomainPtr c_retval;
-    virConnectPtr conn;
-    PyObject *pyobj_conn;
-    char * xmlDesc;
-    PyObject *pyobj_files;
-    unsigned int flags;
-    unsigned int nfiles;
-    int *files = NULL;
-    size_t i;
+    for (i = 0; i < c->njobs; i++) {
+        PyObject *py_result;
 
-    if (!PyArg_ParseTuple(args, (char *)"OzOI:virDomainCreateXMLWithFiles",
-                          &pyobj_conn, &xmlDesc, &pyobj_files, &flags))
-        return NULL;
-    conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
+        if (!(py_result = libvirt_virPyStatsCollectJobResult(&c->jobs[i]))) {
+            Py_CLEAR(py_retval);
+            goto cleanup;
+        }
+        PyList_SET_ITEM(py_retval, i, py_result);
+    }
 
-    nfiles = PyList_Size(pyobj_files);
+ cleanup:
+    if (c) {
+        if (c->lock) {
+            PyThread_acquire_lock(c->lock, WAIT_LOCK);
+            virPyStatsCollectionUnref(c);
+        } else {
+            virPyStatsCollectionFree(c);
+        }
+    }
+    return py_retval;
+}
 
-    if (VIR_ALLOC_N(files, nfiles) < 0)
-        return PyErr_NoMemory();
 
-    for (i = 0; i < nfiles; i++) {
-        PyObject *pyfd;
-        int fd;
+static PyObject *
+libvirt_virDomainBlockCopy(PyObject *self ATTRIBUTE_UNUSED, PyObject *args)
+{
+    PyObject *pyobj_dom = NULL;
+    PyObject *pyobj_dict = NULL;
 
-        pyfd = PyList_GetItem(pyobj_files, i);
+    virDomainPtr dom;
+    char *disk = NULL;
+    char *destxml = NULL;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    unsigned int flags = 0;
+    int c_retval;
 
-        if (libvirt_intUnwrap(pyfd, &fd) < 0)
-            goto cleanup;
+    if (!PyArg_ParseTuple(args, (char *) "Ozz|OI:virDomainBlockCopy",
+                          &pyobj_dom, &disk, &destxml, &pyobj_dict, &flags))
+        return VIR_PY_INT_FAIL;
 
-        files[i] = fd;
+    if (PyDict_Check(pyobj_dict)) {
+        if (virPyDictToTypedParams(pyobj_dict, &params, &nparams, NULL, 0) < 0)
+            return VIR_PY_INT_FAIL;
     }
 
+    dom = (virDomainPtr) PyvirDomain_Get(pyobj_dom);
+
     LIBVIRT_BEGIN_ALLOW_THREADS;
-    c_retval = virDomainCreateXMLWithFiles(conn, xmlDesc, nfiles, files, flags);
+    c_retval = virDomainBlockCopy(dom, disk, destxml, params, nparams, flags);
     LIBVIRT_END_ALLOW_THREADS;
-    py_retval = libvirt_virDomainPtrWrap((virDomainPtr) c_retval);
 
-cleanup:
-    VIR_FREE(files);
-    return py_retval;
+    return libvirt_intWrap(c_retval);
 }
-#endif /* LIBVIR_CHECK_VERSION(1, 1, 1) */
 
+/* Mirror of the domains of a connection, taken from one stats query and
+ * then kept current by native domain event callbacks on the event loop,
+ * so that reading it costs no RPC.  Every change of an entry stamps it
+ * with a new generation of the inventory.  Removed domains stay as
+ * removed entries, for changes() to report, until too many of them
+ * pile up and the oldest are forgotten.  */
+typedef struct {
+    char *name;
+    char uuid[VIR_UUID_STRING_BUFLEN];
+    int id;                             /* -1 if inactive */
+    int state;
+    int reason;
+    unsigned int vcpus;
+    unsigned long long memory;          /* in KiB */
+    unsigned long long maxMemory;       /* in KiB */
+    unsigned long long generation;      /* of the last change */
+    bool removed;
+    bool seen;                          /* by the running snapshot */
+} virPyInventoryEntry;
+
+enum {
+    VIR_PY_INVENTORY_LIFECYCLE,
+    VIR_PY_INVENTORY_BALLOON,
+    VIR_PY_INVENTORY_TUNABLE,
+
+    VIR_PY_INVENTORY_LAST
+};
 
-#if LIBVIR_CHECK_VERSION(1, 2, 5)
-static PyObject *
-libvirt_virDomainFSFreeze(PyObject *self ATTRIBUTE_UNUSED, PyObject *args) {
-    PyObject *py_retval = NULL;
-    int c_retval;
-    virDomainPtr domain;
-    PyObject *pyobj_domain;
-    PyObject *pyobj_list;
-    unsigned int flags;
-    unsigned int nmountpoints = 0;
-    char **mountpoints = NULL;
-    size_t i = 0, j;
+typedef struct {
+    PyThread_type_lock lock;            /* protects all but conn */
+    int refs;
+    virConnectPtr conn;                 /* only changed by resync */
+    int callbackIDs[VIR_PY_INVENTORY_LAST];
+    virPyInventoryEntry *entries;
+    size_t nentries;
+    size_t nremoved;                    /* of the entries */
+    size_t *byUUID;                     /* open addressing indexes of */
+    size_t *byName;                     /* the entries, by position + 1 */
+    size_t nslots;                      /* of each index, a power of 2 */
+    bool byNameValid;                   /* or rebuilt by the next lookup */
+    unsigned int syncing;               /* snapshots running */
+    unsigned long long generation;
+    unsigned long long pruned;          /* removals up to it forgotten */
+} virPyInventory;
+typedef virPyInventory *virPyInventoryPtr;
+
+#define VIR_PY_INVENTORY "virPyInventory"
+
+/* Removed entries kept, past which the oldest half is forgotten */
+#define VIR_PY_INVENTORY_KEEP_REMOVED 256
 
-    if (!PyArg_ParseTuple(args, (char *)"OOI:virDomainFSFreeze",
-                          &pyobj_domain, &pyobj_list, &flags))
-        return NULL;
-    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+static void
+virPyInventoryFree(virPyInventoryPtr inv)
+{
+    size_t i;
 
-    if (PyList_Check(pyobj_list)) {
-        nmountpoints = PyList_Size(pyobj_list);
+    for (i = 0; i < inv->nentries; i++)
+        VIR_FREE(inv->entries[i].name);
+    VIR_FREE(inv->entries);
+    VIR_FREE(inv->byUUID);
+    VIR_FREE(inv->byName);
+    if (inv->conn)
+        virConnectClose(inv->conn);
+    if (inv->lock)
+        PyThread_free_lock(inv->lock);
+    VIR_FREE(inv);
+}
 
-        if (VIR_ALLOC_N(mountpoints, nmountpoints) < 0)
-            return PyErr_NoMemory();
+/* Drop a reference, with inv->lock held, which this releases */
+static void
+virPyInventoryUnref(virPyInventoryPtr inv)
+{
+    if (libvirt_unrefLocked(inv->lock, &inv->refs))
+        virPyInventoryFree(inv);
+}
 
-        for (i = 0; i < nmountpoints; i++) {
-            if (libvirt_charPtrUnwrap(PyList_GetItem(pyobj_list, i),
-                                      mountpoints+i) < 0 ||
-                mountpoints[i] == NULL)
-                goto cleanup;
-        }
-    }
+/* UUIDs are looked up regardless of case, so hash them lowercased */
+static size_t
+virPyInventoryHash(const char *key,
+                   size_t nslots)
+{
+    size_t h = 2166136261U;
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    c_retval = virDomainFSFreeze(domain, (const char **) mountpoints,
-                                 nmountpoints, flags);
-    LIBVIRT_END_ALLOW_THREADS;
+    while (*key)
+        h = (h ^ (unsigned char) tolower((unsigned char) *key++)) * 16777619U;
 
-    py_retval = libvirt_intWrap(c_retval);
+    return h & (nslots - 1);
+}
 
-cleanup:
-    for (j = 0 ; j < i ; j++)
-        VIR_FREE(mountpoints[j]);
-    VIR_FREE(mountpoints);
-    return py_retval;
+static void
+virPyInventoryIndexAdd(size_t *index,
+                       size_t nslots,
+                       const char *key,
+                       size_t pos)
+{
+    size_t h = virPyInventoryHash(key, nslots);
+
+    while (index[h])
+        h = (h + 1) & (nslots - 1);
+    index[h] = pos + 1;
 }
 
+/* Rebuild the UUID index, large enough for @want entries, with
+ * inv->lock held.  It is rebuilt in place when it is large enough
+ * already, which can't fail.  The name index is left for the next
+ * lookup by name to rebuild.  */
+static int
+virPyInventoryReindex(virPyInventoryPtr inv,
+                      size_t want)
+{
+    size_t *index;
+    size_t nslots = 16;
+    size_t i;
 
-static PyObject *
-libvirt_virDomainFSThaw(PyObject *self ATTRIBUTE_UNUSED, PyObject *args) {
-    PyObject *py_retval = NULL;
-    int c_retval;
-    virDomainPtr domain;
-    PyObject *pyobj_domain;
-    PyObject *pyobj_list;
-    unsigned int flags;
-    unsigned int nmountpoints = 0;
-    char **mountpoints = NULL;
-    size_t i = 0, j;
+    while (nslots < want * 2)
+        nslots *= 2;
 
-    if (!PyArg_ParseTuple(args, (char *)"OOI:virDomainFSThaw",
-                          &pyobj_domain, &pyobj_list, &flags))
-        return NULL;
-    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+    if (nslots > inv->nslots) {
+        if (VIR_ALLOC_N(index, nslots) < 0)
+            return -1;
+        VIR_FREE(inv->byUUID);
+        inv->byUUID = index;
+        inv->nslots = nslots;
+    } else {
+        memset(inv->byUUID, 0, inv->nslots * sizeof(*inv->byUUID));
+    }
 
-    if (PyList_Check(pyobj_list)) {
-        nmountpoints = PyList_Size(pyobj_list);
+    for (i = 0; i < inv->nentries; i++)
+        virPyInventoryIndexAdd(inv->byUUID, inv->nslots,
+                               inv->entries[i].uuid, i);
 
-        if (VIR_ALLOC_N(mountpoints, nmountpoints) < 0)
-            return PyErr_NoMemory();
+    VIR_FREE(inv->byName);
+    inv->byNameValid = false;
+    return 0;
+}
 
-        for (i = 0; i < nmountpoints; i++) {
-            if (libvirt_charPtrUnwrap(PyList_GetItem(pyobj_list, i),
-                                      mountpoints+i) < 0 ||
-                mountpoints[i] == NULL)
-                goto cleanup;
-        }
-    }
+/* Index the names of the existing domains, with inv->lock held */
+static int
+virPyInventoryIndexNames(virPyInventoryPtr inv)
+{
+    size_t i;
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    c_retval = virDomainFSThaw(domain, (const char **) mountpoints,
-                               nmountpoints, flags);
-    LIBVIRT_END_ALLOW_THREADS;
+    if (inv->byNameValid)
+        return 0;
 
-    py_retval = libvirt_intWrap(c_retval);
+    VIR_FREE(inv->byName);
+    if (VIR_ALLOC_N(inv->byName, inv->nslots) < 0)
+        return -1;
 
- cleanup:
-    for (j = 0 ; j < i ; j++)
-        VIR_FREE(mountpoints[j]);
-    VIR_FREE(mountpoints);
-    return py_retval;
+    for (i = 0; i < inv->nentries; i++) {
+        if (!inv->entries[i].removed)
+            virPyInventoryIndexAdd(inv->byName, inv->nslots,
+                                   inv->entries[i].name, i);
+    }
+    inv->byNameValid = true;
+    return 0;
 }
 
-static PyObject *
-libvirt_virDomainGetTime(PyObject *self ATTRIBUTE_UNUSED, PyObject *args) {
-    PyObject *py_retval = NULL;
-    PyObject *dict = NULL;
-    PyObject *pyobj_domain, *pyobj_seconds, *pyobj_nseconds;
-    virDomainPtr domain;
-    long long seconds;
-    unsigned int nseconds;
-    unsigned int flags;
-    int c_retval;
-
-    if (!PyArg_ParseTuple(args, (char*)"OI:virDomainGetTime",
-                          &pyobj_domain, &flags))
-        return NULL;
-    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+static virPyInventoryEntry *
+virPyInventoryFind(virPyInventoryPtr inv,
+                   const char *uuid)
+{
+    virPyInventoryEntry *entry;
+    size_t h = virPyInventoryHash(uuid, inv->nslots);
 
-    if (!(dict = PyDict_New()))
-        goto cleanup;
+    while (inv->byUUID[h]) {
+        entry = &inv->entries[inv->byUUID[h] - 1];
+        if (strcasecmp(entry->uuid, uuid) == 0)
+            return entry;
+        h = (h + 1) & (inv->nslots - 1);
+    }
+    return NULL;
+}
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    c_retval = virDomainGetTime(domain, &seconds, &nseconds, flags);
-    LIBVIRT_END_ALLOW_THREADS;
+/* Find the existing domain @name, with inv->lock held and the name
+ * index valid */
+static virPyInventoryEntry *
+virPyInventoryFindName(virPyInventoryPtr inv,
+                       const char *name)
+{
+    virPyInventoryEntry *entry;
+    size_t h = virPyInventoryHash(name, inv->nslots);
 
-    if (c_retval < 0) {
-        py_retval = VIR_PY_NONE;
-        goto cleanup;
+    while (inv->byName[h]) {
+        entry = &inv->entries[inv->byName[h] - 1];
+        if (STREQ(entry->name, name))
+            return entry;
+        h = (h + 1) & (inv->nslots - 1);
     }
+    return NULL;
+}
 
-    if (!(pyobj_seconds = libvirt_longlongWrap(seconds)) ||
-        PyDict_SetItemString(dict, "seconds", pyobj_seconds) < 0)
-        goto cleanup;
-    Py_DECREF(pyobj_seconds);
+/* Append @entry, whose name is taken over on success, as a new entry
+ * with inv->lock held */
+static virPyInventoryEntry *
+virPyInventoryAdd(virPyInventoryPtr inv,
+                  virPyInventoryEntry *entry)
+{
+    virPyInventoryEntry *added;
 
-    if (!(pyobj_nseconds = libvirt_uintWrap(nseconds)) ||
-        PyDict_SetItemString(dict, "nseconds", pyobj_nseconds) < 0)
-        goto cleanup;
-    Py_DECREF(pyobj_nseconds);
+    if ((inv->nentries + 1) * 2 > inv->nslots &&
+        virPyInventoryReindex(inv, inv->nentries + 1) < 0)
+        return NULL;
+    if (VIR_REALLOC_N(inv->entries, inv->nentries + 1) < 0)
+        return NULL;
 
-    py_retval = dict;
-    dict = NULL;
- cleanup:
-    Py_XDECREF(dict);
-    return py_retval;
+    added = &inv->entries[inv->nentries];
+    *added = *entry;
+    added->generation = ++inv->generation;
+    added->seen = true;
+    entry->name = NULL;
+
+    virPyInventoryIndexAdd(inv->byUUID, inv->nslots,
+                           added->uuid, inv->nentries);
+    if (added->removed)
+        inv->nremoved++;
+    else if (inv->byNameValid)
+        virPyInventoryIndexAdd(inv->byName, inv->nslots,
+                               added->name, inv->nentries);
+    inv->nentries++;
+    return added;
 }
 
+static int
+virPyInventoryCompareGeneration(const void *a,
+                                const void *b)
+{
+    unsigned long long ga = *(const unsigned long long *) a;
+    unsigned long long gb = *(const unsigned long long *) b;
 
-static PyObject *
-libvirt_virDomainSetTime(PyObject *self ATTRIBUTE_UNUSED, PyObject *args) {
-    PyObject *py_retval = NULL;
-    PyObject *pyobj_domain;
-    PyObject *pyobj_seconds;
-    PyObject *pyobj_nseconds;
-    PyObject *py_dict;
-    virDomainPtr domain;
-    long long seconds = 0;
-    unsigned int nseconds = 0;
-    unsigned int flags;
-    ssize_t py_dict_size = 0;
-    int c_retval;
+    return ga < gb ? -1 : ga > gb;
+}
 
-    if (!PyArg_ParseTuple(args, (char*)"OOI:virDomainSetTime",
-                          &pyobj_domain, &py_dict, &flags))
-        return NULL;
-    domain = (virDomainPtr) PyvirDomain_Get(pyobj_domain);
+/* Forget the oldest half of the removed entries once there are too
+ * many, with inv->lock held.  Never while a snapshot runs, which would
+ * bring the domains removed meanwhile back if it still reports them.
+ * The changes() callers that have not seen the forgotten removals
+ * yet have to start over.  */
+static void
+virPyInventoryPrune(virPyInventoryPtr inv)
+{
+    unsigned long long *generations;
+    unsigned long long horizon;
+    size_t n = 0;
+    size_t i, j;
 
-    if (PyDict_Check(py_dict)) {
-        py_dict_size = PyDict_Size(py_dict);
-        if ((pyobj_seconds = PyDict_GetItemString(py_dict, "seconds"))) {
-            if (libvirt_longlongUnwrap(pyobj_seconds, &seconds) < 0) {
-                PyErr_Format(PyExc_LookupError, "malformed 'seconds'");
-                goto cleanup;
-            }
-        } else {
-            PyErr_Format(PyExc_LookupError, "Dictionary must contains 'seconds'");
-            goto cleanup;
-        }
+    if (inv->syncing || inv->nremoved <= VIR_PY_INVENTORY_KEEP_REMOVED)
+        return;
 
-        if ((pyobj_nseconds = PyDict_GetItemString(py_dict, "nseconds"))) {
-            if (libvirt_uintUnwrap(pyobj_nseconds, &nseconds) < 0) {
-                PyErr_Format(PyExc_LookupError, "malformed 'nseconds'");
-                goto cleanup;
-            }
-        } else if (py_dict_size > 1) {
-            PyErr_Format(PyExc_LookupError, "Dictionary contains unknown key");
-            goto cleanup;
+    /* Without memory, they are only forgotten at the next removal */
+    if (VIR_ALLOC_N(generations, inv->nremoved) < 0)
+        return;
+    for (i = 0; i < inv->nentries; i++) {
+        if (inv->entries[i].removed)
+            generations[n++] = inv->entries[i].generation;
+    }
+    qsort(generations, n, sizeof(*generations),
+          virPyInventoryCompareGeneration);
+    horizon = generations[n - VIR_PY_INVENTORY_KEEP_REMOVED / 2 - 1];
+    VIR_FREE(generations);
+
+    for (i = j = 0; i < inv->nentries; i++) {
+        if (inv->entries[i].removed &&
+            inv->entries[i].generation <= horizon) {
+            VIR_FREE(inv->entries[i].name);
+            inv->nremoved--;
+            continue;
         }
-    } else if (py_dict != Py_None || !flags) {
-        PyErr_Format(PyExc_TypeError, "time must be a dictionary "
-                     "or None with flags set");
-        goto cleanup;
+        inv->entries[j++] = inv->entries[i];
     }
+    inv->nentries = j;
+    inv->pruned = horizon;
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    c_retval = virDomainSetTime(domain, seconds, nseconds, flags);
-    LIBVIRT_END_ALLOW_THREADS;
-
-    py_retval = libvirt_intWrap(c_retval);
-
- cleanup:
-    return py_retval;
+    /* Fewer entries always fit the current index */
+    ignore_value(virPyInventoryReindex(inv, inv->nentries));
 }
-#endif /* LIBVIR_CHECK_VERSION(1, 2, 5) */
 
+/* Store the data of @entry, whose name is taken over on success, with
+ * inv->lock held.  Entries changed after generation @guard, if not 0,
+ * are newer than @entry and left alone.  */
+static int
+virPyInventoryStore(virPyInventoryPtr inv,
+                    virPyInventoryEntry *entry,
+                    unsigned long long guard)
+{
+    virPyInventoryEntry *old;
 
-#if LIBVIR_CHECK_VERSION(1, 2, 6)
-static PyObject *
-libvirt_virNodeGetFreePages(PyObject *self ATTRIBUTE_UNUSED,
-                            PyObject *args) {
-    PyObject *py_retval = NULL;
-    PyObject *pyobj_conn;
-    PyObject *pyobj_pagesize;
-    PyObject *pyobj_counts = NULL;
-    virConnectPtr conn;
-    unsigned int *pages = NULL;
-    int startCell;
-    unsigned int cellCount;
-    unsigned int flags;
-    unsigned long long *counts = NULL;
-    int c_retval;
-    ssize_t pyobj_pagesize_size, i, j;
+    if (!(old = virPyInventoryFind(inv, entry->uuid)))
+        return virPyInventoryAdd(inv, entry) ? 0 : -1;
+
+    old->seen = true;
+    if (guard && old->generation > guard)
+        return 0;
 
-    if (!PyArg_ParseTuple(args, (char *)"OOiiI:virNodeGetFreePages",
-                          &pyobj_conn, &pyobj_pagesize, &startCell,
-                          &cellCount, &flags))
-        return NULL;
+    if (!old->removed &&
+        STREQ(old->name, entry->name) &&
+        old->id == entry->id &&
+        old->state == entry->state &&
+        old->reason == entry->reason &&
+        old->vcpus == entry->vcpus &&
+        old->memory == entry->memory &&
+        old->maxMemory == entry->maxMemory)
+        return 0;
 
-    if (!PyList_Check(pyobj_pagesize)) {
-        PyErr_Format(PyExc_TypeError, "pagesize must be list");
-        return NULL;
+    if (old->removed) {
+        inv->nremoved--;
+        inv->byNameValid = false;
+    } else if (!STREQ(old->name, entry->name)) {
+        inv->byNameValid = false;
     }
 
-    if (cellCount == 0) {
-        PyErr_Format(PyExc_LookupError, "cellCount must not be zero");
-        return NULL;
+    VIR_FREE(old->name);
+    *old = *entry;
+    old->generation = ++inv->generation;
+    old->seen = true;
+    entry->name = NULL;
+    return 0;
+}
+
+/* Mark @entry removed, with inv->lock held */
+static void
+virPyInventoryMarkRemoved(virPyInventoryPtr inv,
+                          virPyInventoryEntry *entry)
+{
+    if (entry->removed)
+        return;
+
+    entry->removed = true;
+    entry->id = -1;
+    entry->generation = ++inv->generation;
+    inv->nremoved++;
+    inv->byNameValid = false;
+}
+
+/* Mark the entry of @uuid removed, with inv->lock held.  A domain not
+ * known yet gets a nameless removed entry all the same, stamped with a
+ * new generation, so that a snapshot running meanwhile skips it rather
+ * than bringing it back if it still reports the domain.  */
+static void
+virPyInventoryRemove(virPyInventoryPtr inv,
+                     const char *uuid)
+{
+    virPyInventoryEntry *entry;
+    virPyInventoryEntry removed;
+
+    if ((entry = virPyInventoryFind(inv, uuid))) {
+        virPyInventoryMarkRemoved(inv, entry);
+    } else {
+        memset(&removed, 0, sizeof(removed));
+        strcpy(removed.uuid, uuid);
+        removed.id = -1;
+        removed.removed = true;
+        /* Without memory, left for the next resync to fix */
+        ignore_value(virPyInventoryAdd(inv, &removed));
     }
 
-    conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
+    virPyInventoryPrune(inv);
+}
 
-    pyobj_pagesize_size = PyList_Size(pyobj_pagesize);
-    if (VIR_ALLOC_N(pages, pyobj_pagesize_size) < 0 ||
-        VIR_ALLOC_N(counts, pyobj_pagesize_size * cellCount) < 0 ||
-        !(pyobj_counts = PyDict_New()))
-        goto cleanup;
+/* Fill @entry with the current data of @dom, queried from the daemon.
+ * Returns -2 if the domain no longer exists, -1 on other errors.  */
+static int
+virPyInventoryFetch(virDomainPtr dom,
+                    virPyInventoryEntry *entry)
+{
+    virDomainInfo info;
+    virErrorPtr err;
 
-    for (i = 0; i < pyobj_pagesize_size; i++) {
-        PyObject *tmp = PyList_GetItem(pyobj_pagesize, i);
+    memset(entry, 0, sizeof(*entry));
+    if (virDomainGetUUIDString(dom, entry->uuid) < 0)
+        return -1;
 
-        if (libvirt_uintUnwrap(tmp, &pages[i]) < 0)
-            goto cleanup;
+    if (virDomainGetState(dom, &entry->state, &entry->reason, 0) < 0 ||
+        virDomainGetInfo(dom, &info) < 0) {
+        err = virGetLastError();
+        return err && err->code == VIR_ERR_NO_DOMAIN ? -2 : -1;
     }
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    c_retval = virNodeGetFreePages(conn,
-                                   pyobj_pagesize_size, pages,
-                                   startCell, cellCount,
-                                   counts, flags);
-    LIBVIRT_END_ALLOW_THREADS;
+    if (!(entry->name = strdup(virDomainGetName(dom))))
+        return -1;
+    entry->id = virDomainGetID(dom) == (unsigned int) -1 ? -1 :
+        (int) virDomainGetID(dom);
+    entry->vcpus = info.nrVirtCpu;
+    entry->memory = info.memory;
+    entry->maxMemory = info.maxMem;
+    return 0;
+}
 
-    if (c_retval < 0) {
-        py_retval = VIR_PY_NONE;
-        goto cleanup;
+static void
+virPyInventoryRefresh(virPyInventoryPtr inv,
+                      virDomainPtr dom)
+{
+    virPyInventoryEntry entry;
+    int ret;
+
+    if ((ret = virPyInventoryFetch(dom, &entry)) == -1) {
+        /* Left for the next event or resync to fix */
+        VIR_FREE(entry.name);
+        return;
     }
 
-    for (i = 0; i < c_retval;) {
-        PyObject *per_node = NULL;
-        PyObject *node = NULL;
+    PyThread_acquire_lock(inv->lock, WAIT_LOCK);
+    if (ret == -2)
+        virPyInventoryRemove(inv, entry.uuid);
+    else
+        ignore_value(virPyInventoryStore(inv, &entry, 0));
+    PyThread_release_lock(inv->lock);
 
-        if (!(per_node = PyDict_New()) ||
-            !(node = libvirt_intWrap(startCell + i/pyobj_pagesize_size))) {
-            Py_XDECREF(per_node);
-            Py_XDECREF(node);
-            goto cleanup;
-        }
+    VIR_FREE(entry.name);
+}
 
-        for (j = 0; j < pyobj_pagesize_size; j ++) {
-            PyObject *page = NULL;
-            PyObject *count = NULL;
+static int
+libvirt_virPyInventoryLifecycle(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                virDomainPtr dom,
+                                int event ATTRIBUTE_UNUSED,
+                                int detail ATTRIBUTE_UNUSED,
+                                void *opaque)
+{
+    virPyInventoryRefresh(opaque, dom);
+    return 0;
+}
 
-            if (!(page = libvirt_intWrap(pages[j])) ||
-                !(count = libvirt_intWrap(counts[i + j])) ||
-                PyDict_SetItem(per_node, page, count) < 0) {
-                Py_XDECREF(page);
-                Py_XDECREF(count);
-                Py_XDECREF(per_node);
-                Py_XDECREF(node);
-                goto cleanup;
-            }
-        }
-        i += pyobj_pagesize_size;
+static int
+libvirt_virPyInventoryBalloon(virConnectPtr conn ATTRIBUTE_UNUSED,
+                              virDomainPtr dom,
+                              unsigned long long actual,
+                              void *opaque)
+{
+    virPyInventoryPtr inv = opaque;
+    virPyInventoryEntry *entry;
+    char uuid[VIR_UUID_STRING_BUFLEN];
 
-        if (PyDict_SetItem(pyobj_counts, node, per_node) < 0) {
-            Py_XDECREF(per_node);
-            Py_XDECREF(node);
-            goto cleanup;
-        }
+    if (virDomainGetUUIDString(dom, uuid) < 0)
+        return 0;
+
+    PyThread_acquire_lock(inv->lock, WAIT_LOCK);
+    if ((entry = virPyInventoryFind(inv, uuid)) &&
+        !entry->removed && entry->memory != actual) {
+        entry->memory = actual;
+        entry->generation = ++inv->generation;
     }
+    PyThread_release_lock(inv->lock);
+    return 0;
+}
 
-    py_retval = pyobj_counts;
-    pyobj_counts = NULL;
- cleanup:
-    Py_XDECREF(pyobj_counts);
-    VIR_FREE(pages);
-    VIR_FREE(counts);
-    return py_retval;
+#ifdef VIR_DOMAIN_EVENT_ID_TUNABLE
+static int
+libvirt_virPyInventoryTunable(virConnectPtr conn ATTRIBUTE_UNUSED,
+                              virDomainPtr dom,
+                              virTypedParameterPtr params ATTRIBUTE_UNUSED,
+                              int nparams ATTRIBUTE_UNUSED,
+                              void *opaque)
+{
+    virPyInventoryRefresh(opaque, dom);
+    return 0;
 }
+#endif /* VIR_DOMAIN_EVENT_ID_TUNABLE */
+
+static void
+libvirt_virPyInventoryEventFree(void *opaque)
+{
+    virPyInventoryPtr inv = opaque;
 
+    PyThread_acquire_lock(inv->lock, WAIT_LOCK);
+    virPyInventoryUnref(inv);
+}
 
-static PyObject *
-libvirt_virNetworkGetDHCPLeases(PyObject *self ATTRIBUTE_UNUSED,
-                                PyObject *args)
+/* Register the event callbacks on inv->conn, without the GIL held */
+static int
+virPyInventoryAttach(virPyInventoryPtr inv)
 {
-    PyObject *py_retval = NULL;
-    PyObject *py_lease = NULL;
-    virNetworkPtr network;
-    PyObject *pyobj_network;
-    unsigned int flags;
-    virNetworkDHCPLeasePtr *leases = NULL;
-    int leases_count;
-    char *mac = NULL;
+    virConnectDomainEventGenericCallback cbs[VIR_PY_INVENTORY_LAST] = {
+        VIR_DOMAIN_EVENT_CALLBACK(libvirt_virPyInventoryLifecycle),
+        VIR_DOMAIN_EVENT_CALLBACK(libvirt_virPyInventoryBalloon),
+#ifdef VIR_DOMAIN_EVENT_ID_TUNABLE
+        VIR_DOMAIN_EVENT_CALLBACK(libvirt_virPyInventoryTunable),
+#else
+        NULL,
+#endif
+    };
+    int eventIDs[VIR_PY_INVENTORY_LAST] = {
+        VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+        VIR_DOMAIN_EVENT_ID_BALLOON_CHANGE,
+#ifdef VIR_DOMAIN_EVENT_ID_TUNABLE
+        VIR_DOMAIN_EVENT_ID_TUNABLE,
+#else
+        -1,
+#endif
+    };
     size_t i;
+    int id;
 
-    if (!PyArg_ParseTuple(args, (char *) "OzI:virNetworkDHCPLeasePtr",
-                          &pyobj_network, &mac, &flags))
-        return NULL;
+    for (i = 0; i < VIR_PY_INVENTORY_LAST; i++) {
+        if (!cbs[i])
+            continue;
 
-    network = (virNetworkPtr) PyvirNetwork_Get(pyobj_network);
+        PyThread_acquire_lock(inv->lock, WAIT_LOCK);
+        inv->refs++;
+        PyThread_release_lock(inv->lock);
+
+        id = virConnectDomainEventRegisterAny(inv->conn, NULL, eventIDs[i],
+                                              cbs[i], inv,
+                                              libvirt_virPyInventoryEventFree);
+        if (id < 0) {
+            PyThread_acquire_lock(inv->lock, WAIT_LOCK);
+            inv->refs--;
+            PyThread_release_lock(inv->lock);
+
+            /* Older daemons may not know the other events, whose
+             * changes are then only picked up by the next refresh */
+            if (i == VIR_PY_INVENTORY_LIFECYCLE)
+                return -1;
+            virResetLastError();
+            continue;
+        }
+        inv->callbackIDs[i] = id;
+    }
+    return 0;
+}
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    leases_count = virNetworkGetDHCPLeases(network, mac, &leases, flags);
-    LIBVIRT_END_ALLOW_THREADS;
+/* Deregister the event callbacks, without the GIL held.  Errors are
+ * ignored, the connection may be gone already.  */
+static void
+virPyInventoryDetach(virPyInventoryPtr inv)
+{
+    size_t i;
 
-    if (leases_count < 0) {
-        py_retval = VIR_PY_NONE;
-        goto cleanup;
+    for (i = 0; i < VIR_PY_INVENTORY_LAST; i++) {
+        if (inv->callbackIDs[i] < 0)
+            continue;
+        ignore_value(virConnectDomainEventDeregisterAny(inv->conn,
+                                                        inv->callbackIDs[i]));
+        inv->callbackIDs[i] = -1;
     }
+}
 
-    if (!(py_retval = PyList_New(leases_count)))
-        goto no_memory;
+/* Bring the whole inventory up to date with one stats query, without
+ * overwriting what events changed meanwhile, and mark the domains not
+ * reported anymore removed.  Must be called without the GIL held.  */
+static int
+virPyInventorySnapshot(virPyInventoryPtr inv)
+{
+    virDomainStatsRecordPtr *records = NULL;
+    virPyInventoryEntry entry;
+    unsigned long long guard;
+    unsigned long long value;
+    int nrecords;
+    int ival;
+    int ret = -1;
+    size_t i;
 
-    for (i = 0; i < leases_count; i++) {
-        virNetworkDHCPLeasePtr lease = leases[i];
+    memset(&entry, 0, sizeof(entry));
 
-        if ((py_lease = PyDict_New()) == NULL)
-            goto no_memory;
+    PyThread_acquire_lock(inv->lock, WAIT_LOCK);
+    guard = inv->generation;
+    inv->syncing++;
+    for (i = 0; i < inv->nentries; i++)
+        inv->entries[i].seen = false;
+    PyThread_release_lock(inv->lock);
 
-#define VIR_SET_LEASE_ITEM(NAME, VALUE_OBJ_FUNC)                            \
-        do {                                                                \
-            PyObject *tmp_val;                                              \
-                                                                            \
-            if (!(tmp_val = VALUE_OBJ_FUNC))                                \
-                goto no_memory;                                             \
-                                                                            \
-            if (PyDict_SetItemString(py_lease, NAME, tmp_val) < 0) {        \
-                Py_DECREF(tmp_val);                                         \
-                goto no_memory;                                             \
-            }                                                               \
-        } while (0)
-
-        VIR_SET_LEASE_ITEM("iface", libvirt_charPtrWrap(lease->iface));
-        VIR_SET_LEASE_ITEM("expirytime", libvirt_longlongWrap(lease->expirytime));
-        VIR_SET_LEASE_ITEM("type", libvirt_intWrap(lease->type));
-        VIR_SET_LEASE_ITEM("mac", libvirt_charPtrWrap(lease->mac));
-        VIR_SET_LEASE_ITEM("ipaddr", libvirt_charPtrWrap(lease->ipaddr));
-        VIR_SET_LEASE_ITEM("prefix", libvirt_uintWrap(lease->prefix));
-        VIR_SET_LEASE_ITEM("hostname", libvirt_charPtrWrap(lease->hostname));
-        VIR_SET_LEASE_ITEM("clientid", libvirt_charPtrWrap(lease->clientid));
-        VIR_SET_LEASE_ITEM("iaid", libvirt_charPtrWrap(lease->iaid));
+    if ((nrecords = virConnectGetAllDomainStats(inv->conn,
+                                                VIR_DOMAIN_STATS_STATE |
+                                                VIR_DOMAIN_STATS_BALLOON |
+                                                VIR_DOMAIN_STATS_VCPU,
+                                                &records, 0)) < 0)
+        goto cleanup;
 
-#undef VIR_SET_LEASE_ITEM
+    for (i = 0; i < nrecords; i++) {
+        memset(&entry, 0, sizeof(entry));
+        if (virDomainGetUUIDString(records[i]->dom, entry.uuid) < 0 ||
+            !(entry.name = strdup(virDomainGetName(records[i]->dom))))
+            goto cleanup;
 
-        if (PyList_SetItem(py_retval, i, py_lease) < 0)
-            goto no_memory;
+        entry.id = virDomainGetID(records[i]->dom) == (unsigned int) -1 ? -1 :
+            (int) virDomainGetID(records[i]->dom);
+        if (virTypedParamsGetInt(records[i]->params, records[i]->nparams,
+                                 "state.state", &ival) == 1)
+            entry.state = ival;
+        if (virTypedParamsGetInt(records[i]->params, records[i]->nparams,
+                                 "state.reason", &ival) == 1)
+            entry.reason = ival;
+        if (virTypedParamsGetUInt(records[i]->params, records[i]->nparams,
+                                  "vcpu.current", &entry.vcpus) < 0 ||
+            virTypedParamsGetULLong(records[i]->params, records[i]->nparams,
+                                    "balloon.current", &entry.memory) < 0)
+            goto cleanup;
+        if (virTypedParamsGetULLong(records[i]->params, records[i]->nparams,
+                                    "balloon.maximum", &value) == 1)
+            entry.maxMemory = value;
 
-        py_lease = NULL;
+        PyThread_acquire_lock(inv->lock, WAIT_LOCK);
+        if (virPyInventoryStore(inv, &entry, guard) < 0) {
+            PyThread_release_lock(inv->lock);
+            goto cleanup;
+        }
+        PyThread_release_lock(inv->lock);
+        VIR_FREE(entry.name);
     }
 
+    ret = 0;
+
  cleanup:
-    Py_XDECREF(py_lease);
-    if (leases) {
-        for (i = 0; i < leases_count; i++)
-            virNetworkDHCPLeaseFree(leases[i]);
+    PyThread_acquire_lock(inv->lock, WAIT_LOCK);
+    for (i = 0; ret == 0 && i < inv->nentries; i++) {
+        if (!inv->entries[i].seen && inv->entries[i].generation <= guard)
+            virPyInventoryMarkRemoved(inv, &inv->entries[i]);
     }
-    VIR_FREE(leases);
+    inv->syncing--;
+    virPyInventoryPrune(inv);
+    PyThread_release_lock(inv->lock);
 
-    return py_retval;
+    VIR_FREE(entry.name);
+    virDomainStatsRecordListFree(records);
+    return ret;
+}
 
- no_memory:
-    Py_XDECREF(py_retval);
-    py_retval = PyErr_NoMemory();
-    goto cleanup;
+/* Close the inventory, must be called with the GIL held */
+static void
+virPyInventoryClose(virPyInventoryPtr inv)
+{
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    virPyInventoryDetach(inv);
+    LIBVIRT_END_ALLOW_THREADS;
 }
 
-#endif /* LIBVIR_CHECK_VERSION(1, 2, 6) */
+static void
+libvirt_virPyInventoryDestroy(void *ptr)
+{
+    virPyInventoryPtr inv = ptr;
 
-#if LIBVIR_CHECK_VERSION(1, 2, 8)
+    virPyInventoryClose(inv);
+    PyThread_acquire_lock(inv->lock, WAIT_LOCK);
+    virPyInventoryUnref(inv);
+}
+
+static const virPyNativeType virPyInventoryNative = {
+    VIR_PY_INVENTORY,
+    libvirt_virPyInventoryDestroy,
+};
+
+static virPyInventoryPtr
+libvirt_virPyInventoryGet(PyObject *obj)
+{
+    return libvirt_nativeGet(obj, &virPyInventoryNative);
+}
 
 static PyObject *
-convertDomainStatsRecord(virDomainStatsRecordPtr *records,
-                         int nrecords)
+libvirt_virPyInventoryEntryWrap(virPyInventoryEntry *entry)
+{
+    return Py_BuildValue((char *) "{s:s,s:s,s:i,s:i,s:i,s:I,s:K,s:K,s:K,s:N}",
+                         "name", entry->name,
+                         "uuid", entry->uuid,
+                         "id", entry->id,
+                         "state", entry->state,
+                         "reason", entry->reason,
+                         "vcpus", entry->vcpus,
+                         "memory", entry->memory,
+                         "max_memory", entry->maxMemory,
+                         "generation", entry->generation,
+                         "removed", PyBool_FromLong(entry->removed));
+}
+
+/* Copy the entries changed after generation @since, the removed ones
+ * included if asked to, and the current generation, with inv->lock
+ * held.  The removed entries of domains never known are left out.
+ * The python objects are only created once it is released.  */
+static int
+virPyInventoryCopy(virPyInventoryPtr inv,
+                   unsigned long long since,
+                   bool removed,
+                   virPyInventoryEntry **entries,
+                   size_t *nentries,
+                   unsigned long long *generation)
 {
-    PyObject *py_retval;
-    PyObject *py_record;
-    PyObject *py_record_domain = NULL;
-    PyObject *py_record_stats = NULL;
     size_t i;
 
-    if (!(py_retval = PyList_New(nrecords)))
-        return NULL;
-
-    for (i = 0; i < nrecords; i++) {
-        if (!(py_record = PyTuple_New(2)))
-            goto error;
+    *nentries = 0;
+    *generation = inv->generation;
+    if (VIR_ALLOC_N(*entries, inv->nentries ? inv->nentries : 1) < 0)
+        return -1;
 
-        /* libvirt_virDomainPtrWrap steals the object */
-        virDomainRef(records[i]->dom);
-        if (!(py_record_domain = libvirt_virDomainPtrWrap(records[i]->dom))) {
-            virDomainFree(records[i]->dom);
+    for (i = 0; i < inv->nentries; i++) {
+        if (inv->entries[i].generation <= since ||
+            (inv->entries[i].removed && (!removed || !inv->entries[i].name)))
+            continue;
+        (*entries)[*nentries] = inv->entries[i];
+        if (!((*entries)[*nentries].name = strdup(inv->entries[i].name)))
             goto error;
-        }
+        (*nentries)++;
+    }
+    return 0;
 
-        if (!(py_record_stats = getPyVirTypedParameter(records[i]->params,
-                                                       records[i]->nparams)))
-            goto error;
+ error:
+    for (i = 0; i < *nentries; i++)
+        VIR_FREE((*entries)[i].name);
+    VIR_FREE(*entries);
+    return -1;
+}
 
-        if (PyTuple_SetItem(py_record, 0, py_record_domain) < 0)
-            goto error;
+static PyObject *
+libvirt_virDomainInventoryNew(PyObject *self ATTRIBUTE_UNUSED,
+                              PyObject *args)
+{
+    PyObject *pyobj_conn;
+    PyObject *ret;
+    virPyInventoryPtr inv;
+    size_t i;
+    int c_retval;
 
-        py_record_domain = NULL;
+    if (!PyArg_ParseTuple(args, (char *) "O:virDomainInventoryNew",
+                          &pyobj_conn))
+        return NULL;
 
-        if (PyTuple_SetItem(py_record, 1, py_record_stats) < 0)
-            goto error;
+    if (VIR_ALLOC(inv) < 0)
+        return PyErr_NoMemory();
+    inv->refs = 1;
+    for (i = 0; i < VIR_PY_INVENTORY_LAST; i++)
+        inv->callbackIDs[i] = -1;
 
-        py_record_stats = NULL;
+    if (!(inv->lock = PyThread_allocate_lock()) ||
+        virPyInventoryReindex(inv, 0) < 0) {
+        virPyInventoryFree(inv);
+        return PyErr_NoMemory();
+    }
 
-        if (PyList_SetItem(py_retval, i, py_record) < 0)
-            goto error;
+    inv->conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
+    /* The inventory may outlive the python object */
+    virConnectRef(inv->conn);
 
-        py_record = NULL;
+    if (!(ret = libvirt_nativeWrap(inv, &virPyInventoryNative))) {
+        virPyInventoryFree(inv);
+        return NULL;
     }
 
-    return py_retval;
+    /* Listening first, so that nothing is missed by the snapshot */
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    c_retval = virPyInventoryAttach(inv);
+    if (c_retval == 0)
+        c_retval = virPyInventorySnapshot(inv);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (c_retval < 0) {
+        Py_DECREF(ret);
+        return VIR_PY_NONE;
+    }
 
- error:
-    Py_XDECREF(py_retval);
-    Py_XDECREF(py_record);
-    Py_XDECREF(py_record_domain);
-    Py_XDECREF(py_record_stats);
-    return NULL;
+    return ret;
 }
 
-
 static PyObject *
-libvirt_virConnectGetAllDomainStats(PyObject *self ATTRIBUTE_UNUSED,
-                                    PyObject *args)
+libvirt_virDomainInventoryResync(PyObject *self ATTRIBUTE_UNUSED,
+                                 PyObject *args)
 {
+    PyObject *pyobj_inv;
     PyObject *pyobj_conn;
-    PyObject *py_retval;
+    virPyInventoryPtr inv;
     virConnectPtr conn;
-    virDomainStatsRecordPtr *records;
-    int nrecords;
-    unsigned int flags;
-    unsigned int stats;
+    int c_retval;
 
-    if (!PyArg_ParseTuple(args, (char *)"OII:virConnectGetAllDomainStats",
-                          &pyobj_conn, &stats, &flags))
+    if (!PyArg_ParseTuple(args, (char *) "OO:virDomainInventoryResync",
+                          &pyobj_inv, &pyobj_conn) ||
+        !(inv = libvirt_virPyInventoryGet(pyobj_inv)))
         return NULL;
+
     conn = (virConnectPtr) PyvirConnect_Get(pyobj_conn);
 
     LIBVIRT_BEGIN_ALLOW_THREADS;
-    nrecords = virConnectGetAllDomainStats(conn, stats, &records, flags);
+    virPyInventoryDetach(inv);
+    virConnectRef(conn);
+    virConnectClose(inv->conn);
+    inv->conn = conn;
+
+    c_retval = virPyInventoryAttach(inv);
+    if (c_retval == 0)
+        c_retval = virPyInventorySnapshot(inv);
     LIBVIRT_END_ALLOW_THREADS;
 
-    if (nrecords < 0)
-        return VIR_PY_NONE;
+    return libvirt_intWrap(c_retval);
+}
 
-    if (!(py_retval = convertDomainStatsRecord(records, nrecords)))
-        py_retval = VIR_PY_NONE;
+static PyObject *
+libvirt_virDomainInventoryClose(PyObject *self ATTRIBUTE_UNUSED,
+                                PyObject *args)
+{
+    PyObject *pyobj_inv;
+    virPyInventoryPtr inv;
 
-    virDomainStatsRecordListFree(records);
+    if (!PyArg_ParseTuple(args, (char *) "O:virDomainInventoryClose",
+                          &pyobj_inv) ||
+        !(inv = libvirt_virPyInventoryGet(pyobj_inv)))
+        return NULL;
 
-    return py_retval;
-}
+    virPyInventoryClose(inv);
 
+    return VIR_PY_INT_SUCCESS;
+}
 
 static PyObject *
-libvirt_virDomainListGetStats(PyObject *self ATTRIBUTE_UNUSED,
-                              PyObject *args)
+libvirt_virDomainInventoryGeneration(PyObject *self ATTRIBUTE_UNUSED,
+                                     PyObject *args)
 {
-    PyObject *pyobj_conn;
-    PyObject *py_retval;
-    PyObject *py_domlist;
-    virDomainStatsRecordPtr *records = NULL;
-    virDomainPtr *doms = NULL;
-    int nrecords;
-    int ndoms;
-    size_t i;
-    unsigned int flags;
-    unsigned int stats;
+    PyObject *pyobj_inv;
+    virPyInventoryPtr inv;
+    unsigned long long generation;
 
-    if (!PyArg_ParseTuple(args, (char *)"OOII:virDomainListGetStats",
-                          &pyobj_conn, &py_domlist, &stats, &flags))
+    if (!PyArg_ParseTuple(args, (char *) "O:virDomainInventoryGeneration",
+                          &pyobj_inv) ||
+        !(inv = libvirt_virPyInventoryGet(pyobj_inv)))
         return NULL;
 
-    if (PyList_Check(py_domlist)) {
-        ndoms = PyList_Size(py_domlist);
+    PyThread_acquire_lock(inv->lock, WAIT_LOCK);
+    generation = inv->generation;
+    PyThread_release_lock(inv->lock);
 
-        if (VIR_ALLOC_N(doms, ndoms + 1) < 0)
-            return PyErr_NoMemory();
+    return libvirt_ulonglongWrap(generation);
+}
 
-        for (i = 0; i < ndoms; i++)
-            doms[i] = PyvirDomain_Get(PyList_GetItem(py_domlist, i));
+/* Look an existing domain up by UUID string (@byName false) or name */
+static PyObject *
+libvirt_virDomainInventoryLookup(PyObject *self ATTRIBUTE_UNUSED,
+                                 PyObject *args)
+{
+    PyObject *pyobj_inv;
+    PyObject *ret;
+    virPyInventoryPtr inv;
+    virPyInventoryEntry *match;
+    virPyInventoryEntry entry;
+    const char *key;
+    int byName;
+
+    if (!PyArg_ParseTuple(args, (char *) "Ois:virDomainInventoryLookup",
+                          &pyobj_inv, &byName, &key) ||
+        !(inv = libvirt_virPyInventoryGet(pyobj_inv)))
+        return NULL;
+
+    PyThread_acquire_lock(inv->lock, WAIT_LOCK);
+    if (byName) {
+        if (virPyInventoryIndexNames(inv) < 0) {
+            PyThread_release_lock(inv->lock);
+            return PyErr_NoMemory();
+        }
+        match = virPyInventoryFindName(inv, key);
+    } else {
+        match = virPyInventoryFind(inv, key);
     }
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    nrecords = virDomainListGetStats(doms, stats, &records, flags);
-    LIBVIRT_END_ALLOW_THREADS;
-
-    if (nrecords < 0) {
-        py_retval = VIR_PY_NONE;
-        goto cleanup;
+    if (!match || match->removed) {
+        PyThread_release_lock(inv->lock);
+        return VIR_PY_NONE;
     }
 
-    if (!(py_retval = convertDomainStatsRecord(records, nrecords)))
-        py_retval = VIR_PY_NONE;
-
- cleanup:
-    virDomainStatsRecordListFree(records);
-    VIR_FREE(doms);
+    entry = *match;
+    if (!(entry.name = strdup(match->name))) {
+        PyThread_release_lock(inv->lock);
+        return PyErr_NoMemory();
+    }
+    PyThread_release_lock(inv->lock);
 
-    return py_retval;
+    ret = libvirt_virPyInventoryEntryWrap(&entry);
+    VIR_FREE(entry.name);
+    return ret;
 }
 
-
+/* Return (generation, [entries]) of the entries changed after the
+ * given generation */
 static PyObject *
-libvirt_virDomainBlockCopy(PyObject *self ATTRIBUTE_UNUSED, PyObject *args)
+libvirt_virDomainInventoryList(PyObject *self ATTRIBUTE_UNUSED,
+                               PyObject *args)
 {
-    PyObject *pyobj_dom = NULL;
-    PyObject *pyobj_dict = NULL;
-
-    virDomainPtr dom;
-    char *disk = NULL;
-    char *destxml = NULL;
-    virTypedParameterPtr params = NULL;
-    int nparams = 0;
-    unsigned int flags = 0;
+    PyObject *pyobj_inv;
+    PyObject *py_list = NULL;
+    PyObject *py_entry;
+    PyObject *ret = NULL;
+    virPyInventoryPtr inv;
+    virPyInventoryEntry *entries = NULL;
+    unsigned long long since;
+    unsigned long long generation;
+    size_t nentries = 0;
+    size_t i;
+    int removed;
     int c_retval;
 
-    if (!PyArg_ParseTuple(args, (char *) "Ozz|OI:virDomainBlockCopy",
-                          &pyobj_dom, &disk, &destxml, &pyobj_dict, &flags))
-        return VIR_PY_INT_FAIL;
+    if (!PyArg_ParseTuple(args, (char *) "OKi:virDomainInventoryList",
+                          &pyobj_inv, &since, &removed) ||
+        !(inv = libvirt_virPyInventoryGet(pyobj_inv)))
+        return NULL;
 
-    if (PyDict_Check(pyobj_dict)) {
-        if (virPyDictToTypedParams(pyobj_dict, &params, &nparams, NULL, 0) < 0)
-            return VIR_PY_INT_FAIL;
+    PyThread_acquire_lock(inv->lock, WAIT_LOCK);
+    if (since && since < inv->pruned) {
+        generation = inv->pruned;
+        PyThread_release_lock(inv->lock);
+        PyErr_Format(PyExc_ValueError,
+                     "removals up to generation %llu are forgotten",
+                     generation);
+        return NULL;
     }
+    c_retval = virPyInventoryCopy(inv, since, !!removed,
+                                  &entries, &nentries, &generation);
+    PyThread_release_lock(inv->lock);
 
-    dom = (virDomainPtr) PyvirDomain_Get(pyobj_dom);
+    if (c_retval < 0)
+        return PyErr_NoMemory();
 
-    LIBVIRT_BEGIN_ALLOW_THREADS;
-    c_retval = virDomainBlockCopy(dom, disk, destxml, params, nparams, flags);
-    LIBVIRT_END_ALLOW_THREADS;
+    if (!(py_list = PyList_New(nentries)))
+        goto cleanup;
 
-    return libvirt_intWrap(c_retval);
+    for (i = 0; i < nentries; i++) {
+        if (!(py_entry = libvirt_virPyInventoryEntryWrap(&entries[i])))
+            goto cleanup;
+        PyList_SET_ITEM(py_list, i, py_entry);
+    }
+
+    ret = Py_BuildValue((char *) "(KO)", generation, py_list);
+
+ cleanup:
+    Py_XDECREF(py_list);
+    for (i = 0; i < nentries; i++)
+        VIR_FREE(entries[i].name);
+    VIR_FREE(entries);
+    return ret;
 }
 
 #endif /* LIBVIR_CHECK_VERSION(1, 2, 8) */
@@ -8794,6 +15257,10 @@ libvirt_virDomainGetFSInfo(PyObject *self ATTRIBUTE_UNUSED, PyObject *args) {
 
 #endif /* LIBVIR_CHECK_VERSION(1, 2, 11) */
 
+static PyObject *libvirt_virPyCallStatsEnable(PyObject *self, PyObject *args);
+static PyObject *libvirt_virPyCallStatsGet(PyObject *self, PyObject *args);
+static PyObject *libvirt_virPyCallStatsSetTrace(PyObject *self, PyObject *args);
+
 /************************************************************************
  *									*
  *			The registration stuff				*
@@ -8812,11 +15279,16 @@ static PyMethodDef libvirtMethods[] = {
     {(char *) "virConnectListDefinedDomains", libvirt_virConnectListDefinedDomains, METH_VARARGS, NULL},
 #if LIBVIR_CHECK_VERSION(0, 9, 13)
     {(char *) "virConnectListAllDomains", libvirt_virConnectListAllDomains, METH_VARARGS, NULL},
+    {(char *) "virObjectListLength", libvirt_virObjectListLength, METH_VARARGS, NULL},
+    {(char *) "virObjectListItem", libvirt_virObjectListItem, METH_VARARGS, NULL},
+    {(char *) "virObjectListNames", libvirt_virObjectListNames, METH_VARARGS, NULL},
+    {(char *) "virObjectListUUIDs", libvirt_virObjectListUUIDs, METH_VARARGS, NULL},
 #endif /* LIBVIR_CHECK_VERSION(0, 9, 13) */
     {(char *) "virConnectDomainEventRegister", libvirt_virConnectDomainEventRegister, METH_VARARGS, NULL},
     {(char *) "virConnectDomainEventDeregister", libvirt_virConnectDomainEventDeregister, METH_VARARGS, NULL},
     {(char *) "virConnectDomainEventRegisterAny", libvirt_virConnectDomainEventRegisterAny, METH_VARARGS, NULL},
     {(char *) "virConnectDomainEventDeregisterAny", libvirt_virConnectDomainEventDeregisterAny, METH_VARARGS, NULL},
+    {(char *) "virConnectDomainEventRegisterBatch", libvirt_virConnectDomainEventRegisterBatch, METH_VARARGS, NULL},
 #if LIBVIR_CHECK_VERSION(1, 2, 1)
     {(char *) "virConnectNetworkEventRegisterAny", libvirt_virConnectNetworkEventRegisterAny, METH_VARARGS, NULL},
     {(char *) "virConnectNetworkEventDeregisterAny", libvirt_virConnectNetworkEventDeregisterAny, METH_VARARGS, NULL},
@@ -8827,9 +15299,20 @@ static PyMethodDef libvirtMethods[] = {
 #endif /* LIBVIR_CHECK_VERSION(0, 10, 0) */
     {(char *) "virStreamEventAddCallback", libvirt_virStreamEventAddCallback, METH_VARARGS, NULL},
     {(char *) "virStreamRecv", libvirt_virStreamRecv, METH_VARARGS, NULL},
+#ifdef LIBVIRT_HAVE_PY_BUFFER
+    {(char *) "virStreamRecvInto", libvirt_virStreamRecvInto, METH_VARARGS, NULL},
+#endif /* LIBVIRT_HAVE_PY_BUFFER */
+    {(char *) "virStreamRecvToFD", libvirt_virStreamRecvToFD, METH_VARARGS, NULL},
+    {(char *) "virStreamSendFromFD", libvirt_virStreamSendFromFD, METH_VARARGS, NULL},
+    {(char *) "virConsoleMuxNew", libvirt_virConsoleMuxNew, METH_VARARGS, NULL},
+    {(char *) "virConsoleMuxAttach", libvirt_virConsoleMuxAttach, METH_VARARGS, NULL},
+    {(char *) "virConsoleMuxDetach", libvirt_virConsoleMuxDetach, METH_VARARGS, NULL},
+    {(char *) "virConsoleMuxClose", libvirt_virConsoleMuxClose, METH_VARARGS, NULL},
+    {(char *) "virConsoleMuxRead", libvirt_virConsoleMuxRead, METH_VARARGS, NULL},
+    {(char *) "virConsoleMuxInfo", libvirt_virConsoleMuxInfo, METH_VARARGS, NULL},
     {(char *) "virStreamSend", libvirt_virStreamSend, METH_VARARGS, NULL},
     {(char *) "virDomainGetInfo", libvirt_virDomainGetInfo, METH_VARARGS, NULL},
-    {(char *) "virDomainGetState", libvirt_virDomainGetState, METH_VARARGS, NULL},
+    {(char *) "virDomainGetState", (PyCFunction) libvirt_virDomainGetState, LIBVIRT_FASTCALL_FLAGS, NULL},
     {(char *) "virDomainGetControlInfo", libvirt_virDomainGetControlInfo, METH_VARARGS, NULL},
     {(char *) "virDomainGetBlockInfo", libvirt_virDomainGetBlockInfo, METH_VARARGS, NULL},
     {(char *) "virNodeGetInfo", libvirt_virNodeGetInfo, METH_VARARGS, NULL},
@@ -8846,6 +15329,10 @@ static PyMethodDef libvirtMethods[] = {
     {(char *) "virRegisterErrorHandler", libvirt_virRegisterErrorHandler, METH_VARARGS, NULL},
     {(char *) "virGetLastError", libvirt_virGetLastError, METH_VARARGS, NULL},
     {(char *) "virConnGetLastError", libvirt_virConnGetLastError, METH_VARARGS, NULL},
+    {(char *) "virErrorCapture", libvirt_virErrorCapture, METH_VARARGS, NULL},
+    {(char *) "virErrorGetField", libvirt_virErrorGetField, METH_VARARGS, NULL},
+    {(char *) "virErrorGetFields", libvirt_virErrorGetFields, METH_VARARGS, NULL},
+    {(char *) "virErrorLastCode", libvirt_virErrorLastCode, METH_VARARGS, NULL},
     {(char *) "virConnectListNetworks", libvirt_virConnectListNetworks, METH_VARARGS, NULL},
     {(char *) "virConnectListDefinedNetworks", libvirt_virConnectListDefinedNetworks, METH_VARARGS, NULL},
 #if LIBVIR_CHECK_VERSION(0, 10, 2)
@@ -8903,6 +15390,10 @@ static PyMethodDef libvirtMethods[] = {
     {(char *) "virStoragePoolGetUUIDString", libvirt_virStoragePoolGetUUIDString, METH_VARARGS, NULL},
     {(char *) "virStoragePoolLookupByUUID", libvirt_virStoragePoolLookupByUUID, METH_VARARGS, NULL},
     {(char *) "virEventRegisterImpl", libvirt_virEventRegisterImpl, METH_VARARGS, NULL},
+    {(char *) "virEventRegisterAsyncioImpl", libvirt_virEventRegisterAsyncioImpl, METH_VARARGS, NULL},
+    {(char *) "virAioSubmit", libvirt_virAioSubmit, METH_VARARGS, NULL},
+    {(char *) "virAioBatch", libvirt_virAioBatch, METH_VARARGS, NULL},
+    {(char *) "virAioSetMaxWorkers", libvirt_virAioSetMaxWorkers, METH_VARARGS, NULL},
     {(char *) "virEventAddHandle", libvirt_virEventAddHandle, METH_VARARGS, NULL},
     {(char *) "virEventAddTimeout", libvirt_virEventAddTimeout, METH_VARARGS, NULL},
     {(char *) "virEventInvokeHandleCallback", libvirt_virEventInvokeHandleCallback, METH_VARARGS, NULL},
@@ -8938,6 +15429,12 @@ static PyMethodDef libvirtMethods[] = {
 #if LIBVIR_CHECK_VERSION(1, 0, 3)
     {(char *) "virDomainGetJobStats", libvirt_virDomainGetJobStats, METH_VARARGS, NULL},
 #endif /* LIBVIR_CHECK_VERSION(1, 0, 3) */
+#if LIBVIR_CHECK_VERSION(1, 2, 9)
+    {(char *) "virDomainJobMonitorNew", libvirt_virDomainJobMonitorNew, METH_VARARGS, NULL},
+    {(char *) "virDomainJobMonitorStop", libvirt_virDomainJobMonitorStop, METH_VARARGS, NULL},
+    {(char *) "virDomainJobMonitorFinish", libvirt_virDomainJobMonitorFinish, METH_VARARGS, NULL},
+    {(char *) "virDomainJobMonitorProgress", libvirt_virDomainJobMonitorProgress, METH_VARARGS, NULL},
+#endif /* LIBVIR_CHECK_VERSION(1, 2, 9) */
     {(char *) "virDomainSnapshotListNames", libvirt_virDomainSnapshotListNames, METH_VARARGS, NULL},
 #if LIBVIR_CHECK_VERSION(0, 9, 13)
     {(char *) "virDomainListAllSnapshots", libvirt_virDomainListAllSnapshots, METH_VARARGS, NULL},
@@ -8961,6 +15458,12 @@ static PyMethodDef libvirtMethods[] = {
 #endif /* LIBVIR_CHECK_VERSION(1, 1, 0) */
     {(char *) "virDomainBlockPeek", libvirt_virDomainBlockPeek, METH_VARARGS, NULL},
     {(char *) "virDomainMemoryPeek", libvirt_virDomainMemoryPeek, METH_VARARGS, NULL},
+#ifdef LIBVIRT_HAVE_PY_BUFFER
+    {(char *) "virDomainBlockPeekInto", libvirt_virDomainBlockPeekInto, METH_VARARGS, NULL},
+    {(char *) "virDomainMemoryPeekInto", libvirt_virDomainMemoryPeekInto, METH_VARARGS, NULL},
+    {(char *) "virDomainBlockPeekRangesInto", libvirt_virDomainBlockPeekRangesInto, METH_VARARGS, NULL},
+    {(char *) "virDomainMemoryPeekRangesInto", libvirt_virDomainMemoryPeekRangesInto, METH_VARARGS, NULL},
+#endif /* LIBVIRT_HAVE_PY_BUFFER */
     {(char *) "virDomainGetDiskErrors", libvirt_virDomainGetDiskErrors, METH_VARARGS, NULL},
 #if LIBVIR_CHECK_VERSION(0, 10, 2)
     {(char *) "virNodeGetMemoryParameters", libvirt_virNodeGetMemoryParameters, METH_VARARGS, NULL},
@@ -8982,11 +15485,26 @@ static PyMethodDef libvirtMethods[] = {
 #if LIBVIR_CHECK_VERSION(1, 2, 6)
     {(char *) "virNodeGetFreePages", libvirt_virNodeGetFreePages, METH_VARARGS, NULL},
     {(char *) "virNetworkGetDHCPLeases", libvirt_virNetworkGetDHCPLeases, METH_VARARGS, NULL},
+    {(char *) "virNetworkLeaseCacheNew", libvirt_virNetworkLeaseCacheNew, METH_VARARGS, NULL},
+    {(char *) "virNetworkLeaseCacheRefresh", libvirt_virNetworkLeaseCacheRefresh, METH_VARARGS, NULL},
+    {(char *) "virNetworkLeaseCacheInvalidate", libvirt_virNetworkLeaseCacheInvalidate, METH_VARARGS, NULL},
+    {(char *) "virNetworkLeaseCacheLookup", libvirt_virNetworkLeaseCacheLookup, METH_VARARGS, NULL},
+    {(char *) "virNetworkLeaseCacheList", libvirt_virNetworkLeaseCacheList, METH_VARARGS, NULL},
 #endif /* LIBVIR_CHECK_VERSION(1, 2, 6) */
 #if LIBVIR_CHECK_VERSION(1, 2, 8)
     {(char *) "virConnectGetAllDomainStats", libvirt_virConnectGetAllDomainStats, METH_VARARGS, NULL},
+    {(char *) "virConnectGetAllDomainStatsColumns", libvirt_virConnectGetAllDomainStatsColumns, METH_VARARGS, NULL},
     {(char *) "virDomainListGetStats", libvirt_virDomainListGetStats, METH_VARARGS, NULL},
+    {(char *) "virDomainStatsSamplerNew", libvirt_virDomainStatsSamplerNew, METH_NOARGS, NULL},
+    {(char *) "virDomainStatsSamplerSample", libvirt_virDomainStatsSamplerSample, METH_VARARGS, NULL},
+    {(char *) "virConnectCollectStats", libvirt_virConnectCollectStats, METH_VARARGS, NULL},
     {(char *) "virDomainBlockCopy", libvirt_virDomainBlockCopy, METH_VARARGS, NULL},
+    {(char *) "virDomainInventoryNew", libvirt_virDomainInventoryNew, METH_VARARGS, NULL},
+    {(char *) "virDomainInventoryResync", libvirt_virDomainInventoryResync, METH_VARARGS, NULL},
+    {(char *) "virDomainInventoryClose", libvirt_virDomainInventoryClose, METH_VARARGS, NULL},
+    {(char *) "virDomainInventoryGeneration", libvirt_virDomainInventoryGeneration, METH_VARARGS, NULL},
+    {(char *) "virDomainInventoryLookup", libvirt_virDomainInventoryLookup, METH_VARARGS, NULL},
+    {(char *) "virDomainInventoryList", libvirt_virDomainInventoryList, METH_VARARGS, NULL},
 #endif /* LIBVIR_CHECK_VERSION(1, 2, 8) */
 #if LIBVIR_CHECK_VERSION(1, 2, 9)
     {(char *) "virNodeAllocPages", libvirt_virNodeAllocPages, METH_VARARGS, NULL},
@@ -8997,10 +15515,317 @@ static PyMethodDef libvirtMethods[] = {
 #if LIBVIR_CHECK_VERSION(1, 2, 14)
     {(char *) "virDomainInterfaceAddresses", libvirt_virDomainInterfaceAddresses, METH_VARARGS, NULL},
 #endif /* LIBVIR_CHECK_VERSION(1, 2, 14) */
+    {(char *) "virPyCallStatsEnable", libvirt_virPyCallStatsEnable, METH_VARARGS, NULL},
+    {(char *) "virPyCallStatsGet", libvirt_virPyCallStatsGet, METH_VARARGS, NULL},
+    {(char *) "virPyCallStatsSetTrace", libvirt_virPyCallStatsSetTrace, METH_VARARGS, NULL},
     {NULL, NULL, 0, NULL}
 };
 
+/*
+ * Per-API call statistics
+ *
+ * Enabling them replaces every function of the module by a trampoline
+ * calling the original one, so that there is no cost besides testing
+ * libvirt_callStatsActive while they are disabled.  The time a call
+ * spent in libvirt is what its LIBVIRT_BEGIN/END_ALLOW_THREADS
+ * sections add to its virPyCall, the rest of the call is spent parsing
+ * the arguments and converting the result.
+ */
+typedef struct {
+    PyMethodDef def;            /* trampoline */
+    PyMethodDef *orig;
+    PyObject *origfunc;
+    PyObject *func;
+    unsigned long long calls;
+    double native;
+    double nativeMax;
+    double convert;
+} virPyCallStatsEntry;
+typedef virPyCallStatsEntry *virPyCallStatsEntryPtr;
+
+#define VIR_PY_CALL_STATS_ENTRY "virPyCallStatsEntry"
+
+static PyObject *libvirtmod_module;
+static virPyCallStatsEntryPtr libvirt_callStatsEntries;
+static size_t libvirt_callStatsNEntries;
+static PyObject *libvirt_callStatsTrace;
+static bool libvirt_callStatsInTrace;
+
+/* Calls the original function with either @args or @fastargs and
+ * @nargs, depending on its convention */
+static PyObject *
+libvirt_virPyCallStatsRun(PyObject *self,
+                          PyObject *args,
+                          PyObject *const *fastargs,
+                          Py_ssize_t nargs)
+{
+    virPyCallStatsEntryPtr entry;
+    virPyCall call;
+    virPyCallPtr *prev;
+    PyObject *ret;
+    PyObject *result;
+    PyObject *exc_type, *exc_value, *exc_tb;
+    double start;
+    double elapsed;
+
+#ifdef Py_CAPSULE_H
+    entry = PyCapsule_GetPointer(self, VIR_PY_CALL_STATS_ENTRY);
+#else
+    entry = PyCObject_AsVoidPtr(self);
+#endif
+
+    call.tstate = PyThreadState_GET();
+    call.native = 0;
+    call.next = libvirt_callStatsActive;
+    libvirt_callStatsActive = &call;
+
+    start = virTimeSecondsNow();
+#if LIBVIRT_HAVE_FASTCALL
+    if (entry->orig->ml_flags & METH_FASTCALL)
+        ret = ((_PyCFunctionFast) (void (*)(void)) entry->orig->ml_meth)
+            (PyCFunction_GET_SELF(entry->origfunc), fastargs, nargs);
+    else
+#endif
+        ret = entry->orig->ml_meth(PyCFunction_GET_SELF(entry->origfunc), args);
+    elapsed = virTimeSecondsNow() - start;
+
+    /* Other threads may have linked their calls in front of ours */
+    for (prev = &libvirt_callStatsActive; *prev != &call; prev = &(*prev)->next)
+        ;
+    *prev = call.next;
+
+    entry->calls++;
+    entry->native += call.native;
+    if (call.native > entry->nativeMax)
+        entry->nativeMax = call.native;
+    entry->convert += elapsed - call.native;
+
+    /* Calls made by the trace callback itself are not traced */
+    if (libvirt_callStatsTrace && !libvirt_callStatsInTrace) {
+        libvirt_callStatsInTrace = true;
+        PyErr_Fetch(&exc_type, &exc_value, &exc_tb);
+        result = PyObject_CallFunction(libvirt_callStatsTrace,
+                                       (char *) "sdd",
+                                       entry->orig->ml_name,
+                                       call.native,
+                                       elapsed - call.native);
+        if (!result) {
+            PyErr_Print();
+            PyErr_Clear();
+        }
+        Py_XDECREF(result);
+        PyErr_Restore(exc_type, exc_value, exc_tb);
+        libvirt_callStatsInTrace = false;
+    }
+
+    return ret;
+}
+
+static PyObject *
+libvirt_virPyCallStatsTrampoline(PyObject *self,
+                                 PyObject *args)
+{
+    return libvirt_virPyCallStatsRun(self, args, NULL, 0);
+}
+
+#if LIBVIRT_HAVE_FASTCALL
+static PyObject *
+libvirt_virPyCallStatsFastTrampoline(PyObject *self,
+                                     PyObject *const *args,
+                                     Py_ssize_t nargs)
+{
+    return libvirt_virPyCallStatsRun(self, NULL, args, nargs);
+}
+#endif
+
+static int
+libvirt_virPyCallStatsInit(void)
+{
+    virPyCallStatsEntryPtr entries;
+    PyObject *capsule;
+    size_t nentries = 0;
+    size_t i;
+
+    while (libvirtMethods[nentries].ml_name)
+        nentries++;
+
+    if (VIR_ALLOC_N(entries, nentries) < 0) {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    for (i = 0; i < nentries; i++) {
+        entries[i].orig = &libvirtMethods[i];
+        entries[i].def = libvirtMethods[i];
+#if LIBVIRT_HAVE_FASTCALL
+        if (entries[i].def.ml_flags & METH_FASTCALL)
+            entries[i].def.ml_meth =
+                (PyCFunction) (void (*)(void)) libvirt_virPyCallStatsFastTrampoline;
+        else
+#endif
+            entries[i].def.ml_meth = libvirt_virPyCallStatsTrampoline;
+
+        if (!(entries[i].origfunc = PyObject_GetAttrString(libvirtmod_module,
+                                                           entries[i].def.ml_name)))
+            goto error;
+
+#ifdef Py_CAPSULE_H
+        capsule = PyCapsule_New(&entries[i], VIR_PY_CALL_STATS_ENTRY, NULL);
+#else
+        capsule = PyCObject_FromVoidPtr(&entries[i], NULL);
+#endif
+        if (!capsule)
+            goto error;
+        entries[i].func = PyCFunction_New(&entries[i].def, capsule);
+        Py_DECREF(capsule);
+        if (!entries[i].func)
+            goto error;
+    }
+
+    libvirt_callStatsEntries = entries;
+    libvirt_callStatsNEntries = nentries;
+    return 0;
+
+ error:
+    for (i = 0; i < nentries; i++) {
+        Py_XDECREF(entries[i].origfunc);
+        Py_XDECREF(entries[i].func);
+    }
+    VIR_FREE(entries);
+    return -1;
+}
+
+static PyObject *
+libvirt_virPyCallStatsEnable(PyObject *self ATTRIBUTE_UNUSED,
+                             PyObject *args)
+{
+    PyObject *func;
+    int enable;
+    size_t i;
+
+    if (!PyArg_ParseTuple(args, (char *)"i:virPyCallStatsEnable", &enable))
+        return NULL;
+
+    if (!libvirt_callStatsEntries && libvirt_virPyCallStatsInit() < 0)
+        return NULL;
+
+    for (i = 0; i < libvirt_callStatsNEntries; i++) {
+        /* These ones stay out of the statistics they manage */
+        if (strncmp(libvirt_callStatsEntries[i].def.ml_name,
+                    "virPyCallStats", 14) == 0)
+            continue;
+
+        if (enable)
+            func = libvirt_callStatsEntries[i].func;
+        else
+            func = libvirt_callStatsEntries[i].origfunc;
+        if (PyObject_SetAttrString(libvirtmod_module,
+                                   libvirt_callStatsEntries[i].def.ml_name,
+                                   func) < 0)
+            return NULL;
+    }
+
+    return VIR_PY_NONE;
+}
+
+static PyObject *
+libvirt_virPyCallStatsGet(PyObject *self ATTRIBUTE_UNUSED,
+                          PyObject *args)
+{
+    PyObject *py_retval;
+    PyObject *info;
+    virPyCallStatsEntryPtr entry;
+    int reset = 0;
+    size_t i;
+
+    if (!PyArg_ParseTuple(args, (char *)"|i:virPyCallStatsGet", &reset))
+        return NULL;
+
+    if (!(py_retval = PyDict_New()))
+        return NULL;
+
+    for (i = 0; i < libvirt_callStatsNEntries; i++) {
+        entry = &libvirt_callStatsEntries[i];
+        if (!entry->calls)
+            continue;
+
+        if (!(info = Py_BuildValue((char *) "(Kddd)",
+                                   entry->calls, entry->native,
+                                   entry->nativeMax, entry->convert)))
+            goto error;
+        if (PyDict_SetItemString(py_retval, entry->def.ml_name, info) < 0) {
+            Py_DECREF(info);
+            goto error;
+        }
+        Py_DECREF(info);
+
+        if (reset) {
+            entry->calls = 0;
+            entry->native = 0;
+            entry->nativeMax = 0;
+            entry->convert = 0;
+        }
+    }
+
+    return py_retval;
+
+ error:
+    Py_DECREF(py_retval);
+    return NULL;
+}
+
+static PyObject *
+libvirt_virPyCallStatsSetTrace(PyObject *self ATTRIBUTE_UNUSED,
+                               PyObject *args)
+{
+    PyObject *pyobj_cb;
+
+    if (!PyArg_ParseTuple(args, (char *)"O:virPyCallStatsSetTrace", &pyobj_cb))
+        return NULL;
+
+    if (pyobj_cb != Py_None && !PyCallable_Check(pyobj_cb)) {
+        PyErr_SetString(PyExc_TypeError, "trace callback must be callable");
+        return NULL;
+    }
+
+    Py_XDECREF(libvirt_callStatsTrace);
+    libvirt_callStatsTrace = NULL;
+    if (pyobj_cb != Py_None) {
+        Py_INCREF(pyobj_cb);
+        libvirt_callStatsTrace = pyobj_cb;
+    }
+
+    return VIR_PY_NONE;
+}
+
 #if PY_MAJOR_VERSION > 2
+# if LIBVIRT_HAVE_MULTIPHASE_INIT
+static PyInterpreterState *libvirtmod_interpreter;
+
+static int
+libvirtModuleExec(PyObject *module)
+{
+    if (virInitialize() < 0) {
+        PyErr_SetString(PyExc_RuntimeError, "cannot initialize libvirt");
+        return -1;
+    }
+
+    if (libvirt_moduleClaimInterpreter(&libvirtmod_interpreter,
+                                       "libvirtmod") < 0)
+        return -1;
+
+    libvirtmod_module = module;
+
+    return 0;
+}
+
+static PyModuleDef_Slot libvirtModuleSlots[] = {
+    {Py_mod_exec, libvirtModuleExec},
+    LIBVIRT_MODULE_SLOTS
+    {0, NULL}
+};
+# endif /* LIBVIRT_HAVE_MULTIPHASE_INIT */
+
 static struct PyModuleDef moduledef = {
         PyModuleDef_HEAD_INIT,
 # ifndef __CYGWIN__
@@ -9009,9 +15834,17 @@ static struct PyModuleDef moduledef = {
         "cygvirtmod",
 # endif
         NULL,
+# if LIBVIRT_HAVE_MULTIPHASE_INIT
+        0,
+# else
         -1,
+# endif
         libvirtMethods,
+# if LIBVIRT_HAVE_MULTIPHASE_INIT
+        libvirtModuleSlots,
+# else
         NULL,
+# endif
         NULL,
         NULL,
         NULL
@@ -9025,14 +15858,19 @@ PyInit_cygvirtmod
 # endif
   (void)
 {
+# if LIBVIRT_HAVE_MULTIPHASE_INIT
+    return PyModuleDef_Init(&moduledef);
+# else
     PyObject *module;
 
     if (virInitialize() < 0)
         return NULL;
 
     module = PyModule_Create(&moduledef);
+    libvirtmod_module = module;
 
     return module;
+# endif
 }
 #else /* ! PY_MAJOR_VERSION > 2 */
 void
@@ -9047,7 +15885,7 @@ initcygvirtmod
         return;
 
     /* initialize the python extension module */
-    Py_InitModule((char *)
+    libvirtmod_module = Py_InitModule((char *)
 # ifndef __CYGWIN__
                   "libvirtmod",
 # else
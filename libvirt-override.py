@@ -17,6 +17,10 @@ except ImportError:
             raise lib_e
 
 import types
+import array
+import weakref
+import threading
+import time
 
 # The root of all libvirt errors.
 class libvirtError(Exception):
@@ -24,60 +28,101 @@ class libvirtError(Exception):
 
         # Never call virConnGetLastError().
         # virGetLastError() is now thread local
-        err = libvirtmod.virGetLastError()
+        #
+        # Only the message is converted right away, the other fields
+        # are read from the copy of the error when asked for.
+        err = libvirtmod.virErrorCapture()
         if err is None:
+            self._err = None
             msg = defmsg
         else:
-            msg = err[2]
+            (self._err, msg) = err
+        self._errinfo = None
 
         Exception.__init__(self, msg)
 
-        self.err = err
+    def _get_err(self):
+        if self._errinfo is None and self._err is not None:
+            self._errinfo = libvirtmod.virErrorGetFields(self._err)
+        return self._errinfo
 
-    def get_error_code(self):
-        if self.err is None:
+    def _set_err(self, err):
+        self._err = None
+        self._errinfo = err
+
+    err = property(_get_err, _set_err)
+
+    def _get_field(self, field):
+        if self._errinfo is not None:
+            return self._errinfo[field]
+        if self._err is None:
             return None
-        return self.err[0]
+        return libvirtmod.virErrorGetField(self._err, field)
+
+    def __reduce__(self):
+        # The copy of the error can't be pickled, its fields can
+        state = dict(self.__dict__)
+        state["_err"] = None
+        state["_errinfo"] = self.err
+        return (Exception.__new__, (type(self),) + self.args, state)
+
+    def get_error_code(self):
+        return self._get_field(0)
 
     def get_error_domain(self):
-        if self.err is None:
-            return None
-        return self.err[1]
+        return self._get_field(1)
 
     def get_error_message(self):
-        if self.err is None:
-            return None
-        return self.err[2]
+        return self._get_field(2)
 
     def get_error_level(self):
-        if self.err is None:
-            return None
-        return self.err[3]
+        return self._get_field(3)
 
     def get_str1(self):
-        if self.err is None:
-            return None
-        return self.err[4]
+        return self._get_field(4)
 
     def get_str2(self):
-        if self.err is None:
-            return None
-        return self.err[5]
+        return self._get_field(5)
 
     def get_str3(self):
-        if self.err is None:
-            return None
-        return self.err[6]
+        return self._get_field(6)
 
     def get_int1(self):
-        if self.err is None:
-            return None
-        return self.err[7]
+        return self._get_field(7)
 
     def get_int2(self):
-        if self.err is None:
+        return self._get_field(8)
+
+# Called by the lookup*OrNone methods when @func found nothing: raises
+# libvirtError unless the object was just missing, that is the last
+# error is @code, without creating any exception in that case.
+def _virLookupMiss(func, code, conn=None):
+    if libvirtmod.virErrorLastCode() != code:
+        raise libvirtError("%s() failed" % func, conn=conn)
+
+# The chunks virStream.sendAll slices as they are when partly sent
+if sys.version_info[0] > 2:
+    _virStringTypes = (bytes, str)
+else:
+    _virStringTypes = (str, unicode)
+
+# Returns a memoryview of the buffer exported by @obj as flat bytes,
+# which the stream methods count in, or None where there is no such
+# view: @obj has no new style buffer, memoryview is missing (python
+# 2.6) or can't cast the buffer to bytes (python 2.7)
+def _virByteView(obj):
+    try:
+        view = memoryview(obj)
+    except (NameError, TypeError):
+        return None
+    if view.ndim != 1 or view.itemsize != 1:
+        if not hasattr(view, "cast"):
+            return None
+        try:
+            view = view.cast("B")
+        except TypeError:
             return None
-        return self.err[8]
+    return view
 
 #
 # register the libvirt global error handler
@@ -211,3 +256,1038 @@ def virEventAddTimeout(timeout, cb, opaque):
     ret = libvirtmod.virEventAddTimeout(timeout, cbData)
     if ret == -1: raise libvirtError ('virEventAddTimeout() failed')
     return ret
+
+def virEventRegisterAsyncioImpl(loop=None):
+    """
+    register an event implementation running on an asyncio event loop
+
+    @loop: the asyncio event loop to use, the current one if None
+
+    File handles are watched with the loop's add_reader()/add_writer()
+    and timers are scheduled with call_later(), while the handle and
+    timer bookkeeping is done by the C module, so python code only
+    runs when a file handle is ready or a timer expires.  This must
+    be called before opening any connection, only one loop can be
+    registered, and events are only dispatched while it runs.
+
+    Returns the loop in use.
+    """
+    if loop is None:
+        import asyncio
+        loop = asyncio.get_event_loop()
+    ret = libvirtmod.virEventRegisterAsyncioImpl(loop)
+    if ret == -1: raise libvirtError ('virEventRegisterAsyncioImpl() failed')
+    return loop
+
+def aioCall(func, *args, **kwargs):
+    """
+    run a blocking call on the libvirt worker pool
+
+    @func: the callable to run, typically a bound method such as
+           dom.migrate3 or conn.listAllDomains
+    @args, @kwargs: the arguments to call it with
+
+    The call runs on a native worker thread, which only holds the
+    interpreter lock while converting the arguments and the result.
+    Returns an asyncio future of the current event loop, resolved
+    with the result of the call or the exception it raised.
+    """
+    import asyncio
+    loop = asyncio.get_event_loop()
+    future = loop.create_future()
+    libvirtmod.virAioSubmit(loop, future, func, args, kwargs or None)
+    return future
+
+def aioSetMaxWorkers(count):
+    """
+    set the maximum number of threads of the aioCall() worker pool,
+    calls wait for a free worker once that many are running
+    """
+    libvirtmod.virAioSetMaxWorkers(count)
+
+class _virAioProxy(object):
+    def __init__(self, obj):
+        self._obj = obj
+
+    def __getattr__(self, name):
+        func = getattr(self._obj, name)
+        if not callable(func):
+            raise AttributeError(name)
+
+        def call(*args, **kwargs):
+            return aioCall(func, *args, **kwargs)
+        return call
+
+def aio(obj):
+    """
+    return a view of the libvirt object @obj whose methods return
+    asyncio futures, running the calls on the aioCall() worker pool:
+
+        info = await libvirt.aio(dom).info()
+        job = await libvirt.aio(dom).jobStats()
+    """
+    return _virAioProxy(obj)
+
+class _virBatch(object):
+    def __init__(self, conn):
+        self._conn = conn
+        self._calls = []
+        self.results = None
+
+    def call(self, func, *args, **kwargs):
+        """
+        queue a call of @func with @args and @kwargs, and return its
+        index in the list of results
+        """
+        self._calls.append((func, args, kwargs or None))
+        return len(self._calls) - 1
+
+    def __call__(self, obj):
+        return _virBatchProxy(self, obj)
+
+    def run(self):
+        """
+        issue all the queued calls at once on the aioCall() worker pool
+        and wait for them to complete.  Returns a list of (ok, value)
+        tuples in the order the calls were queued: ok is True and value
+        the result of the calls which succeeded, ok is False and value
+        the exception raised by the calls which failed, so that a call
+        returning an exception instance is never taken for a failure
+        """
+        calls = self._calls
+        self._calls = []
+        ret = []
+        for (failed, result) in libvirtmod.virAioBatch(calls):
+            ret.append((not failed, result))
+        return ret
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, type, value, traceback):
+        if type is None:
+            self.results = self.run()
+        else:
+            self._calls = []
+
+class _virBatchProxy(object):
+    def __init__(self, batch, obj):
+        self._batch = batch
+        self._obj = obj
+
+    def __getattr__(self, name):
+        func = getattr(self._obj, name)
+        if not callable(func):
+            raise AttributeError(name)
+
+        def call(*args, **kwargs):
+            return self._batch.call(func, *args, **kwargs)
+        return call
+
+
+class DomainStatsSampler(object):
+    """
+    Computes per-second rates of the cumulative domain statistics
+    counters, such as cpu.time, vcpu.N.time, block.N.rd.bytes or
+    net.N.tx.pkts, between successive queries.
+
+    @conn: the virConnect to query
+    @stats, @flags: as for virConnect.getAllDomainStats
+    @doms: a list of virDomain to query with domainListGetStats
+           instead of all the domains of @conn
+
+    Only the known cumulative fields get a rate: gauges such as
+    balloon.current or cpu.cache.monitor.N.bytes are left out even
+    where their names look like those of counters.
+
+    The counters of the previous sample are kept by the C module, so
+    no python copy of them is needed.  Domains are matched up by UUID
+    and a counter going backwards is taken as a reset, so it gets no
+    rate for that sample.
+    """
+    def __init__(self, conn, stats=0, flags=0, doms=None):
+        self._conn = conn
+        self._stats = stats
+        self._flags = flags
+        self._doms = doms
+        self._o = libvirtmod.virDomainStatsSamplerNew()
+        self.interval = 0.0
+
+    def sample(self):
+        """
+        Query the statistics and return a list of (dom, rates) tuples,
+        rates mapping every counter field to its per-second rate since
+        the previous sample.  It is empty for the first sample, and for
+        domains that were not part of the previous one.  The interval
+        between the two samples, in seconds, is stored in self.interval.
+        """
+        if self._doms is None:
+            domlist = None
+        else:
+            domlist = [dom._o for dom in self._doms]
+        ret = libvirtmod.virDomainStatsSamplerSample(self._o, self._conn._o,
+                                                     domlist, self._stats,
+                                                     self._flags)
+        if ret is None:
+            raise libvirtError("virDomainStatsSamplerSample() failed", conn=self._conn)
+
+        (self.interval, records) = ret
+        return [(self._conn._wrapDomain(dom), rates) for (dom, rates) in records]
+
+def collectStats(conns, stats=0, flags=0, max_parallel=16, timeout_ms=-1):
+    """
+    Query statistics for all domains of many connections at once
+
+    @conns: the list of virConnect to query
+    @stats, @flags: as for virConnect.getAllDomainStats
+    @max_parallel: how many connections to query at the same time
+    @timeout_ms: how long to wait for each connection, -1 for ever
+
+    The queries run on native threads without the interpreter lock,
+    which is only taken to convert the results once they are all in.
+    Returns a list with an entry per connection, in the same order:
+    the list of (dom, stats) tuples getAllDomainStats would return, or
+    the libvirtError instance describing why it failed or timed out.
+    The error of a connection that timed out has the code
+    VIR_ERR_OPERATION_TIMEOUT; it keeps being queried in the background
+    and its result is discarded.  If no worker thread can be started
+    to replace the ones left behind, the connections not queried yet
+    fail with VIR_ERR_OPERATION_FAILED.
+    """
+    ret = libvirtmod.virConnectCollectStats([conn._o for conn in conns],
+                                            stats, flags, max_parallel,
+                                            timeout_ms)
+    results = []
+    for (conn, (status, value)) in zip(conns, ret):
+        if status == 0:
+            results.append([(conn._wrapDomain(dom), domstats) for (dom, domstats) in value])
+            continue
+
+        if status == 1:
+            defmsg = "virConnectGetAllDomainStats() failed"
+        else:
+            defmsg = "virConnectGetAllDomainStats() timed out"
+        err = libvirtError.__new__(libvirtError)
+        Exception.__init__(err, value and value[2] or defmsg)
+        err.err = value
+        results.append(err)
+    return results
+
+class _virObjectList(object):
+    """
+    Sequence returned by the listAll* methods when called with lazy=True
+
+    It holds the native object pointers returned by libvirt and only
+    wraps an object when it is accessed, through @wrap.  names() and
+    uuids() list the names and UUID strings of the objects without
+    wrapping any of them, which matters for lists of many thousands.
+    uuids() is only supported for the object types which have a UUID.
+    """
+    def __init__(self, objs, wrap):
+        self._o = objs
+        self._wrap = wrap
+
+    def __len__(self):
+        return libvirtmod.virObjectListLength(self._o)
+
+    def __getitem__(self, idx):
+        if isinstance(idx, slice):
+            return [self[i] for i in range(*idx.indices(len(self)))]
+        if idx < 0:
+            idx += len(self)
+        if idx < 0:
+            raise IndexError("list index out of range")
+        return self._wrap(libvirtmod.virObjectListItem(self._o, idx))
+
+    def __iter__(self):
+        for i in range(len(self)):
+            yield self._wrap(libvirtmod.virObjectListItem(self._o, i))
+
+    def names(self):
+        """Returns the list of the object names"""
+        return libvirtmod.virObjectListNames(self._o)
+
+    def uuids(self):
+        """Returns the list of the object UUID strings"""
+        ret = libvirtmod.virObjectListUUIDs(self._o)
+        if ret is None:
+            raise libvirtError("virObjectListUUIDs() failed")
+        return ret
+
+#
+# Per-API call statistics
+#
+def enableCallStats(enabled=True):
+    """
+    Start or stop recording, for every libvirt API called through this
+    module, how many times it was called and how long it took.  Calls
+    cost nothing extra while it is disabled, which is the default.
+    """
+    libvirtmod.virPyCallStatsEnable(enabled)
+
+def getCallStats(reset=False):
+    """
+    Returns a dict mapping the name of every API called since the
+    statistics were enabled, or last reset, to a dict holding:
+
+        calls: how many times it was called
+        time: the seconds spent in libvirt, with the interpreter
+              lock released
+        max_time: the longest time a single call spent in libvirt
+        convert_time: the seconds spent parsing the arguments and
+                      converting the results to python objects
+
+    If @reset is True, the statistics are reset once read.
+    """
+    ret = {}
+    for (name, (calls, time, max_time, convert_time)) in libvirtmod.virPyCallStatsGet(reset).items():
+        ret[name] = {"calls": calls, "time": time, "max_time": max_time,
+                     "convert_time": convert_time}
+    return ret
+
+def setCallTraceCallback(cb):
+    """
+    While the call statistics are enabled, call @cb(name, time,
+    convert_time) after every API call, with the times of that call as
+    reported by getCallStats.  Calls made by @cb are not traced, and
+    None removes the callback.
+    """
+    libvirtmod.virPyCallStatsSetTrace(cb)
+
+#
+# Cache of the XML documents of a connection
+#
+class _virXMLCache(object):
+    """
+    Documents cached by virConnect.enableXMLCache, the domain ones
+    under their UUID and the host ones under None.  Each UUID has a
+    generation bumped by every invalidation of its documents, and the
+    whole cache one bumped by invalidateAll, so that a document fetched
+    while an event for its domain was being dispatched isn't stored
+    once already stale.
+    """
+    def __init__(self):
+        self._lock = threading.Lock()
+        self._docs = {}
+        self._generations = {}
+        self._epoch = 0
+        self.hits = 0
+        self.misses = 0
+        self.invalidations = 0
+
+    def lookup(self, uuid, key):
+        """Returns (document, generation), document being None on a miss"""
+        with self._lock:
+            doc = self._docs.get(uuid, {}).get(key)
+            if doc is None:
+                self.misses += 1
+            else:
+                self.hits += 1
+            return (doc, (self._epoch, self._generations.get(uuid, 0)))
+
+    def store(self, uuid, key, doc, generation):
+        with self._lock:
+            if (self._epoch, self._generations.get(uuid, 0)) == generation:
+                self._docs.setdefault(uuid, {})[key] = doc
+
+    def invalidate(self, uuid):
+        with self._lock:
+            self._generations[uuid] = self._generations.get(uuid, 0) + 1
+            if self._docs.pop(uuid, None) is not None:
+                self.invalidations += 1
+
+    def invalidateAll(self):
+        with self._lock:
+            self._epoch += 1
+            self.invalidations += len(self._docs)
+            self._docs = {}
+
+    def stats(self):
+        with self._lock:
+            return { "hits": self.hits,
+                     "misses": self.misses,
+                     "invalidations": self.invalidations,
+                     "entries": sum([len(docs) for docs in self._docs.values()]) }
+
+#
+# Cache of the DHCP leases of a network
+#
+def _leaseCacheInvalidate(conn, net, event, detail, cache):
+    libvirtmod.virNetworkLeaseCacheInvalidate(cache)
+
+class NetworkLeaseCache(object):
+    """
+    Cache of the DHCP leases of the virNetwork @net, indexed by MAC
+    address, IP address and hostname, the first and last ignoring case.
+
+    The leases are kept as returned by libvirt and only converted to
+    dicts, like those returned by virNetwork.DHCPLeases, for the leases
+    a lookup returns.  libvirt doesn't report lease changes, so the
+    cache is refreshed from the next lookup on once it is older than
+    @max_age seconds, if not None, or once a lifecycle event of the
+    network was received, which needs a registered event loop.
+    refresh(mac) fetches the leases of a single MAC address, when told
+    about a new one by other means.
+    """
+    _MAC = 0
+    _IPADDR = 1
+    _HOSTNAME = 2
+
+    def __init__(self, net, max_age=None):
+        self._net = net
+        self._o = libvirtmod.virNetworkLeaseCacheNew(net._o)
+        if max_age is None:
+            self._maxAge = -1
+        else:
+            self._maxAge = int(max_age * 1000)
+        self._cbid = net.connect().networkEventRegisterAny(net, VIR_NETWORK_EVENT_ID_LIFECYCLE,
+                                                           _leaseCacheInvalidate, self._o)
+
+    def _lookup(self, field, key):
+        ret = libvirtmod.virNetworkLeaseCacheLookup(self._o, field, key, self._maxAge)
+        if ret is None:
+            raise libvirtError('virNetworkGetDHCPLeases() failed')
+        return ret
+
+    def byMAC(self, mac):
+        """Returns the list of the leases of the MAC address @mac"""
+        return self._lookup(self._MAC, mac)
+
+    def byIP(self, ipaddr):
+        """Returns the lease of the IP address @ipaddr, or None"""
+        ret = self._lookup(self._IPADDR, ipaddr)
+        if not ret:
+            return None
+        return ret[0]
+
+    def byHostname(self, hostname):
+        """Returns the list of the leases of the host @hostname"""
+        return self._lookup(self._HOSTNAME, hostname)
+
+    def leases(self):
+        """Returns the list of all the leases"""
+        ret = libvirtmod.virNetworkLeaseCacheList(self._o, self._maxAge)
+        if ret is None:
+            raise libvirtError('virNetworkGetDHCPLeases() failed')
+        return ret
+
+    def refresh(self, mac=None):
+        """
+        Fetch the leases of the MAC address @mac again, or all of them
+        if None
+        """
+        ret = libvirtmod.virNetworkLeaseCacheRefresh(self._o, mac)
+        if ret == -1:
+            raise libvirtError('virNetworkGetDHCPLeases() failed')
+
+    def invalidate(self):
+        """Have the next lookup fetch all the leases again"""
+        libvirtmod.virNetworkLeaseCacheInvalidate(self._o)
+
+    def close(self):
+        """Stop listening to the events of the network"""
+        if self._cbid is not None:
+            self._net.connect().networkEventDeregisterAny(self._cbid)
+            self._cbid = None
+
+#
+# Events reported by the job monitor of virDomain.jobMonitor
+#
+# VIR_PYTHON_JOB_MONITOR_STALLED:    data_remaining didn't reach a new low
+#                                    for stall_ms
+# VIR_PYTHON_JOB_MONITOR_DIRTY_RATE: memory_dirty_rate went over dirty_rate
+# VIR_PYTHON_JOB_MONITOR_DOWNTIME:   the monitor raised the maximum
+#                                    migration downtime
+# VIR_PYTHON_JOB_MONITOR_POSTCOPY:   the monitor switched the migration
+#                                    to post-copy
+# VIR_PYTHON_JOB_MONITOR_COMPLETED:  the job ended, or the domain is gone
+#
+VIR_PYTHON_JOB_MONITOR_STALLED = 1
+VIR_PYTHON_JOB_MONITOR_DIRTY_RATE = 2
+VIR_PYTHON_JOB_MONITOR_DOWNTIME = 3
+VIR_PYTHON_JOB_MONITOR_POSTCOPY = 4
+VIR_PYTHON_JOB_MONITOR_COMPLETED = 5
+
+class _virJobMonitor(object):
+    def __init__(self, dom, cb, opaque, interval_ms, stall_ms, dirty_rate,
+                 downtimes, postcopy):
+        def dispatch(event, progress):
+            cb(dom, event, progress, opaque)
+
+        if downtimes is not None:
+            downtimes = list(downtimes)
+        self._o = libvirtmod.virDomainJobMonitorNew(dom._o, dispatch,
+                                                    interval_ms, stall_ms,
+                                                    dirty_rate, downtimes,
+                                                    postcopy)
+
+    def progress(self):
+        """
+        Returns the dict of the fields of the last job stats sampled by
+        the monitor, without querying them
+        """
+        return libvirtmod.virDomainJobMonitorProgress(self._o)
+
+    def stop(self):
+        """Stop polling, no callback is made once this returns"""
+        libvirtmod.virDomainJobMonitorStop(self._o)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, type, value, traceback):
+        # The job of a synchronous call is over once it returns, usually
+        # before the monitor polled it again, so report its end now
+        libvirtmod.virDomainJobMonitorFinish(self._o)
+
+#
+# States of the consoles of a ConsoleMux, the last three are also the
+# reasons passed to its callback:
+#
+# VIR_PYTHON_CONSOLE_OPEN:       the console is being followed
+# VIR_PYTHON_CONSOLE_EOF:        the stream of the console ended
+# VIR_PYTHON_CONSOLE_ERROR:      the stream of the console failed
+# VIR_PYTHON_CONSOLE_SINK_ERROR: writing to the file descriptor failed
+# VIR_PYTHON_CONSOLE_DETACHED:   detach() or close() was called while open
+#
+VIR_PYTHON_CONSOLE_OPEN = 0
+VIR_PYTHON_CONSOLE_EOF = 1
+VIR_PYTHON_CONSOLE_ERROR = 2
+VIR_PYTHON_CONSOLE_SINK_ERROR = 3
+VIR_PYTHON_CONSOLE_DETACHED = 4
+
+class ConsoleMux(object):
+    """
+    Follows the consoles of many domains at once, moving their output
+    from the registered event loop straight to a file descriptor and/or
+    a ring buffer per console, without calling into python:
+
+        mux = libvirt.ConsoleMux(closed_cb)
+        for dom in conn.listAllDomains(libvirt.VIR_CONNECT_LIST_DOMAINS_ACTIVE):
+            mux.attach(dom, fd=logs[dom.name()].fileno(), ring_size=64 * 1024)
+
+    An event loop implementation must have been registered before
+    the connections were opened.  The callback, if any, is only called
+    when the stream of a console ends or fails, or when writing to its
+    file descriptor fails, as cb(console, reason, message, opaque),
+    console being the ID returned by attach(), reason one of the
+    VIR_PYTHON_CONSOLE_* values and message the error message or None.
+    A closed console keeps its ring buffer and counters until detached.
+    """
+    def __init__(self, cb=None, opaque=None):
+        if cb is None:
+            dispatch = None
+        else:
+            def dispatch(console, reason, message):
+                cb(console, reason, message, opaque)
+
+        self._o = libvirtmod.virConsoleMuxNew(dispatch)
+        self._domains = {}
+
+    def attach(self, dom, dev_name=None, fd=None, ring_size=0, flags=0):
+        """
+        Open the console @dev_name of the virDomain @dom, as done by
+        virDomain.openConsole with @flags, and follow it.  Its output is
+        written to the file descriptor @fd, if not None, and kept in a
+        ring buffer of its last @ring_size bytes, returned by read().
+        While a nonblocking @fd is full, the output is dropped rather
+        than stalling the event loop.  The multiplexer doesn't close
+        @fd, which must stay open while the console is attached.
+        Returns the ID of the console.
+        """
+        if fd is None:
+            fd = -1
+        st = dom.connect().newStream(VIR_STREAM_NONBLOCK)
+        dom.openConsole(dev_name, st, flags)
+        ret = libvirtmod.virConsoleMuxAttach(self._o, st._o, fd, ring_size)
+        if ret is None:
+            st.abort()
+            raise libvirtError('virStreamEventAddCallback() failed')
+        self._domains[ret] = dom
+        return ret
+
+    def detach(self, console):
+        """Stop following @console, if still open, and forget it"""
+        libvirtmod.virConsoleMuxDetach(self._o, console)
+        del self._domains[console]
+
+    def read(self, console, clear=False):
+        """
+        Returns the content of the ring buffer of @console, oldest byte
+        first, and empties it if @clear is True
+        """
+        return libvirtmod.virConsoleMuxRead(self._o, console, clear)
+
+    def info(self, console):
+        """
+        Returns a dict describing @console: its VIR_PYTHON_CONSOLE_*
+        'state', the number of bytes 'received' from its stream and
+        'dropped' by its file descriptor, and the number of bytes
+        'buffered' in its ring
+        """
+        return libvirtmod.virConsoleMuxInfo(self._o, console)
+
+    def consoles(self):
+        """Returns a dict of the attached consoles and their virDomain"""
+        return dict(self._domains)
+
+    def close(self):
+        """Detach all the consoles"""
+        libvirtmod.virConsoleMuxClose(self._o)
+        self._domains = {}
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, type, value, traceback):
+        self.close()
+
+#
+# Local mirror of the domains of a connection
+#
+def _inventoryClosed(conn, reason, ref):
+    inv = ref()
+    if inv is None or inv._closed:
+        return
+    inv._stale = True
+    try:
+        inv.resync(inv._reconnect())
+    except libvirtError:
+        pass
+
+class DomainInventory(object):
+    """
+    Mirror of the domains of the virConnect @conn, taken with a single
+    getAllDomainStats query and then kept current by native lifecycle,
+    balloon change and tunable event callbacks, which need a registered
+    event loop implementation.  Reading it makes no RPC, so it replaces
+    polling listAllDomains() and the state of each domain:
+
+        inv = libvirt.DomainInventory(conn)
+        gen = 0
+        while True:
+            (gen, changed) = inv.changes(gen)
+            for entry in changed:
+                ...
+
+    Each domain is described by a dict with the 'name', 'uuid' (as a
+    string), 'id' (-1 if inactive), 'state' and 'reason' (as returned
+    by virDomain.state), 'vcpus', 'memory' and 'max_memory' (in KiB),
+    'generation' and 'removed' keys.  Every change stamps the entry
+    with a new generation of the inventory, the removed domains are
+    kept as entries marked removed until more than 256 of them pile
+    up, when the oldest half is forgotten.
+
+    If @reconnect is given, the inventory takes the close callback of
+    @conn.  Once the connection is closed, the inventory is stale and
+    reconnect() is called for a new virConnect, which the inventory
+    then resyncs with.  Otherwise, or if reconnect() raised
+    libvirtError, resync() must be called with a new connection.
+    """
+    def __init__(self, conn, reconnect=None):
+        self._conn = conn
+        self._reconnect = reconnect
+        self._lock = threading.Lock()
+        self._stale = False
+        self._closed = False
+        self._o = libvirtmod.virDomainInventoryNew(conn._o)
+        if self._o is None:
+            raise libvirtError('virConnectGetAllDomainStats() failed', conn=conn)
+        if reconnect is not None:
+            self._watch(conn)
+
+    def _watch(self, conn):
+        # Weakly referenced, or the connection would keep it alive
+        conn.registerCloseCallback(_inventoryClosed, weakref.ref(self))
+
+    def resync(self, conn=None):
+        """
+        Bring the whole inventory up to date with one stats query on
+        @conn, or on the current connection if None, moving its event
+        callbacks there.  Entries only change generation if their data
+        did, and the domains not reported anymore are marked removed.
+        """
+        with self._lock:
+            if self._closed:
+                raise libvirtError('DomainInventory is closed')
+            if conn is None:
+                conn = self._conn
+            ret = libvirtmod.virDomainInventoryResync(self._o, conn._o)
+            if ret == -1:
+                raise libvirtError('virConnectGetAllDomainStats() failed', conn=conn)
+            if conn is not self._conn and self._reconnect is not None:
+                self._watch(conn)
+            self._conn = conn
+            self._stale = False
+
+    def stale(self):
+        """Whether the connection got closed since the last resync"""
+        return self._stale
+
+    def generation(self):
+        """Returns the generation of the last change"""
+        return libvirtmod.virDomainInventoryGeneration(self._o)
+
+    def lookupByName(self, name):
+        """Returns the entry of the domain @name, or None"""
+        return libvirtmod.virDomainInventoryLookup(self._o, True, name)
+
+    def lookupByUUIDString(self, uuidstr):
+        """Returns the entry of the domain of UUID @uuidstr, or None"""
+        return libvirtmod.virDomainInventoryLookup(self._o, False, uuidstr)
+
+    def domains(self):
+        """Returns the list of the entries of the existing domains"""
+        return libvirtmod.virDomainInventoryList(self._o, 0, False)[1]
+
+    def changes(self, since=0):
+        """
+        Returns a tuple (generation, entries) of the current generation
+        and of the entries changed after generation @since, those of
+        the removed domains included, to pass generation back as
+        @since next time.  Raises ValueError if removals made after
+        @since have been forgotten meanwhile, after which changes(0)
+        starts over with the entries of all the known domains.
+        """
+        return libvirtmod.virDomainInventoryList(self._o, since, True)
+
+    def __iter__(self):
+        return iter(self.domains())
+
+    def close(self):
+        """Stop following the events of the connection"""
+        # Serialized with a resync run by the close callback, which
+        # would otherwise register the events again
+        with self._lock:
+            if not self._closed:
+                libvirtmod.virDomainInventoryClose(self._o)
+                self._closed = True
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, type, value, traceback):
+        self.close()
+
+#
+# Pool of connections shared by the threads of a process
+#
+
+# Immune to changes of the wall clock, where available
+_monotonic = getattr(time, "monotonic", time.time)
+
+class ConnectionPool(object):
+    """
+    Keeps up to @size connections to @uri open, handing them out to one
+    user at a time.
+
+    @auth, @flags: as for openAuth(), the connections are opened with
+                   open() or openReadOnly() if @auth is None
+    @keepalive_interval, @keepalive_count: as for virConnect.setKeepAlive,
+                   disabled if @keepalive_interval is 0
+
+    Connections whose peer went away are evicted by a close callback
+    as soon as it is noticed, which needs a registered event loop, as
+    does the keepalive.  The pool owns the close callback of its
+    connections, users should not replace it.
+
+    Connections are opened one at a time, so that a restart of the
+    daemon doesn't send all the waiting threads to reconnect at once.
+    After a failure to open one, every caller gets a new libvirtError
+    repeating that failure, which it is chained to, for @retry_delay
+    seconds, doubling up to @max_retry_delay until an open succeeds.
+    """
+    def __init__(self, uri=None, size=4, keepalive_interval=5,
+                 keepalive_count=5, auth=None, flags=0,
+                 retry_delay=0.5, max_retry_delay=30):
+        self.uri = uri
+        self.size = size
+        self._keepalive = (keepalive_interval, keepalive_count)
+        self._auth = auth
+        self._flags = flags
+        self._retryDelay = retry_delay
+        self._maxRetryDelay = max_retry_delay
+        self._lock = threading.Lock()
+        self._cond = threading.Condition(self._lock)
+        self._openLock = threading.Lock()
+        self._idle = []
+        self._dead = []
+        self._busy = set()
+        self._count = 0
+        self._closed = False
+        self._openError = None
+        self._retryAt = 0
+        self._delay = retry_delay
+        self._local = threading.local()
+
+    def _closeCallback(self, conn, reason, opaque):
+        with self._lock:
+            conn._poolDead = True
+            if conn in self._idle:
+                self._idle.remove(conn)
+                self._count -= 1
+                # Not closed from within its own close callback
+                self._dead.append(conn)
+                self._cond.notify()
+
+    def _discard(self, conn):
+        try:
+            conn.unregisterCloseCallback()
+        except libvirtError:
+            pass
+        try:
+            conn.close()
+        except libvirtError:
+            pass
+
+    def _repeatOpenError(self):
+        # Each caller gets its own exception, with its own traceback,
+        # instead of all of them raising and altering the same one
+        cause = self._openError
+        err = libvirtError.__new__(type(cause))
+        err.__dict__.update(cause.__dict__)
+        Exception.__init__(err, *cause.args)
+        err.__cause__ = cause
+        return err
+
+    def _open(self):
+        with self._openLock:
+            if self._openError is not None and _monotonic() < self._retryAt:
+                raise self._repeatOpenError()
+            try:
+                if self._auth is not None:
+                    conn = openAuth(self.uri, self._auth, self._flags)
+                elif self._flags & VIR_CONNECT_RO:
+                    conn = openReadOnly(self.uri)
+                else:
+                    conn = open(self.uri)
+            except libvirtError as e:
+                self._openError = e
+                self._retryAt = _monotonic() + self._delay
+                self._delay = min(self._delay * 2, self._maxRetryDelay)
+                raise
+            self._openError = None
+            self._delay = self._retryDelay
+
+        conn._poolDead = False
+        try:
+            if self._keepalive[0] > 0:
+                conn.setKeepAlive(*self._keepalive)
+        except libvirtError:
+            # Without an event loop, dead connections are only noticed
+            # by isAlive() when checked out
+            pass
+        conn.registerCloseCallback(self._closeCallback, None)
+        return conn
+
+    def acquire(self, timeout=None):
+        """
+        Check out a connection for the exclusive use of the caller, to
+        give back with release().  Waits up to @timeout seconds, or
+        forever if None, for one to be released when all @size of them
+        are in use, raising libvirtError if none was.
+        """
+        if timeout is not None:
+            deadline = _monotonic() + timeout
+        conn = None
+        opening = False
+        with self._lock:
+            while conn is None and not opening:
+                if self._closed:
+                    raise libvirtError("connection pool is closed")
+                dead = self._dead
+                self._dead = []
+                if self._idle:
+                    conn = self._idle.pop()
+                    if conn._poolDead or not conn.isAlive():
+                        self._count -= 1
+                        dead.append(conn)
+                        conn = None
+                elif self._count < self.size:
+                    self._count += 1
+                    opening = True
+                elif timeout is None:
+                    self._cond.wait()
+                else:
+                    remaining = deadline - _monotonic()
+                    if remaining <= 0:
+                        raise libvirtError("no connection to %s released in time" % self.uri)
+                    self._cond.wait(remaining)
+                if dead:
+                    self._lock.release()
+                    try:
+                        for d in dead:
+                            self._discard(d)
+                    finally:
+                        self._lock.acquire()
+            if conn is not None:
+                self._busy.add(conn)
+                return conn
+
+        try:
+            conn = self._open()
+        except:
+            with self._lock:
+                self._count -= 1
+                self._cond.notify()
+            raise
+        with self._lock:
+            self._busy.add(conn)
+        return conn
+
+    def release(self, conn):
+        """
+        Give back a connection checked out with acquire().  Raises
+        ValueError if @conn is not checked out from this pool, such as
+        when it was given back already.
+        """
+        with self._lock:
+            if conn not in self._busy:
+                raise ValueError("connection not checked out from this pool")
+            self._busy.remove(conn)
+            if not conn._poolDead and not self._closed:
+                self._idle.append(conn)
+                self._cond.notify()
+                return
+            self._count -= 1
+            self._cond.notify()
+        self._discard(conn)
+
+    def connection(self, timeout=None):
+        """
+        Returns a context manager checking out a connection, typically
+        for the duration of a task, as acquire() does:
+
+            with pool.connection() as conn:
+                dom = conn.lookupByName(name)
+        """
+        return _virPoolLease(self, self.acquire(timeout))
+
+    def threadConnection(self, timeout=None):
+        """
+        Returns the connection checked out by the calling thread, doing
+        so as acquire() does on its first call.  It is kept until the
+        thread exits or calls releaseThreadConnection(), and replaced
+        if it dies in between, so it costs next to nothing to call this
+        before every use.
+        """
+        lease = getattr(self._local, "lease", None)
+        if lease is not None:
+            if not lease.conn._poolDead:
+                return lease.conn
+            self.releaseThreadConnection()
+        self._local.lease = _virPoolLease(self, self.acquire(timeout))
+        return self._local.lease.conn
+
+    def releaseThreadConnection(self):
+        """Give back the connection checked out by threadConnection()"""
+        lease = getattr(self._local, "lease", None)
+        if lease is not None:
+            self._local.lease = None
+            lease.release()
+
+    def close(self):
+        """
+        Close the idle connections, and the others as they are released
+        """
+        with self._lock:
+            self._closed = True
+            conns = self._idle + self._dead
+            self._count -= len(self._idle)
+            self._idle = []
+            self._dead = []
+            self._cond.notify_all()
+        for conn in conns:
+            self._discard(conn)
+
+class _virPoolLease(object):
+    def __init__(self, pool, conn):
+        self._pool = pool
+        self.conn = conn
+
+    def release(self):
+        conn = self.conn
+        if conn is not None:
+            self.conn = None
+            self._pool.release(conn)
+
+    def __enter__(self):
+        return self.conn
+
+    def __exit__(self, type, value, traceback):
+        self.release()
+
+    def __del__(self):
+        # Gives back the connection of a thread which exited
+        self.release()
+
+#
+# CPU map representations, for the cpumap_format parameter of the
+# methods returning CPU maps
+#
+# VIR_PYTHON_CPUMAP_TUPLE: a tuple (list for ioThreadInfo and getCPUMap)
+#                          holding a bool per CPU
+# VIR_PYTHON_CPUMAP_BYTES: bytes in libvirt's layout, bit N % 8 of byte
+#                          N / 8 being set if CPU N is in the map
+# VIR_PYTHON_CPUMAP_INT:   an int whose bit N is set if CPU N is in the map
+#
+# Methods pinning CPUs accept any of them as their cpumap.
+#
+VIR_PYTHON_CPUMAP_TUPLE = 0
+VIR_PYTHON_CPUMAP_BYTES = 1
+VIR_PYTHON_CPUMAP_INT = 2
+
+#
+# Sparse modes of virStream.recvToFD and virStream.sendFromFD:
+#
+# VIR_PYTHON_STREAM_SPARSE_NONE:   every byte is moved
+# VIR_PYTHON_STREAM_SPARSE_LOCAL:  zero blocks are turned into holes of
+#                                  the file received to, and the holes
+#                                  of the file sent from aren't read
+# VIR_PYTHON_STREAM_SPARSE_STREAM: zero blocks and holes also cross the
+#                                  stream as holes, which needs libvirt
+#                                  3.4.0 and a stream opened with the
+#                                  VIR_STORAGE_VOL_*_SPARSE_STREAM flag
+#
+VIR_PYTHON_STREAM_SPARSE_NONE = 0
+VIR_PYTHON_STREAM_SPARSE_LOCAL = 1
+VIR_PYTHON_STREAM_SPARSE_STREAM = 2
+
+
+#
+# Build an array.array out of a packed column of typed parameter values
+#
+def _typedParamArray(typ, data):
+    """
+    @typ: the VIR_TYPED_PARAM_* type of the values
+    @data: bytes holding the values in their native C representation
+    """
+    if typ == VIR_TYPED_PARAM_INT:
+        codes = ('i',)
+    elif typ == VIR_TYPED_PARAM_UINT:
+        codes = ('I',)
+    elif typ == VIR_TYPED_PARAM_LLONG:
+        codes = ('q', 'l')
+    elif typ == VIR_TYPED_PARAM_ULLONG:
+        codes = ('Q', 'L')
+    elif typ == VIR_TYPED_PARAM_DOUBLE:
+        codes = ('d',)
+    else:
+        codes = ('b',)
+
+    # Python 2 lacks the 'q' and 'Q' type codes, fall back to 'l' and
+    # 'L' which are 64 bit wide on LP64 platforms
+    for code in codes:
+        try:
+            ret = array.array(code)
+        except ValueError:
+            continue
+        if typ in (VIR_TYPED_PARAM_LLONG, VIR_TYPED_PARAM_ULLONG) and ret.itemsize != 8:
+            continue
+        if sys.version_info[0] > 2:
+            ret.frombytes(data)
+        else:
+            ret.fromstring(data)
+        return ret
+
+    raise libvirtError("no array type code for typed parameter type %d" % typ)
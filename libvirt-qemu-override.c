@@ -338,6 +338,527 @@ libvirt_qemu_virConnectDomainQemuMonitorEventDeregister(PyObject *self ATTRIBUTE
     py_retval = libvirt_intWrap(ret);
     return py_retval;
 }
+
+
+/*
+ * Filtered and batched monitor event delivery
+ *
+ * The events are filtered by name and queued from the libvirt callback
+ * without taking the GIL, which is only taken to deliver a whole batch
+ * as cb(conn, events, opaque).  Events with a rate limit are coalesced
+ * per domain: only the latest one is kept until the limit allows the
+ * next one to be delivered.
+ */
+typedef struct {
+    virDomainPtr dom;
+    char *event;
+    long long seconds;
+    unsigned int micros;
+    char *details;
+} virPyQemuMonitorEvent;
+
+typedef struct {
+    char *event;
+    unsigned long long limit;           /* in milliseconds */
+} virPyQemuMonitorEventLimit;
+
+/* Rate limited event of a domain */
+typedef struct {
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    const virPyQemuMonitorEventLimit *limit;
+    double last;                        /* last delivery, in seconds */
+    bool pending;
+    virPyQemuMonitorEvent event;        /* latest one, if pending */
+} virPyQemuMonitorEventKind;
+
+typedef struct {
+    PyThread_type_lock lock;
+    int timer;                          /* flush timer, -1 if none */
+    bool armed;                         /* flush timer is enabled */
+    size_t maxBatch;
+    int maxDelay;                       /* in milliseconds */
+    PyObject *cbData;
+    char **events;                      /* sorted, NULL for all of them */
+    size_t nevents;
+    virPyQemuMonitorEventLimit *limits; /* sorted by event */
+    size_t nlimits;
+    virPyQemuMonitorEvent *queue;       /* maxBatch entries, or NULL */
+    size_t nqueue;
+    virPyQemuMonitorEventKind *kinds;
+    size_t nkinds;
+    size_t npending;                    /* kinds with a pending event */
+} virPyQemuMonitorEventBatch;
+typedef virPyQemuMonitorEventBatch *virPyQemuMonitorEventBatchPtr;
+
+static int
+virPyQemuMonitorEventNameCompare(const void *a, const void *b)
+{
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+static void
+virPyQemuMonitorEventClear(virPyQemuMonitorEvent *event)
+{
+    if (event->dom)
+        virDomainFree(event->dom);
+    VIR_FREE(event->event);
+    VIR_FREE(event->details);
+    memset(event, 0, sizeof(*event));
+}
+
+static int
+virPyQemuMonitorEventSet(virPyQemuMonitorEvent *event,
+                         virDomainPtr dom,
+                         const char *name,
+                         long long seconds,
+                         unsigned int micros,
+                         const char *details)
+{
+    if (!(event->event = strdup(name)) ||
+        (details && !(event->details = strdup(details)))) {
+        virPyQemuMonitorEventClear(event);
+        return -1;
+    }
+
+    virDomainRef(dom);
+    event->dom = dom;
+    event->seconds = seconds;
+    event->micros = micros;
+    return 0;
+}
+
+static int
+virPyQemuMonitorEventTimeCompare(const void *a, const void *b)
+{
+    const virPyQemuMonitorEvent *ea = a;
+    const virPyQemuMonitorEvent *eb = b;
+
+    if (ea->seconds != eb->seconds)
+        return ea->seconds < eb->seconds ? -1 : 1;
+    if (ea->micros != eb->micros)
+        return ea->micros < eb->micros ? -1 : 1;
+    return 0;
+}
+
+/* Take the events which can be delivered at @now out of @batch, and
+ * arm the flush timer for the rate limited ones left, if any.  Must be
+ * called with the batch lock held.  */
+static virPyQemuMonitorEvent *
+virPyQemuMonitorEventBatchSteal(virPyQemuMonitorEventBatchPtr batch,
+                                double now,
+                                size_t *nevents)
+{
+    virPyQemuMonitorEvent *events;
+    int wait = 0;
+    size_t i;
+
+    *nevents = 0;
+    if (VIR_ALLOC_N(events, batch->nqueue + batch->npending + 1) < 0)
+        return NULL;
+
+    memcpy(events, batch->queue, batch->nqueue * sizeof(*events));
+    *nevents = batch->nqueue;
+    VIR_FREE(batch->queue);
+    batch->nqueue = 0;
+
+    for (i = 0; i < batch->nkinds; i++) {
+        virPyQemuMonitorEventKind *kind = &batch->kinds[i];
+        double next = kind->last + kind->limit->limit / 1000.0;
+        int left;
+
+        if (!kind->pending)
+            continue;
+
+        if (next > now) {
+            /* Round up, so the timer never fires before the limit */
+            if ((next - now) * 1000 >= INT_MAX)
+                left = INT_MAX;
+            else
+                left = (next - now) * 1000 + 1;
+            if (!wait || left < wait)
+                wait = left;
+            continue;
+        }
+
+        events[(*nevents)++] = kind->event;
+        memset(&kind->event, 0, sizeof(kind->event));
+        kind->pending = false;
+        kind->last = now;
+        batch->npending--;
+    }
+
+    if (wait) {
+        virEventUpdateTimeout(batch->timer, wait);
+        batch->armed = true;
+    } else if (batch->armed) {
+        virEventUpdateTimeout(batch->timer, -1);
+        batch->armed = false;
+    }
+
+    /* Coalesced events go back in the order they happened */
+    qsort(events, *nevents, sizeof(*events), virPyQemuMonitorEventTimeCompare);
+
+    if (*nevents == 0)
+        VIR_FREE(events);
+    return events;
+}
+
+/* Call the batch dispatcher, consuming the @nevents @events.  Must be
+ * called without the GIL held.  */
+static void
+virPyQemuMonitorEventBatchDeliver(virPyQemuMonitorEventBatchPtr batch,
+                                  virPyQemuMonitorEvent *events,
+                                  size_t nevents)
+{
+    PyObject *pyobj_cb;
+    PyObject *pyobj_conn;
+    PyObject *pyobj_list = NULL;
+    PyObject *pyobj_ret = NULL;
+    PyObject *pyobj_dom;
+    PyObject *item;
+    size_t i;
+
+    LIBVIRT_ENSURE_THREAD_STATE;
+
+    pyobj_cb = libvirt_qemu_lookupPythonFunc("_dispatchQemuMonitorEventBatchCallback");
+    if (!pyobj_cb)
+        goto cleanup;
+
+    pyobj_conn = PyDict_GetItemString(batch->cbData, "conn");
+
+    if (!(pyobj_list = PyList_New(nevents)))
+        goto cleanup;
+
+    for (i = 0; i < nevents; i++) {
+        /* The tuple takes over the reference of the queued event */
+        if (!(pyobj_dom = libvirt_virDomainPtrWrap(events[i].dom)))
+            goto cleanup;
+        events[i].dom = NULL;
+
+        item = Py_BuildValue((char *) "(NsLIz)", pyobj_dom, events[i].event,
+                             events[i].seconds, events[i].micros,
+                             events[i].details);
+        if (!item)
+            goto cleanup;
+        PyList_SET_ITEM(pyobj_list, i, item);
+    }
+
+    pyobj_ret = PyObject_CallFunction(pyobj_cb, (char *) "OOO",
+                                      pyobj_conn, pyobj_list, batch->cbData);
+
+ cleanup:
+    Py_XDECREF(pyobj_list);
+
+    if (!pyobj_ret) {
+        DEBUG("%s - ret:%p\n", __FUNCTION__, pyobj_ret);
+        PyErr_Print();
+    } else {
+        Py_DECREF(pyobj_ret);
+    }
+
+    LIBVIRT_RELEASE_THREAD_STATE;
+
+    for (i = 0; i < nevents; i++)
+        virPyQemuMonitorEventClear(&events[i]);
+    VIR_FREE(events);
+}
+
+static void
+virPyQemuMonitorEventBatchCallback(virConnectPtr conn ATTRIBUTE_UNUSED,
+                                   virDomainPtr dom,
+                                   const char *event,
+                                   long long seconds,
+                                   unsigned int micros,
+                                   const char *details,
+                                   void *opaque)
+{
+    virPyQemuMonitorEventBatchPtr batch = opaque;
+    virPyQemuMonitorEventLimit *limit = NULL;
+    virPyQemuMonitorEventKind *kind = NULL;
+    virPyQemuMonitorEvent *full = NULL;
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    size_t nfull = 0;
+    size_t i;
+
+    if (batch->events &&
+        !bsearch(&event, batch->events, batch->nevents,
+                 sizeof(*batch->events), virPyQemuMonitorEventNameCompare))
+        return;
+
+    if (batch->limits) {
+        /* The key is compared as the first member of the entries */
+        limit = bsearch(&event, batch->limits, batch->nlimits,
+                        sizeof(*batch->limits),
+                        virPyQemuMonitorEventNameCompare);
+        if (limit && virDomainGetUUID(dom, uuid) < 0)
+            return;
+    }
+
+    PyThread_acquire_lock(batch->lock, WAIT_LOCK);
+
+    if (limit) {
+        for (i = 0; i < batch->nkinds; i++) {
+            if (batch->kinds[i].limit == limit &&
+                memcmp(batch->kinds[i].uuid, uuid, VIR_UUID_BUFLEN) == 0) {
+                kind = &batch->kinds[i];
+                break;
+            }
+        }
+
+        if (!kind) {
+            if (VIR_REALLOC_N(batch->kinds, batch->nkinds + 1) < 0)
+                goto cleanup;
+            kind = &batch->kinds[batch->nkinds++];
+            memset(kind, 0, sizeof(*kind));
+            memcpy(kind->uuid, uuid, VIR_UUID_BUFLEN);
+            kind->limit = limit;
+        }
+
+        if (kind->pending) {
+            virPyQemuMonitorEventClear(&kind->event);
+            kind->pending = false;
+            batch->npending--;
+        }
+        if (virPyQemuMonitorEventSet(&kind->event, dom, event,
+                                     seconds, micros, details) < 0)
+            goto cleanup;
+        kind->pending = true;
+        batch->npending++;
+    } else {
+        /* Full if stealing its events failed, drop this one */
+        if (batch->nqueue == batch->maxBatch ||
+            (!batch->queue &&
+             VIR_ALLOC_N(batch->queue, batch->maxBatch) < 0))
+            goto cleanup;
+        if (virPyQemuMonitorEventSet(&batch->queue[batch->nqueue], dom, event,
+                                     seconds, micros, details) < 0)
+            goto cleanup;
+        batch->nqueue++;
+
+        if (batch->nqueue == batch->maxBatch) {
+            full = virPyQemuMonitorEventBatchSteal(batch, virTimeSecondsNow(),
+                                                   &nfull);
+            goto cleanup;
+        }
+    }
+
+    if (!batch->armed) {
+        virEventUpdateTimeout(batch->timer, batch->maxDelay);
+        batch->armed = true;
+    }
+
+ cleanup:
+    PyThread_release_lock(batch->lock);
+
+    if (full)
+        virPyQemuMonitorEventBatchDeliver(batch, full, nfull);
+}
+
+static void
+virPyQemuMonitorEventBatchTimeout(int timer ATTRIBUTE_UNUSED,
+                                  void *opaque)
+{
+    virPyQemuMonitorEventBatchPtr batch = opaque;
+    virPyQemuMonitorEvent *events = NULL;
+    size_t nevents = 0;
+    double now = virTimeSecondsNow();
+
+    PyThread_acquire_lock(batch->lock, WAIT_LOCK);
+    events = virPyQemuMonitorEventBatchSteal(batch, now, &nevents);
+    PyThread_release_lock(batch->lock);
+
+    if (events)
+        virPyQemuMonitorEventBatchDeliver(batch, events, nevents);
+}
+
+/* Free callback of the flush timer, the events still queued when the
+ * registration goes away are dropped */
+static void
+virPyQemuMonitorEventBatchFree(void *opaque)
+{
+    virPyQemuMonitorEventBatchPtr batch = opaque;
+    size_t i;
+
+    for (i = 0; i < batch->nqueue; i++)
+        virPyQemuMonitorEventClear(&batch->queue[i]);
+    VIR_FREE(batch->queue);
+    for (i = 0; i < batch->nkinds; i++)
+        virPyQemuMonitorEventClear(&batch->kinds[i].event);
+    VIR_FREE(batch->kinds);
+    for (i = 0; i < batch->nevents; i++)
+        VIR_FREE(batch->events[i]);
+    VIR_FREE(batch->events);
+    for (i = 0; i < batch->nlimits; i++)
+        VIR_FREE(batch->limits[i].event);
+    VIR_FREE(batch->limits);
+
+    if (batch->cbData) {
+        LIBVIRT_ENSURE_THREAD_STATE;
+        Py_DECREF(batch->cbData);
+        LIBVIRT_RELEASE_THREAD_STATE;
+    }
+    if (batch->lock)
+        PyThread_free_lock(batch->lock);
+
+    VIR_FREE(batch);
+}
+
+/* Free callback of the registration */
+static void
+virPyQemuMonitorEventBatchRelease(void *opaque)
+{
+    virPyQemuMonitorEventBatchPtr batch = opaque;
+
+    /* The event loop calls virPyQemuMonitorEventBatchFree once the
+     * timer is gone */
+    if (batch->timer < 0 || virEventRemoveTimeout(batch->timer) < 0)
+        virPyQemuMonitorEventBatchFree(batch);
+}
+
+/* Fill the event filter and rate limits of @batch from a list of event
+ * names, or None, and a dict of limits in milliseconds, or None */
+static int
+virPyQemuMonitorEventBatchParse(virPyQemuMonitorEventBatchPtr batch,
+                                PyObject *pyobj_events,
+                                PyObject *pyobj_limits)
+{
+    PyObject *key;
+    PyObject *value;
+    Py_ssize_t pos = 0;
+    size_t i;
+
+    if (pyobj_events != Py_None) {
+        if (!PyList_Check(pyobj_events)) {
+            PyErr_SetString(PyExc_TypeError, "events must be a list or None");
+            return -1;
+        }
+
+        batch->nevents = PyList_Size(pyobj_events);
+        if (VIR_ALLOC_N(batch->events, batch->nevents + 1) < 0) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        for (i = 0; i < batch->nevents; i++) {
+            if (libvirt_charPtrUnwrap(PyList_GetItem(pyobj_events, i),
+                                      &batch->events[i]) < 0)
+                return -1;
+            if (!batch->events[i]) {
+                PyErr_SetString(PyExc_TypeError, "event names must be strings");
+                return -1;
+            }
+        }
+        qsort(batch->events, batch->nevents, sizeof(*batch->events),
+              virPyQemuMonitorEventNameCompare);
+    }
+
+    if (pyobj_limits != Py_None) {
+        if (!PyDict_Check(pyobj_limits)) {
+            PyErr_SetString(PyExc_TypeError, "rate limits must be a dict or None");
+            return -1;
+        }
+
+        if (VIR_ALLOC_N(batch->limits, PyDict_Size(pyobj_limits) + 1) < 0) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        while (PyDict_Next(pyobj_limits, &pos, &key, &value)) {
+            virPyQemuMonitorEventLimit *limit = &batch->limits[batch->nlimits];
+
+            if (libvirt_charPtrUnwrap(key, &limit->event) < 0 ||
+                libvirt_ulonglongUnwrap(value, &limit->limit) < 0)
+                return -1;
+            batch->nlimits++;
+            if (!limit->event) {
+                PyErr_SetString(PyExc_TypeError, "event names must be strings");
+                return -1;
+            }
+        }
+        qsort(batch->limits, batch->nlimits, sizeof(*batch->limits),
+              virPyQemuMonitorEventNameCompare);
+    }
+
+    return 0;
+}
+
+static PyObject *
+libvirt_qemu_virConnectDomainQemuMonitorEventRegisterBatch(PyObject *self ATTRIBUTE_UNUSED,
+                                                           PyObject *args)
+{
+    PyObject *pyobj_conn;
+    PyObject *pyobj_dom;
+    PyObject *pyobj_events;
+    PyObject *pyobj_limits;
+    PyObject *pyobj_cbData;
+    virConnectPtr conn;
+    virDomainPtr dom;
+    virPyQemuMonitorEventBatchPtr batch;
+    unsigned int maxBatch;
+    int maxDelay;
+    unsigned int flags;
+    int ret;
+
+    if (!PyArg_ParseTuple
+        (args, (char *) "OOOOOIiI:virConnectDomainQemuMonitorEventRegisterBatch",
+         &pyobj_conn, &pyobj_dom, &pyobj_events, &pyobj_limits,
+         &pyobj_cbData, &maxBatch, &maxDelay, &flags))
+        return NULL;
+
+    if (maxBatch == 0 || maxDelay < 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "max_batch must be positive and max_delay_ms "
+                        "must not be negative");
+        return NULL;
+    }
+
+    conn = PyvirConnect_Get(pyobj_conn);
+    if (pyobj_dom == Py_None)
+        dom = NULL;
+    else
+        dom = PyvirDomain_Get(pyobj_dom);
+
+    if (VIR_ALLOC(batch) < 0)
+        return PyErr_NoMemory();
+
+    batch->timer = -1;
+    batch->maxBatch = maxBatch;
+    batch->maxDelay = maxDelay;
+    Py_INCREF(pyobj_cbData);
+    batch->cbData = pyobj_cbData;
+
+    if (!(batch->lock = PyThread_allocate_lock())) {
+        PyErr_NoMemory();
+        goto error;
+    }
+
+    if (virPyQemuMonitorEventBatchParse(batch, pyobj_events, pyobj_limits) < 0)
+        goto error;
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    batch->timer = virEventAddTimeout(-1, virPyQemuMonitorEventBatchTimeout,
+                                      batch, virPyQemuMonitorEventBatchFree);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    if (batch->timer < 0) {
+        virPyQemuMonitorEventBatchFree(batch);
+        return VIR_PY_INT_FAIL;
+    }
+
+    LIBVIRT_BEGIN_ALLOW_THREADS;
+    ret = virConnectDomainQemuMonitorEventRegister(conn, dom, NULL,
+                                                   virPyQemuMonitorEventBatchCallback,
+                                                   batch,
+                                                   virPyQemuMonitorEventBatchRelease,
+                                                   flags);
+    if (ret < 0)
+        virPyQemuMonitorEventBatchRelease(batch);
+    LIBVIRT_END_ALLOW_THREADS;
+
+    return libvirt_intWrap(ret);
+
+ error:
+    virPyQemuMonitorEventBatchFree(batch);
+    return NULL;
+}
 #endif /* LIBVIR_CHECK_VERSION(1, 2, 3) */
 
 /************************************************************************
@@ -354,11 +875,33 @@ static PyMethodDef libvirtQemuMethods[] = {
 #if LIBVIR_CHECK_VERSION(1, 2, 3)
     {(char *) "virConnectDomainQemuMonitorEventRegister", libvirt_qemu_virConnectDomainQemuMonitorEventRegister, METH_VARARGS, NULL},
     {(char *) "virConnectDomainQemuMonitorEventDeregister", libvirt_qemu_virConnectDomainQemuMonitorEventDeregister, METH_VARARGS, NULL},
+    {(char *) "virConnectDomainQemuMonitorEventRegisterBatch", libvirt_qemu_virConnectDomainQemuMonitorEventRegisterBatch, METH_VARARGS, NULL},
 #endif /* LIBVIR_CHECK_VERSION(1, 2, 3) */
     {NULL, NULL, 0, NULL}
 };
 
 #if PY_MAJOR_VERSION > 2
+# if LIBVIRT_HAVE_MULTIPHASE_INIT
+static PyInterpreterState *libvirtmod_qemu_interpreter;
+
+static int
+libvirtQemuModuleExec(PyObject *module ATTRIBUTE_UNUSED)
+{
+    if (virInitialize() < 0) {
+        PyErr_SetString(PyExc_RuntimeError, "cannot initialize libvirt");
+        return -1;
+    }
+
+    return libvirt_moduleClaimInterpreter(&libvirtmod_qemu_interpreter, "libvirtmod_qemu");
+}
+
+static PyModuleDef_Slot libvirtQemuModuleSlots[] = {
+    {Py_mod_exec, libvirtQemuModuleExec},
+    LIBVIRT_MODULE_SLOTS
+    {0, NULL}
+};
+# endif /* LIBVIRT_HAVE_MULTIPHASE_INIT */
+
 static struct PyModuleDef moduledef = {
         PyModuleDef_HEAD_INIT,
 # ifndef __CYGWIN__
@@ -367,9 +910,17 @@ static struct PyModuleDef moduledef = {
         "cygvirtmod_qemu",
 # endif
         NULL,
+# if LIBVIRT_HAVE_MULTIPHASE_INIT
+        0,
+# else
         -1,
+# endif
         libvirtQemuMethods,
+# if LIBVIRT_HAVE_MULTIPHASE_INIT
+        libvirtQemuModuleSlots,
+# else
         NULL,
+# endif
         NULL,
         NULL,
         NULL
@@ -383,6 +934,9 @@ PyInit_cygvirtmod_qemu
 # endif
   (void)
 {
+# if LIBVIRT_HAVE_MULTIPHASE_INIT
+    return PyModuleDef_Init(&moduledef);
+# else
     PyObject *module;
 
     if (virInitialize() < 0)
@@ -391,6 +945,7 @@ PyInit_cygvirtmod_qemu
     module = PyModule_Create(&moduledef);
 
     return module;
+# endif
 }
 #else /* ! PY_MAJOR_VERSION > 2 */
 void
@@ -33,3 +33,47 @@ def qemuMonitorEventRegister(conn, dom, event, cb, opaque, flags=0):
         raise libvirt.libvirtError ('virConnectDomainQemuMonitorEventRegister() failed')
     conn.qemuMonitorEventCallbackID[ret] = opaque
     return ret
+
+def _dispatchQemuMonitorEventBatchCallback(conn, events, cbData):
+    """Dispatches batches of events to python user qemu monitor event
+       batch callbacks
+    """
+    cb = cbData["cb"]
+    opaque = cbData["opaque"]
+
+    cb(conn, [(libvirt.virDomain(conn, _obj=dom), event, seconds, micros, details)
+              for (dom, event, seconds, micros, details) in events], opaque)
+    return 0
+
+def qemuMonitorEventRegisterBatch(conn, dom, events, cb, opaque,
+                                  rate_limits=None, max_batch=64,
+                                  max_delay_ms=100, flags=0):
+    """Adds a qemu monitor event callback receiving the events in
+       batches, as cb(conn, events, opaque) where each entry of the
+       events list is a (dom, event, seconds, micros, details) tuple.
+
+       Only the events named in @events are delivered, or all of them
+       if it is None.  @rate_limits maps event names to the minimum
+       number of milliseconds between two deliveries of that event for
+       a domain: only the latest one is kept while waiting.  Filtering
+       and coalescing happen before the interpreter lock is taken.
+
+       A batch is delivered once @max_batch events are queued, or
+       @max_delay_ms after the first of them.  Requires a registered
+       event loop implementation.  The callback is removed with
+       qemuMonitorEventDeregister()."""
+    if not hasattr(conn, 'qemuMonitorEventCallbackID'):
+        conn.qemuMonitorEventCallbackID = {}
+    cbData = { "cb": cb, "conn": conn, "opaque": opaque }
+    if events is not None:
+        events = list(events)
+    if rate_limits is not None:
+        rate_limits = dict(rate_limits)
+    if dom is None:
+        ret = libvirtmod_qemu.virConnectDomainQemuMonitorEventRegisterBatch(conn._o, None, events, rate_limits, cbData, max_batch, max_delay_ms, flags)
+    else:
+        ret = libvirtmod_qemu.virConnectDomainQemuMonitorEventRegisterBatch(conn._o, dom._o, events, rate_limits, cbData, max_batch, max_delay_ms, flags)
+    if ret == -1:
+        raise libvirt.libvirtError ('virConnectDomainQemuMonitorEventRegisterBatch() failed')
+    conn.qemuMonitorEventCallbackID[ret] = opaque
+    return ret
@@ -22,6 +22,7 @@
 #include <errno.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 #include <libvirt/libvirt.h>
 #include "libvirt-utils.h"
@@ -140,6 +141,44 @@ int virFileClose(int *fdptr)
     return rc;
 }
 
+/**
+ * virTimeMillisNow:
+ * @now: filled with the current time in milliseconds
+ *
+ * Retrieve the current time of the monotonic clock, which is only
+ * suitable for measuring intervals.
+ *
+ * Returns 0 on success, -1 on error with errno set
+ */
+int virTimeMillisNow(unsigned long long *now)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+        return -1;
+
+    *now = (ts.tv_sec * 1000ull) + (ts.tv_nsec / 1000000);
+    return 0;
+}
+
+/**
+ * virTimeSecondsNow:
+ *
+ * Retrieve the current time of the monotonic clock in seconds, with
+ * its full resolution, which is only suitable for measuring intervals.
+ *
+ * Returns the time in seconds, or 0 on error
+ */
+double virTimeSecondsNow(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+        return 0;
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 #if ! LIBVIR_CHECK_VERSION(1, 0, 2)
 /**
  * virTypedParamsClear:
@@ -210,6 +210,10 @@ int virFileClose(int *fdptr)
 # define VIR_FORCE_CLOSE(FD) \
     ignore_value(virFileClose(&(FD)))
 
+int virTimeMillisNow(unsigned long long *now)
+        ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+double virTimeSecondsNow(void);
+
 # if ! LIBVIR_CHECK_VERSION(1, 0, 2)
 void virTypedParamsClear(virTypedParameterPtr params, int nparams);
 
@@ -334,16 +334,129 @@ for name in sorted(finalklassmap):
         fail = True
 
 
+# Python classes built on private entry points of libvirtmod rather
+# than on the public C API: each of their methods maps to the entry
+# point it wraps, or to None if it is pure python
+privateklassmap = {
+    "ConnectionPool": {
+        "acquire": None,
+        "release": None,
+        "connection": None,
+        "threadConnection": None,
+        "releaseThreadConnection": None,
+        "close": None,
+    },
+    "NetworkLeaseCache": {
+        "__init__": "virNetworkLeaseCacheNew",
+        "byMAC": "virNetworkLeaseCacheLookup",
+        "byIP": "virNetworkLeaseCacheLookup",
+        "byHostname": "virNetworkLeaseCacheLookup",
+        "leases": "virNetworkLeaseCacheList",
+        "refresh": "virNetworkLeaseCacheRefresh",
+        "invalidate": "virNetworkLeaseCacheInvalidate",
+        "close": None,
+    },
+    "ConsoleMux": {
+        "__init__": "virConsoleMuxNew",
+        "attach": "virConsoleMuxAttach",
+        "detach": "virConsoleMuxDetach",
+        "read": "virConsoleMuxRead",
+        "info": "virConsoleMuxInfo",
+        "consoles": None,
+        "close": "virConsoleMuxClose",
+    },
+    "DomainStatsSampler": {
+        "__init__": "virDomainStatsSamplerNew",
+        "sample": "virDomainStatsSamplerSample",
+    },
+    "DomainInventory": {
+        "__init__": "virDomainInventoryNew",
+        "resync": "virDomainInventoryResync",
+        "stale": None,
+        "generation": "virDomainInventoryGeneration",
+        "lookupByName": "virDomainInventoryLookup",
+        "lookupByUUIDString": "virDomainInventoryLookup",
+        "domains": "virDomainInventoryList",
+        "changes": "virDomainInventoryList",
+        "close": "virDomainInventoryClose",
+    },
+}
+
+# Python methods of the other classes that have no C API of their own
+# but wrap a private entry point of libvirtmod, or the binding of
+# another C API
+privatefunctions = {
+    "libvirt.virEventRegisterAsyncioImpl": "virEventRegisterAsyncioImpl",
+    "libvirt.aioCall": "virAioSubmit",
+    "libvirt.aioSetMaxWorkers": "virAioSetMaxWorkers",
+    "libvirt.collectStats": "virConnectCollectStats",
+    "libvirt.enableCallStats": "virPyCallStatsEnable",
+    "libvirt.getCallStats": "virPyCallStatsGet",
+    "libvirt.setCallTraceCallback": "virPyCallStatsSetTrace",
+    "virConnect.getAllDomainStatsColumns": "virConnectGetAllDomainStatsColumns",
+    "virConnect.domainEventRegisterBatch": "virConnectDomainEventRegisterBatch",
+    "virConnect.batch": "virAioBatch",
+    "virConnect.lookupByNameOrNone": "virDomainLookupByName",
+    "virConnect.lookupByIDOrNone": "virDomainLookupByID",
+    "virConnect.lookupByUUIDOrNone": "virDomainLookupByUUID",
+    "virConnect.lookupByUUIDStringOrNone": "virDomainLookupByUUIDString",
+    "virConnect.networkLookupByNameOrNone": "virNetworkLookupByName",
+    "virConnect.networkLookupByUUIDStringOrNone": "virNetworkLookupByUUIDString",
+    "virConnect.storagePoolLookupByNameOrNone": "virStoragePoolLookupByName",
+    "virConnect.storagePoolLookupByUUIDStringOrNone": "virStoragePoolLookupByUUIDString",
+    "virConnect.storageVolLookupByKeyOrNone": "virStorageVolLookupByKey",
+    "virConnect.storageVolLookupByPathOrNone": "virStorageVolLookupByPath",
+    "virDomain.blockPeekInto": "virDomainBlockPeekInto",
+    "virDomain.memoryPeekInto": "virDomainMemoryPeekInto",
+    "virDomain.blockPeekRangesInto": "virDomainBlockPeekRangesInto",
+    "virDomain.memoryPeekRangesInto": "virDomainMemoryPeekRangesInto",
+    "virDomain.jobMonitor": "virDomainJobMonitorNew",
+    "virDomain.snapshotLookupByNameOrNone": "virDomainSnapshotLookupByName",
+    "virStoragePool.storageVolLookupByNameOrNone": "virStorageVolLookupByName",
+    "virStream.recvInto": "virStreamRecvInto",
+    "virStream.recvToFD": "virStreamRecvToFD",
+    "virStream.sendFromFD": "virStreamSendFromFD",
+}
+
+def check_private_binding(key, pyname):
+    if not hasattr(libvirt.libvirtmod, pyname):
+        print("FAIL %s -> libvirt.libvirtmod.%s      (C binding does not exist)" %
+              (key, pyname))
+        return False
+    if verbose:
+        print("PASS %s -> libvirt.libvirtmod.%s" % (key, pyname))
+    return True
+
+for klass in sorted(privateklassmap):
+    for func in sorted(gotfunctions.get(klass, [])):
+        if func not in privateklassmap[klass]:
+            print("FAIL %s.%s       (Python API not mapped to C)" % (klass, func))
+            fail = True
+
+    for func in sorted(privateklassmap[klass]):
+        pyname = privateklassmap[klass][func]
+        if pyname is not None and \
+           not check_private_binding("%s.%s" % (klass, func), pyname):
+            fail = True
+
 # Phase 6: Validate that every python API has a corresponding C API
 for klass in gotfunctions:
-    if klass == "libvirtError":
+    # Pure python classes, and those checked above
+    if klass == "libvirtError" or klass in privateklassmap:
         continue
     for func in sorted(gotfunctions[klass]):
+        key = "%s.%s" % (klass, func)
+        if key in privatefunctions:
+            if not check_private_binding(key, privatefunctions[key]):
+                fail = True
+            continue
+
         # These are pure python methods with no C APi
-        if func in ["connect", "getConnect", "domain", "getDomain"]:
+        if func in ["connect", "getConnect", "domain", "getDomain",
+                    "aio", "enableDomainCache", "enableXMLCache",
+                    "invalidateXMLCache", "xmlCacheStats"]:
             continue
 
-        key = "%s.%s" % (klass, func)
         if not key in usedfunctions:
             print("FAIL %s.%s       (Python API not mapped to C)" % (klass, func))
             fail = True
@@ -295,6 +295,39 @@ class my_test(Command):
         self.spawn([sys.executable, "sanitytest.py", self.build_platlib, apis[0]])
         self.spawn([sys.executable, "/usr/bin/nosetests"])
 
+class my_bench(my_test):
+    user_options = my_test.user_options + [
+        ('output=', 'o',
+         "write the JSON results to this file"),
+        ('iterations=', 'n',
+         "calls per benchmark"),
+        ('domains=', 'd',
+         "synthetic domains to create"),
+    ]
+
+    description = "Run binding benchmarks against the test driver."
+
+    def initialize_options(self):
+        my_test.initialize_options(self)
+        self.output = None
+        self.iterations = None
+        self.domains = None
+
+    def run(self):
+        """
+        Run benchmark suite
+        """
+
+        args = [sys.executable, "benchmark.py"]
+        if self.output is not None:
+            args += ["--output", self.output]
+        if self.iterations is not None:
+            args += ["--iterations", str(self.iterations)]
+        if self.domains is not None:
+            args += ["--domains", str(self.domains)]
+        args.append(self.build_platlib)
+        self.spawn(args)
+
 
 class my_clean(clean):
     def run(self):
@@ -326,7 +359,8 @@ setup(name = 'libvirt-python',
           'clean': my_clean,
           'sdist': my_sdist,
           'rpm': my_rpm,
-          'test': my_test
+          'test': my_test,
+          'bench': my_bench
       },
       classifiers = [
           "Development Status :: 5 - Production/Stable",
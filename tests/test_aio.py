@@ -0,0 +1,105 @@
+import subprocess
+import sys
+import unittest
+import libvirt
+
+# Only one event implementation can be registered by a process, so the
+# asyncio one is driven from a child python, which runs this and prints
+# what its callbacks saw
+_eventLoopScript = """
+import asyncio
+import os
+import libvirt
+
+loop = asyncio.new_event_loop()
+asyncio.set_event_loop(loop)
+libvirt.virEventRegisterAsyncioImpl(loop)
+
+seen = []
+def timeout(timer, opaque):
+    seen.append(opaque)
+    libvirt.virEventRemoveTimeout(timer)
+
+def handle(watch, fd, events, opaque):
+    os.read(fd, 1)
+    seen.append(opaque)
+    libvirt.virEventRemoveHandle(watch)
+
+def lifecycle(conn, dom, event, detail, opaque):
+    seen.append(opaque)
+    loop.stop()
+
+(rfd, wfd) = os.pipe()
+libvirt.virEventAddHandle(rfd, libvirt.VIR_EVENT_HANDLE_READABLE,
+                          handle, "handle")
+libvirt.virEventAddTimeout(0, timeout, "timeout")
+
+conn = libvirt.open("test:///default")
+conn.domainEventRegisterAny(None, libvirt.VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+                            lifecycle, "lifecycle")
+dom = conn.lookupByName("test")
+
+loop.call_soon(os.write, wfd, b"x")
+loop.call_soon(dom.suspend)
+loop.call_later(10, loop.stop)
+loop.run_forever()
+dom.resume()
+print(" ".join(sorted(seen)))
+"""
+
+class TestLibvirtAsyncio(unittest.TestCase):
+    def setUp(self):
+        if sys.version_info < (3, 4):
+            self.skipTest("asyncio needs Python 3.4 or newer")
+
+    def testEventRegisterAsyncioImpl(self):
+        out = subprocess.check_output([sys.executable, "-c", _eventLoopScript])
+        self.assertEquals(out.split(), [b"handle", b"lifecycle", b"timeout"])
+
+class TestLibvirtAioCall(unittest.TestCase):
+    def setUp(self):
+        if sys.version_info < (3, 5):
+            self.skipTest("aioCall needs Python 3.5 or newer")
+        import asyncio
+        self.loop = asyncio.new_event_loop()
+        asyncio.set_event_loop(self.loop)
+        self.conn = libvirt.open("test:///default")
+        self.dom = self.conn.lookupByName("test")
+
+    def tearDown(self):
+        self.dom = None
+        self.conn = None
+        self.loop.close()
+
+    def _run(self, future):
+        return self.loop.run_until_complete(future)
+
+    def testAioCall(self):
+        self.assertEquals(self._run(libvirt.aioCall(self.dom.info)),
+                          self.dom.info())
+        self.assertEquals(self._run(libvirt.aio(self.dom).XMLDesc(0)),
+                          self.dom.XMLDesc(0))
+        doms = self._run(libvirt.aioCall(self.conn.listAllDomains, flags=0))
+        self.assertEquals([dom.name() for dom in doms], ["test"])
+
+        self.assertRaises(AttributeError, lambda: libvirt.aio(self.dom)._o)
+
+    def testAioCallError(self):
+        future = libvirt.aio(self.conn).lookupByName("nosuchdomain")
+        try:
+            self._run(future)
+            self.fail("lookupByName did not fail")
+        except libvirt.libvirtError as e:
+            self.assertEquals(e.get_error_code(), libvirt.VIR_ERR_NO_DOMAIN)
+
+    def testAioSetMaxWorkers(self):
+        import asyncio
+        self.assertRaises(ValueError, libvirt.aioSetMaxWorkers, 0)
+        libvirt.aioSetMaxWorkers(2)
+        try:
+            # The calls past the limit wait for a free worker
+            futures = [libvirt.aio(self.dom).info() for i in range(20)]
+            results = self._run(asyncio.gather(*futures))
+            self.assertEquals(results, [self.dom.info()] * 20)
+        finally:
+            libvirt.aioSetMaxWorkers(32)
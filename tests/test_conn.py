@@ -1,4 +1,5 @@
 
+import pickle
 import unittest
 import libvirt
 
@@ -14,3 +15,233 @@ class TestLibvirtConn(unittest.TestCase):
         self.assertEquals(len(doms), 1)
         self.assertEquals(type(doms[0]), libvirt.virDomain)
         self.assertEquals(doms[0].name(), "test")
+
+    def testConnDomainListLazy(self):
+        doms = self.conn.listAllDomains(lazy=True)
+        self.assertEquals(len(doms), 1)
+        self.assertEquals(type(doms[0]), libvirt.virDomain)
+        self.assertEquals(doms[0].name(), "test")
+        self.assertEquals(doms[-1].name(), "test")
+        self.assertEquals([dom.name() for dom in doms], ["test"])
+        self.assertEquals([dom.name() for dom in doms[0:1]], ["test"])
+        self.assertRaises(IndexError, lambda: doms[1])
+
+        self.assertEquals(doms.names(), ["test"])
+        self.assertEquals(doms.uuids(), [doms[0].UUIDString()])
+
+    def testConnNetworkListLazy(self):
+        nets = self.conn.listAllNetworks(lazy=True)
+        self.assertEquals(nets.names(),
+                          [net.name() for net in self.conn.listAllNetworks()])
+        self.assertEquals(nets.uuids(), [net.UUIDString() for net in nets])
+
+    def testConnLookupOrNone(self):
+        dom = self.conn.lookupByNameOrNone("test")
+        self.assertEquals(dom.name(), "test")
+        self.assertEquals(self.conn.lookupByIDOrNone(dom.ID()).name(), "test")
+        self.assertEquals(self.conn.lookupByUUIDOrNone(dom.UUID()).name(), "test")
+        self.assertEquals(self.conn.lookupByUUIDStringOrNone(dom.UUIDString()).name(),
+                          "test")
+        self.assertEquals(self.conn.lookupByNameOrNone("nosuchdomain"), None)
+        self.assertEquals(self.conn.lookupByIDOrNone(12345), None)
+        self.assertEquals(self.conn.lookupByUUIDStringOrNone(
+            "11111111-2222-3333-4444-555555555555"), None)
+
+        self.assertEquals(self.conn.networkLookupByNameOrNone("default").name(),
+                          "default")
+        self.assertEquals(self.conn.networkLookupByNameOrNone("nosuchnetwork"),
+                          None)
+        self.assertEquals(self.conn.storagePoolLookupByNameOrNone("default-pool").name(),
+                          "default-pool")
+        self.assertEquals(self.conn.storagePoolLookupByNameOrNone("nosuchpool"),
+                          None)
+        self.assertEquals(dom.snapshotLookupByNameOrNone("nosuchsnapshot"), None)
+
+        # Only a missing object is not an error
+        self.assertRaises(libvirt.libvirtError,
+                          self.conn.lookupByUUIDStringOrNone, "not-a-uuid")
+
+    def testConnError(self):
+        try:
+            self.conn.lookupByName("nosuchdomain")
+            self.fail("lookupByName of a missing domain succeeded")
+        except libvirt.libvirtError as e:
+            err = e
+
+        self.assertEquals(err.get_error_code(), libvirt.VIR_ERR_NO_DOMAIN)
+        self.assertEquals(err.get_error_domain(), libvirt.VIR_FROM_TEST)
+        self.assertEquals(err.err[0], libvirt.VIR_ERR_NO_DOMAIN)
+        self.assertEquals(err.err[2], err.get_error_message())
+        self.assertEquals(str(err), err.get_error_message())
+
+        copy = pickle.loads(pickle.dumps(err))
+        self.assertEquals(type(copy), libvirt.libvirtError)
+        self.assertEquals(str(copy), str(err))
+        self.assertEquals(copy.err, err.err)
+        self.assertEquals(copy.get_error_code(), libvirt.VIR_ERR_NO_DOMAIN)
+        self.assertEquals(copy.get_error_message(), err.get_error_message())
+
+    def testConnBatch(self):
+        dom = self.conn.lookupByName("test")
+        with self.conn.batch() as b:
+            self.assertEquals(b(dom).info(), 0)
+            self.assertEquals(b(self.conn).lookupByName("nosuchdomain"), 1)
+            self.assertEquals(b.call(getattr, dom, "name"), 2)
+            # Returns an exception instance, yet succeeds
+            self.assertEquals(b.call(ValueError, "made"), 3)
+        self.assertEquals(len(b.results), 4)
+
+        self.assertEquals(b.results[0], (True, dom.info()))
+        (ok, err) = b.results[1]
+        self.assertFalse(ok)
+        self.assertEquals(err.get_error_code(), libvirt.VIR_ERR_NO_DOMAIN)
+        (ok, name) = b.results[2]
+        self.assertTrue(ok)
+        self.assertEquals(name(), "test")
+        (ok, exc) = b.results[3]
+        self.assertTrue(ok)
+        self.assertEquals(str(exc), "made")
+
+        # Leaving on an error issues nothing
+        try:
+            with self.conn.batch() as b:
+                b(dom).info()
+                raise ValueError("stop")
+        except ValueError:
+            pass
+        self.assertEquals(b.results, None)
+        self.assertEquals(b.run(), [])
+
+class TestLibvirtConnectionPool(unittest.TestCase):
+    def setUp(self):
+        self.pool = libvirt.ConnectionPool("test:///default", size=1)
+
+    def tearDown(self):
+        self.pool.close()
+        self.pool = None
+
+    def testPoolAcquireRelease(self):
+        conn = self.pool.acquire()
+        self.assertEquals(conn.listAllDomains()[0].name(), "test")
+
+        # The only connection is checked out
+        self.assertRaises(libvirt.libvirtError, self.pool.acquire, 0.1)
+
+        self.pool.release(conn)
+        self.assertRaises(ValueError, self.pool.release, conn)
+        self.assertRaises(ValueError, self.pool.release,
+                          libvirt.open("test:///default"))
+
+        again = self.pool.acquire(0.1)
+        self.assertTrue(again is conn)
+        self.pool.release(again)
+
+    def testPoolConnection(self):
+        with self.pool.connection() as conn:
+            self.assertEquals(conn.lookupByName("test").name(), "test")
+            self.assertRaises(libvirt.libvirtError, self.pool.acquire, 0.1)
+        with self.pool.connection(0.1) as again:
+            self.assertTrue(again is conn)
+
+        conn = self.pool.threadConnection()
+        self.assertTrue(self.pool.threadConnection() is conn)
+        self.pool.releaseThreadConnection()
+        self.pool.release(self.pool.acquire(0.1))
+
+    def testPoolClose(self):
+        conn = self.pool.acquire()
+        self.pool.close()
+        self.assertRaises(libvirt.libvirtError, self.pool.acquire)
+        self.pool.release(conn)
+
+class TestLibvirtDomainInventory(unittest.TestCase):
+    xml = ("<domain type='test'><name>%s</name><memory>8192</memory>"
+           "<os><type>hvm</type></os></domain>")
+
+    def setUp(self):
+        # The inventory follows domain events
+        libvirt.virEventRegisterDefaultImpl()
+        self.conn = libvirt.open("test:///default")
+        try:
+            self.inv = libvirt.DomainInventory(self.conn)
+        except libvirt.libvirtError as e:
+            if e.get_error_code() != libvirt.VIR_ERR_NO_SUPPORT:
+                raise
+            self.skipTest("getAllDomainStats is not supported by this libvirt")
+
+    def tearDown(self):
+        self.inv.close()
+        self.inv = None
+        self.conn = None
+
+    def testInventorySnapshot(self):
+        dom = self.conn.lookupByName("test")
+        entries = self.inv.domains()
+        self.assertEquals(len(entries), 1)
+        entry = entries[0]
+        self.assertEquals(entry["name"], "test")
+        self.assertEquals(entry["uuid"], dom.UUIDString())
+        self.assertEquals(entry["id"], dom.ID())
+        self.assertEquals([entry["state"], entry["reason"]], list(dom.state()))
+        self.assertEquals(entry["vcpus"], dom.info()[3])
+        self.assertEquals(entry["memory"], dom.info()[2])
+        self.assertEquals(entry["removed"], False)
+        self.assertEquals(list(self.inv), entries)
+
+        self.assertEquals(self.inv.lookupByName("test"), entry)
+        self.assertEquals(self.inv.lookupByUUIDString(entry["uuid"].upper()),
+                          entry)
+        self.assertEquals(self.inv.lookupByName("nosuchdomain"), None)
+
+    def testInventoryChanges(self):
+        (gen, entries) = self.inv.changes()
+        self.assertEquals(gen, self.inv.generation())
+        self.assertEquals([entry["name"] for entry in entries], ["test"])
+        self.assertEquals(self.inv.changes(gen), (gen, []))
+
+        dom = self.conn.defineXML(self.xml % "inventory-test")
+        try:
+            # Nothing changed for the others
+            self.inv.resync()
+            (added, entries) = self.inv.changes(gen)
+            self.assertEquals([entry["name"] for entry in entries],
+                              ["inventory-test"])
+            self.assertEquals(entries[0]["id"], -1)
+            self.assertEquals(entries[0]["removed"], False)
+            self.assertEquals(self.inv.lookupByName("inventory-test"),
+                              entries[0])
+        finally:
+            dom.undefine()
+
+        self.inv.resync()
+        (removed, entries) = self.inv.changes(added)
+        self.assertEquals([entry["name"] for entry in entries],
+                          ["inventory-test"])
+        self.assertEquals(entries[0]["removed"], True)
+        self.assertEquals(self.inv.lookupByName("inventory-test"), None)
+        self.assertEquals([entry["name"] for entry in self.inv.domains()],
+                          ["test"])
+
+    def testInventoryPrune(self):
+        gen = self.inv.generation()
+        doms = [self.conn.defineXML(self.xml % ("inventory-test-%d" % i))
+                for i in range(300)]
+        try:
+            self.inv.resync()
+        finally:
+            for dom in doms:
+                dom.undefine()
+        self.inv.resync()
+
+        # The oldest removals are forgotten, the newest still reported
+        self.assertRaises(ValueError, self.inv.changes, gen)
+        (latest, entries) = self.inv.changes(0)
+        removed = [entry for entry in entries if entry["removed"]]
+        self.assertTrue(0 < len(removed) <= 256)
+        self.assertEquals([entry["name"] for entry in self.inv.domains()],
+                          ["test"])
+
+    def testInventoryClose(self):
+        self.inv.close()
+        self.inv.close()
+        self.assertRaises(libvirt.libvirtError, self.inv.resync)
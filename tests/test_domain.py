@@ -1,4 +1,6 @@
 
+import os
+import time
 import unittest
 import libvirt
 
@@ -17,3 +19,168 @@ class TestLibvirtDomain(unittest.TestCase):
         self.assertTrue("weight" in params)
         params["weight"] = 100
         self.dom.setSchedulerParameters(params)
+
+    def _memoryPeek(self, start, size):
+        try:
+            return self.dom.memoryPeek(start, size, libvirt.VIR_MEMORY_VIRTUAL)
+        except libvirt.libvirtError as e:
+            if e.get_error_code() != libvirt.VIR_ERR_NO_SUPPORT:
+                raise
+            self.skipTest("memoryPeek is not supported by this libvirt")
+
+    def testDomainMemoryPeekInto(self):
+        expected = self._memoryPeek(0, 16)
+        buf = bytearray(16)
+        self.dom.memoryPeekInto(0, buf, libvirt.VIR_MEMORY_VIRTUAL)
+        self.assertEquals(bytes(buf), expected)
+
+        buf = bytearray(32)
+        self.dom.memoryPeekInto(0, memoryview(buf)[8:24],
+                                libvirt.VIR_MEMORY_VIRTUAL)
+        self.assertEquals(bytes(buf[8:24]), expected)
+        self.assertEquals(bytes(buf[:8]), b"\0" * 8)
+
+        self.assertRaises(TypeError, self.dom.memoryPeekInto,
+                          0, b"\0" * 16, libvirt.VIR_MEMORY_VIRTUAL)
+
+    def testDomainMemoryPeekRangesInto(self):
+        expected = self._memoryPeek(0, 4) + self._memoryPeek(8, 4)
+        buf = bytearray(8)
+        ret = self.dom.memoryPeekRangesInto([(0, 4), (8, 4)], buf,
+                                            libvirt.VIR_MEMORY_VIRTUAL)
+        self.assertEquals(ret, 8)
+        self.assertEquals(bytes(buf), expected)
+
+        self.assertRaises(ValueError, self.dom.memoryPeekRangesInto,
+                          [(0, 4), (8, 8)], buf, libvirt.VIR_MEMORY_VIRTUAL)
+
+    def testDomainXMLCache(self):
+        # The cache follows domain events
+        libvirt.virEventRegisterDefaultImpl()
+        self.assertEquals(self.conn.xmlCacheStats(), None)
+        self.conn.enableXMLCache()
+        try:
+            xml = self.dom.XMLDesc()
+            self.assertEquals(self.dom.XMLDesc(), xml)
+            stats = self.conn.xmlCacheStats()
+            self.assertEquals((stats["hits"], stats["misses"]), (1, 1))
+            self.assertEquals(stats["entries"], 1)
+
+            # Each set of flags is a document of its own
+            self.dom.XMLDesc(libvirt.VIR_DOMAIN_XML_INACTIVE)
+            self.assertEquals(self.conn.xmlCacheStats()["entries"], 2)
+
+            # Changes reported by no event still drop the documents
+            self.dom.setMemory(self.dom.info()[2])
+            stats = self.conn.xmlCacheStats()
+            self.assertEquals(stats["invalidations"], 1)
+            self.assertEquals(stats["entries"], 0)
+            self.assertEquals(self.dom.XMLDesc(), xml)
+            self.assertEquals(self.conn.xmlCacheStats()["misses"], 3)
+
+            self.conn.invalidateXMLCache(self.dom)
+            stats = self.conn.xmlCacheStats()
+            self.assertEquals(stats["invalidations"], 2)
+            self.assertEquals(stats["entries"], 0)
+
+            caps = self.conn.getCapabilities()
+            self.assertEquals(self.conn.getCapabilities(), caps)
+            self.dom.XMLDesc()
+            stats = self.conn.xmlCacheStats()
+            self.assertEquals((stats["hits"], stats["misses"]), (2, 5))
+            self.assertEquals(stats["entries"], 2)
+
+            # Host documents included
+            self.conn.invalidateXMLCache()
+            stats = self.conn.xmlCacheStats()
+            self.assertEquals(stats["invalidations"], 4)
+            self.assertEquals(stats["entries"], 0)
+        finally:
+            self.conn.enableXMLCache(False)
+        self.assertEquals(self.conn.xmlCacheStats(), None)
+        self.assertEquals(self.dom.XMLDesc(), xml)
+
+    def testDomainJobMonitorFinish(self):
+        events = []
+        def cb(dom, event, progress, opaque):
+            events.append((dom.name(), event, progress["type"], opaque))
+
+        with self.dom.jobMonitor(cb, "opaque", interval_ms=10) as mon:
+            # No job, so nothing to report while polling
+            time.sleep(0.1)
+            self.assertEquals(events, [])
+            progress = mon.progress()
+            self.assertEquals(progress["type"], libvirt.VIR_DOMAIN_JOB_NONE)
+            self.assertEquals(progress["stalls"], 0)
+            self.assertEquals(progress["postcopy"], False)
+
+        # The end of the job is reported once, when leaving the block
+        self.assertEquals(events, [("test", libvirt.VIR_PYTHON_JOB_MONITOR_COMPLETED,
+                                    libvirt.VIR_DOMAIN_JOB_NONE, "opaque")])
+        time.sleep(0.05)
+        self.assertEquals(len(events), 1)
+
+    def testDomainJobMonitorStop(self):
+        events = []
+        mon = self.dom.jobMonitor(lambda *args: events.append(args),
+                                  interval_ms=10)
+        mon.stop()
+        with mon:
+            pass
+        time.sleep(0.05)
+        self.assertEquals(events, [])
+
+        self.assertRaises(ValueError, self.dom.jobMonitor, None, interval_ms=0)
+        self.assertRaises(TypeError, self.dom.jobMonitor, None, downtimes=1)
+
+class TestLibvirtConsoleMux(unittest.TestCase):
+    def setUp(self):
+        libvirt.virEventRegisterDefaultImpl()
+        self.conn = libvirt.open("test:///default")
+        self.dom = self.conn.lookupByName("test")
+        self.closed = []
+        self.mux = libvirt.ConsoleMux(
+            lambda console, reason, message, opaque:
+                self.closed.append((console, reason, opaque)), "opaque")
+
+    def tearDown(self):
+        self.mux.close()
+        self.mux = None
+        self.dom = None
+        self.conn = None
+
+    def testConsoleMuxUnknown(self):
+        self.assertEquals(self.mux.consoles(), {})
+        self.assertRaises(KeyError, self.mux.read, 1)
+        self.assertRaises(KeyError, self.mux.info, 1)
+        self.assertRaises(KeyError, self.mux.detach, 1)
+        with libvirt.ConsoleMux() as mux:
+            self.assertEquals(mux.consoles(), {})
+
+    def testConsoleMuxAttach(self):
+        (rfd, wfd) = os.pipe()
+        try:
+            try:
+                console = self.mux.attach(self.dom, fd=wfd, ring_size=16)
+            except libvirt.libvirtError as e:
+                if e.get_error_code() != libvirt.VIR_ERR_NO_SUPPORT:
+                    raise
+                self.assertEquals(self.mux.consoles(), {})
+                self.skipTest("openConsole is not supported by this libvirt")
+
+            self.assertEquals(list(self.mux.consoles().keys()), [console])
+            self.assertEquals(self.mux.consoles()[console].name(), "test")
+            info = self.mux.info(console)
+            self.assertTrue(info["buffered"] <= 16)
+            self.assertTrue(info["buffered"] <= info["received"])
+            self.assertEquals(info["state"], libvirt.VIR_PYTHON_CONSOLE_OPEN)
+            self.assertTrue(len(self.mux.read(console, clear=True)) <= 16)
+
+            # Detaching is not a reason to call back
+            self.mux.detach(console)
+            self.assertEquals(self.mux.consoles(), {})
+            self.assertRaises(KeyError, self.mux.info, console)
+            self.assertEquals(self.closed, [])
+        finally:
+            os.close(rfd)
+            os.close(wfd)
@@ -0,0 +1,49 @@
+
+import unittest
+import libvirt
+
+class TestLibvirtNetworkLeaseCache(unittest.TestCase):
+    def setUp(self):
+        libvirt.virEventRegisterDefaultImpl()
+        self.conn = libvirt.open("test:///default")
+        self.net = self.conn.networkLookupByName("default")
+        try:
+            self.leases = self.net.DHCPLeases()
+        except libvirt.libvirtError as e:
+            if e.get_error_code() != libvirt.VIR_ERR_NO_SUPPORT:
+                raise
+            self.skipTest("DHCPLeases is not supported by this libvirt")
+        self.cache = libvirt.NetworkLeaseCache(self.net)
+
+    def tearDown(self):
+        self.cache.close()
+        self.cache = None
+        self.net = None
+        self.conn = None
+
+    def _keys(self, leases):
+        return sorted([(lease["mac"], lease["ipaddr"]) for lease in leases])
+
+    def testLeaseCacheList(self):
+        self.assertEquals(self._keys(self.cache.leases()),
+                          self._keys(self.leases))
+        self.cache.invalidate()
+        self.assertEquals(self._keys(self.cache.leases()),
+                          self._keys(self.leases))
+        self.cache.refresh()
+        self.assertEquals(self._keys(self.cache.leases()),
+                          self._keys(self.leases))
+
+    def testLeaseCacheLookup(self):
+        for lease in self.leases:
+            key = (lease["mac"], lease["ipaddr"])
+            self.assertTrue(key in self._keys(self.cache.byMAC(lease["mac"])))
+            self.assertTrue(key in self._keys(self.cache.byMAC(lease["mac"].upper())))
+            self.assertEquals(self.cache.byIP(lease["ipaddr"])["ipaddr"],
+                              lease["ipaddr"])
+            if lease["hostname"]:
+                self.assertTrue(key in self._keys(self.cache.byHostname(lease["hostname"])))
+
+        self.assertEquals(self.cache.byMAC("02:00:00:00:00:00"), [])
+        self.assertEquals(self.cache.byIP("203.0.113.1"), None)
+        self.assertEquals(self.cache.byHostname("nosuchhost"), [])
@@ -0,0 +1,47 @@
+import unittest
+import libvirt
+import libvirt_qemu
+
+class TestLibvirtQemuMonitorEventBatch(unittest.TestCase):
+    def setUp(self):
+        libvirt.virEventRegisterDefaultImpl()
+        self.conn = libvirt.open("test:///default")
+        self.batches = []
+
+    def tearDown(self):
+        self.conn = None
+
+    def _cb(self, conn, events, opaque):
+        self.batches.append(events)
+
+    def _register(self, *args, **kwargs):
+        return libvirt_qemu.qemuMonitorEventRegisterBatch(self.conn, None,
+                                                          *args, **kwargs)
+
+    def testRegisterBatchArguments(self):
+        # Checked before anything is registered with libvirt
+        self.assertRaises(ValueError, self._register, None, self._cb, None,
+                          max_batch=0)
+        self.assertRaises(ValueError, self._register, None, self._cb, None,
+                          max_delay_ms=-1)
+        self.assertRaises(TypeError, self._register, ["SHUTDOWN", 1],
+                          self._cb, None)
+        self.assertRaises(TypeError, self._register, None, self._cb, None,
+                          rate_limits={1: 100})
+        self.assertRaises(TypeError, self._register, None, self._cb, None,
+                          rate_limits={"BALLOON_CHANGE": "often"})
+
+    def testRegisterBatchUnsupported(self):
+        # The test driver has no QEMU monitor, so the registration fails
+        # and must not leave a callback behind
+        try:
+            callbackID = self._register(["SHUTDOWN", "BALLOON_CHANGE"],
+                                        self._cb, None,
+                                        rate_limits={"BALLOON_CHANGE": 1000})
+        except libvirt.libvirtError as e:
+            self.assertEquals(e.get_error_code(), libvirt.VIR_ERR_NO_SUPPORT)
+            self.assertEquals(getattr(self.conn, "qemuMonitorEventCallbackID",
+                                      {}), {})
+            return
+        libvirt_qemu.qemuMonitorEventDeregister(self.conn, callbackID)
+        self.assertEquals(self.batches, [])
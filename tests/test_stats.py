@@ -0,0 +1,152 @@
+import time
+import unittest
+import libvirt
+
+class TestLibvirtDomainStatsSampler(unittest.TestCase):
+    def setUp(self):
+        self.conn = libvirt.open("test:///default")
+        try:
+            records = self.conn.getAllDomainStats()
+        except libvirt.libvirtError as e:
+            if e.get_error_code() != libvirt.VIR_ERR_NO_SUPPORT:
+                raise
+            self.skipTest("getAllDomainStats is not supported by this libvirt")
+        self.stats = dict([(dom.UUIDString(), stats) for (dom, stats) in records])
+
+    def tearDown(self):
+        self.conn = None
+
+    def testSamplerRates(self):
+        sampler = libvirt.DomainStatsSampler(self.conn)
+        first = sampler.sample()
+        self.assertEquals(sorted([dom.UUIDString() for (dom, rates) in first]),
+                          sorted(self.stats.keys()))
+        self.assertEquals([rates for (dom, rates) in first],
+                          [{}] * len(first))
+
+        time.sleep(0.05)
+        second = sampler.sample()
+        self.assertTrue(sampler.interval > 0)
+        for (dom, rates) in second:
+            stats = self.stats[dom.UUIDString()]
+            for field in ("cpu.time", "vcpu.0.time", "net.0.rx.bytes",
+                          "block.0.rd.reqs", "block.0.wr.bytes"):
+                if field in stats:
+                    self.assertTrue(field in rates)
+            for (field, rate) in rates.items():
+                self.assertTrue(field in stats)
+                self.assertTrue(rate >= 0)
+
+            # Gauges get no rate
+            for field in ("state.state", "balloon.current", "vcpu.current",
+                          "block.0.capacity", "block.0.allocation"):
+                self.assertFalse(field in rates)
+
+    def testSamplerDomains(self):
+        dom = self.conn.lookupByName("test")
+        sampler = libvirt.DomainStatsSampler(self.conn, doms=[dom])
+        sampler.sample()
+        records = sampler.sample()
+        self.assertEquals([d.name() for (d, rates) in records], ["test"])
+
+class TestLibvirtCollectStats(unittest.TestCase):
+    def setUp(self):
+        self.conns = [libvirt.open("test:///default") for i in range(4)]
+        try:
+            self.conns[0].getAllDomainStats()
+        except libvirt.libvirtError as e:
+            if e.get_error_code() != libvirt.VIR_ERR_NO_SUPPORT:
+                raise
+            self.skipTest("getAllDomainStats is not supported by this libvirt")
+        self.names = sorted([dom.name() for (dom, stats) in
+                             self.conns[0].getAllDomainStats()])
+
+    def tearDown(self):
+        self.conns = None
+
+    def _names(self, result):
+        return sorted([dom.name() for (dom, stats) in result])
+
+    def testCollectStats(self):
+        results = libvirt.collectStats(self.conns, max_parallel=2)
+        self.assertEquals(len(results), len(self.conns))
+        for (conn, result) in zip(self.conns, results):
+            self.assertEquals(self._names(result), self.names)
+            for (dom, stats) in result:
+                self.assertTrue(dom.connect() is conn)
+                self.assertTrue("state.state" in stats)
+
+        self.assertEquals(libvirt.collectStats([]), [])
+
+    def testCollectStatsFailure(self):
+        # Each connection gets its own error
+        results = libvirt.collectStats(self.conns, stats=1 << 30,
+                                       flags=libvirt.VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS)
+        self.assertEquals(len(results), len(self.conns))
+        for result in results:
+            self.assertTrue(isinstance(result, libvirt.libvirtError))
+            self.assertTrue(result.get_error_code() != libvirt.VIR_ERR_OK)
+
+    def testCollectStatsTimeout(self):
+        # Queries give up at once, replacing their worker every time, so
+        # each connection either made it or timed out
+        results = libvirt.collectStats(self.conns, max_parallel=1,
+                                       timeout_ms=0)
+        self.assertEquals(len(results), len(self.conns))
+        for result in results:
+            if isinstance(result, libvirt.libvirtError):
+                self.assertEquals(result.get_error_code(),
+                                  libvirt.VIR_ERR_OPERATION_TIMEOUT)
+            else:
+                self.assertEquals(self._names(result), self.names)
+
+class TestLibvirtCallStats(unittest.TestCase):
+    def setUp(self):
+        self.conn = libvirt.open("test:///default")
+        self.dom = self.conn.lookupByName("test")
+        libvirt.enableCallStats()
+        libvirt.getCallStats(reset=True)
+
+    def tearDown(self):
+        libvirt.setCallTraceCallback(None)
+        libvirt.enableCallStats(False)
+        self.dom = None
+        self.conn = None
+
+    def _calls(self, name, reset=False):
+        return libvirt.getCallStats(reset).get(name, {"calls": 0})["calls"]
+
+    def testCallStats(self):
+        for i in range(3):
+            self.dom.info()
+        stats = libvirt.getCallStats()["virDomainGetInfo"]
+        self.assertEquals(stats["calls"], 3)
+        self.assertTrue(0 <= stats["max_time"] <= stats["time"])
+        self.assertTrue(stats["convert_time"] >= 0)
+
+        self.assertEquals(self._calls("virDomainGetInfo", reset=True), 3)
+        self.assertEquals(self._calls("virDomainGetInfo"), 0)
+
+        # Nothing is recorded while disabled
+        libvirt.enableCallStats(False)
+        self.dom.info()
+        libvirt.enableCallStats()
+        self.assertEquals(self._calls("virDomainGetInfo"), 0)
+        self.dom.info()
+        self.assertEquals(self._calls("virDomainGetInfo"), 1)
+
+    def testCallTrace(self):
+        traced = []
+        def trace(name, time, convert_time):
+            # Not traced itself
+            self.dom.name()
+            traced.append(name)
+        libvirt.setCallTraceCallback(trace)
+        self.dom.info()
+        self.dom.info()
+        libvirt.setCallTraceCallback(None)
+        self.dom.info()
+        self.assertEquals(traced.count("virDomainGetInfo"), 2)
+        self.assertFalse("virDomainGetName" in traced)
+
+        self.assertRaises(TypeError, libvirt.setCallTraceCallback, 1)
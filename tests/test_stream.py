@@ -0,0 +1,194 @@
+import array
+import sys
+import tempfile
+import unittest
+import libvirt
+
+class _FakeRecvStream(libvirt.virStream):
+    # Hands out @data @chunk bytes at a time to the python loops of
+    # virStream, without a libvirt stream behind
+    def __init__(self, data, chunk):
+        self._o = None
+        self.data = data
+        self.chunk = chunk
+
+    def recvInto(self, buf, nbytes=-1):
+        view = memoryview(buf).cast("B")
+        n = min(len(view), self.chunk, len(self.data))
+        view[:n] = self.data[:n]
+        self.data = self.data[n:]
+        return n
+
+    def abort(self):
+        pass
+
+class _FakeSendStream(libvirt.virStream):
+    # Takes at most @chunk bytes per send, to exercise the partial
+    # sends of virStream.sendAll
+    def __init__(self, chunk):
+        self._o = None
+        self.chunk = chunk
+        self.sent = []
+
+    def send(self, data):
+        n = min(len(data), self.chunk)
+        chunk = data[:n]
+        if hasattr(chunk, "tobytes"):
+            # bytes() of a memoryview is its repr on Python 2
+            chunk = chunk.tobytes()
+        self.sent.append(bytes(chunk))
+        return n
+
+    def abort(self):
+        pass
+
+class TestLibvirtStream(unittest.TestCase):
+    def setUp(self):
+        self.conn = libvirt.open("test:///default")
+        self.dom = self.conn.lookupByName("test")
+
+    def tearDown(self):
+        self.dom = None
+        self.conn = None
+
+    def _screenshot(self, flags=0):
+        stream = self.conn.newStream(flags)
+        try:
+            self.dom.screenshot(stream, 0)
+        except libvirt.libvirtError as e:
+            if e.get_error_code() != libvirt.VIR_ERR_NO_SUPPORT:
+                raise
+            self.skipTest("screenshot is not supported by this libvirt")
+        return stream
+
+    def _recvAll(self):
+        stream = self._screenshot()
+        data = []
+        stream.recvAll(lambda s, buf, opaque: data.append(buf), None)
+        stream.finish()
+        return b"".join(data)
+
+    def testStreamRecvInto(self):
+        expected = self._recvAll()
+        stream = self._screenshot()
+        got = bytearray()
+        buf = bytearray(1000)
+        while True:
+            ret = stream.recvInto(buf, 500)
+            self.assertTrue(0 <= ret <= 500)
+            if ret == 0:
+                break
+            got += buf[:ret]
+        stream.finish()
+        self.assertEquals(bytes(got), expected)
+
+        stream = self._screenshot()
+        self.assertRaises(TypeError, stream.recvInto, b"\0" * 16)
+        stream.abort()
+
+    def testStreamRecvAllBuffer(self):
+        expected = self._recvAll()
+        stream = self._screenshot()
+        data = []
+        stream.recvAll(lambda s, buf, opaque: data.append(bytes(buf)), None,
+                       bytearray(777))
+        stream.finish()
+        self.assertEquals(b"".join(data), expected)
+
+    def testStreamRecvAllTypedBuffer(self):
+        if sys.version_info[0] < 3:
+            self.skipTest("typed buffers can't be viewed as bytes")
+        # The chunks are sliced by bytes, not by items of the buffer
+        stream = _FakeRecvStream(b"0123456789" * 10, 10)
+        data = []
+        stream.recvAll(lambda s, buf, opaque: data.append(bytes(buf)), None,
+                       array.array("i", [0] * 16))
+        self.assertEquals(data, [b"0123456789"] * 10)
+
+    def testStreamRecvToFD(self):
+        expected = self._recvAll()
+        progress = []
+        with tempfile.TemporaryFile() as f:
+            stream = self._screenshot()
+            ret = stream.recvToFD(f.fileno(), 512,
+                                  lambda s, total, opaque: progress.append(total),
+                                  None, 0)
+            stream.finish()
+            self.assertEquals(ret, len(expected))
+            f.seek(0)
+            self.assertEquals(f.read(), expected)
+        # Once more when the stream ended, with everything in
+        self.assertTrue(len(progress) > 0)
+        self.assertEquals(progress[-1], len(expected))
+        self.assertEquals(progress, sorted(progress))
+
+    def testStreamRecvToFDSparse(self):
+        expected = self._recvAll()
+        with tempfile.TemporaryFile() as f:
+            stream = self._screenshot()
+            (logical, physical) = stream.recvToFD(
+                f.fileno(), sparse=libvirt.VIR_PYTHON_STREAM_SPARSE_LOCAL)
+            stream.finish()
+            self.assertEquals(logical, len(expected))
+            self.assertTrue(physical <= logical)
+            f.seek(0)
+            self.assertEquals(f.read(), expected)
+
+    def testStreamRecvToFDProgressError(self):
+        def progress(stream, total, opaque):
+            raise ValueError("stop")
+
+        with tempfile.TemporaryFile() as f:
+            stream = self._screenshot()
+            self.assertRaises(ValueError, stream.recvToFD, f.fileno(), 512,
+                              progress, None, 0)
+
+    def testStreamSendFromFD(self):
+        pool = self.conn.storagePoolLookupByName("default-pool")
+        vol = pool.createXML("<volume><name>pump.img</name>"
+                             "<capacity unit='bytes'>65536</capacity>"
+                             "</volume>", 0)
+        try:
+            stream = self.conn.newStream(0)
+            try:
+                vol.upload(stream, 0, 65536, 0)
+            except libvirt.libvirtError as e:
+                if e.get_error_code() != libvirt.VIR_ERR_NO_SUPPORT:
+                    raise
+                self.skipTest("upload is not supported by this libvirt")
+
+            with tempfile.TemporaryFile() as f:
+                f.write(b"libvirt" * 1000)
+                f.seek(0)
+                self.assertEquals(stream.sendFromFD(f.fileno(), 1024), 7000)
+            stream.finish()
+        finally:
+            vol.delete(0)
+
+    def _sendAll(self, chunks, chunk):
+        stream = _FakeSendStream(chunk)
+        chunks = list(chunks) + [b""]
+        stream.sendAll(lambda s, nbytes, opaque: chunks.pop(0), None)
+        return stream.sent
+
+    def testStreamSendAll(self):
+        sent = self._sendAll([b"0123456789", bytearray(b"abcdef")], 4)
+        self.assertEquals(sent, [b"0123", b"4567", b"89", b"abcd", b"ef"])
+
+        sent = self._sendAll([memoryview(b"0123456789")[2:7]], 2)
+        self.assertEquals(sent, [b"23", b"45", b"6"])
+
+    def testStreamSendAllTypedBuffer(self):
+        if sys.version_info[0] < 3:
+            self.skipTest("typed buffers can't be viewed as bytes")
+        # Partial sends are sliced by bytes, not by items of the buffer
+        data = array.array("i", range(8))
+        sent = self._sendAll([data], 6)
+        self.assertEquals(b"".join(sent), data.tobytes())
+        self.assertEquals([len(chunk) for chunk in sent], [6] * 5 + [2])
+
+    def testStreamSendAllHandlerError(self):
+        def handler(stream, nbytes, opaque):
+            raise ValueError("stop")
+
+        self.assertRaises(ValueError, _FakeSendStream(4).sendAll, handler, None)
@@ -483,6 +483,71 @@ libvirt_virStorageVolPtrWrap(virStorageVolPtr node)
     return ret;
 }
 
+#if LIBVIRT_HAVE_FASTCALL
+int
+libvirt_fastcallArgsCheck(const char *name,
+                          Py_ssize_t nargs,
+                          Py_ssize_t expected)
+{
+    if (nargs == expected)
+        return 0;
+
+    PyErr_Format(PyExc_TypeError,
+                 "%s() takes exactly %zd argument%s (%zd given)",
+                 name, expected, expected == 1 ? "" : "s", nargs);
+    return -1;
+}
+
+/* Same conversion as the 'I' format, without overflow checking */
+int
+libvirt_fastcallUintUnwrap(PyObject *obj, unsigned int *val)
+{
+    unsigned long long_val;
+
+    if (!PyLong_Check(obj)) {
+        PyErr_SetString(PyExc_TypeError, "an integer is required");
+        return -1;
+    }
+
+    long_val = PyLong_AsUnsignedLongMask(obj);
+    if ((long_val == (unsigned long) -1) && PyErr_Occurred())
+        return -1;
+
+    *val = long_val;
+    return 0;
+}
+
+/* Same conversion as the 'z' format: @str borrows the UTF-8 buffer of
+ * @obj, or is NULL for None */
+int
+libvirt_fastcallStringUnwrap(PyObject *obj, char **str)
+{
+    const char *utf8;
+    Py_ssize_t size;
+
+    if (obj == Py_None) {
+        *str = NULL;
+        return 0;
+    }
+
+    if (!PyUnicode_Check(obj)) {
+        PyErr_Format(PyExc_TypeError, "str or None expected, not %s",
+                     Py_TYPE(obj)->tp_name);
+        return -1;
+    }
+
+    if (!(utf8 = PyUnicode_AsUTF8AndSize(obj, &size)))
+        return -1;
+    if (strlen(utf8) != (size_t) size) {
+        PyErr_SetString(PyExc_ValueError, "embedded null character");
+        return -1;
+    }
+
+    *str = (char *) utf8;
+    return 0;
+}
+#endif /* LIBVIRT_HAVE_FASTCALL */
+
 PyObject *
 libvirt_virConnectPtrWrap(virConnectPtr node)
 {
@@ -624,3 +689,109 @@ libvirt_virVoidPtrWrap(void* node)
     ret = libvirt_buildPyObject(node, "void*", NULL);
     return ret;
 }
+
+#ifdef Py_CAPSULE_H
+static void
+libvirt_nativeDestroy(PyObject *obj)
+{
+    const virPyNativeType *type = PyCapsule_GetContext(obj);
+
+    type->free(PyCapsule_GetPointer(obj, type->name));
+}
+#else
+static void
+libvirt_nativeDestroy(void *ptr, void *desc)
+{
+    const virPyNativeType *type = desc;
+
+    type->free(ptr);
+}
+#endif
+
+PyObject *
+libvirt_nativeWrap(void *ptr,
+                   const virPyNativeType *type)
+{
+    PyObject *ret;
+
+#ifdef Py_CAPSULE_H
+    if ((ret = PyCapsule_New(ptr, type->name, libvirt_nativeDestroy)) &&
+        PyCapsule_SetContext(ret, (void *) type) < 0) {
+        /* Don't let the destructor run without its type */
+        PyCapsule_SetDestructor(ret, NULL);
+        Py_CLEAR(ret);
+    }
+#else
+    ret = PyCObject_FromVoidPtrAndDesc(ptr, (void *) type,
+                                       libvirt_nativeDestroy);
+#endif
+
+    return ret;
+}
+
+void *
+libvirt_nativeGet(PyObject *obj,
+                  const virPyNativeType *type)
+{
+#ifdef Py_CAPSULE_H
+    return PyCapsule_GetPointer(obj, type->name);
+#else
+    if (!PyCObject_Check(obj) || PyCObject_GetDesc(obj) != type) {
+        PyErr_Format(PyExc_TypeError, "expected a %s", type->name);
+        return NULL;
+    }
+    return PyCObject_AsVoidPtr(obj);
+#endif
+}
+
+bool
+libvirt_unrefLocked(PyThread_type_lock lock,
+                    int *refs)
+{
+    bool last = --*refs == 0;
+
+    PyThread_release_lock(lock);
+    return last;
+}
+
+virPyCallPtr libvirt_callStatsActive;
+
+/* Returns the innermost call in progress in the thread @tstate */
+virPyCallPtr
+libvirt_callStatsLookup(PyThreadState *tstate)
+{
+    virPyCallPtr call;
+
+    for (call = libvirt_callStatsActive; call; call = call->next) {
+        if (call->tstate == tstate)
+            return call;
+    }
+    return NULL;
+}
+
+#if LIBVIRT_HAVE_MULTIPHASE_INIT
+/* Bind the module @name to the current interpreter, recorded in @owner,
+ * failing if it was already executed in another one */
+int
+libvirt_moduleClaimInterpreter(PyInterpreterState **owner,
+                               const char *name)
+{
+    PyInterpreterState *interp;
+
+# if PY_VERSION_HEX >= 0x03090000
+    interp = PyInterpreterState_Get();
+# else
+    interp = PyThreadState_Get()->interp;
+# endif
+
+    if (*owner && *owner != interp) {
+        PyErr_Format(PyExc_ImportError,
+                     "%s does not support being loaded in more than "
+                     "one interpreter", name);
+        return -1;
+    }
+
+    *owner = interp;
+    return 0;
+}
+#endif /* LIBVIRT_HAVE_MULTIPHASE_INIT */
@@ -27,6 +27,11 @@
 typedef ssize_t Py_ssize_t;
 #endif
 
+/* The Py_buffer based buffer protocol appeared in python 2.6.  */
+#if PY_MAJOR_VERSION > 2 || PY_MINOR_VERSION >= 6
+# define LIBVIRT_HAVE_PY_BUFFER 1
+#endif
+
 #define PyvirConnect_Get(v) (((v) == Py_None) ? NULL : \
         (((PyvirConnect_Object *)(v))->obj))
 
@@ -192,6 +197,95 @@ PyObject * libvirt_virNWFilterPtrWrap(virNWFilterPtr node);
 PyObject * libvirt_virStreamPtrWrap(virStreamPtr node);
 PyObject * libvirt_virDomainSnapshotPtrWrap(virDomainSnapshotPtr node);
 
+/*
+ * Native objects handed to python
+ *
+ * libvirt_nativeWrap returns a capsule (a CObject before python 2.7)
+ * owning @ptr, which is given to the free function of @type once
+ * python releases it.  libvirt_nativeGet returns the pointer held by
+ * @obj, raising an exception and returning NULL if @obj isn't a
+ * capsule of @type.
+ */
+typedef struct {
+    const char *name;
+    void (*free)(void *ptr);
+} virPyNativeType;
+
+PyObject *libvirt_nativeWrap(void *ptr, const virPyNativeType *type);
+void *libvirt_nativeGet(PyObject *obj, const virPyNativeType *type);
+
+/* Drop one of the *@refs references to an object with its @lock held,
+ * which is released; returns true if it was the last one, for the
+ * caller to free the object */
+bool libvirt_unrefLocked(PyThread_type_lock lock, int *refs);
+
+
+/*
+ * Calling convention of the generated wrappers
+ *
+ * Where the interpreter supports it they take their arguments as a
+ * vector, unpacked one by one, instead of a tuple parsed again against
+ * a format string on every call.
+ */
+#if PY_VERSION_HEX >= 0x03070000
+# define LIBVIRT_HAVE_FASTCALL 1
+# define LIBVIRT_FASTCALL_FLAGS METH_FASTCALL
+# define LIBVIRT_FASTCALL_ARGS PyObject *const *args, Py_ssize_t nargs
+# define LIBVIRT_FASTCALL_NOARGS \
+    PyObject *const *args ATTRIBUTE_UNUSED, Py_ssize_t nargs
+
+int libvirt_fastcallArgsCheck(const char *name, Py_ssize_t nargs,
+                              Py_ssize_t expected);
+int libvirt_fastcallUintUnwrap(PyObject *obj, unsigned int *val);
+int libvirt_fastcallStringUnwrap(PyObject *obj, char **str);
+#else
+# define LIBVIRT_HAVE_FASTCALL 0
+# define LIBVIRT_FASTCALL_FLAGS METH_VARARGS
+# define LIBVIRT_FASTCALL_ARGS PyObject *args
+# define LIBVIRT_FASTCALL_NOARGS PyObject *args ATTRIBUTE_UNUSED
+#endif
+
+/*
+ * Module initialization
+ *
+ * Where the interpreter supports it the modules use multi-phase
+ * initialization, and that is all: they have no per-interpreter module
+ * state, and their callback registries and caches are process wide
+ * statics that rely on the GIL.  libvirt's error handler and event
+ * implementation are process wide, and its callbacks get back into
+ * python through PyGILState, which only knows about the main
+ * interpreter.  The modules therefore tell the interpreter that they
+ * can't be loaded in others and that they still need the GIL, and
+ * before 3.12, where the former can't be declared, their exec slot
+ * refuses to run in a second interpreter.
+ */
+#if PY_VERSION_HEX >= 0x03050000
+# define LIBVIRT_HAVE_MULTIPHASE_INIT 1
+#else
+# define LIBVIRT_HAVE_MULTIPHASE_INIT 0
+#endif
+
+#if PY_VERSION_HEX >= 0x030C0000
+# define LIBVIRT_MODULE_INTERPRETERS_SLOT \
+    {Py_mod_multiple_interpreters, Py_MOD_MULTIPLE_INTERPRETERS_NOT_SUPPORTED},
+#else
+# define LIBVIRT_MODULE_INTERPRETERS_SLOT
+#endif
+
+#if PY_VERSION_HEX >= 0x030D0000
+# define LIBVIRT_MODULE_GIL_SLOT {Py_mod_gil, Py_MOD_GIL_USED},
+#else
+# define LIBVIRT_MODULE_GIL_SLOT
+#endif
+
+#define LIBVIRT_MODULE_SLOTS \
+    LIBVIRT_MODULE_INTERPRETERS_SLOT \
+    LIBVIRT_MODULE_GIL_SLOT
+
+#if LIBVIRT_HAVE_MULTIPHASE_INIT
+int libvirt_moduleClaimInterpreter(PyInterpreterState **owner,
+                                   const char *name);
+#endif
 
 /* Provide simple macro statement wrappers (adapted from GLib, in turn from Perl):
  *  LIBVIRT_STMT_START { statements; } LIBVIRT_STMT_END;
@@ -220,15 +314,42 @@ PyObject * libvirt_virDomainSnapshotPtrWrap(virDomainSnapshotPtr node);
 # endif /* !(__GNUC__ && !__STRICT_ANSI__ && !__cplusplus) */
 #endif
 
+/*
+ * Per-API call statistics
+ *
+ * While they are enabled, the module functions are called through a
+ * trampoline which links a virPyCall in libvirt_callStatsActive for
+ * the duration of the call, and the sections releasing the interpreter
+ * lock add the time they spent in libvirt to it.  When they are
+ * disabled the list is empty and these sections only test it.
+ */
+typedef struct _virPyCall virPyCall;
+typedef virPyCall *virPyCallPtr;
+struct _virPyCall {
+    PyThreadState *tstate;
+    double native;          /* seconds spent with the lock released */
+    virPyCallPtr next;
+};
+
+extern virPyCallPtr libvirt_callStatsActive;
+virPyCallPtr libvirt_callStatsLookup(PyThreadState *tstate);
+
 #define LIBVIRT_BEGIN_ALLOW_THREADS			\
   LIBVIRT_STMT_START {					\
     PyThreadState *_save = NULL;			\
+    virPyCallPtr _call = NULL;				\
+    double _call_start = 0;				\
+    if (libvirt_callStatsActive &&			\
+        (_call = libvirt_callStatsLookup(PyThreadState_GET()))) \
+      _call_start = virTimeSecondsNow();		\
     if (PyEval_ThreadsInitialized())			\
       _save = PyEval_SaveThread();
 
 #define LIBVIRT_END_ALLOW_THREADS                           \
   if (PyEval_ThreadsInitialized())			    \
     PyEval_RestoreThread(_save);			    \
+  if (_call)						    \
+    _call->native += virTimeSecondsNow() - _call_start; \
     } LIBVIRT_STMT_END
 
 #define LIBVIRT_ENSURE_THREAD_STATE			\